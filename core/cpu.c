@@ -19,6 +19,8 @@
 #include <ccan/str/str.h>
 #include <ccan/container_of/container_of.h>
 #include <xscom.h>
+#include <cmpxchg.h>
+#include <debug_descriptor.h>
 
 /* The cpu_threads array is static and indexed by PIR in
  * order to speed up lookup from asm entry points
@@ -53,10 +55,24 @@ struct cpu_job {
 	void			(*func)(void *data);
 	void			*data;
 	const char		*name;
+	/* Woken up on completion, if it sleeps */
+	struct cpu_thread	*waiter;
+	struct cpu_job_group	*group;
+	/* Who may steal it: anybody (-1), a CPU of that chip, or nobody */
+	int32_t			chip_id;
+	bool			pinned;
 	bool			complete;
 	bool		        no_return;
 };
 
+static DEFINE_POOL_CACHE(cpu_job_cache, "cpu_job", sizeof(struct cpu_job), 8);
+
+/* Queued jobs which another CPU than their target may run */
+static uint32_t cpu_jobs_stealable;
+
+/* How long a waiter sleeps at most, for pollers and missed wakeups */
+#define CPU_JOB_WAIT_SLICE_MS	5
+
 /* attribute const as cpu_stacks is constant. */
 unsigned long __attrconst cpu_stack_bottom(unsigned int pir)
 {
@@ -90,13 +106,8 @@ void __nomcount cpu_relax(void)
 	barrier();
 }
 
-static void cpu_wake(struct cpu_thread *cpu)
+static void cpu_poke(struct cpu_thread *cpu)
 {
-	/* Is it idle ? If not, no need to wake */
-	sync();
-	if (!cpu->in_idle)
-		return;
-
 	if (proc_gen == proc_gen_p8) {
 		/* Poke IPI */
 		icp_kick_cpu(cpu);
@@ -105,6 +116,42 @@ static void cpu_wake(struct cpu_thread *cpu)
 	}
 }
 
+static void cpu_wake(struct cpu_thread *cpu)
+{
+	/* Is it idle ? If not, no need to wake */
+	sync();
+	if (!cpu->in_idle)
+		return;
+
+	cpu_poke(cpu);
+}
+
+/* Wake up a CPU sleeping in cpu_wait_job() */
+static void cpu_wake_waiter(struct cpu_thread *cpu)
+{
+	sync();
+	if (!pm_enabled || !cpu->in_sleep || cpu == this_cpu())
+		return;
+
+	cpu_poke(cpu);
+}
+
+static uint32_t cpu_job_add(uint32_t *count, int32_t delta)
+{
+	uint32_t old;
+
+	do {
+		old = *count;
+	} while (cmpxchg32(count, old, old + delta) != old);
+
+	return old + delta;
+}
+
+static bool cpu_job_stealable(struct cpu_job *job)
+{
+	return !job->pinned && !job->no_return;
+}
+
 /*
  * If chip_id is >= 0, schedule the job on that node.
  * Otherwise schedule the job anywhere.
@@ -121,6 +168,9 @@ static struct cpu_thread *cpu_find_job_target(int32_t chip_id)
 	 * Additionally we don't check the list but the job count
 	 * on the target CPUs, since that is decremented *after*
 	 * a job has been completed.
+	 *
+	 * While booting, the boot CPU only runs its jobs at a few
+	 * points of its own choosing, so it isn't a target either.
 	 */
 
 
@@ -131,6 +181,8 @@ static struct cpu_thread *cpu_find_job_target(int32_t chip_id)
 			continue;
 		if (cpu == me || !cpu_is_thread0(cpu) || cpu->job_has_no_return)
 			continue;
+		if (cpu == boot_cpu && opal_booting())
+			continue;
 		if (cpu->job_count)
 			continue;
 		lock(&cpu->job_lock);
@@ -152,6 +204,8 @@ static struct cpu_thread *cpu_find_job_target(int32_t chip_id)
 			continue;
 		if (cpu == me || cpu->job_has_no_return)
 			continue;
+		if (cpu == boot_cpu && opal_booting())
+			continue;
 		if (!best || cpu->job_count < best_count) {
 			best = cpu;
 			best_count = cpu->job_count;
@@ -189,15 +243,73 @@ static void queue_job_on_cpu(struct cpu_thread *cpu, struct cpu_job *job)
 		cpu->job_has_no_return = true;
 	else
 		cpu->job_count++;
+	if (cpu_job_stealable(job))
+		cpu_job_add(&cpu_jobs_stealable, 1);
 	if (pm_enabled)
 		cpu_wake(cpu);
 	unlock(&cpu->job_lock);
 }
 
-struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
-				const char *name,
-				void (*func)(void *data), void *data,
-				bool no_return)
+static struct cpu_job *cpu_job_alloc(const char *name,
+				     void (*func)(void *data), void *data,
+				     struct cpu_job_group *grp)
+{
+	struct cpu_job *job;
+
+	job = pool_cache_get(&cpu_job_cache);
+	if (!job)
+		return NULL;
+	job->func = func;
+	job->data = data;
+	job->name = name;
+	job->waiter = this_cpu();
+	job->group = grp;
+	job->chip_id = -1;
+	job->pinned = false;
+	job->complete = false;
+	job->no_return = false;
+	if (grp)
+		cpu_job_add(&grp->pending, 1);
+
+	return job;
+}
+
+/* Give back a job that never got queued */
+static void cpu_job_cancel(struct cpu_job *job)
+{
+	if (job->group)
+		cpu_job_add(&job->group->pending, -1);
+	pool_cache_put(&cpu_job_cache, job);
+}
+
+/*
+ * Group jobs are nobody else's to wait for, so they are freed here.
+ * Everything we need is read before the completion is visible, as the
+ * waiter may then free the job or group.
+ */
+static void cpu_job_complete(struct cpu_job *job)
+{
+	struct cpu_job_group *grp = job->group;
+	struct cpu_thread *waiter = job->waiter;
+
+	if (grp) {
+		pool_cache_put(&cpu_job_cache, job);
+		lwsync();
+		if (cpu_job_add(&grp->pending, -1) == 0)
+			cpu_wake_waiter(waiter);
+		return;
+	}
+
+	lwsync();
+	job->complete = true;
+	cpu_wake_waiter(waiter);
+}
+
+static struct cpu_job *cpu_queue_job_grp(struct cpu_thread *cpu,
+					 struct cpu_job_group *grp,
+					 const char *name,
+					 void (*func)(void *data), void *data,
+					 bool no_return)
 {
 	struct cpu_job *job;
 
@@ -212,14 +324,11 @@ struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 		return NULL;
 	}
 
-	job = zalloc(sizeof(struct cpu_job));
+	job = cpu_job_alloc(name, func, data, grp);
 	if (!job)
 		return NULL;
-	job->func = func;
-	job->data = data;
-	job->name = name;
-	job->complete = false;
 	job->no_return = no_return;
+	job->pinned = cpu != NULL;
 
 	/* Pick a candidate. Returns with target queue locked */
 	if (cpu == NULL)
@@ -234,7 +343,7 @@ struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 		if (!this_cpu()->job_has_no_return)
 			this_cpu()->job_has_no_return = no_return;
 		func(data);
-		job->complete = true;
+		cpu_job_complete(job);
 		return job;
 	}
 
@@ -243,21 +352,52 @@ struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 	return job;
 }
 
-struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
+struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 				const char *name,
-				void (*func)(void *data), void *data)
+				void (*func)(void *data), void *data,
+				bool no_return)
+{
+	return cpu_queue_job_grp(cpu, NULL, name, func, data, no_return);
+}
+
+struct cpu_job *cpu_queue_job_remote(const char *name,
+				     void (*func)(void *data), void *data)
 {
 	struct cpu_thread *cpu;
 	struct cpu_job *job;
 
-	job = zalloc(sizeof(struct cpu_job));
+#ifdef DEBUG_SERIALIZE_CPU_JOBS
+	return NULL;
+#endif
+	job = cpu_job_alloc(name, func, data, NULL);
 	if (!job)
 		return NULL;
-	job->func = func;
-	job->data = data;
-	job->name = name;
-	job->complete = false;
-	job->no_return = false;
+
+	/* Pick a candidate. Returns with target queue locked */
+	cpu = cpu_find_job_target(-1);
+	if (cpu == NULL) {
+		cpu_job_cancel(job);
+		return NULL;
+	}
+
+	queue_job_on_cpu(cpu, job);
+
+	return job;
+}
+
+static struct cpu_job *cpu_queue_job_on_node_grp(uint32_t chip_id,
+						 struct cpu_job_group *grp,
+						 const char *name,
+						 void (*func)(void *data),
+						 void *data)
+{
+	struct cpu_thread *cpu;
+	struct cpu_job *job;
+
+	job = cpu_job_alloc(name, func, data, grp);
+	if (!job)
+		return NULL;
+	job->chip_id = chip_id;
 
 	/* Pick a candidate. Returns with target queue locked */
 	cpu = cpu_find_job_target(chip_id);
@@ -268,11 +408,11 @@ struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 		if (cpu->chip_id == chip_id) {
 			/* Run it now if we're the right node. */
 			func(data);
-			job->complete = true;
+			cpu_job_complete(job);
 			return job;
 		}
 		/* Otherwise fail. */
-		free(job);
+		cpu_job_cancel(job);
 		return NULL;
 	}
 
@@ -281,89 +421,166 @@ struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 	return job;
 }
 
+struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
+				const char *name,
+				void (*func)(void *data), void *data)
+{
+	return cpu_queue_job_on_node_grp(chip_id, NULL, name, func, data);
+}
+
+void cpu_job_group_init(struct cpu_job_group *grp)
+{
+	grp->pending = 0;
+	grp->waiter = this_cpu();
+}
+
+bool cpu_job_group_queue(struct cpu_job_group *grp, struct cpu_thread *cpu,
+			 const char *name,
+			 void (*func)(void *data), void *data)
+{
+	return cpu_queue_job_grp(cpu, grp, name, func, data, false) != NULL;
+}
+
+bool cpu_job_group_queue_on_node(struct cpu_job_group *grp, uint32_t chip_id,
+				 const char *name,
+				 void (*func)(void *data), void *data)
+{
+	if (cpu_queue_job_on_node_grp(chip_id, grp, name, func, data))
+		return true;
+
+	/* Nobody there, run it anywhere */
+	return cpu_queue_job_grp(NULL, grp, name, func, data, false) != NULL;
+}
+
 bool cpu_poll_job(struct cpu_job *job)
 {
 	lwsync();
 	return job->complete;
 }
 
-void cpu_wait_job(struct cpu_job *job, bool free_it)
+bool cpu_check_jobs(struct cpu_thread *cpu)
 {
-	unsigned long time_waited = 0;
+	return !list_empty_nocheck(&cpu->job_queue);
+}
 
-	if (!job)
-		return;
+static struct cpu_job *cpu_pop_job(struct cpu_thread *cpu)
+{
+	struct cpu_job *job;
 
-	while (!job->complete) {
-		/* This will call OPAL pollers for us */
-		time_wait_ms(10);
-		time_waited += 10;
-		lwsync();
-		if ((time_waited % 30000) == 0) {
-			prlog(PR_INFO, "cpu_wait_job(%s) for %lums\n",
-			      job->name, time_waited);
-			backtrace();
+	lock(&cpu->job_lock);
+	job = list_pop(&cpu->job_queue, struct cpu_job, link);
+	if (job && cpu_job_stealable(job))
+		cpu_job_add(&cpu_jobs_stealable, -1);
+	unlock(&cpu->job_lock);
+
+	return job;
+}
+
+/*
+ * Take the most recently queued job we're allowed to run from a CPU
+ * which has more than the one it's busy with. Our own chip's CPUs are
+ * tried first, as their jobs may want to stay local.
+ */
+static struct cpu_job *cpu_steal_job(struct cpu_thread *me)
+{
+	struct cpu_thread *cpu;
+	struct cpu_job *job, *j;
+	int pass;
+
+	if (!cpu_jobs_stealable)
+		return NULL;
+
+	for (pass = 0; pass < 2; pass++) {
+		for_each_available_cpu(cpu) {
+			if (cpu == me || (cpu->chip_id == me->chip_id) == pass)
+				continue;
+			if (cpu->job_count < 2)
+				continue;
+
+			job = NULL;
+			lock(&cpu->job_lock);
+			list_for_each_rev(&cpu->job_queue, j, link) {
+				if (!cpu_job_stealable(j))
+					continue;
+				if (j->chip_id >= 0 && j->chip_id != me->chip_id)
+					continue;
+				job = j;
+				break;
+			}
+			if (job) {
+				list_del(&job->link);
+				cpu->job_count--;
+				cpu_job_add(&cpu_jobs_stealable, -1);
+			}
+			unlock(&cpu->job_lock);
+
+			if (job) {
+				prlog(PR_TRACE, "CPU 0x%x stole job %s from 0x%x\n",
+				      me->pir, job->name, cpu->pir);
+				return job;
+			}
 		}
 	}
-	lwsync();
-
-	if (time_waited > 1000)
-		prlog(PR_DEBUG, "cpu_wait_job(%s) for %lums\n",
-		      job->name, time_waited);
 
-	if (free_it)
-		free(job);
+	return NULL;
 }
 
-bool cpu_check_jobs(struct cpu_thread *cpu)
+static void cpu_run_job(struct cpu_thread *cpu, struct cpu_job *job)
 {
-	return !list_empty_nocheck(&cpu->job_queue);
+	void (*func)(void *) = job->func;
+	void *data = job->data;
+	bool no_return = job->no_return;
+
+	prlog(PR_TRACE, "running job %s on %x\n", job->name, cpu->pir);
+	if (no_return)
+		pool_cache_put(&cpu_job_cache, job);
+	func(data);
+	if (!list_empty(&cpu->locks_held)) {
+		if (no_return)
+			prlog(PR_ERR, "OPAL no-return job returned with"
+			      "locks held!\n");
+		else
+			prlog(PR_ERR, "OPAL job %s returning with locks held\n",
+			      job->name);
+		drop_my_locks(true);
+	}
 }
 
 void cpu_process_jobs(void)
 {
 	struct cpu_thread *cpu = this_cpu();
-	struct cpu_job *job = NULL;
-	void (*func)(void *);
-	void *data;
+	struct cpu_job *job;
 
 	sync();
 	if (!cpu_check_jobs(cpu))
 		return;
 
-	lock(&cpu->job_lock);
-	while (true) {
-		bool no_return;
-
-		job = list_pop(&cpu->job_queue, struct cpu_job, link);
-		if (!job)
-			break;
+	while ((job = cpu_pop_job(cpu)) != NULL) {
+		bool no_return = job->no_return;
 
-		func = job->func;
-		data = job->data;
-		no_return = job->no_return;
-		unlock(&cpu->job_lock);
-		prlog(PR_TRACE, "running job %s on %x\n", job->name, cpu->pir);
+		cpu_run_job(cpu, job);
 		if (no_return)
-			free(job);
-		func(data);
-		if (!list_empty(&cpu->locks_held)) {
-			if (no_return)
-				prlog(PR_ERR, "OPAL no-return job returned with"
-				      "locks held!\n");
-			else
-				prlog(PR_ERR, "OPAL job %s returning with locks held\n",
-				      job->name);
-			drop_my_locks(true);
-		}
+			continue;
+
 		lock(&cpu->job_lock);
-		if (!no_return) {
-			cpu->job_count--;
-			lwsync();
-			job->complete = true;
-		}
+		cpu->job_count--;
+		unlock(&cpu->job_lock);
+		cpu_job_complete(job);
 	}
-	unlock(&cpu->job_lock);
+}
+
+bool cpu_steal_jobs(void)
+{
+	struct cpu_thread *cpu = this_cpu();
+	struct cpu_job *job;
+
+	job = cpu_steal_job(cpu);
+	if (!job)
+		return false;
+
+	cpu_run_job(cpu, job);
+	cpu_job_complete(job);
+	return true;
 }
 
 enum cpu_wake_cause {
@@ -538,12 +755,16 @@ void cpu_idle_job(void)
 		cpu_idle_pm(cpu_wake_on_job);
 	} else {
 		struct cpu_thread *cpu = this_cpu();
+		unsigned long end = mftb() + msecs_to_tb(1);
 
 		smt_lowest();
-		/* Check for jobs again */
+		/* Check for jobs again, ours or, now and then, others' */
 		while (!cpu_check_jobs(cpu)) {
 			if (pm_enabled)
 				break;
+			if (cpu_jobs_stealable &&
+			    tb_compare(mftb(), end) == TB_AAFTERB)
+				break;
 			cpu_relax();
 			barrier();
 		}
@@ -590,6 +811,94 @@ no_pm:
 	}
 }
 
+/*
+ * Wait for done() like time_wait() would, running pollers if allowed.
+ * Rather than sitting idle, we run our own jobs and steal others' while
+ * booting, and otherwise sleep until the job's completion wakes us up.
+ */
+static void cpu_job_wait(bool (*done)(void *arg), void *arg, const char *name)
+{
+	struct cpu_thread *cpu = this_cpu();
+	unsigned long start = mftb(), now, end, waited;
+	unsigned long slice = msecs_to_tb(CPU_JOB_WAIT_SLICE_MS);
+	unsigned long next_warn = 30000;
+	bool can_poll, can_help;
+
+	can_poll = list_empty(&cpu->locks_held) &&
+		(cpu == boot_cpu || !opal_booting());
+	can_help = list_empty(&cpu->locks_held) && opal_booting();
+
+	while (!done(arg)) {
+		if (can_help) {
+			if (cpu_check_jobs(cpu)) {
+				cpu_process_jobs();
+				continue;
+			}
+			if (cpu_steal_jobs())
+				continue;
+		}
+
+		if (can_poll)
+			opal_run_pollers();
+
+		now = mftb();
+		end = now + slice;
+		if (pm_enabled && !cpu->tb_invalid) {
+			mtspr(SPR_DEC, slice);
+			cpu_idle_pm(cpu_wake_on_dec);
+		} else {
+			smt_lowest();
+			while (!done(arg) &&
+			       tb_compare(mftb(), end) == TB_ABEFOREB)
+				barrier();
+			smt_medium();
+		}
+
+		waited = tb_to_msecs(mftb() - start);
+		if (waited >= next_warn) {
+			prlog(PR_INFO, "cpu_wait_job(%s) for %lums\n",
+			      name, waited);
+			backtrace();
+			next_warn += 30000;
+		}
+	}
+	lwsync();
+
+	waited = tb_to_msecs(mftb() - start);
+	if (waited > 1000)
+		prlog(PR_DEBUG, "cpu_wait_job(%s) for %lums\n", name, waited);
+}
+
+static bool cpu_job_done(void *arg)
+{
+	return cpu_poll_job(arg);
+}
+
+void cpu_wait_job(struct cpu_job *job, bool free_it)
+{
+	if (!job)
+		return;
+
+	cpu_job_wait(cpu_job_done, job, job->name);
+
+	if (free_it)
+		pool_cache_put(&cpu_job_cache, job);
+}
+
+static bool cpu_job_group_done(void *arg)
+{
+	struct cpu_job_group *grp = arg;
+
+	sync();
+	return !grp->pending;
+}
+
+void cpu_job_group_wait(struct cpu_job_group *grp)
+{
+	assert(grp->waiter == this_cpu());
+	cpu_job_wait(cpu_job_group_done, grp, "group");
+}
+
 static void cpu_pm_disable(void)
 {
 	struct cpu_thread *cpu;
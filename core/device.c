@@ -9,6 +9,7 @@
 #include <device.h>
 #include <stdlib.h>
 #include <skiboot.h>
+#include <lock.h>
 #include <libfdt/libfdt.h>
 #include <libfdt/libfdt_internal.h>
 #include <ccan/str/str.h>
@@ -20,36 +21,419 @@ u32 last_phandle = 0;
 
 struct dt_node *dt_root;
 struct dt_node *dt_chosen;
+bool dt_flat_stale;
 
-static const char *take_name(const char *name)
+/*
+ * Lookup indexes.
+ *
+ * Every node is hashed by phandle in one global index. A node with at
+ * least DT_INDEX_MIN children (or properties) also gets an index of them
+ * by name, built when it crosses that threshold and maintained from then
+ * on; smaller nodes are simply scanned. Failing to allocate or grow a
+ * per-node index only makes lookups slower.
+ *
+ * DT updates can come from parallel jobs, so the global indexes, which
+ * are rehashed (and the old table freed) as they grow, are only used
+ * under their lock: dt_phandle_lock, or dt_name_lock for the property
+ * names below. A node's own indexes are as safe as its lists are.
+ */
+#define DT_INDEX_MIN		16
+#define DT_INDEX_MIN_BITS	5
+
+struct dt_index {
+	unsigned int bits;
+	unsigned int count;
+	struct dt_hnode **buckets;
+};
+
+static struct dt_hnode *dt_phandle_buckets[1 << DT_INDEX_MIN_BITS];
+static struct dt_index dt_phandle_index0 = {
+	.bits = DT_INDEX_MIN_BITS,
+	.buckets = dt_phandle_buckets,
+};
+static struct dt_index *dt_phandle_index = &dt_phandle_index0;
+static struct lock dt_phandle_lock = LOCK_UNLOCKED;
+
+static struct dt_hnode *dt_name_buckets[1 << DT_INDEX_MIN_BITS];
+static struct dt_index dt_name_index0 = {
+	.bits = DT_INDEX_MIN_BITS,
+	.buckets = dt_name_buckets,
+};
+static struct dt_index *dt_name_index = &dt_name_index0;
+
+/* FNV-1a */
+static u32 dt_hash_strn(const char *s, size_t len)
+{
+	u32 hash = 2166136261u;
+
+	while (len--) {
+		hash ^= (unsigned char)*s++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static u32 dt_hash_str(const char *s)
 {
-	if (!is_rodata(name) && !(name = strdup(name))) {
-		prerror("Failed to allocate copy of name");
-		abort();
+	return dt_hash_strn(s, strlen(s));
+}
+
+static struct dt_index *dt_index_alloc(unsigned int bits)
+{
+	struct dt_index *idx;
+
+	idx = zalloc(sizeof(*idx) + (sizeof(*idx->buckets) << bits));
+	if (!idx)
+		return NULL;
+	idx->bits = bits;
+	idx->buckets = (void *)(idx + 1);
+	return idx;
+}
+
+static void dt_index_free(struct dt_index *idx)
+{
+	if (idx != &dt_phandle_index0 && idx != &dt_name_index0)
+		free(idx);
+}
+
+static struct dt_hnode **dt_index_bucket(const struct dt_index *idx,
+					 u32 hash)
+{
+	return &idx->buckets[hash & ((1u << idx->bits) - 1)];
+}
+
+static void __dt_index_add(struct dt_index *idx, struct dt_hnode *h)
+{
+	struct dt_hnode **b = dt_index_bucket(idx, h->hash);
+
+	h->next = *b;
+	if (h->next)
+		h->next->pprev = &h->next;
+	h->pprev = b;
+	*b = h;
+}
+
+static void dt_index_add(struct dt_index **idxp, struct dt_hnode *h)
+{
+	struct dt_index *idx = *idxp, *new;
+	struct dt_hnode *e;
+	unsigned int i;
+
+	/* Keep chains short, if we can't grow we just get longer ones */
+	if (idx->count >= (1u << idx->bits) &&
+	    (new = dt_index_alloc(idx->bits + 1))) {
+		for (i = 0; i < (1u << idx->bits); i++) {
+			while ((e = idx->buckets[i])) {
+				idx->buckets[i] = e->next;
+				__dt_index_add(new, e);
+			}
+		}
+		new->count = idx->count;
+		dt_index_free(idx);
+		*idxp = idx = new;
+	}
+
+	__dt_index_add(idx, h);
+	idx->count++;
+}
+
+static void dt_index_del(struct dt_index *idx, struct dt_hnode *h)
+{
+	*h->pprev = h->next;
+	if (h->next)
+		h->next->pprev = h->pprev;
+	h->next = NULL;
+	h->pprev = NULL;
+	idx->count--;
+}
+
+static void dt_index_children(struct dt_node *node)
+{
+	struct dt_node *child;
+
+	node->child_index = dt_index_alloc(DT_INDEX_MIN_BITS);
+	if (!node->child_index)
+		return;
+
+	list_for_each(&node->children, child, list)
+		dt_index_add(&node->child_index, &child->name_hash);
+}
+
+static void dt_index_props(struct dt_node *node)
+{
+	struct dt_property *p;
+
+	node->prop_index = dt_index_alloc(DT_INDEX_MIN_BITS);
+	if (!node->prop_index)
+		return;
+
+	list_for_each(&node->properties, p, list)
+		dt_index_add(&node->prop_index, &p->hash);
+}
+
+static struct dt_node *dt_index_find_child(const struct dt_node *node,
+					   const char *name, size_t len)
+{
+	u32 hash = dt_hash_strn(name, len);
+	struct dt_hnode *h;
+	struct dt_node *child;
+
+	for (h = *dt_index_bucket(node->child_index, hash); h; h = h->next) {
+		child = container_of(h, struct dt_node, name_hash);
+		if (h->hash == hash && !strncmp(child->name, name, len) &&
+		    !child->name[len])
+			return child;
+	}
+	return NULL;
+}
+
+/* Mark a node, and so everything above it, for re-flattening */
+static void dt_dirty(struct dt_node *node)
+{
+	for (; node && !node->flat_dirty; node = node->parent)
+		node->flat_dirty = true;
+}
+
+static void dt_set_phandle(struct dt_node *node, u32 phandle)
+{
+	dt_dirty(node);
+	lock(&dt_phandle_lock);
+	dt_index_del(dt_phandle_index, &node->phandle_hash);
+	node->phandle = phandle;
+	node->phandle_hash.hash = phandle;
+	dt_index_add(&dt_phandle_index, &node->phandle_hash);
+	unlock(&dt_phandle_lock);
+}
+
+/*
+ * Node and property arena.
+ *
+ * Nodes (with their name, unless it's in rodata) and properties of up
+ * to DT_ARENA_MAX bytes are carved out of slabs rather than being
+ * malloc'd one by one; anything bigger still goes to the heap. Slabs
+ * start small and double up to DT_ARENA_SLAB_MAX as the tree grows.
+ * Freed objects are kept on a free list per DT_ARENA_ALIGN sized class
+ * for reuse, and once the last one is gone, normally because the whole
+ * tree was freed, the slabs go back to the heap.
+ */
+#define DT_ARENA_SLAB_MIN	0x400
+#define DT_ARENA_SLAB_MAX	0x10000
+#define DT_ARENA_ALIGN		16
+#define DT_ARENA_MAX		512
+#define DT_ARENA_CLASSES	(DT_ARENA_MAX / DT_ARENA_ALIGN)
+
+struct dt_arena_slab {
+	struct dt_arena_slab *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+static struct lock dt_arena_lock = LOCK_UNLOCKED;
+static struct dt_arena_slab *dt_arena_slabs;
+static void *dt_arena_free_list[DT_ARENA_CLASSES];
+static unsigned long dt_arena_live;
+static size_t dt_arena_slab_size = DT_ARENA_SLAB_MIN;
+
+/* What an allocation of @size bytes really takes up */
+static size_t dt_arena_size(size_t size)
+{
+	if (size > DT_ARENA_MAX)
+		return size;
+	return ALIGN_UP(size, DT_ARENA_ALIGN);
+}
+
+static void *dt_arena_alloc(size_t size)
+{
+	struct dt_arena_slab *slab;
+	void **free_list, *obj;
+	size_t slab_size;
+
+	if (size > DT_ARENA_MAX)
+		return malloc(size);
+
+	size = dt_arena_size(size);
+	free_list = &dt_arena_free_list[size / DT_ARENA_ALIGN - 1];
+
+	lock(&dt_arena_lock);
+	for (;;) {
+		obj = *free_list;
+		if (obj) {
+			*free_list = *(void **)obj;
+			break;
+		}
+
+		slab = dt_arena_slabs;
+		if (slab && slab->used + size <= slab->size) {
+			obj = slab->data + slab->used;
+			slab->used += size;
+			break;
+		}
+
+		slab_size = dt_arena_slab_size;
+		if (dt_arena_slab_size < DT_ARENA_SLAB_MAX)
+			dt_arena_slab_size <<= 1;
+
+		/* Don't hold the arena lock over malloc() */
+		unlock(&dt_arena_lock);
+		slab = malloc(slab_size);
+		if (!slab)
+			return NULL;
+		lock(&dt_arena_lock);
+		slab->size = slab_size - sizeof(*slab);
+		slab->used = 0;
+		slab->next = dt_arena_slabs;
+		dt_arena_slabs = slab;
+	}
+	dt_arena_live++;
+	unlock(&dt_arena_lock);
+
+	return obj;
+}
+
+static void dt_arena_free(void *obj, size_t size)
+{
+	struct dt_arena_slab *slabs = NULL, *slab;
+	void **free_list;
+
+	if (size > DT_ARENA_MAX) {
+		free(obj);
+		return;
+	}
+
+	size = dt_arena_size(size);
+	free_list = &dt_arena_free_list[size / DT_ARENA_ALIGN - 1];
+
+	lock(&dt_arena_lock);
+	*(void **)obj = *free_list;
+	*free_list = obj;
+	if (!--dt_arena_live) {
+		slabs = dt_arena_slabs;
+		dt_arena_slabs = NULL;
+		dt_arena_slab_size = DT_ARENA_SLAB_MIN;
+		memset(dt_arena_free_list, 0, sizeof(dt_arena_free_list));
+	}
+	unlock(&dt_arena_lock);
+
+	while ((slab = slabs)) {
+		slabs = slab->next;
+		free(slab);
+	}
+}
+
+/*
+ * Property names are interned: there are only a few hundred distinct
+ * ones, so each is stored once, reference counted by the properties
+ * using it.
+ */
+struct dt_name {
+	struct dt_hnode hash;
+	unsigned int refs;
+	char str[];
+};
+
+static struct lock dt_name_lock = LOCK_UNLOCKED;
+
+static struct dt_name *dt_name_lookup(const char *name, u32 hash)
+{
+	struct dt_hnode *h;
+	struct dt_name *n;
+
+	for (h = *dt_index_bucket(dt_name_index, hash); h; h = h->next) {
+		n = container_of(h, struct dt_name, hash);
+		if (h->hash == hash && streq(n->str, name))
+			return n;
+	}
+	return NULL;
+}
+
+static const char *dt_name_get(const char *name, u32 hash)
+{
+	size_t len = strlen(name) + 1;
+	struct dt_name *n;
+
+	lock(&dt_name_lock);
+	n = dt_name_lookup(name, hash);
+	if (!n) {
+		n = dt_arena_alloc(sizeof(*n) + len);
+		if (!n) {
+			prerror("Failed to allocate name \"%s\"\n", name);
+			abort();
+		}
+		memcpy(n->str, name, len);
+		n->refs = 0;
+		n->hash.hash = hash;
+		dt_index_add(&dt_name_index, &n->hash);
+	}
+	n->refs++;
+	unlock(&dt_name_lock);
+
+	return n->str;
+}
+
+static void dt_name_put(const char *name)
+{
+	struct dt_name *n = (struct dt_name *)
+		(name - container_off(struct dt_name, str));
+
+	lock(&dt_name_lock);
+	if (--n->refs) {
+		unlock(&dt_name_lock);
+		return;
 	}
-	return name;
+	dt_index_del(dt_name_index, &n->hash);
+	unlock(&dt_name_lock);
+
+	dt_arena_free(n, sizeof(*n) + strlen(name) + 1);
+}
+
+/* Node names not in rodata are stored right after the node */
+static size_t dt_node_size(const struct dt_node *node)
+{
+	if (node->name != (const char *)(node + 1))
+		return sizeof(*node);
+	return sizeof(*node) + strlen(node->name) + 1;
 }
 
-static void free_name(const char *name)
+static void free_property(struct dt_property *p)
 {
-	if (!is_rodata(name))
-		free((char *)name);
+	dt_name_put(p->name);
+	dt_arena_free(p, sizeof(*p) + p->size);
 }
 
 static struct dt_node *new_node(const char *name)
 {
-	struct dt_node *node = malloc(sizeof *node);
+	size_t len = is_rodata(name) ? 0 : strlen(name) + 1;
+	struct dt_node *node = dt_arena_alloc(sizeof(*node) + len);
 	if (!node) {
 		prerror("Failed to allocate node\n");
 		abort();
 	}
 
-	node->name = take_name(name);
+	if (len) {
+		memcpy(node + 1, name, len);
+		node->name = (const char *)(node + 1);
+	} else {
+		node->name = name;
+	}
 	node->parent = NULL;
 	list_head_init(&node->properties);
 	list_head_init(&node->children);
+	node->nr_children = 0;
+	node->nr_props = 0;
+	node->child_index = NULL;
+	node->prop_index = NULL;
+	node->name_hash.hash = dt_hash_str(node->name);
+	node->name_hash.pprev = NULL;
+	node->flat_dirty = true;
+	node->flat_off = 0;
+	node->flat_len = 0;
 	/* FIXME: locking? */
 	node->phandle = new_phandle();
+	node->phandle_hash.hash = node->phandle;
+	lock(&dt_phandle_lock);
+	dt_index_add(&dt_phandle_index, &node->phandle_hash);
+	unlock(&dt_phandle_lock);
 	return node;
 }
 
@@ -91,6 +475,22 @@ int dt_cmp_subnodes(const struct dt_node *a, const struct dt_node *b)
 	return strcmp(a->name, b->name);
 }
 
+static void dt_add_child(struct dt_node *parent, struct dt_node *child)
+{
+	child->parent = parent;
+	parent->nr_children++;
+
+	/* Anything flattened for where it was before is no use here */
+	child->flat_dirty = true;
+	child->flat_len = 0;
+	dt_dirty(parent);
+
+	if (parent->child_index)
+		dt_index_add(&parent->child_index, &child->name_hash);
+	else if (parent->nr_children >= DT_INDEX_MIN)
+		dt_index_children(parent);
+}
+
 bool dt_attach_root(struct dt_node *parent, struct dt_node *root)
 {
 	struct dt_node *node;
@@ -99,7 +499,16 @@ bool dt_attach_root(struct dt_node *parent, struct dt_node *root)
 
 	if (list_empty(&parent->children)) {
 		list_add(&parent->children, &root->list);
-		root->parent = parent;
+		dt_add_child(parent, root);
+
+		return true;
+	}
+
+	/* Children are mostly added in order, which needs no walk */
+	node = list_tail(&parent->children, struct dt_node, list);
+	if (dt_cmp_subnodes(node, root) < 0) {
+		list_add_tail(&parent->children, &root->list);
+		dt_add_child(parent, root);
 
 		return true;
 	}
@@ -121,7 +530,7 @@ bool dt_attach_root(struct dt_node *parent, struct dt_node *root)
 	}
 
 	list_add_before(&parent->children, &root->list, &node->list);
-	root->parent = parent;
+	dt_add_child(parent, root);
 
 	return true;
 }
@@ -131,8 +540,12 @@ static inline void dt_destroy(struct dt_node *dn)
 	if (!dn)
 		return;
 
-	free_name(dn->name);
-	free(dn);
+	lock(&dt_phandle_lock);
+	dt_index_del(dt_phandle_index, &dn->phandle_hash);
+	unlock(&dt_phandle_lock);
+	free(dn->child_index);
+	free(dn->prop_index);
+	dt_arena_free(dn, dt_node_size(dn));
 }
 	
 struct dt_node *dt_new(struct dt_node *parent, const char *name)
@@ -356,6 +769,21 @@ struct dt_node *dt_find_by_path(struct dt_node *root, const char *path)
 		if (pnl == 0 && pal == 0)
 			break;
 
+		/*
+		 * The index can only tell us about exact name matches, and
+		 * a name without a unit address may match one with.
+		 */
+		if (root->child_index && pnl) {
+			n = dt_index_find_child(root, pn,
+						pal ? pnl + 1 + pal : pnl);
+			if (n) {
+				root = n;
+				continue;
+			}
+			if (pal)
+				return NULL;
+		}
+
 		/* Compare with each child node */
 		match = false;
 		list_for_each(&root->children, n, list) {
@@ -408,10 +836,35 @@ struct dt_node *dt_new_check(struct dt_node *parent, const char *name)
 }
 
 
+static bool dt_is_descendant(const struct dt_node *root,
+			     const struct dt_node *node)
+{
+	for (node = node->parent; node; node = node->parent)
+		if (node == root)
+			return true;
+	return false;
+}
+
 struct dt_node *dt_find_by_phandle(struct dt_node *root, u32 phandle)
 {
-	struct dt_node *node;
+	struct dt_node *node, *match = NULL;
+	struct dt_hnode *h;
 
+	lock(&dt_phandle_lock);
+	for (h = *dt_index_bucket(dt_phandle_index, phandle); h; h = h->next) {
+		node = container_of(h, struct dt_node, phandle_hash);
+		if (node->phandle != phandle || !dt_is_descendant(root, node))
+			continue;
+		/* Duplicates are rare (eg. mid-import), take the first */
+		if (match)
+			goto walk;
+		match = node;
+	}
+	unlock(&dt_phandle_lock);
+	return match;
+
+walk:
+	unlock(&dt_phandle_lock);
 	dt_for_each_node(root, node)
 		if (node->phandle == phandle)
 			return node;
@@ -421,8 +874,10 @@ struct dt_node *dt_find_by_phandle(struct dt_node *root, u32 phandle)
 static struct dt_property *new_property(struct dt_node *node,
 					const char *name, size_t size)
 {
-	struct dt_property *p = malloc(sizeof(*p) + size);
+	size_t alloc = dt_arena_size(sizeof(struct dt_property) + size);
+	struct dt_property *p = dt_arena_alloc(alloc);
 	char *path;
+	u32 hash;
 
 	if (!p) {
 		path = dt_get_path(node);
@@ -440,9 +895,20 @@ static struct dt_property *new_property(struct dt_node *node,
 
 	}
 
-	p->name = take_name(name);
+	hash = dt_hash_str(name);
+	p->name = dt_name_get(name, hash);
 	p->len = size;
+	p->size = alloc - sizeof(*p);
+	p->hash.hash = hash;
+	p->hash.pprev = NULL;
 	list_add_tail(&node->properties, &p->list);
+
+	dt_dirty(node);
+	node->nr_props++;
+	if (node->prop_index)
+		dt_index_add(&node->prop_index, &p->hash);
+	else if (node->nr_props >= DT_INDEX_MIN)
+		dt_index_props(node);
 	return p;
 }
 
@@ -459,7 +925,7 @@ struct dt_property *dt_add_property(struct dt_node *node,
 	if (strcmp(name, "linux,phandle") == 0 ||
 	    strcmp(name, "phandle") == 0) {
 		assert(size == 4);
-		node->phandle = *(const u32 *)val;
+		dt_set_phandle(node, *(const u32 *)val);
 		if (node->phandle >= last_phandle)
 			set_last_phandle(node->phandle);
 		return NULL;
@@ -473,13 +939,33 @@ struct dt_property *dt_add_property(struct dt_node *node,
 
 void dt_resize_property(struct dt_property **prop, size_t len)
 {
-	size_t new_len = sizeof(**prop) + len;
+	size_t alloc = dt_arena_size(sizeof(**prop) + len);
+	struct dt_property *old = *prop;
+
+	dt_flat_stale = true;
+	if (len <= old->size)
+		return;
 
-	*prop = realloc(*prop, new_len);
+	*prop = dt_arena_alloc(alloc);
+	if (!*prop) {
+		prerror("Failed to resize property \"%s\" to %zu bytes\n",
+			old->name, len);
+		abort();
+	}
+	memcpy(*prop, old, sizeof(*old) + old->size);
+	(*prop)->size = alloc - sizeof(**prop);
+	dt_arena_free(old, sizeof(*old) + old->size);
 
 	/* Fix up linked lists in case we moved. (note: not an empty list). */
 	(*prop)->list.next->prev = &(*prop)->list;
 	(*prop)->list.prev->next = &(*prop)->list;
+
+	/* Likewise the index, if the node has one */
+	if ((*prop)->hash.pprev) {
+		*(*prop)->hash.pprev = &(*prop)->hash;
+		if ((*prop)->hash.next)
+			(*prop)->hash.next->pprev = &(*prop)->hash.next;
+	}
 }
 
 struct dt_property *dt_add_property_string(struct dt_node *node,
@@ -582,8 +1068,11 @@ struct dt_property *__dt_add_property_strings(struct dt_node *node,
 void dt_del_property(struct dt_node *node, struct dt_property *prop)
 {
 	list_del_from(&node->properties, &prop->list);
-	free_name(prop->name);
-	free(prop);
+	dt_dirty(node);
+	node->nr_props--;
+	if (node->prop_index)
+		dt_index_del(node->prop_index, &prop->hash);
+	free_property(prop);
 }
 
 u32 dt_property_get_cell(const struct dt_property *prop, u32 index)
@@ -605,6 +1094,7 @@ void dt_property_set_cell(struct dt_property *prop, u32 index, u32 val)
 	assert(prop->len >= (index+1)*sizeof(u32));
 	/* Always aligned, so this works. */
 	((fdt32_t *)prop->prop)[index] = cpu_to_fdt32(val);
+	dt_flat_stale = true;
 }
 
 /* First child of this node. */
@@ -645,6 +1135,19 @@ struct dt_node *dt_next(const struct dt_node *root,
 struct dt_property *__dt_find_property(struct dt_node *node, const char *name)
 {
 	struct dt_property *i;
+	struct dt_hnode *h;
+	u32 hash;
+
+	if (node->prop_index) {
+		hash = dt_hash_str(name);
+		h = *dt_index_bucket(node->prop_index, hash);
+		for (; h; h = h->next) {
+			i = container_of(h, struct dt_property, hash);
+			if (h->hash == hash && strcmp(i->name, name) == 0)
+				return i;
+		}
+		return NULL;
+	}
 
 	list_for_each(&node->properties, i, list)
 		if (strcmp(i->name, name) == 0)
@@ -655,12 +1158,7 @@ struct dt_property *__dt_find_property(struct dt_node *node, const char *name)
 const struct dt_property *dt_find_property(const struct dt_node *node,
 					   const char *name)
 {
-	const struct dt_property *i;
-
-	list_for_each(&node->properties, i, list)
-		if (strcmp(i->name, name) == 0)
-			return i;
-	return NULL;
+	return __dt_find_property((struct dt_node *)node, name);
 }
 
 void dt_check_del_prop(struct dt_node *node, const char *name)
@@ -833,13 +1331,17 @@ void dt_free(struct dt_node *node)
 	while ((child = list_top(&node->children, struct dt_node, list)))
 		dt_free(child);
 
-	while ((p = list_pop(&node->properties, struct dt_property, list))) {
-		free_name(p->name);
-		free(p);
-	}
+	while ((p = list_pop(&node->properties, struct dt_property, list)))
+		free_property(p);
 
-	if (node->parent)
+	if (node->parent) {
+		dt_dirty(node->parent);
 		list_del_from(&node->parent->children, &node->list);
+		node->parent->nr_children--;
+		if (node->parent->child_index)
+			dt_index_del(node->parent->child_index,
+				     &node->name_hash);
+	}
 	dt_destroy(node);
 }
 
@@ -1100,7 +1602,7 @@ void dt_adjust_subtree_phandle(struct dt_node *dev,
 
 	dt_for_each_node(dev, node) {
 		const char **props_to_update;
-		node->phandle += import_phandle;
+		dt_set_phandle(node, node->phandle + import_phandle);
 
 		/*
 		 * calculate max_phandle(new_tree), needed to update
@@ -2,15 +2,32 @@
 /*
  * Produce and consume flattened device trees
  *
+ * We write the blob ourselves rather than through libfdt's sequential
+ * write functions, in two passes: one working out exactly how big it
+ * will be, then one filling it in.
+ *
+ * The flattened dt_root is kept around. Each node records where its
+ * subtree sits in the structure block, relative to its parent's, and
+ * whether it has changed since (see dt_dirty()). Flattening again only
+ * re-serialises the nodes on the way down to what changed and copies
+ * everything else from the previous structure block, and any subtree
+ * can be handed out straight from it.
+ *
+ * Property names are de-duplicated through a hash keyed on the
+ * (interned) name pointer. The strings block only ever grows, so the
+ * name offsets in the cached structure block stay valid.
+ *
  * Copyright 2013-2019 IBM Corp.
  */
 
 #include <skiboot.h>
 #include <stdarg.h>
 #include <libfdt.h>
+#include <libfdt/libfdt_internal.h>
 #include <device.h>
 #include <chip.h>
 #include <cpu.h>
+#include <lock.h>
 #include <opal.h>
 #include <interrupts.h>
 #include <fsp.h>
@@ -18,8 +35,6 @@
 #include <vpd.h>
 #include <ccan/str/str.h>
 
-static int fdt_error;
-
 #undef DEBUG_FDT
 #ifdef DEBUG_FDT
 #define FDT_DBG(fmt, a...)	prlog(PR_DEBUG, "FDT: " fmt, ##a)
@@ -27,38 +42,44 @@ static int fdt_error;
 #define FDT_DBG(fmt, a...)
 #endif
 
-static void __save_err(int err, const char *str)
-{
-	FDT_DBG("rc: %d from \"%s\"\n", err, str);
-	if (err && !fdt_error) {
-		prerror("FDT: Error %d from \"%s\"\n", err, str);
-		fdt_error = err;
-	}
-}
-
-#define save_err(...) __save_err(__VA_ARGS__, #__VA_ARGS__)
-
-static void dt_property_cell(void *fdt, const char *name, u32 cell)
-{
-	save_err(fdt_property_cell(fdt, name, cell));
-}
-
-static void dt_begin_node(void *fdt, const struct dt_node *dn)
-{
-	save_err(fdt_begin_node(fdt, dn->name));
-
-	dt_property_cell(fdt, "phandle", dn->phandle);
-}
-
-static void dt_property(void *fdt, const struct dt_property *p)
-{
-	save_err(fdt_property(fdt, p->name, p->prop, p->len));
-}
-
-static void dt_end_node(void *fdt)
-{
-	save_err(fdt_end_node(fdt));
-}
+#define FDT_NAMES_MIN		256
+#define FDT_STRINGS_MIN		0x1000
+
+struct fdt_name {
+	const char *name;
+	u32 off;
+};
+
+struct fdt_strtab {
+	char *buf;
+	u32 len;
+	u32 size;
+	struct fdt_name *names;
+	u32 nr_names;
+	u32 names_size;
+};
+
+struct fdt_flat {
+	/* Use and update the nodes' flat_* fields */
+	bool cached;
+	const struct dt_node *root;
+	char *dt_struct;
+	u32 struct_len;
+	struct fdt_strtab strings;
+};
+
+/* What to put in a blob */
+struct fdt_blob {
+	const char *dt_struct;
+	u32 struct_len;
+	const struct fdt_strtab *strings;
+	const struct dt_property *ranges;
+};
+
+static const char fdt_phandle_name[] = "phandle";
+
+static struct lock fdt_lock = LOCK_UNLOCKED;
+static struct fdt_flat fdt_cache = { .cached = true };
 
 #ifdef DEBUG_FDT
 static void dump_fdt(void *fdt)
@@ -102,115 +123,415 @@ static void dump_fdt(void *fdt)
 }
 #endif
 
-static void flatten_dt_properties(void *fdt, const struct dt_node *dn)
+static u32 fdt_name_hash(const char *name)
+{
+	return ((unsigned long)name >> 3) * 0x9e3779b1u;
+}
+
+static bool fdt_names_grow(struct fdt_strtab *t)
+{
+	struct fdt_name *old = t->names, *names;
+	u32 i, j, size = t->names_size ? t->names_size * 2 : FDT_NAMES_MIN;
+
+	names = zalloc(size * sizeof(*names));
+	if (!names)
+		return false;
+
+	for (i = 0; i < t->names_size; i++) {
+		if (!old[i].name)
+			continue;
+		j = fdt_name_hash(old[i].name) & (size - 1);
+		while (names[j].name)
+			j = (j + 1) & (size - 1);
+		names[j] = old[i];
+	}
+	free(old);
+	t->names = names;
+	t->names_size = size;
+	return true;
+}
+
+static int fdt_strtab_add(struct fdt_strtab *t, const char *name)
+{
+	u32 len = strlen(name) + 1, size;
+	char *buf;
+	int off;
+
+	if (t->len + len > t->size) {
+		size = t->size ? t->size : FDT_STRINGS_MIN;
+		while (t->len + len > size)
+			size *= 2;
+		buf = realloc(t->buf, size);
+		if (!buf)
+			return -1;
+		t->buf = buf;
+		t->size = size;
+	}
+
+	off = t->len;
+	memcpy(t->buf + off, name, len);
+	t->len += len;
+	return off;
+}
+
+/* Offset of @name in the strings block, adding it if needed */
+static int fdt_name_off(struct fdt_strtab *t, const char *name)
+{
+	struct fdt_name *n;
+	u32 i;
+	int off;
+
+	if ((t->nr_names + 1) * 2 > t->names_size && !fdt_names_grow(t))
+		return -1;
+
+	for (i = fdt_name_hash(name) & (t->names_size - 1);
+	     (n = &t->names[i])->name; i = (i + 1) & (t->names_size - 1)) {
+		if (n->name != name)
+			continue;
+		if (streq(t->buf + n->off, name))
+			return n->off;
+
+		/* The name it was went away, and the memory got reused */
+		off = fdt_strtab_add(t, name);
+		if (off >= 0)
+			n->off = off;
+		return off;
+	}
+
+	off = fdt_strtab_add(t, name);
+	if (off < 0)
+		return -1;
+	n->name = name;
+	n->off = off;
+	t->nr_names++;
+	return off;
+}
+
+static void fdt_strtab_free(struct fdt_strtab *t)
+{
+	free(t->buf);
+	free(t->names);
+}
+
+static u32 fdt_prop_size(size_t len)
+{
+	return sizeof(struct fdt_property) + FDT_TAGALIGN(len);
+}
+
+/* The node's begin tag, name and properties */
+static u32 fdt_head_size(const struct dt_node *dn)
 {
 	const struct dt_property *p;
+	u32 size;
+
+	size = FDT_TAGSIZE + FDT_TAGALIGN(strlen(dn->name) + 1);
+	size += fdt_prop_size(sizeof(u32));
+	list_for_each(&dn->properties, p, list) {
+		if (!strstarts(p->name, DT_PRIVATE))
+			size += fdt_prop_size(p->len);
+	}
+	return size;
+}
+
+/* Can we copy what was flattened for @dn last time? */
+static bool fdt_node_reusable(const struct fdt_flat *flat,
+			      const struct dt_node *dn, bool base_valid)
+{
+	return flat->cached && base_valid && !dn->flat_dirty && dn->flat_len;
+}
+
+/*
+ * First pass: how big is @dn's subtree going to be? This also puts the
+ * names it uses in the strings block, so the second pass can't fail.
+ */
+static long fdt_size_node(struct fdt_flat *flat, const struct dt_node *dn,
+			  bool base_valid)
+{
+	const struct dt_property *p;
+	const struct dt_node *child;
+	long size, child_size;
+
+	if (fdt_node_reusable(flat, dn, base_valid))
+		return dn->flat_len;
 
+	list_for_each(&dn->properties, p, list) {
+		if (strstarts(p->name, DT_PRIVATE))
+			continue;
+		if (fdt_name_off(&flat->strings, p->name) < 0)
+			return -1;
+	}
+	size = fdt_head_size(dn) + FDT_TAGSIZE;
+
+	base_valid = base_valid && flat->cached && dn->flat_len;
+	list_for_each(&dn->children, child, list) {
+		child_size = fdt_size_node(flat, child, base_valid);
+		if (child_size < 0)
+			return -1;
+		size += child_size;
+	}
+
+	return size;
+}
+
+static char *fdt_put_tag(char *out, u32 tag)
+{
+	*(fdt32_t *)out = cpu_to_fdt32(tag);
+	return out + FDT_TAGSIZE;
+}
+
+static char *fdt_put_prop(char *out, int nameoff, const void *val, u32 len)
+{
+	struct fdt_property *prop = (struct fdt_property *)out;
+
+	prop->tag = cpu_to_fdt32(FDT_PROP);
+	prop->len = cpu_to_fdt32(len);
+	prop->nameoff = cpu_to_fdt32(nameoff);
+	memcpy(prop->data, val, len);
+	memset(prop->data + len, 0, FDT_TAGALIGN(len) - len);
+	return out + fdt_prop_size(len);
+}
+
+/*
+ * Second pass: write out @dn's subtree, copying the parts that haven't
+ * changed from the @old structure block where @dn used to be at
+ * @old_off. Returns how much was written.
+ */
+static u32 fdt_emit_node(struct fdt_flat *flat, struct dt_node *dn,
+			 bool base_valid, const char *old, u32 old_off,
+			 char *out)
+{
+	const struct dt_property *p;
+	struct dt_node *child;
+	u32 name_len = strlen(dn->name) + 1;
+	__be32 phandle = cpu_to_fdt32(dn->phandle);
+	char *pos = out;
+	u32 len;
+
+	if (fdt_node_reusable(flat, dn, base_valid)) {
+		memcpy(out, old + old_off, dn->flat_len);
+		return dn->flat_len;
+	}
+
+	FDT_DBG("node: %s\n", dn->name);
+	pos = fdt_put_tag(pos, FDT_BEGIN_NODE);
+	memcpy(pos, dn->name, name_len);
+	memset(pos + name_len, 0, FDT_TAGALIGN(name_len) - name_len);
+	pos += FDT_TAGALIGN(name_len);
+
+	pos = fdt_put_prop(pos, fdt_name_off(&flat->strings, fdt_phandle_name),
+			   &phandle, sizeof(phandle));
 	list_for_each(&dn->properties, p, list) {
 		if (strstarts(p->name, DT_PRIVATE))
 			continue;
 
 		FDT_DBG("  prop: %s size: %ld\n", p->name, p->len);
-		dt_property(fdt, p);
+		pos = fdt_put_prop(pos, fdt_name_off(&flat->strings, p->name),
+				   p->prop, p->len);
 	}
+
+	base_valid = base_valid && flat->cached && dn->flat_len;
+	list_for_each(&dn->children, child, list) {
+		len = fdt_emit_node(flat, child, base_valid, old,
+				    old_off + child->flat_off, pos);
+		if (flat->cached)
+			child->flat_off = pos - out;
+		pos += len;
+	}
+
+	pos = fdt_put_tag(pos, FDT_END_NODE);
+
+	if (flat->cached) {
+		dn->flat_len = pos - out;
+		dn->flat_dirty = false;
+	}
+	return pos - out;
 }
 
-static void flatten_dt_node(void *fdt, const struct dt_node *root,
-			    bool exclusive)
+/* Bring the flattened copy of @root up to date */
+static int fdt_refresh(struct fdt_flat *flat, struct dt_node *root)
 {
-	const struct dt_node *i;
-
-	if (!exclusive) {
-		FDT_DBG("node: %s\n", root->name);
-		dt_begin_node(fdt, root);
-		flatten_dt_properties(fdt, root);
+	bool base_valid;
+	long size;
+	char *buf;
+
+	base_valid = flat->cached && flat->dt_struct && flat->root == root &&
+		!dt_flat_stale;
+	if (fdt_node_reusable(flat, root, base_valid))
+		return 0;
+
+	if (fdt_name_off(&flat->strings, fdt_phandle_name) < 0)
+		return -1;
+	size = fdt_size_node(flat, root, base_valid);
+	if (size < 0)
+		return -1;
+
+	buf = malloc(size);
+	if (!buf)
+		return -1;
+
+	fdt_emit_node(flat, root, base_valid, flat->dt_struct, 0, buf);
+	if (flat->cached) {
+		root->flat_off = 0;
+		dt_flat_stale = false;
 	}
 
-	list_for_each(&root->children, i, list)
-		flatten_dt_node(fdt, i, false);
+	free(flat->dt_struct);
+	flat->dt_struct = buf;
+	flat->struct_len = size;
+	flat->root = root;
+	return 0;
+}
+
+/* Where @dn's subtree is in the cached structure block */
+static u32 fdt_cached_off(const struct dt_node *dn)
+{
+	u32 off = 0;
 
-	if (!exclusive)
-		dt_end_node(fdt);
+	for (; dn; dn = dn->parent)
+		off += dn->flat_off;
+	return off;
 }
 
-static void create_dtb_reservemap(void *fdt, const struct dt_node *root)
+static bool fdt_in_cache(const struct dt_node *dn)
 {
-	uint64_t base, size;
-	const __be64 *ranges;
-	const struct dt_property *prop;
-	int i;
+	while (dn->parent)
+		dn = dn->parent;
+	return dt_root && dn == dt_root;
+}
 
-	/* Duplicate the reserved-ranges property into the fdt reservemap */
-	prop = dt_find_property(root, "reserved-ranges");
-	if (prop) {
-		ranges = (const void *)prop->prop;
-
-		for (i = 0; i < prop->len / (sizeof(uint64_t) * 2); i++) {
-			base = be64_to_cpu(*(ranges++));
-			size = be64_to_cpu(*(ranges++));
-			save_err(fdt_add_reservemap_entry(fdt, base, size));
+/*
+ * Work out what goes in the blob for @root. Subtrees of dt_root come
+ * from the cache, anything else is flattened into @tmp, which the
+ * caller has to free once done with @blob.
+ */
+static int fdt_prepare(struct fdt_blob *blob, struct fdt_flat *tmp,
+		       const struct dt_node *root, bool exclusive)
+{
+	struct fdt_flat *flat = &fdt_cache;
+	const struct dt_node *first, *last;
+	u32 off;
+
+	memset(blob, 0, sizeof(*blob));
+	memset(tmp, 0, sizeof(*tmp));
+
+	if (root == dt_root && !exclusive)
+		blob->ranges = dt_find_property(root, "reserved-ranges");
+
+	if (!fdt_in_cache(root)) {
+		flat = tmp;
+		if (fdt_refresh(flat, (struct dt_node *)root))
+			return -1;
+		blob->dt_struct = flat->dt_struct;
+		blob->struct_len = flat->struct_len;
+		blob->strings = &flat->strings;
+
+		/* Just the children, between root's head and its end tag */
+		if (exclusive) {
+			off = fdt_head_size(root);
+			blob->dt_struct += off;
+			blob->struct_len -= off + FDT_TAGSIZE;
 		}
+		return 0;
 	}
 
-	save_err(fdt_finish_reservemap(fdt));
+	if (fdt_refresh(flat, dt_root))
+		return -1;
+
+	off = fdt_cached_off(root);
+	if (!exclusive) {
+		blob->dt_struct = flat->dt_struct + off;
+		blob->struct_len = root->flat_len;
+	} else if (!list_empty(&root->children)) {
+		first = list_top(&root->children, struct dt_node, list);
+		last = list_tail(&root->children, struct dt_node, list);
+		blob->dt_struct = flat->dt_struct + off + first->flat_off;
+		blob->struct_len = last->flat_off + last->flat_len -
+			first->flat_off;
+	}
+	blob->strings = &flat->strings;
+	return 0;
 }
 
-static int __create_dtb(void *fdt, size_t len,
-			const struct dt_node *root,
-			bool exclusive)
+static u32 fdt_blob_rsvmap_off(void)
 {
-	if (chip_quirk(QUIRK_SLOW_SIM))
-		save_err(fdt_create_with_flags(fdt, len, FDT_CREATE_FLAG_NO_NAME_DEDUP));
-	else
-		save_err(fdt_create_with_flags(fdt, len, 0));
-	if (fdt_error)
-		goto err;
+	return ALIGN_UP(sizeof(struct fdt_header),
+			sizeof(struct fdt_reserve_entry));
+}
 
-	if (root == dt_root && !exclusive)
-		create_dtb_reservemap(fdt, root);
-	else
-		save_err(fdt_finish_reservemap(fdt));
+static u32 fdt_blob_nr_rsv(const struct fdt_blob *blob)
+{
+	if (!blob->ranges)
+		return 0;
+	return blob->ranges->len / sizeof(struct fdt_reserve_entry);
+}
 
-	flatten_dt_node(fdt, root, exclusive);
+static size_t fdt_blob_size(const struct fdt_blob *blob)
+{
+	return fdt_blob_rsvmap_off() +
+		(fdt_blob_nr_rsv(blob) + 1) * sizeof(struct fdt_reserve_entry) +
+		blob->struct_len + FDT_TAGSIZE + blob->strings->len;
+}
 
-	save_err(fdt_finish(fdt));
-	if (fdt_error) {
-err:
-		prerror("dtb: error %s\n", fdt_strerror(fdt_error));
-		return fdt_error;
-	}
+static void fdt_blob_write(const struct fdt_blob *blob, void *fdt)
+{
+	struct fdt_reserve_entry *rsv;
+	u32 nr_rsv = fdt_blob_nr_rsv(blob);
+	u32 off_struct, off_strings;
+	char *pos;
 
-#ifdef DEBUG_FDT
-	dump_fdt(fdt);
-#endif
-	return 0;
+	memset(fdt, 0, fdt_blob_rsvmap_off());
+
+	/* Duplicate the reserved-ranges property into the fdt reservemap */
+	rsv = fdt + fdt_blob_rsvmap_off();
+	if (nr_rsv)
+		memcpy(rsv, blob->ranges->prop, nr_rsv * sizeof(*rsv));
+	memset(&rsv[nr_rsv], 0, sizeof(*rsv));
+
+	off_struct = (void *)&rsv[nr_rsv + 1] - fdt;
+	pos = fdt + off_struct;
+	memcpy(pos, blob->dt_struct, blob->struct_len);
+	pos = fdt_put_tag(pos + blob->struct_len, FDT_END);
+
+	off_strings = pos - (char *)fdt;
+	memcpy(pos, blob->strings->buf, blob->strings->len);
+
+	fdt_set_magic(fdt, FDT_MAGIC);
+	fdt_set_totalsize(fdt, off_strings + blob->strings->len);
+	fdt_set_off_dt_struct(fdt, off_struct);
+	fdt_set_off_dt_strings(fdt, off_strings);
+	fdt_set_off_mem_rsvmap(fdt, fdt_blob_rsvmap_off());
+	fdt_set_version(fdt, FDT_LAST_SUPPORTED_VERSION);
+	fdt_set_last_comp_version(fdt, FDT_FIRST_SUPPORTED_VERSION);
+	fdt_set_size_dt_strings(fdt, blob->strings->len);
+	fdt_set_size_dt_struct(fdt, blob->struct_len + FDT_TAGSIZE);
 }
 
 void *create_dtb(const struct dt_node *root, bool exclusive)
 {
+	struct fdt_blob blob;
+	struct fdt_flat tmp;
 	void *fdt = NULL;
-	size_t len = DEVICE_TREE_MAX_SIZE;
-	uint32_t old_last_phandle = get_last_phandle();
-	int ret;
-
-	do {
-		set_last_phandle(old_last_phandle);
-		fdt_error = 0;
-		fdt = malloc(len);
-		if (!fdt) {
-			prerror("dtb: could not malloc %lu\n", (long)len);
-			return NULL;
-		}
 
-		ret = __create_dtb(fdt, len, root, exclusive);
-		if (ret) {
-			free(fdt);
-			fdt = NULL;
-		}
+	lock(&fdt_lock);
+	if (fdt_prepare(&blob, &tmp, root, exclusive)) {
+		prerror("dtb: could not flatten device tree\n");
+		goto out;
+	}
 
-		len *= 2;
-	} while (ret == -FDT_ERR_NOSPACE);
+	fdt = malloc(fdt_blob_size(&blob));
+	if (!fdt) {
+		prerror("dtb: could not malloc %zu\n", fdt_blob_size(&blob));
+		goto out;
+	}
+	fdt_blob_write(&blob, fdt);
 
+#ifdef DEBUG_FDT
+	dump_fdt(fdt);
+#endif
+out:
+	free(tmp.dt_struct);
+	fdt_strtab_free(&tmp.strings);
+	unlock(&fdt_lock);
 	return fdt;
 }
 
@@ -218,10 +539,10 @@ static int64_t opal_get_device_tree(uint32_t phandle,
 				    uint64_t buf, uint64_t len)
 {
 	struct dt_node *root;
+	struct fdt_blob blob;
+	struct fdt_flat tmp;
 	void *fdt = (void *)buf;
-	uint32_t old_last_phandle;
-	int64_t totalsize;
-	int ret;
+	int64_t rc;
 
 	if (!opal_addr_valid(fdt))
 		return OPAL_PARAMETER;
@@ -230,29 +551,25 @@ static int64_t opal_get_device_tree(uint32_t phandle,
 	if (!root)
 		return OPAL_PARAMETER;
 
-	if (!fdt) {
-		fdt = create_dtb(root, true);
-		if (!fdt)
-			return OPAL_INTERNAL_ERROR;
-		totalsize = fdt_totalsize(fdt);
-		free(fdt);
-		return totalsize;
-	}
-
-	if (!len)
+	if (fdt && !len)
 		return OPAL_PARAMETER;
 
-	fdt_error = 0;
-	old_last_phandle = get_last_phandle();
-	ret = __create_dtb(fdt, len, root, true);
-	if (ret) {
-		set_last_phandle(old_last_phandle);
-		if (ret == -FDT_ERR_NOSPACE)
-			return OPAL_NO_MEM;
-
-		return OPAL_EMPTY;
+	lock(&fdt_lock);
+	if (fdt_prepare(&blob, &tmp, root, true)) {
+		rc = fdt ? OPAL_EMPTY : OPAL_INTERNAL_ERROR;
+	} else if (!fdt) {
+		/* Just asking how big it is */
+		rc = fdt_blob_size(&blob);
+	} else if (len < fdt_blob_size(&blob)) {
+		rc = OPAL_NO_MEM;
+	} else {
+		fdt_blob_write(&blob, fdt);
+		rc = OPAL_SUCCESS;
 	}
+	free(tmp.dt_struct);
+	fdt_strtab_free(&tmp.strings);
+	unlock(&fdt_lock);
 
-	return OPAL_SUCCESS;
+	return rc;
 }
 opal_call(OPAL_GET_DEVICE_TREE, opal_get_device_tree, 3);
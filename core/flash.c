@@ -31,6 +31,8 @@ struct flash {
 	bool			busy;
 	bool			no_erase;
 	struct blocklevel_device *bl;
+	/* Parsed TOC, dropped when the host or a reservation writes over it */
+	struct ffs_cache	*ffs;
 	uint64_t		size;
 	uint32_t		block_size;
 	int			id;
@@ -79,6 +81,8 @@ void flash_release(void)
 {
 	lock(&flash_lock);
 	system_flash->busy = false;
+	/* We can't tell what whoever had it did to the TOC */
+	ffs_cache_invalidate(system_flash->ffs, 0, system_flash->size);
 	unlock(&flash_lock);
 }
 
@@ -176,6 +180,7 @@ static int flash_nvram_write(uint32_t dst, void *src, uint32_t len)
 	rc = blocklevel_write(nvram_flash->bl, nvram_offset + dst, src, len);
 
 	lock(&flash_lock);
+	ffs_cache_invalidate(nvram_flash->ffs, nvram_offset + dst, len);
 	nvram_flash->busy = false;
 out:
 	unlock(&flash_lock);
@@ -223,13 +228,13 @@ static int flash_nvram_probe(struct flash *flash, struct ffs_handle *ffs)
 
 /* core flash support */
 
-static struct dt_node *flash_add_dt_node(struct flash *flash, int id)
+static struct dt_node *flash_add_dt_node(struct flash *flash, int id,
+		struct ffs_handle *ffs)
 {
 	int i;
 	int rc;
 	const char *name;
 	bool ecc;
-	struct ffs_handle *ffs;
 	int ffs_part_num, ffs_part_start, ffs_part_size;
 	struct dt_node *flash_node;
 	struct dt_node *partition_container_node;
@@ -257,15 +262,9 @@ static struct dt_node *flash_add_dt_node(struct flash *flash, int id)
 	dt_add_property_cells(partition_container_node, "#size-cells", 1);
 
 	/* Add partitions */
-	for (i = 0, name = NULL; i < ARRAY_SIZE(part_name_map); i++) {
+	for (i = 0, name = NULL; ffs && i < ARRAY_SIZE(part_name_map); i++) {
 		name = part_name_map[i].name;
 
-		rc = ffs_init(0, flash->size, flash->bl, &ffs, 1);
-		if (rc) {
-			prerror("Can't open ffs handle\n");
-			continue;
-		}
-
 		rc = ffs_lookup_part(ffs, name, &ffs_part_num);
 		if (rc) {
 			/* This is not an error per-se, some partitions
@@ -374,12 +373,15 @@ int flash_register(struct blocklevel_device *bl)
 
 	flash->busy = false;
 	flash->bl = bl;
+	flash->ffs = NULL;
 	flash->no_erase = !(bl->flags & WRITE_NEED_ERASE);
 	flash->size = size;
 	flash->block_size = block_size;
 	flash->id = num_flashes();
 
-	rc = ffs_init(0, flash->size, bl, &ffs, 1);
+	rc = ffs_cache_init(0, flash->size, bl, true, &flash->ffs);
+	if (!rc)
+		rc = ffs_cache_get(flash->ffs, 0, &ffs);
 	if (rc) {
 		/**
 		 * @fwts-label NoFFS
@@ -392,13 +394,10 @@ int flash_register(struct blocklevel_device *bl)
 		ffs = NULL;
 	}
 
-	node = flash_add_dt_node(flash, flash->id);
+	node = flash_add_dt_node(flash, flash->id, ffs);
 
 	setup_system_flash(flash, node, name, ffs);
 
-	if (ffs)
-		ffs_close(ffs);
-
 	lock(&flash_lock);
 	list_add(&flashes, &flash->list);
 	unlock(&flash_lock);
@@ -463,6 +462,10 @@ static int64_t opal_flash_op(enum flash_op op, uint64_t id, uint64_t offset,
 		assert(0);
 	}
 
+	/* Even a failed write may have changed the TOC */
+	if (op != FLASH_OP_READ)
+		ffs_cache_invalidate(flash->ffs, offset, size);
+
 	if (rc) {
 		rc = OPAL_HARDWARE;
 		goto err;
@@ -561,6 +564,108 @@ static size_t sizeof_elf_from_hdr(void *buf)
 	return sz;
 }
 
+/*
+ * Partitions are read in chunks of this size so that whoever consumes
+ * the data (the xz decoder) can start before the whole read is done.
+ */
+#define FLASH_LOAD_CHUNK	0x10000
+
+struct flash_load_resource_item {
+	enum resource_id id;
+	uint32_t subid;
+	int result;
+	void *buf;
+	size_t *len;
+	struct list_node link;
+	/* Optionally decompressed as it's read */
+	struct xz_decompress *xz;
+	/* Where the caller's data ended up, for flash_load_finish() */
+	void *content;
+	size_t content_size;
+};
+
+static void xz_decompress(void *data);
+
+/*
+ * Start decompressing the @size bytes at @src as they are read in. The
+ * decoder waits for data we read with flash_lock held, so it can only
+ * do that on another CPU. If there's none, flash_load_finish()
+ * decompresses it once it's all read.
+ */
+static void flash_load_xz_start(struct flash_load_resource_item *r,
+				void *src, size_t size)
+{
+	struct xz_decompress *xz = r->xz;
+
+	if (!xz)
+		return;
+
+	xz->src = src;
+	xz->src_size = size;
+	xz->src_avail = 0;
+	xz->src_done = false;
+	xz->status = OPAL_PARTIAL;
+	xz->job = NULL;
+	xz->streaming = false;
+	if (!xz->dst || !xz->dst_size || !size)
+		return;
+
+	xz->streaming = true;
+	xz->job = cpu_queue_job_remote("xz_decompress", xz_decompress, xz);
+	if (!xz->job)
+		xz->streaming = false;
+}
+
+/* Everything up to @end has been read */
+static void flash_load_progress(struct flash_load_resource_item *r, void *end)
+{
+	struct xz_decompress *xz = r->xz;
+
+	if (!xz || !xz->job || end <= xz->src)
+		return;
+
+	/* Make the data visible before saying it's there */
+	lwsync();
+	xz->src_avail = MIN((size_t)(end - xz->src), xz->src_size);
+}
+
+/* No more data is coming, optionally wait for the decoder to finish */
+static void flash_load_xz_end(struct flash_load_resource_item *r, bool wait)
+{
+	struct xz_decompress *xz = r->xz;
+
+	if (!xz || !xz->job)
+		return;
+
+	lwsync();
+	xz->src_done = true;
+	if (wait) {
+		cpu_wait_job(xz->job, true);
+		xz->job = NULL;
+	}
+}
+
+static int flash_load_read(struct flash *flash,
+			   struct flash_load_resource_item *r,
+			   uint64_t pos, void *buf, size_t len)
+{
+	size_t chunk;
+	int rc;
+
+	while (len) {
+		chunk = MIN(len, (size_t)FLASH_LOAD_CHUNK);
+		rc = blocklevel_read(flash->bl, pos, buf, chunk);
+		if (rc)
+			return rc;
+		pos += chunk;
+		buf += chunk;
+		len -= chunk;
+		flash_load_progress(r, buf);
+	}
+
+	return 0;
+}
+
 /*
  * load a resource from FLASH
  * buf and len shouldn't account for ECC even if partition is ECCed.
@@ -571,9 +676,12 @@ static size_t sizeof_elf_from_hdr(void *buf)
  * For trusted boot, the whole partition containing the subpart is measured.
  *
  * Additionally, the logic to work out how much to read from flash is insane.
+ *
+ * This only does the reading, flash_load_finish() then verifies and
+ * measures what was read and moves subpartitions into place without
+ * holding up the flash.
  */
-static int flash_load_resource(enum resource_id id, uint32_t subid,
-			       void *buf, size_t *len)
+static int flash_load_resource(struct flash_load_resource_item *r)
 {
 	int i;
 	int rc = OPAL_RESOURCE;
@@ -583,11 +691,16 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 	bool status = false;
 	bool ecc;
 	bool part_signed = false;
+	enum resource_id id = r->id;
+	uint32_t subid = r->subid;
+	void *buf = r->buf;
+	size_t *len = r->len;
 	void *bufp = buf;
 	size_t bufsz = *len;
 	int ffs_part_num, ffs_part_start, ffs_part_size;
 	int content_size = 0;
 	int offset = 0;
+	size_t first;
 
 	lock(&flash_lock);
 
@@ -627,7 +740,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		goto out_unlock;
 	}
 
-	rc = ffs_init(0, flash->size, flash->bl, &ffs, 1);
+	rc = ffs_cache_get(flash->ffs, 0, &ffs);
 	if (rc) {
 		prerror("Can't open ffs handle: %d\n", rc);
 		goto out_unlock;
@@ -639,13 +752,13 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		 * are purposefully absent, don't spam the logs
 		 */
 	        prlog(PR_DEBUG, "No %s partition\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 	rc = ffs_part_info(ffs, ffs_part_num, NULL,
 			   &ffs_part_start, NULL, &ffs_part_size, &ecc);
 	if (rc) {
 		prerror("Failed to get %s partition info\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 	prlog(PR_DEBUG,"%s partition %s ECC\n",
 	      name, ecc  ? "has" : "doesn't have");
@@ -657,7 +770,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 	if (ffs_part_size < SECURE_BOOT_HEADERS_SIZE) {
 		prerror("secboot headers bigger than "
 			"partition size 0x%x\n", ffs_part_size);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 
 	rc = blocklevel_read(flash->bl, ffs_part_start, bufp,
@@ -666,7 +779,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		prerror("failed to read the first 0x%x from "
 			"%s partition, rc %d\n", SECURE_BOOT_HEADERS_SIZE,
 			name, rc);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 
 	part_signed = stb_is_container(bufp, SECURE_BOOT_HEADERS_SIZE);
@@ -688,37 +801,61 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		if (content_size > bufsz) {
 			prerror("content size > buffer size\n");
 			rc = OPAL_PARAMETER;
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 
 		if (*len > ffs_part_size) {
 			prerror("FLASH: Cannot load %s. Content is larger than the partition\n",
 					name);
 			rc = OPAL_PARAMETER;
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 
 		ffs_part_start += SECURE_BOOT_HEADERS_SIZE;
 
-		rc = blocklevel_read(flash->bl, ffs_part_start, bufp,
-					  content_size);
+		/*
+		 * A subpartition's header is at the start of the payload,
+		 * so get that first to know where to decompress from.
+		 */
+		if (subid == RESOURCE_SUBID_NONE) {
+			flash_load_xz_start(r, bufp, content_size);
+			first = 0;
+		} else {
+			BUILD_ASSERT(FLASH_SUBPART_HEADER_SIZE <= FLASH_LOAD_CHUNK);
+			first = MIN((size_t)content_size, (size_t)FLASH_LOAD_CHUNK);
+		}
+
+		rc = flash_load_read(flash, r, ffs_part_start, bufp, first);
 		if (rc) {
 			prerror("failed to read content size %d"
 				" %s partition, rc %d\n",
 				content_size, name, rc);
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 
-		if (subid == RESOURCE_SUBID_NONE)
-			goto done_reading;
+		if (subid != RESOURCE_SUBID_NONE) {
+			rc = flash_subpart_info(bufp, content_size,
+						ffs_part_size, NULL, subid,
+						&offset, &content_size);
+			if (rc) {
+				prerror("Failed to parse subpart info for %s\n",
+					name);
+				goto out_unlock;
+			}
+			flash_load_xz_start(r, bufp + offset, content_size);
+			flash_load_progress(r, bufp + first);
+		}
 
-		rc = flash_subpart_info(bufp, content_size, ffs_part_size,
-					NULL, subid, &offset, &content_size);
+		rc = flash_load_read(flash, r, ffs_part_start + first,
+				     bufp + first,
+				     *len - SECURE_BOOT_HEADERS_SIZE - first);
 		if (rc) {
-			prerror("Failed to parse subpart info for %s\n",
-				name);
-			goto out_free_ffs;
+			prerror("failed to read content size %d"
+				" %s partition, rc %d\n",
+				content_size, name, rc);
+			goto out_unlock;
 		}
+
 		bufp += offset;
 		goto done_reading;
 	} else /* stb_signed */ {
@@ -739,7 +876,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 					prerror("Invalid ELF header part"
 						" %s\n", name);
 					rc = OPAL_RESOURCE;
-					goto out_free_ffs;
+					goto out_unlock;
 				}
 			} else {
 				content_size = ffs_part_size;
@@ -749,17 +886,18 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 					" buffer size %lu\n", name,
 					content_size, bufsz);
 				rc = OPAL_PARAMETER;
-				goto out_free_ffs;
+				goto out_unlock;
 			}
 			prlog(PR_DEBUG, "computed %s size %u\n",
 			      name, content_size);
-			rc = blocklevel_read(flash->bl, ffs_part_start,
-						  buf, content_size);
+			flash_load_xz_start(r, buf, content_size);
+			rc = flash_load_read(flash, r, ffs_part_start,
+					     buf, content_size);
 			if (rc) {
 				prerror("failed to read content size %d"
 					" %s partition, rc %d\n",
 					content_size, name, rc);
-				goto out_free_ffs;
+				goto out_unlock;
 			}
 			*len = content_size;
 			goto done_reading;
@@ -771,7 +909,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		if (rc) {
 			prerror("FAILED reading subpart info. rc=%d\n",
 				rc);
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 
 		*len = ffs_part_size;
@@ -784,45 +922,71 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		 * Afterwards, we memmove() things back into place for
 		 * the caller.
 		 */
-		rc = blocklevel_read(flash->bl, ffs_part_start,
-					  buf, ffs_part_size);
+		flash_load_xz_start(r, buf + offset, content_size);
+		rc = flash_load_read(flash, r, ffs_part_start,
+				     buf, ffs_part_size);
+		if (rc) {
+			prerror("failed to read %s partition, rc %d\n",
+				name, rc);
+			goto out_unlock;
+		}
 
 		bufp += offset;
 	}
 
 done_reading:
+	r->content = bufp;
+	r->content_size = content_size;
+	status = true;
+
+out_unlock:
+	unlock(&flash_lock);
+	/* A failed read may be retried, so the decoder has to be done with */
+	flash_load_xz_end(r, !status);
+	return status ? OPAL_SUCCESS : rc;
+}
+
+/*
+ * Run on another CPU once a resource has been read, overlapping with
+ * reading the next one.
+ */
+static void flash_load_finish(void *data)
+{
+	struct flash_load_resource_item *r = data;
+	struct xz_decompress *xz = r->xz;
+
 	/*
 	 * Verify and measure the retrieved PNOR partition as part of the
 	 * secure boot and trusted boot requirements
 	 */
-	secureboot_verify(id, buf, *len);
-	trustedboot_measure(id, buf, *len);
+	secureboot_verify(r->id, r->buf, *r->len);
+	trustedboot_measure(r->id, r->buf, *r->len);
+
+	/* The decoder reads from where the data landed, let it finish */
+	flash_load_xz_end(r, true);
 
 	/* Find subpartition */
-	if (subid != RESOURCE_SUBID_NONE) {
-		memmove(buf, bufp, content_size);
-		*len = content_size;
+	if (r->subid != RESOURCE_SUBID_NONE) {
+		memmove(r->buf, r->content, r->content_size);
+		*r->len = r->content_size;
 	}
 
-	status = true;
-
-out_free_ffs:
-	ffs_close(ffs);
-out_unlock:
-	unlock(&flash_lock);
-	return status ? OPAL_SUCCESS : rc;
+	/*
+	 * It couldn't be streamed, or the stream needed more memory than
+	 * we'd give it, so do it in one go.
+	 */
+	if (xz && (!xz->streaming || xz->status == OPAL_UNSUPPORTED)) {
+		prlog(PR_DEBUG, "Decompressing %x/%x after reading it\n",
+		      r->id, r->subid);
+		xz->src = r->buf;
+		xz->src_size = *r->len;
+		xz->streaming = false;
+		xz_start_decompress(xz);
+		wait_xz_decompress(xz);
+		xz->job = NULL;
+	}
 }
 
-
-struct flash_load_resource_item {
-	enum resource_id id;
-	uint32_t subid;
-	int result;
-	void *buf;
-	size_t *len;
-	struct list_node link;
-};
-
 static LIST_HEAD(flash_load_resource_queue);
 static LIST_HEAD(flash_loaded_resources);
 static struct lock flash_load_resource_lock = LOCK_UNLOCKED;
@@ -865,53 +1029,86 @@ int flash_resource_loaded(enum resource_id id, uint32_t subid)
 #define FLASH_LOAD_WAIT_MS	5000
 #define FLASH_LOAD_RETRIES	(2 * 5 * (60 / (FLASH_LOAD_WAIT_MS / 1000)))
 
-static void flash_load_resources(void *data __unused)
+static void flash_load_one(struct flash_load_resource_item *r)
 {
-	struct flash_load_resource_item *r;
 	int retries = FLASH_LOAD_RETRIES;
-	int result = OPAL_RESOURCE;
+	int result;
 
-	lock(&flash_load_resource_lock);
 	do {
-		if (list_empty(&flash_load_resource_queue)) {
+		result = flash_load_resource(r);
+		if (result == OPAL_SUCCESS)
 			break;
-		}
-		r = list_top(&flash_load_resource_queue,
-			     struct flash_load_resource_item, link);
-		if (r->result != OPAL_EMPTY)
-			prerror("flash_load_resources() list_top unexpected "
-				" result %d\n", r->result);
-		r->result = OPAL_BUSY;
-		unlock(&flash_load_resource_lock);
 
-		while (retries) {
-			result = flash_load_resource(r->id, r->subid, r->buf,
-						     r->len);
-			if (result == OPAL_SUCCESS) {
-				retries = FLASH_LOAD_RETRIES;
-				break;
-			}
+		if (result != FLASH_ERR_AGAIN &&
+				result != FLASH_ERR_DEVICE_GONE)
+			break;
 
-			if (result != FLASH_ERR_AGAIN &&
-					result != FLASH_ERR_DEVICE_GONE)
-				break;
+		time_wait_ms(FLASH_LOAD_WAIT_MS);
+
+		retries--;
+
+		prlog(PR_WARNING,
+		      "Retrying load of %d:%d, %d attempts remain\n",
+		      r->id, r->subid, retries);
+	} while (retries);
+
+	/* Will reuse the result from when we hit retries == 0 */
+	r->result = result;
+}
+
+/* Called with flash_load_resource_lock held */
+static void flash_load_publish(struct flash_load_resource_item *r)
+{
+	list_del(&r->link);
+	list_add_tail(&flash_loaded_resources, &r->link);
+}
+
+/*
+ * Resources stay on the queue until they're published as loaded, which
+ * is once they've been read and then finished. The finishing of one is
+ * overlapped with reading the next.
+ */
+static void flash_load_resources(void *data __unused)
+{
+	struct flash_load_resource_item *r, *i, *prev = NULL;
+	struct cpu_job *finish = NULL;
 
-			time_wait_ms(FLASH_LOAD_WAIT_MS);
+	lock(&flash_load_resource_lock);
+	while (!list_empty(&flash_load_resource_queue)) {
+		r = NULL;
+		list_for_each(&flash_load_resource_queue, i, link) {
+			if (i->result == OPAL_EMPTY) {
+				r = i;
+				break;
+			}
+		}
+		if (r)
+			r->result = OPAL_BUSY;
+		unlock(&flash_load_resource_lock);
 
-			retries--;
+		if (r)
+			flash_load_one(r);
 
-			prlog(PR_WARNING,
-			      "Retrying load of %d:%d, %d attempts remain\n",
-			      r->id, r->subid, retries);
+		if (finish) {
+			cpu_wait_job(finish, true);
+			finish = NULL;
+		}
+		if (r && r->result == OPAL_SUCCESS) {
+			finish = cpu_queue_job(NULL, "flash_load_finish",
+					       flash_load_finish, r);
+			if (!finish)
+				flash_load_finish(r);
 		}
 
 		lock(&flash_load_resource_lock);
-		r = list_pop(&flash_load_resource_queue,
-			     struct flash_load_resource_item, link);
-		/* Will reuse the result from when we hit retries == 0 */
-		r->result = result;
-		list_add_tail(&flash_loaded_resources, &r->link);
-	} while(true);
+		if (prev)
+			flash_load_publish(prev);
+		prev = NULL;
+		if (r && finish)
+			prev = r;
+		else if (r)
+			flash_load_publish(r);
+	}
 	unlock(&flash_load_resource_lock);
 }
 
@@ -926,13 +1123,14 @@ static void start_flash_load_resource_job(void)
 	cpu_process_local_jobs();
 }
 
-int flash_start_preload_resource(enum resource_id id, uint32_t subid,
-				 void *buf, size_t *len)
+int flash_start_preload_resource_xz(enum resource_id id, uint32_t subid,
+				    void *buf, size_t *len,
+				    struct xz_decompress *xz)
 {
 	struct flash_load_resource_item *r;
 	bool start_thread = false;
 
-	r = malloc(sizeof(struct flash_load_resource_item));
+	r = zalloc(sizeof(struct flash_load_resource_item));
 
 	assert(r != NULL);
 	r->id = id;
@@ -940,6 +1138,9 @@ int flash_start_preload_resource(enum resource_id id, uint32_t subid,
 	r->buf = buf;
 	r->len = len;
 	r->result = OPAL_EMPTY;
+	r->xz = xz;
+	if (xz)
+		xz->status = OPAL_PARTIAL;
 
 	prlog(PR_DEBUG, "Queueing preload of %x/%x\n",
 	      r->id, r->subid);
@@ -957,6 +1158,12 @@ int flash_start_preload_resource(enum resource_id id, uint32_t subid,
 	return OPAL_SUCCESS;
 }
 
+int flash_start_preload_resource(enum resource_id id, uint32_t subid,
+				 void *buf, size_t *len)
+{
+	return flash_start_preload_resource_xz(id, subid, buf, len, NULL);
+}
+
 /*
  * The `libxz` decompression routines are blocking; the new decompression
  * routines, wrapper around `libxz` functions, provide support for asynchronous
@@ -969,7 +1176,160 @@ int flash_start_preload_resource(enum resource_id id, uint32_t subid,
  * When the decompression is successful, the xz_decompress->status will be
  * `OPAL_SUCCESS` else OPAL_PARAMETER, see definition of xz_decompress structure
  * for details.
+ *
+ * The flash loader can also stream into the decompressor while it reads, see
+ * flash_start_preload_resource_xz().
+ */
+/*
+ * Decompress whatever the flash loader has read so far, waiting for more
+ * until it says it's done. The dictionary lives outside the output
+ * buffer in that mode, so don't let it get bigger than the output.
+ */
+static enum xz_ret xz_decompress_stream(struct xz_decompress *xz,
+					struct xz_dec *s, struct xz_buf *b)
+{
+	enum xz_ret ret;
+	size_t avail;
+	bool done;
+
+	for (;;) {
+		/* Pairs with the lwsync()s in flash_load_progress/xz_end() */
+		done = xz->src_done;
+		lwsync();
+		avail = xz->src_avail;
+		lwsync();
+
+		b->in_size = avail;
+		ret = xz_dec_run(s, b);
+		if (ret != XZ_OK)
+			return ret;
+		if (b->in_pos < b->in_size)
+			continue;
+		if (done)
+			return XZ_DATA_ERROR;
+
+		while (xz->src_avail == avail && !xz->src_done)
+			cpu_relax();
+	}
+}
+
+/*
+ * Images made with xz --block-size have several independent blocks, which
+ * are spread over a few CPUs. Each has its own decoder, they take the next
+ * block until there are none left.
  */
+#define XZ_PARALLEL_MAX		8
+
+struct xz_parallel {
+	struct xz_decompress	*xz;
+	struct xz_block		*blocks;
+	uint32_t		nr_blocks;
+	uint32_t		next;
+	enum xz_ret		error;
+	struct lock		lock;
+};
+
+static void xz_decompress_blocks(void *data)
+{
+	struct xz_parallel *p = data;
+	struct xz_block *blk;
+	struct xz_dec *s;
+	struct xz_buf b;
+	enum xz_ret ret;
+
+	s = xz_dec_init(XZ_SINGLE, 0);
+	if (!s) {
+		lock(&p->lock);
+		p->error = XZ_MEM_ERROR;
+		unlock(&p->lock);
+		return;
+	}
+
+	for (;;) {
+		lock(&p->lock);
+		if (p->next == p->nr_blocks || p->error != XZ_STREAM_END) {
+			unlock(&p->lock);
+			break;
+		}
+		blk = &p->blocks[p->next++];
+		unlock(&p->lock);
+
+		b.in = p->xz->src + blk->in_pos;
+		b.in_pos = 0;
+		b.in_size = blk->in_size;
+		b.out = p->xz->dst + blk->out_pos;
+		b.out_pos = 0;
+		b.out_size = blk->out_size;
+
+		ret = xz_dec_block_run(s, &b, blk->check);
+		if (ret == XZ_STREAM_END && b.out_pos != blk->out_size)
+			ret = XZ_DATA_ERROR;
+		if (ret != XZ_STREAM_END) {
+			lock(&p->lock);
+			p->error = ret;
+			unlock(&p->lock);
+			break;
+		}
+	}
+
+	xz_dec_end(s);
+}
+
+/* Returns false if the image only has one block */
+static bool xz_decompress_parallel(struct xz_decompress *xz)
+{
+	struct cpu_job_group grp;
+	struct xz_parallel p;
+	struct xz_block *last;
+	int nr, i;
+
+	nr = xz_dec_blocks(xz->src, xz->src_size, NULL, 0);
+	if (nr < 2)
+		return false;
+
+	p.blocks = malloc(nr * sizeof(struct xz_block));
+	if (!p.blocks)
+		return false;
+	xz_dec_blocks(xz->src, xz->src_size, p.blocks, nr);
+
+	last = &p.blocks[nr - 1];
+	if (last->out_pos + last->out_size > xz->dst_size) {
+		prerror("xz output is 0x%lx bytes, more than 0x%lx\n",
+			last->out_pos + last->out_size, xz->dst_size);
+		free(p.blocks);
+		xz->xz_error = XZ_BUF_ERROR;
+		xz->status = OPAL_PARAMETER;
+		return true;
+	}
+
+	p.xz = xz;
+	p.nr_blocks = nr;
+	p.next = 0;
+	p.error = XZ_STREAM_END;
+	init_lock(&p.lock);
+
+	/* We're one of the workers */
+	cpu_job_group_init(&grp);
+	for (i = 1; i < MIN(nr, XZ_PARALLEL_MAX); i++)
+		if (!cpu_job_group_queue(&grp, NULL, "xz_decompress_blocks",
+					 xz_decompress_blocks, &p))
+			break;
+	xz_decompress_blocks(&p);
+	cpu_job_group_wait(&grp);
+
+	prlog(PR_DEBUG, "xz: %d blocks on %d CPUs\n", nr, i);
+
+	xz->xz_error = p.error;
+	if (p.error != XZ_STREAM_END) {
+		prerror("failed to decompress subpartition\n");
+		xz->status = OPAL_PARAMETER;
+	} else
+		xz->status = OPAL_SUCCESS;
+
+	free(p.blocks);
+	return true;
+}
+
 static void xz_decompress(void *data)
 {
 	struct xz_decompress *xz = (struct xz_decompress *)data;
@@ -978,16 +1338,23 @@ static void xz_decompress(void *data)
 
 	/* Initialize the xz library first */
 	xz_crc32_init();
-	s = xz_dec_init(XZ_SINGLE, 0);
+
+	xz->xz_error = XZ_DATA_ERROR;
+	xz->status = OPAL_PARTIAL;
+
+	if (!xz->streaming && xz_decompress_parallel(xz))
+		return;
+
+	if (xz->streaming)
+		s = xz_dec_init(XZ_DYNALLOC, xz->dst_size);
+	else
+		s = xz_dec_init(XZ_SINGLE, 0);
 	if (s == NULL) {
 		prerror("initialization error for xz\n");
 		xz->status = OPAL_NO_MEM;
 		return;
 	}
 
-	xz->xz_error = XZ_DATA_ERROR;
-	xz->status = OPAL_PARTIAL;
-
 	b.in = xz->src;
 	b.in_pos = 0;
 	b.in_size = xz->src_size;
@@ -996,8 +1363,14 @@ static void xz_decompress(void *data)
 	b.out_size = xz->dst_size;
 
 	/* Start decompressing */
-	xz->xz_error = xz_dec_run(s, &b);
-	if (xz->xz_error != XZ_STREAM_END) {
+	if (xz->streaming)
+		xz->xz_error = xz_decompress_stream(xz, s, &b);
+	else
+		xz->xz_error = xz_dec_run(s, &b);
+	if (xz->xz_error == XZ_MEMLIMIT_ERROR) {
+		/* The caller can retry without streaming */
+		xz->status = OPAL_UNSUPPORTED;
+	} else if (xz->xz_error != XZ_STREAM_END) {
 		prerror("failed to decompress subpartition\n");
 		xz->status = OPAL_PARAMETER;
 	} else
@@ -46,6 +46,8 @@
 #include <debug_descriptor.h>
 #include <occ.h>
 #include <opal-dump.h>
+#include <opal-latency.h>
+#include <opal-poller.h>
 
 enum proc_gen proc_gen;
 unsigned int pcie_max_link_speed;
@@ -505,28 +507,21 @@ static void cpu_disable_ME_RI_one(void *param __unused)
 
 static int64_t cpu_disable_ME_RI_all(void)
 {
+	struct cpu_job_group grp;
 	struct cpu_thread *cpu;
-	struct cpu_job **jobs;
-
-	jobs = zalloc(sizeof(struct cpu_job *) * (cpu_max_pir + 1));
-	assert(jobs);
 
+	cpu_job_group_init(&grp);
 	for_each_available_cpu(cpu) {
 		if (cpu == this_cpu())
 			continue;
-		jobs[cpu->pir] = cpu_queue_job(cpu, "cpu_disable_ME_RI",
-						cpu_disable_ME_RI_one, NULL);
+		cpu_job_group_queue(&grp, cpu, "cpu_disable_ME_RI",
+				    cpu_disable_ME_RI_one, NULL);
 	}
 
 	/* this cpu */
 	cpu_disable_ME_RI_one(NULL);
 
-	for_each_available_cpu(cpu) {
-		if (jobs[cpu->pir])
-			cpu_wait_job(jobs[cpu->pir], true);
-	}
-
-	free(jobs);
+	cpu_job_group_wait(&grp);
 
 	return OPAL_SUCCESS;
 }
@@ -1179,6 +1174,10 @@ void __noreturn __nomcount main_cpu_entry(const void *fdt)
 	/* Allocate our split trace buffers now. Depends add_opal_node() */
 	init_trace_buffers();
 
+	/* Likewise the OPAL call latency histograms and poller statistics */
+	opal_lat_init();
+	opal_poller_init();
+
 	/* On P8, get the ICPs and make sure they are in a sane state */
 	init_interrupts();
 	if (proc_gen == proc_gen_p8)
@@ -1396,7 +1395,7 @@ void __noreturn __secondary_cpu_entry(void)
 	while(true) {
 		if (cpu_check_jobs(cpu))
 			cpu_process_jobs();
-		else
+		else if (!cpu_steal_jobs())
 			cpu_idle_job();
 	}
 }
@@ -28,9 +28,145 @@ static LIST_HEAD(irq_sources);
 static LIST_HEAD(irq_sources2);
 static struct lock irq_lock = LOCK_UNLOCKED;
 
+/*
+ * Lookups go through a sorted snapshot of both lists, searched without
+ * taking irq_lock. Updates build and publish a new snapshot under
+ * irq_lock. Once they've dropped it, as readers may stay in their read
+ * section across source callbacks which take it, they wait for every CPU
+ * to leave any read section that could still be looking at the old one
+ * (or at a source being unregistered) before freeing it.
+ *
+ * The read side is a per-CPU nesting count. The sync() after raising it
+ * orders it against loading the snapshot pointer, pairing with the sync()
+ * between publishing and checking the counts in irq_synchronize().
+ */
+struct irq_range {
+	uint32_t		start;
+	uint32_t		end;
+	struct irq_source	*is;
+};
+
+struct irq_index {
+	unsigned int		nr;	/* Primary sources */
+	unsigned int		nr2;	/* Secondary sources, after those */
+	struct irq_range	r[];
+};
+
+static struct irq_index *irq_index;
+
+static inline void irq_read_begin(void)
+{
+	this_cpu()->irq_readers++;
+	sync();
+}
+
+static inline void irq_read_end(void)
+{
+	lwsync();
+	this_cpu()->irq_readers--;
+}
+
+static void irq_synchronize(void)
+{
+	struct cpu_thread *c;
+
+	sync();
+	for_each_cpu(c) {
+		/* We might be updating from a source's own callback */
+		if (c == this_cpu() || !c->irq_readers)
+			continue;
+		smt_lowest();
+		while (c->irq_readers)
+			barrier();
+		smt_medium();
+	}
+}
+
+static unsigned int irq_index_fill(struct irq_range *r, struct list_head *list)
+{
+	struct irq_source *is;
+	unsigned int i, j, n = 0;
+
+	/* Insertion sort, the lists are short and mostly in order */
+	list_for_each(list, is, link) {
+		for (i = n; i && r[i - 1].start > is->start; i--)
+			;
+		for (j = n; j > i; j--)
+			r[j] = r[j - 1];
+		r[i].start = is->start;
+		r[i].end = is->end;
+		r[i].is = is;
+		n++;
+	}
+	return n;
+}
+
+/* Called with irq_lock held, returns the old index for irq_index_free() */
+static struct irq_index *irq_index_update(void)
+{
+	struct irq_index *new, *old = irq_index;
+	struct irq_source *is;
+	unsigned int n = 0;
+
+	list_for_each(&irq_sources, is, link)
+		n++;
+	list_for_each(&irq_sources2, is, link)
+		n++;
+
+	new = malloc(sizeof(*new) + n * sizeof(struct irq_range));
+	assert(new);
+	new->nr = irq_index_fill(new->r, &irq_sources);
+	new->nr2 = irq_index_fill(new->r + new->nr, &irq_sources2);
+
+	lwsync();
+	irq_index = new;
+	return old;
+}
+
+/* Called without irq_lock */
+static void irq_index_free(struct irq_index *old)
+{
+	irq_synchronize();
+	free(old);
+}
+
+static struct irq_source *irq_range_find(const struct irq_range *r,
+					 unsigned int nr, uint32_t isn)
+{
+	unsigned int lo = 0, hi = nr, mid;
+
+	/* Find the last range starting at or below isn */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (r[mid].start <= isn)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo && isn < r[lo - 1].end)
+		return r[lo - 1].is;
+	return NULL;
+}
+
+static struct irq_source *__irq_find_source(uint32_t isn)
+{
+	struct irq_index *idx = irq_index;
+	struct irq_source *is;
+
+	if (!idx)
+		return NULL;
+
+	/* Primary sources win over secondary ones */
+	is = irq_range_find(idx->r, idx->nr, isn);
+	if (!is)
+		is = irq_range_find(idx->r + idx->nr, idx->nr2, isn);
+	return is;
+}
+
 void __register_irq_source(struct irq_source *is, bool secondary)
 {
 	struct irq_source *is1;
+	struct irq_index *old;
 	struct list_head *list = secondary ? &irq_sources2 : &irq_sources;
 
 	prlog(PR_DEBUG, "IRQ: Registering %04x..%04x ops @%p (data %p)%s\n",
@@ -48,7 +184,9 @@ void __register_irq_source(struct irq_source *is, bool secondary)
 		}
 	}
 	list_add_tail(list, &is->link);
+	old = irq_index_update();
 	unlock(&irq_lock);
+	irq_index_free(old);
 }
 
 void register_irq_source(const struct irq_source_ops *ops, void *data,
@@ -69,6 +207,7 @@ void register_irq_source(const struct irq_source_ops *ops, void *data,
 void unregister_irq_source(uint32_t start, uint32_t count)
 {
 	struct irq_source *is;
+	struct irq_index *old;
 
 	/* Note: We currently only unregister from the primary sources */
 	lock(&irq_lock);
@@ -82,8 +221,10 @@ void unregister_irq_source(uint32_t start, uint32_t count)
 				assert(0);
 			}
 			list_del(&is->link);
+			old = irq_index_update();
 			unlock(&irq_lock);
-			/* XXX Add synchronize / RCU */
+			/* Nobody can be using it once this returns */
+			irq_index_free(old);
 			free(is);
 			return;
 		}
@@ -98,25 +239,11 @@ struct irq_source *irq_find_source(uint32_t isn)
 {
 	struct irq_source *is;
 
-	lock(&irq_lock);
-	/*
-	 * XXX This really needs some kind of caching !
-	 */
-	list_for_each(&irq_sources, is, link) {
-		if (isn >= is->start && isn < is->end) {
-			unlock(&irq_lock);
-			return is;
-		}
-	}
-	list_for_each(&irq_sources2, is, link) {
-		if (isn >= is->start && isn < is->end) {
-			unlock(&irq_lock);
-			return is;
-		}
-	}
-	unlock(&irq_lock);
+	irq_read_begin();
+	is = __irq_find_source(isn);
+	irq_read_end();
 
-	return NULL;
+	return is;
 }
 
 void irq_for_each_source(void (*cb)(struct irq_source *, void *), void *data)
@@ -421,59 +548,74 @@ bool __irq_source_eoi(struct irq_source *is, uint32_t isn)
 
 bool irq_source_eoi(uint32_t isn)
 {
-	struct irq_source *is = irq_find_source(isn);
+	struct irq_source *is;
+	bool ret = false;
 
-	if (!is)
-		return false;
+	irq_read_begin();
+	is = __irq_find_source(isn);
+	if (is)
+		ret = __irq_source_eoi(is, isn);
+	irq_read_end();
 
-	return __irq_source_eoi(is, isn);
+	return ret;
 }
 
 static int64_t opal_set_xive(uint32_t isn, uint16_t server, uint8_t priority)
 {
-	struct irq_source *is = irq_find_source(isn);
+	struct irq_source *is;
+	int64_t ret = OPAL_PARAMETER;
 
-	if (!is || !is->ops->set_xive)
-		return OPAL_PARAMETER;
+	irq_read_begin();
+	is = __irq_find_source(isn);
+	if (is && is->ops->set_xive)
+		ret = is->ops->set_xive(is, isn, server, priority);
+	irq_read_end();
 
-	return is->ops->set_xive(is, isn, server, priority);
+	return ret;
 }
 opal_call(OPAL_SET_XIVE, opal_set_xive, 3);
 
 static int64_t opal_get_xive(uint32_t isn, __be16 *server, uint8_t *priority)
 {
-	struct irq_source *is = irq_find_source(isn);
+	struct irq_source *is;
 	uint16_t s;
-	int64_t ret;
+	int64_t ret = OPAL_PARAMETER;
 
 	if (!opal_addr_valid(server))
 		return OPAL_PARAMETER;
 
-	if (!is || !is->ops->get_xive)
-		return OPAL_PARAMETER;
+	irq_read_begin();
+	is = __irq_find_source(isn);
+	if (is && is->ops->get_xive) {
+		ret = is->ops->get_xive(is, isn, &s, priority);
+		*server = cpu_to_be16(s);
+	}
+	irq_read_end();
 
-	ret = is->ops->get_xive(is, isn, &s, priority);
-	*server = cpu_to_be16(s);
 	return ret;
 }
 opal_call(OPAL_GET_XIVE, opal_get_xive, 3);
 
 static int64_t opal_handle_interrupt(uint32_t isn, __be64 *outstanding_event_mask)
 {
-	struct irq_source *is = irq_find_source(isn);
+	struct irq_source *is;
 	int64_t rc = OPAL_SUCCESS;
 
 	if (!opal_addr_valid(outstanding_event_mask))
 		return OPAL_PARAMETER;
 
 	/* No source ? return */
+	irq_read_begin();
+	is = __irq_find_source(isn);
 	if (!is || !is->ops->interrupt) {
+		irq_read_end();
 		rc = OPAL_PARAMETER;
 		goto bail;
 	}
 
 	/* Run it */
 	is->ops->interrupt(is, isn);
+	irq_read_end();
 
 	/* Check timers if SBE timer isn't working */
 	if (!p8_sbe_timer_ok() && !p9_sbe_timer_ok())
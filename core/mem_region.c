@@ -17,6 +17,7 @@
 #include <types.h>
 #include <mem_region.h>
 #include <mem_region-malloc.h>
+#include <pool.h>
 
 /* Memory poisoning on free (if POISON_MEM_REGION set to 1) */
 #ifdef DEBUG
@@ -117,6 +118,9 @@ struct free_hdr {
 #define ALLOC_HDR_LONGS (sizeof(struct alloc_hdr) / sizeof(long))
 #define ALLOC_MIN_LONGS (sizeof(struct free_hdr) / sizeof(long) + 1)
 
+/* How many blocks of the request's own size class we try before moving up */
+#define FREE_BIN_PROBE	4
+
 /* Avoid ugly casts. */
 static void *region_start(const struct mem_region *region)
 {
@@ -141,6 +145,39 @@ static struct alloc_hdr *next_hdr(const struct mem_region *region,
 	return next;
 }
 
+/* Size class of a free block: floor(log2(longs)), clamped to the last bin. */
+static unsigned int free_bin(unsigned long num_longs)
+{
+	unsigned int bin = BITS_PER_LONG - 1 - __builtin_clzl(num_longs);
+
+	if (bin >= MEM_REGION_FREE_BINS)
+		bin = MEM_REGION_FREE_BINS - 1;
+	return bin;
+}
+
+static bool region_free_list_inited(const struct mem_region *region)
+{
+	return region->free_list[0].n.next != NULL;
+}
+
+static void free_list_add(struct mem_region *region, struct free_hdr *f)
+{
+	unsigned int bin = free_bin(f->hdr.num_longs);
+
+	list_add(&region->free_list[bin], &f->list);
+	region->free_bins |= 1UL << bin;
+}
+
+/* Must be called before the block's num_longs changes. */
+static void free_list_del(struct mem_region *region, struct free_hdr *f)
+{
+	unsigned int bin = free_bin(f->hdr.num_longs);
+
+	list_del_from(&region->free_list[bin], &f->list);
+	if (list_empty(&region->free_list[bin]))
+		region->free_bins &= ~(1UL << bin);
+}
+
 #if POISON_MEM_REGION == 1
 static void mem_poison(struct free_hdr *f)
 {
@@ -159,14 +196,18 @@ static void mem_poison(struct free_hdr *f)
 static void init_allocatable_region(struct mem_region *region)
 {
 	struct free_hdr *f = region_start(region);
+	unsigned int i;
+
 	assert(region->type == REGION_SKIBOOT_HEAP ||
 	       region->type == REGION_MEMORY);
 	f->hdr.num_longs = region->len / sizeof(long);
 	f->hdr.free = true;
 	f->hdr.prev_free = false;
 	*tailer(f) = f->hdr.num_longs;
-	list_head_init(&region->free_list);
-	list_add(&region->free_list, &f->list);
+	for (i = 0; i < MEM_REGION_FREE_BINS; i++)
+		list_head_init(&region->free_list[i]);
+	region->free_bins = 0;
+	free_list_add(region, f);
 #if POISON_MEM_REGION == 1
 	mem_poison(f);
 #endif
@@ -194,28 +235,29 @@ static void make_free(struct mem_region *region, struct free_hdr *f,
 		assert(!prev->hdr.prev_free);
 
 		/* Expand to cover the one we just freed. */
+		free_list_del(region, prev);
 		prev->hdr.num_longs += f->hdr.num_longs;
 		f = prev;
 	} else {
 		f->hdr.free = true;
 		f->hdr.location = location;
-		list_add(&region->free_list, &f->list);
 	}
 
-	/* Fix up tailer. */
-	*tailer(f) = f->hdr.num_longs;
-
 	/* If next is free, coalesce it */
 	next = next_hdr(region, &f->hdr);
 	if (next) {
-		next->prev_free = true;
 		if (next->free) {
 			struct free_hdr *next_free = (void *)next;
-			list_del_from(&region->free_list, &next_free->list);
-			/* Maximum of one level of recursion */
-			make_free(region, next_free, location, true);
-		}
+
+			free_list_del(region, next_free);
+			f->hdr.num_longs += next->num_longs;
+		} else
+			next->prev_free = true;
 	}
+
+	/* Fix up tailer, and file it under its (possibly new) size class. */
+	*tailer(f) = f->hdr.num_longs;
+	free_list_add(region, f);
 }
 
 /* Can we fit this many longs with this alignment in this free block? */
@@ -309,7 +351,7 @@ void mem_dump_allocs(void)
 		       (long long)region->start,
 		       (long long)(region->start + region->len - 1),
 		       region->name);
-		if (region->free_list.n.next == NULL) {
+		if (!region_free_list_inited(region)) {
 			prlog(PR_INFO, "    no allocs\n");
 			continue;
 		}
@@ -349,6 +391,8 @@ void mem_dump_allocs(void)
 				count, bytes, hdr_location(h), bytes * count);
 		}
 	}
+
+	pool_cache_dump();
 }
 
 int64_t mem_dump_free(void)
@@ -367,7 +411,7 @@ int64_t mem_dump_free(void)
 			continue;
 		region_free = 0;
 
-		if (region->free_list.n.next == NULL) {
+		if (!region_free_list_inited(region)) {
 			continue;
 		}
 		for (hdr = region_start(region); hdr; hdr = next_hdr(region, hdr)) {
@@ -390,6 +434,8 @@ static void *__mem_alloc(struct mem_region *region, size_t size, size_t align,
 			 const char *location)
 {
 	size_t alloc_longs, offset;
+	unsigned long bins;
+	unsigned int bin, probe;
 	struct free_hdr *f;
 	struct alloc_hdr *next;
 
@@ -405,7 +451,7 @@ static void *__mem_alloc(struct mem_region *region, size_t size, size_t align,
 		return NULL;
 
 	/* First allocation? */
-	if (region->free_list.n.next == NULL)
+	if (!region_free_list_inited(region))
 		init_allocatable_region(region);
 
 	/* Don't do screwy sizes. */
@@ -423,13 +469,41 @@ static void *__mem_alloc(struct mem_region *region, size_t size, size_t align,
 	if (alloc_longs < ALLOC_MIN_LONGS)
 		alloc_longs = ALLOC_MIN_LONGS;
 
-	/* Walk free list. */
-	list_for_each(&region->free_list, f, list) {
+	/*
+	 * Blocks in our own size class may still be too small, so only
+	 * probe the first few of them. Every block in a larger class is
+	 * big enough (only alignment can make us skip one), so next we go
+	 * to the smallest non-empty class above us. Only if that fails
+	 * do we walk the whole of our own class.
+	 */
+	bin = free_bin(alloc_longs);
+	probe = 0;
+	list_for_each(&region->free_list[bin], f, list) {
+		if (++probe > FREE_BIN_PROBE)
+			break;
 		/* We may have to skip some to meet alignment. */
 		if (fits(f, alloc_longs, align, &offset))
 			goto found;
 	}
 
+	bins = region->free_bins & ~((2UL << bin) - 1);
+	while (bins) {
+		unsigned int b = __builtin_ctzl(bins);
+
+		bins &= bins - 1;
+		list_for_each(&region->free_list[b], f, list) {
+			if (fits(f, alloc_longs, align, &offset))
+				goto found;
+		}
+	}
+
+	if (probe > FREE_BIN_PROBE) {
+		list_for_each(&region->free_list[bin], f, list) {
+			if (fits(f, alloc_longs, align, &offset))
+				goto found;
+		}
+	}
+
 	return NULL;
 
 found:
@@ -437,7 +511,7 @@ found:
 	assert(!f->hdr.prev_free);
 
 	/* This block is no longer free. */
-	list_del_from(&region->free_list, &f->list);
+	free_list_del(region, f);
 	f->hdr.free = false;
 	f->hdr.location = location;
 
@@ -568,7 +642,7 @@ bool mem_resize(struct mem_region *region, void *mem, size_t len,
 
 	/* OK, it's free and big enough, absorb it. */
 	f = (struct free_hdr *)next;
-	list_del_from(&region->free_list, &f->list);
+	free_list_del(region, f);
 	hdr->num_longs += next->num_longs;
 	hdr->location = location;
 
@@ -592,6 +666,7 @@ bool mem_check(const struct mem_region *region)
 	size_t frees = 0;
 	struct alloc_hdr *hdr, *prev_free = NULL;
 	struct free_hdr *f;
+	unsigned int bin;
 
 	/* Check it's sanely aligned. */
 	if (region->start % sizeof(long)) {
@@ -608,7 +683,7 @@ bool mem_check(const struct mem_region *region)
 	/* Not ours to play with, or empty?  Don't do anything. */
 	if (!(region->type == REGION_MEMORY ||
 	      region->type == REGION_SKIBOOT_HEAP) ||
-	    region->free_list.n.next == NULL)
+	    !region_free_list_inited(region))
 		return true;
 
 	/* Walk linearly. */
@@ -653,9 +728,29 @@ bool mem_check(const struct mem_region *region)
 		}
 	}
 
-	/* Now walk free list. */
-	list_for_each(&region->free_list, f, list)
-		frees ^= (unsigned long)f - region->start;
+	/* Now walk the free lists, checking each block is filed correctly. */
+	for (bin = 0; bin < MEM_REGION_FREE_BINS; bin++) {
+		bool empty = list_empty(&region->free_list[bin]);
+
+		if (empty == !!(region->free_bins & (1UL << bin))) {
+			prerror("Region '%s' free bin %u %sempty but marked"
+				" %sempty\n", region->name, bin,
+				empty ? "" : "not ", empty ? "not " : "");
+			return false;
+		}
+		list_for_each(&region->free_list[bin], f, list) {
+			if (!f->hdr.free ||
+			    free_bin(f->hdr.num_longs) != bin) {
+				prerror("Region '%s' %s %p (%s) size %zu"
+					" in free bin %u\n", region->name,
+					f->hdr.free ? "free" : "alloc",
+					f, hdr_location(&f->hdr),
+					f->hdr.num_longs * sizeof(long), bin);
+				return false;
+			}
+			frees ^= (unsigned long)f - region->start;
+		}
+	}
 
 	if (frees) {
 		prerror("Region '%s' free list and walk do not match!\n",
@@ -693,7 +788,8 @@ static struct mem_region *new_region(const char *name,
 	region->len = len;
 	region->node = node;
 	region->type = type;
-	region->free_list.n.next = NULL;
+	region->free_list[0].n.next = NULL;
+	region->free_bins = 0;
 	init_lock(&region->free_list_lock);
 
 	return region;
@@ -1147,15 +1243,17 @@ void mem_region_init(void)
 static uint64_t allocated_length(const struct mem_region *r)
 {
 	struct free_hdr *f, *last = NULL;
+	unsigned int bin;
 
 	/* No allocations at all? */
-	if (r->free_list.n.next == NULL)
+	if (!region_free_list_inited(r))
 		return 0;
 
 	/* Find last free block. */
-	list_for_each(&r->free_list, f, list)
-		if (f > last)
-			last = f;
+	for (bin = 0; bin < MEM_REGION_FREE_BINS; bin++)
+		list_for_each(&r->free_list[bin], f, list)
+			if (f > last)
+				last = f;
 
 	/* No free blocks? */
 	if (!last)
@@ -1202,7 +1300,7 @@ void mem_region_release_unused(void)
 			struct free_hdr *last = region_start(r) + used_len;
 
 			/* Remove the final free block. */
-			list_del_from(&r->free_list, &last->list);
+			free_list_del(r, last);
 
 			for_linux = split_region(r, r->start + used_len,
 						 REGION_OS);
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Statistics exported to the host
+ *
+ * Each region is listed under firmware/exports, which Linux turns into a
+ * read-only file under /sys/firmware/opal/exports.
+ *
+ * Copyright 2019 IBM Corp.
+ */
+
+#include <skiboot.h>
+#include <opal-internal.h>
+#include <cpu.h>
+#include <device.h>
+#include <string.h>
+
+/* The host only reads these, so don't share a cache line with anything */
+#define OPAL_EXPORT_ALIGN	128
+
+void *opal_export_alloc(const char *name, size_t size)
+{
+	struct dt_node *exports;
+	void *p;
+
+	p = local_alloc(this_cpu()->chip_id, size, OPAL_EXPORT_ALIGN);
+	if (!p) {
+		prerror("OPAL: Failed to allocate %s\n", name);
+		return NULL;
+	}
+	memset(p, 0, size);
+
+	exports = dt_find_by_path(opal_node, "firmware/exports");
+	if (exports)
+		dt_add_property_u64s(exports, name, (uint64_t)p, size);
+	return p;
+}
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * OPAL call latency histograms
+ *
+ * opal_exit_check() accounts every call in a log2 histogram for its
+ * token, in a block of memory owned by the calling CPU. Only that CPU
+ * ever writes its block, so no locking or atomics are needed; the host
+ * may see a call half accounted, which doesn't matter for statistics.
+ *
+ * Copyright 2019 IBM Corp.
+ */
+
+#include <skiboot.h>
+#include <opal-latency.h>
+#include <opal-internal.h>
+#include <cpu.h>
+#include <timebase.h>
+
+static unsigned int opal_lat_bucket(uint64_t tb)
+{
+	unsigned int b;
+
+	if (!tb)
+		return 0;
+
+	b = 63 - __builtin_clzl(tb);
+	return b < OPAL_LAT_BUCKETS ? b : OPAL_LAT_BUCKETS - 1;
+}
+
+void opal_lat_record(struct cpu_thread *cpu, uint64_t token, uint64_t tb)
+{
+	struct opal_lat_token *t;
+	unsigned int b;
+
+	if (!cpu->opal_lat || token > OPAL_LAST)
+		return;
+
+	t = &cpu->opal_lat->tokens[token];
+	b = opal_lat_bucket(tb);
+
+	t->buckets[b] = cpu_to_be32(be32_to_cpu(t->buckets[b]) + 1);
+	t->total_tb = cpu_to_be64(be64_to_cpu(t->total_tb) + tb);
+	if (tb > be64_to_cpu(t->max_tb))
+		t->max_tb = cpu_to_be64(tb);
+}
+
+void opal_lat_init(void)
+{
+	struct opal_lat_header *hdr;
+	struct opal_lat_cpu *lc;
+	struct cpu_thread *t;
+	unsigned int nr_cpus = 0;
+
+	for_each_cpu(t)
+		nr_cpus++;
+
+	hdr = opal_export_alloc("opal_latency",
+				sizeof(*hdr) + nr_cpus * sizeof(*lc));
+	if (!hdr)
+		return;
+
+	hdr->version = cpu_to_be32(OPAL_LAT_VERSION);
+	hdr->nr_cpus = cpu_to_be32(nr_cpus);
+	hdr->nr_tokens = cpu_to_be32(OPAL_LAST + 1);
+	hdr->nr_buckets = cpu_to_be32(OPAL_LAT_BUCKETS);
+	hdr->tb_hz = cpu_to_be64(tb_hz);
+	hdr->cpu_size = cpu_to_be64(sizeof(*lc));
+
+	lc = (void *)(hdr + 1);
+	for_each_cpu(t) {
+		lc->pir = cpu_to_be32(t->pir);
+		t->opal_lat = lc++;
+	}
+}
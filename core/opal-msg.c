@@ -2,6 +2,14 @@
 /*
  * OPAL Message queue between host and skiboot
  *
+ * Messages go through a fixed size ring which any number of CPUs may
+ * queue to at once without taking a lock or allocating, so bursts of
+ * events (EEH, OCC, HMI...) don't hit the allocator. When the ring is
+ * full, new messages are allocated and queued behind it on an overflow
+ * list, under opal_msg_lock, until the host has drained it: callers such
+ * as OPAL_MSG_ASYNC_COMP users can't cope with a message going missing.
+ * The host side is serialised by opal_msg_lock.
+ *
  * Copyright 2013-2019 IBM Corp.
  */
 
@@ -9,29 +17,223 @@
 #include <skiboot.h>
 #include <opal-msg.h>
 #include <opal-api.h>
+#include <opal-internal.h>
+#include <cpu.h>
+#include <device.h>
 #include <lock.h>
+#include <cmpxchg.h>
 
-#define OPAL_MAX_MSGS		(OPAL_MSG_TYPE_MAX + OPAL_MAX_ASYNC_COMP - 1)
+#define OPAL_MSG_RING_MASK	(OPAL_MSG_RING_SIZE - 1)
 
-struct opal_msg_entry {
-	struct list_node link;
+struct opal_msg_slot {
+	/* Relative to the slot index, see opal_msg_seq() */
+	uint64_t seq;
 	void (*consumed)(void *data, int status);
-	bool extended;
 	void *data;
+	/* Messages bigger than struct opal_msg live outside the ring */
+	struct opal_msg *ext;
+	/* Already consumed by opal_check_completion() */
+	bool taken;
 	struct opal_msg msg;
 };
 
-static LIST_HEAD(msg_free_list);
-static LIST_HEAD(msg_pending_list);
+static struct opal_msg_slot msg_ring[OPAL_MSG_RING_SIZE];
+
+/* Queued once the ring was full, behind everything in it */
+struct opal_msg_overflow {
+	struct list_node link;
+	struct opal_msg_slot slot;
+};
+
+static LIST_HEAD(msg_overflow);
+static unsigned int msg_overflowed;
+
+/*
+ * Number of the next message to queue, and to hand to the host. While
+ * MSG_TAIL_OVERFLOW is set in msg_tail, new messages go on msg_overflow.
+ * It's set in the same cmpxchg that finds the ring full, so no producer
+ * can claim a slot after one has decided to overflow, and it's cleared
+ * once msg_overflow is empty again.
+ */
+#define MSG_TAIL_OVERFLOW	(1ull << 63)
+static uint64_t msg_tail;
+static uint64_t msg_head;
 
 static struct lock opal_msg_lock = LOCK_UNLOCKED;
 
+/* Statistics, moved to the exported region by opal_init_msg() */
+static struct opal_msg_type_stats boot_msg_stats[OPAL_MSG_TYPE_MAX];
+static struct opal_msg_type_stats *msg_stats = boot_msg_stats;
+
+/*
+ * A slot's sequence number says whose turn it is: the producer of
+ * message number pos may fill it when it reads pos, the host may consume
+ * it when it reads pos + 1. It's stored relative to the slot's index so
+ * that the zeroed ring is usable from the start.
+ */
+static uint64_t opal_msg_seq(struct opal_msg_slot *slot)
+{
+	return slot->seq + (slot - msg_ring);
+}
+
+static void opal_msg_set_seq(struct opal_msg_slot *slot, uint64_t seq)
+{
+	slot->seq = seq - (slot - msg_ring);
+}
+
+static struct opal_msg *opal_msg_of(struct opal_msg_slot *slot)
+{
+	return slot->ext ? slot->ext : &slot->msg;
+}
+
+static uint32_t opal_msg_stat_add32(__be32 *stat, int32_t delta)
+{
+	__be32 old, new;
+
+	do {
+		old = *stat;
+		new = cpu_to_be32(be32_to_cpu(old) + delta);
+	} while (__cmpxchg32((uint32_t *)stat, old, new) != old);
+
+	return be32_to_cpu(new);
+}
+
+static void opal_msg_stat_inc64(__be64 *stat)
+{
+	__be64 old, new;
+
+	do {
+		old = *stat;
+		new = cpu_to_be64(be64_to_cpu(old) + 1);
+	} while (__cmpxchg64((uint64_t *)stat, old, new) != old);
+}
+
+static void opal_msg_stat_queued(enum opal_msg_type msg_type)
+{
+	struct opal_msg_type_stats *s;
+	__be32 hw;
+	uint32_t pending;
+
+	if (msg_type >= OPAL_MSG_TYPE_MAX)
+		return;
+	s = &msg_stats[msg_type];
+
+	opal_msg_stat_inc64(&s->queued);
+	pending = opal_msg_stat_add32(&s->pending, 1);
+	do {
+		hw = s->high_water;
+		if (pending <= be32_to_cpu(hw))
+			break;
+	} while (__cmpxchg32((uint32_t *)&s->high_water, hw,
+			     cpu_to_be32(pending)) != hw);
+}
+
+static void opal_msg_stat_consumed(struct opal_msg *msg)
+{
+	uint32_t msg_type = be32_to_cpu(msg->msg_type);
+
+	if (msg_type < OPAL_MSG_TYPE_MAX)
+		opal_msg_stat_add32(&msg_stats[msg_type].pending, -1);
+}
+
+static void opal_msg_stat_overflowed(enum opal_msg_type msg_type)
+{
+	struct opal_msg_type_stats *s;
+
+	if (msg_type >= OPAL_MSG_TYPE_MAX)
+		return;
+	s = &msg_stats[msg_type];
+
+	/* Say so once, the counter tells the rest */
+	if (!s->overflowed)
+		prlog(PR_NOTICE, "Message ring full, queueing type %d "
+		      "messages outside it\n", msg_type);
+	opal_msg_stat_inc64(&s->overflowed);
+}
+
+static void opal_msg_stat_dropped(enum opal_msg_type msg_type)
+{
+	if (msg_type < OPAL_MSG_TYPE_MAX)
+		opal_msg_stat_inc64(&msg_stats[msg_type].dropped);
+}
+
+static bool opal_msg_in_ring(struct opal_msg_slot *slot)
+{
+	return slot >= msg_ring && slot < msg_ring + OPAL_MSG_RING_SIZE;
+}
+
+static void opal_msg_fill(struct opal_msg_slot *slot,
+			  enum opal_msg_type msg_type, void *data,
+			  void (*consumed)(void *data, int status),
+			  struct opal_msg *ext,
+			  size_t params_size, const void *params)
+{
+	struct opal_msg *msg;
+
+	slot->consumed = consumed;
+	slot->data = data;
+	slot->ext = ext;
+	slot->taken = false;
+	msg = opal_msg_of(slot);
+	msg->msg_type = cpu_to_be32(msg_type);
+	msg->size = cpu_to_be32(params_size);
+	memcpy(msg->params, params, params_size);
+}
+
+static uint64_t opal_msg_tail(void)
+{
+	return *(volatile uint64_t *)&msg_tail;
+}
+
+static void opal_msg_tail_update(uint64_t set, uint64_t clear)
+{
+	uint64_t tail;
+
+	do {
+		tail = opal_msg_tail();
+	} while (__cmpxchg64(&msg_tail, tail, (tail | set) & ~clear) != tail);
+}
+
+/* The slow path, once the ring is full */
+static int opal_msg_queue_overflow(enum opal_msg_type msg_type, void *data,
+				   void (*consumed)(void *data, int status),
+				   struct opal_msg *ext,
+				   size_t params_size, const void *params)
+{
+	struct opal_msg_overflow *entry;
+
+	entry = zalloc(sizeof(*entry));
+	if (!entry) {
+		prerror("Message ring full and allocation failed\n");
+		opal_msg_stat_dropped(msg_type);
+		if (ext)
+			free(ext);
+		return OPAL_RESOURCE;
+	}
+	opal_msg_fill(&entry->slot, msg_type, data, consumed, ext,
+		      params_size, params);
+
+	lock(&opal_msg_lock);
+	list_add_tail(&msg_overflow, &entry->link);
+	msg_overflowed++;
+	/* The list may have emptied since we saw the flag */
+	opal_msg_tail_update(MSG_TAIL_OVERFLOW, 0);
+	opal_msg_stat_overflowed(msg_type);
+	opal_msg_stat_queued(msg_type);
+	opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
+				OPAL_EVENT_MSG_PENDING);
+	unlock(&opal_msg_lock);
+
+	return OPAL_SUCCESS;
+}
+
 int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
 		    void (*consumed)(void *data, int status),
 		    size_t params_size, const void *params)
 {
-	struct opal_msg_entry *entry;
-	uint64_t entry_size;
+	struct opal_msg_slot *slot;
+	struct opal_msg *ext = NULL;
+	uint64_t pos, seq, prev;
 
 	if ((params_size + OPAL_MSG_HDR_SIZE) > OPAL_MSG_SIZE) {
 		prlog(PR_DEBUG, "param_size (0x%x) > opal_msg param size (0x%x)\n",
@@ -39,44 +241,136 @@ int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
 		return OPAL_PARAMETER;
 	}
 
-	lock(&opal_msg_lock);
-
 	if (params_size > OPAL_MSG_FIXED_PARAMS_SIZE) {
-		entry_size = sizeof(struct opal_msg_entry) + params_size;
-		entry_size -= OPAL_MSG_FIXED_PARAMS_SIZE;
-		entry = zalloc(entry_size);
-		if (entry)
-			entry->extended = true;
-	} else {
-		entry = list_pop(&msg_free_list, struct opal_msg_entry, link);
-		if (!entry) {
-			prerror("No available node in the free list, allocating\n");
-			entry = zalloc(sizeof(struct opal_msg_entry));
+		ext = zalloc(OPAL_MSG_HDR_SIZE + params_size);
+		if (!ext) {
+			prerror("Allocation failed\n");
+			return OPAL_RESOURCE;
 		}
 	}
-	if (!entry) {
-		prerror("Allocation failed\n");
-		unlock(&opal_msg_lock);
-		return OPAL_RESOURCE;
+
+	/* Claim the slot for message number pos */
+	pos = opal_msg_tail();
+	for (;;) {
+		/* Stay behind what's already overflowed */
+		if (pos & MSG_TAIL_OVERFLOW)
+			return opal_msg_queue_overflow(msg_type, data,
+						       consumed, ext,
+						       params_size, params);
+
+		slot = &msg_ring[pos & OPAL_MSG_RING_MASK];
+		seq = opal_msg_seq(slot);
+		if (seq == pos) {
+			prev = __cmpxchg64(&msg_tail, pos, pos + 1);
+		} else if ((int64_t)(seq - pos) < 0) {
+			/* Still holds the message from the previous lap */
+			prev = __cmpxchg64(&msg_tail, pos,
+					   pos | MSG_TAIL_OVERFLOW);
+		} else {
+			pos = opal_msg_tail();
+			continue;
+		}
+		if (prev == pos)
+			break;
+		pos = prev;
 	}
+	if (seq != pos)
+		return opal_msg_queue_overflow(msg_type, data, consumed, ext,
+					       params_size, params);
+	lwsync();
+
+	opal_msg_fill(slot, msg_type, data, consumed, ext,
+		      params_size, params);
+	opal_msg_stat_queued(msg_type);
+
+	/* Hand it to the host */
+	lwsync();
+	opal_msg_set_seq(slot, pos + 1);
+
+	/*
+	 * Only take the event lock if the host may not know yet. Pairs
+	 * with the re-check in opal_msg_update_pending().
+	 */
+	sync();
+	if (!(opal_pending_events & OPAL_EVENT_MSG_PENDING))
+		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
+					OPAL_EVENT_MSG_PENDING);
 
-	entry->consumed = consumed;
-	entry->data = data;
-	entry->msg.msg_type = cpu_to_be32(msg_type);
-	entry->msg.size = cpu_to_be32(params_size);
-	memcpy(entry->msg.params, params, params_size);
+	return OPAL_SUCCESS;
+}
 
-	list_add_tail(&msg_pending_list, &entry->link);
-	opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
-				OPAL_EVENT_MSG_PENDING);
-	unlock(&opal_msg_lock);
+/*
+ * Return the head slot to the producers, or free an overflowed message.
+ * Called with opal_msg_lock held
+ */
+static void opal_msg_release(struct opal_msg_slot *slot)
+{
+	struct opal_msg_overflow *entry;
 
-	return OPAL_SUCCESS;
+	if (slot->ext) {
+		free(slot->ext);
+		slot->ext = NULL;
+	}
+	if (!opal_msg_in_ring(slot)) {
+		entry = container_of(slot, struct opal_msg_overflow, slot);
+		list_del(&entry->link);
+		free(entry);
+		if (!--msg_overflowed)
+			opal_msg_tail_update(0, MSG_TAIL_OVERFLOW);
+		return;
+	}
+	lwsync();
+	opal_msg_set_seq(slot, msg_head + OPAL_MSG_RING_SIZE);
+	msg_head++;
+}
+
+/* The oldest message not taken yet, if any. Called with opal_msg_lock held */
+static struct opal_msg_slot *opal_msg_peek(void)
+{
+	struct opal_msg_overflow *entry;
+	struct opal_msg_slot *slot;
+
+	for (;;) {
+		slot = &msg_ring[msg_head & OPAL_MSG_RING_MASK];
+		if (opal_msg_seq(slot) != msg_head + 1) {
+			if ((opal_msg_tail() & ~MSG_TAIL_OVERFLOW) == msg_head)
+				break;
+			/*
+			 * Claimed but not filled in yet. Wait for it rather
+			 * than hand out anything queued after it.
+			 */
+			cpu_relax();
+			continue;
+		}
+		lwsync();
+		if (!slot->taken)
+			return slot;
+		opal_msg_release(slot);
+	}
+
+	entry = list_top(&msg_overflow, struct opal_msg_overflow, link);
+	return entry ? &entry->slot : NULL;
+}
+
+/* Called with opal_msg_lock held */
+static void opal_msg_update_pending(void)
+{
+	if (opal_msg_peek())
+		return;
+
+	opal_update_pending_evt(OPAL_EVENT_MSG_PENDING, 0);
+
+	/* A producer may have seen the event still set */
+	sync();
+	if (opal_msg_peek())
+		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
+					OPAL_EVENT_MSG_PENDING);
 }
 
 static int64_t opal_get_msg(uint64_t *buffer, uint64_t size)
 {
-	struct opal_msg_entry *entry;
+	struct opal_msg_slot *slot;
+	struct opal_msg *msg;
 	void (*callback)(void *data, int status);
 	void *data;
 	uint64_t msg_size;
@@ -90,36 +384,32 @@ static int64_t opal_get_msg(uint64_t *buffer, uint64_t size)
 
 	lock(&opal_msg_lock);
 
-	entry = list_pop(&msg_pending_list, struct opal_msg_entry, link);
-	if (!entry) {
+	slot = opal_msg_peek();
+	if (!slot) {
 		unlock(&opal_msg_lock);
 		return OPAL_RESOURCE;
 	}
 
-	msg_size = OPAL_MSG_HDR_SIZE + be32_to_cpu(entry->msg.size);
+	msg = opal_msg_of(slot);
+	msg_size = OPAL_MSG_HDR_SIZE + be32_to_cpu(msg->size);
 	if (size < msg_size) {
 		/* Send partial data to Linux */
 		prlog(PR_NOTICE, "Sending partial data [msg_type : 0x%x, "
 		      "msg_size : 0x%x, buf_size : 0x%x]\n",
-		      be32_to_cpu(entry->msg.msg_type),
+		      be32_to_cpu(msg->msg_type),
 		      (u32)msg_size, (u32)size);
 
-		entry->msg.size = cpu_to_be32(size - OPAL_MSG_HDR_SIZE);
+		msg->size = cpu_to_be32(size - OPAL_MSG_HDR_SIZE);
 		msg_size = size;
 		rc = OPAL_PARTIAL;
 	}
 
-	memcpy((void *)buffer, (void *)&entry->msg, msg_size);
-	callback = entry->consumed;
-	data = entry->data;
-
-	if (entry->extended)
-		free(entry);
-	else
-		list_add(&msg_free_list, &entry->link);
-
-	if (list_empty(&msg_pending_list))
-		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING, 0);
+	memcpy((void *)buffer, (void *)msg, msg_size);
+	callback = slot->consumed;
+	data = slot->data;
+	opal_msg_stat_consumed(msg);
+	opal_msg_release(slot);
+	opal_msg_update_pending();
 
 	unlock(&opal_msg_lock);
 
@@ -130,36 +420,120 @@ static int64_t opal_get_msg(uint64_t *buffer, uint64_t size)
 }
 opal_call(OPAL_GET_MSG, opal_get_msg, 2);
 
+static int64_t opal_get_msgs(uint64_t *buffer, uint64_t size)
+{
+	struct {
+		void (*callback)(void *data, int status);
+		void *data;
+	} done[OPAL_GET_MSGS_MAX];
+	struct opal_msg_slot *slot;
+	struct opal_msg *msg;
+	uint64_t msg_size, off = 0;
+	int i, count = 0;
+
+	if (size < sizeof(struct opal_msg) || !buffer)
+		return OPAL_PARAMETER;
+
+	if (!opal_addr_valid(buffer))
+		return OPAL_PARAMETER;
+
+	lock(&opal_msg_lock);
+
+	while (count < OPAL_GET_MSGS_MAX) {
+		slot = opal_msg_peek();
+		if (!slot)
+			break;
+
+		/* Records are 8-byte aligned and never split */
+		msg = opal_msg_of(slot);
+		msg_size = OPAL_MSG_HDR_SIZE + be32_to_cpu(msg->size);
+		if (off + msg_size > size)
+			break;
+
+		memcpy((void *)buffer + off, msg, msg_size);
+		off += ALIGN_UP(msg_size, 8);
+		done[count].callback = slot->consumed;
+		done[count].data = slot->data;
+		count++;
+		opal_msg_stat_consumed(msg);
+		opal_msg_release(slot);
+	}
+	opal_msg_update_pending();
+	slot = opal_msg_peek();
+
+	unlock(&opal_msg_lock);
+
+	for (i = 0; i < count; i++)
+		if (done[i].callback)
+			done[i].callback(done[i].data, OPAL_SUCCESS);
+
+	if (count)
+		return count;
+
+	/* Either nothing to get or the next one needs OPAL_GET_MSG */
+	return slot ? OPAL_PARTIAL : OPAL_RESOURCE;
+}
+opal_call(OPAL_GET_MSGS, opal_get_msgs, 2);
+
+static bool opal_msg_is_completion(struct opal_msg_slot *slot, uint64_t token)
+{
+	struct opal_msg *msg = opal_msg_of(slot);
+
+	return !slot->taken &&
+		be32_to_cpu(msg->msg_type) == OPAL_MSG_ASYNC_COMP &&
+		be64_to_cpu(msg->params[0]) == token;
+}
+
 static int64_t opal_check_completion(uint64_t *buffer, uint64_t size,
 				     uint64_t token)
 {
-	struct opal_msg_entry *entry, *next_entry;
+	struct opal_msg_overflow *entry;
+	struct opal_msg_slot *slot = NULL;
+	struct opal_msg *msg;
 	void (*callback)(void *data, int status) = NULL;
 	int rc = OPAL_BUSY;
 	void *data = NULL;
+	uint64_t pos;
 
 	if (!opal_addr_valid(buffer))
 		return OPAL_PARAMETER;
 
 	lock(&opal_msg_lock);
-	list_for_each_safe(&msg_pending_list, entry, next_entry, link) {
-		if (be32_to_cpu(entry->msg.msg_type) == OPAL_MSG_ASYNC_COMP &&
-		    be64_to_cpu(entry->msg.params[0]) == token) {
-			list_del(&entry->link);
-			callback = entry->consumed;
-			data = entry->data;
-			list_add(&msg_free_list, &entry->link);
-			if (list_empty(&msg_pending_list))
-				opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
-							0);
-			rc = OPAL_SUCCESS;
+	for (pos = msg_head; ; pos++) {
+		slot = &msg_ring[pos & OPAL_MSG_RING_MASK];
+		if (opal_msg_seq(slot) != pos + 1) {
+			slot = NULL;
 			break;
 		}
+		lwsync();
+		if (opal_msg_is_completion(slot, token))
+			break;
+	}
+	if (!slot) {
+		list_for_each(&msg_overflow, entry, link) {
+			if (opal_msg_is_completion(&entry->slot, token)) {
+				slot = &entry->slot;
+				break;
+			}
+		}
 	}
 
-	if (rc == OPAL_SUCCESS && size >= sizeof(struct opal_msg))
-		memcpy(buffer, &entry->msg, sizeof(entry->msg));
-
+	if (slot) {
+		msg = opal_msg_of(slot);
+		callback = slot->consumed;
+		data = slot->data;
+		if (size >= sizeof(struct opal_msg))
+			memcpy(buffer, msg, sizeof(struct opal_msg));
+		opal_msg_stat_consumed(msg);
+
+		/* A ring slot goes back once it reaches the head */
+		if (opal_msg_in_ring(slot))
+			slot->taken = true;
+		else
+			opal_msg_release(slot);
+		opal_msg_update_pending();
+		rc = OPAL_SUCCESS;
+	}
 	unlock(&opal_msg_lock);
 
 	if (callback)
@@ -172,22 +546,20 @@ opal_call(OPAL_CHECK_ASYNC_COMPLETION, opal_check_completion, 3);
 
 void opal_init_msg(void)
 {
-	struct opal_msg_entry *entry;
-	int i;
-
-	for (i = 0; i < OPAL_MAX_MSGS; i++, entry++) {
-                entry = zalloc(sizeof(*entry));
-                if (!entry)
-                        goto err;
-		list_add_tail(&msg_free_list, &entry->link);
-        }
-        return;
-
-err:
-        for (; i > 0; i--) {
-                entry = list_pop(&msg_free_list, struct opal_msg_entry, link);
-                if (entry)
-                        free(entry);
-        }
+	struct opal_msg_stats_header *hdr;
+
+	hdr = opal_export_alloc("opal_msg_stats",
+				sizeof(*hdr) + sizeof(boot_msg_stats));
+	if (!hdr)
+		return;
+
+	hdr->version = cpu_to_be32(OPAL_MSG_STATS_VERSION);
+	hdr->nr_types = cpu_to_be32(OPAL_MSG_TYPE_MAX);
+	hdr->ring_size = cpu_to_be32(OPAL_MSG_RING_SIZE);
+	hdr->entry_size = cpu_to_be32(sizeof(struct opal_msg_type_stats));
+
+	/* Only the boot CPU queues messages this early */
+	memcpy(hdr + 1, boot_msg_stats, sizeof(boot_msg_stats));
+	lwsync();
+	msg_stats = (struct opal_msg_type_stats *)(hdr + 1);
 }
-
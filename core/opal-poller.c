@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * OPAL pollers
+ *
+ * Pollers are run from opal_run_pollers(), on every opal_poll_events()
+ * and from time_wait(). Each may ask to be run no more often than a given
+ * interval, in which case the CPUs race to claim each run and only the
+ * winner calls it. Time spent in each poller is accounted and exported to
+ * the host.
+ *
+ * Copyright 2019 IBM Corp.
+ */
+
+#include <skiboot.h>
+#include <opal.h>
+#include <opal-poller.h>
+#include <lock.h>
+#include <timebase.h>
+#include <string.h>
+
+struct opal_poll_entry {
+	struct list_node		link;
+	void				(*poller)(void *data);
+	void				*data;
+	uint64_t			interval;
+	uint64_t			next_run;
+	struct opal_poller_stats	*stats;
+	struct opal_poller_stats	own_stats;
+};
+
+static struct list_head opal_pollers = LIST_HEAD_INIT(opal_pollers);
+static struct lock opal_poll_lock = LOCK_UNLOCKED;
+static struct opal_poller_header *poller_hdr;
+
+/* Move a poller's statistics to the exported table, if there's room */
+static void opal_poller_export(struct opal_poll_entry *ent)
+{
+	struct opal_poller_stats *slot;
+	uint32_t nr;
+
+	if (!poller_hdr)
+		return;
+	nr = be32_to_cpu(poller_hdr->nr_pollers);
+	if (nr == OPAL_POLLER_MAX)
+		return;
+
+	slot = (struct opal_poller_stats *)(poller_hdr + 1) + nr;
+	*slot = *ent->stats;
+	ent->stats = slot;
+	lwsync();
+	poller_hdr->nr_pollers = cpu_to_be32(nr + 1);
+}
+
+void __opal_add_poller(void (*poller)(void *data), void *data,
+		       const char *name, uint32_t interval_us)
+{
+	struct opal_poll_entry *ent;
+
+	ent = zalloc(sizeof(struct opal_poll_entry));
+	assert(ent);
+	ent->poller = poller;
+	ent->data = data;
+	ent->interval = usecs_to_tb(interval_us);
+	ent->stats = &ent->own_stats;
+	strncpy(ent->stats->name, name, OPAL_POLLER_NAME_LEN - 1);
+	ent->stats->interval_tb = cpu_to_be64(ent->interval);
+	lock(&opal_poll_lock);
+	opal_poller_export(ent);
+	list_add_tail(&opal_pollers, &ent->link);
+	unlock(&opal_poll_lock);
+}
+
+void opal_del_poller(void (*poller)(void *data))
+{
+	struct opal_poll_entry *ent;
+
+	/* XXX This is currently unused. To solve various "interesting"
+	 * locking issues, the pollers are run locklessly, so if we were
+	 * to free them, we would have to be careful, using something
+	 * akin to RCU to synchronize with other OPAL entries. For now
+	 * if anybody uses it, print a warning and leak the entry, don't
+	 * free it.
+	 */
+	/**
+	 * @fwts-label UnsupportedOPALdelpoller
+	 * @fwts-advice Currently removing a poller is DANGEROUS and
+	 * MUST NOT be done in production firmware.
+	 */
+	prlog(PR_ALERT, "WARNING: Unsupported opal_del_poller."
+	      " Interesting locking issues, don't call this.\n");
+
+	lock(&opal_poll_lock);
+	list_for_each(&opal_pollers, ent, link) {
+		if (ent->poller == poller) {
+			list_del(&ent->link);
+			/* free(ent); */
+			break;
+		}
+	}
+	unlock(&opal_poll_lock);
+}
+
+static bool opal_poller_due(struct opal_poll_entry *ent, uint64_t now)
+{
+	uint64_t next;
+
+	if (!ent->interval)
+		return true;
+
+	next = ent->next_run;
+	if (tb_compare(now, next) == TB_ABEFOREB)
+		return false;
+
+	/* Whoever moves next_run on owns this run */
+	return __cmpxchg64(&ent->next_run, next, now + ent->interval) == next;
+}
+
+static void opal_poller_account(struct opal_poll_entry *ent, uint64_t tb)
+{
+	struct opal_poller_stats *s = ent->stats;
+
+	s->runs = cpu_to_be64(be64_to_cpu(s->runs) + 1);
+	s->total_tb = cpu_to_be64(be64_to_cpu(s->total_tb) + tb);
+	if (tb > be64_to_cpu(s->max_tb))
+		s->max_tb = cpu_to_be64(tb);
+}
+
+void opal_run_poller_list(void)
+{
+	struct opal_poll_entry *ent;
+	struct opal_poller_stats *s;
+	uint64_t now = mftb(), end;
+
+	/* The pollers are run locklessly, see comment in opal_del_poller */
+	list_for_each(&opal_pollers, ent, link) {
+		if (!opal_poller_due(ent, now)) {
+			s = ent->stats;
+			s->skips = cpu_to_be64(be64_to_cpu(s->skips) + 1);
+			continue;
+		}
+
+		ent->poller(ent->data);
+
+		end = mftb();
+		opal_poller_account(ent, end - now);
+		now = end;
+	}
+}
+
+void opal_poller_init(void)
+{
+	struct opal_poll_entry *ent;
+
+	poller_hdr = opal_export_alloc("opal_pollers", sizeof(*poller_hdr) +
+			OPAL_POLLER_MAX * sizeof(struct opal_poller_stats));
+	if (!poller_hdr)
+		return;
+
+	poller_hdr->version = cpu_to_be32(OPAL_POLLER_VERSION);
+	poller_hdr->max_pollers = cpu_to_be32(OPAL_POLLER_MAX);
+	poller_hdr->tb_hz = cpu_to_be64(tb_hz);
+	poller_hdr->entry_size = cpu_to_be64(sizeof(struct opal_poller_stats));
+
+	/* Only the boot CPU runs pollers this early */
+	lock(&opal_poll_lock);
+	list_for_each(&opal_pollers, ent, link)
+		opal_poller_export(ent);
+	unlock(&opal_poll_lock);
+}
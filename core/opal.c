@@ -23,6 +23,8 @@
 #include <elf-abi.h>
 #include <errorlog.h>
 #include <occ.h>
+#include <opal-latency.h>
+#include <opal-poller.h>
 
 /* Pending events to signal via opal_poll_events */
 uint64_t opal_pending_events;
@@ -165,7 +167,8 @@ int64_t opal_exit_check(int64_t retval, struct stack_frame *eframe)
 	struct cpu_thread *cpu = this_cpu();
 	uint64_t token = eframe->gpr[0];
 	uint64_t now = mftb();
-	uint64_t call_time = tb_to_msecs(now - cpu->entered_opal_call_at);
+	uint64_t call_tb = now - cpu->entered_opal_call_at;
+	uint64_t call_time = tb_to_msecs(call_tb);
 
 	if (!cpu->in_opal_call) {
 		disable_fast_reboot("Un-accounted firmware entry");
@@ -182,6 +185,7 @@ int64_t opal_exit_check(int64_t retval, struct stack_frame *eframe)
 			      cpu->pir, token, retval);
 			drop_my_locks(true);
 		}
+		opal_lat_record(cpu, token, call_tb);
 	}
 
 	if (call_time > 100 && token != OPAL_RESYNC_TIMEBASE) {
@@ -494,63 +498,10 @@ static uint64_t opal_test_func(uint64_t arg)
 }
 opal_call(OPAL_TEST, opal_test_func, 1);
 
-struct opal_poll_entry {
-	struct list_node	link;
-	void			(*poller)(void *data);
-	void			*data;
-};
-
-static struct list_head opal_pollers = LIST_HEAD_INIT(opal_pollers);
-static struct lock opal_poll_lock = LOCK_UNLOCKED;
-
-void opal_add_poller(void (*poller)(void *data), void *data)
-{
-	struct opal_poll_entry *ent;
-
-	ent = zalloc(sizeof(struct opal_poll_entry));
-	assert(ent);
-	ent->poller = poller;
-	ent->data = data;
-	lock(&opal_poll_lock);
-	list_add_tail(&opal_pollers, &ent->link);
-	unlock(&opal_poll_lock);
-}
-
-void opal_del_poller(void (*poller)(void *data))
-{
-	struct opal_poll_entry *ent;
-
-	/* XXX This is currently unused. To solve various "interesting"
-	 * locking issues, the pollers are run locklessly, so if we were
-	 * to free them, we would have to be careful, using something
-	 * akin to RCU to synchronize with other OPAL entries. For now
-	 * if anybody uses it, print a warning and leak the entry, don't
-	 * free it.
-	 */
-	/**
-	 * @fwts-label UnsupportedOPALdelpoller
-	 * @fwts-advice Currently removing a poller is DANGEROUS and
-	 * MUST NOT be done in production firmware.
-	 */
-	prlog(PR_ALERT, "WARNING: Unsupported opal_del_poller."
-	      " Interesting locking issues, don't call this.\n");
-
-	lock(&opal_poll_lock);
-	list_for_each(&opal_pollers, ent, link) {
-		if (ent->poller == poller) {
-			list_del(&ent->link);
-			/* free(ent); */
-			break;
-		}
-	}
-	unlock(&opal_poll_lock);
-}
-
 void opal_run_pollers(void)
 {
 	static int pollers_with_lock_warnings = 0;
 	static int poller_recursion = 0;
-	struct opal_poll_entry *poll_ent;
 	bool was_in_poller;
 
 	/* Don't re-enter on this CPU, unless it was an OPAL re-entry */
@@ -604,9 +555,7 @@ void opal_run_pollers(void)
 	/* We run the timers first */
 	check_timers(false);
 
-	/* The pollers are run lokelessly, see comment in opal_del_poller */
-	list_for_each(&opal_pollers, poll_ent, link)
-		poll_ent->poller(poll_ent->data);
+	opal_run_poller_list();
 
 	/* Disable poller flag */
 	this_cpu()->in_poller = was_in_poller;
@@ -382,6 +382,152 @@ static int64_t opal_pci_tce_kill(uint64_t phb_id,
 }
 opal_call(OPAL_PCI_TCE_KILL, opal_pci_tce_kill, 6);
 
+static bool pci_tce_kill_before(const struct pci_tce_kill *a,
+				const struct pci_tce_kill *b)
+{
+	if (a->pe_number != b->pe_number)
+		return a->pe_number < b->pe_number;
+	if (a->tce_size != b->tce_size)
+		return a->tce_size < b->tce_size;
+	return a->dma_addr < b->dma_addr;
+}
+
+/* Grow @a to cover @b if they touch, @a being the one starting first */
+static bool pci_tce_kill_merge(struct pci_tce_kill *a,
+			       const struct pci_tce_kill *b)
+{
+	uint64_t a_end, b_end, npages;
+
+	if (a->pe_number != b->pe_number || a->tce_size != b->tce_size)
+		return false;
+
+	a_end = a->dma_addr + (uint64_t)a->npages * a->tce_size;
+	if (b->dma_addr > a_end)
+		return false;
+
+	b_end = b->dma_addr + (uint64_t)b->npages * b->tce_size;
+	if (b_end <= a_end)
+		return true;
+
+	npages = (b_end - a->dma_addr) / a->tce_size;
+	if (npages > UINT32_MAX)
+		return false;
+	a->npages = npages;
+	return true;
+}
+
+static void pci_tce_kill_get(struct pci_tce_kill *k,
+			     const struct opal_tce_kill_range *range)
+{
+	k->pe_number = be64_to_cpu(range->pe_number);
+	k->dma_addr = be64_to_cpu(range->dma_addr);
+	k->tce_size = be32_to_cpu(range->tce_size);
+	k->npages = be32_to_cpu(range->npages);
+}
+
+static bool pci_tce_kill_valid(const struct pci_tce_kill *k)
+{
+	return k->tce_size && !(k->tce_size & (k->tce_size - 1)) &&
+		!(k->dma_addr & (k->tce_size - 1));
+}
+
+/*
+ * Convert the host's ranges, sorting them by PE, page size and address
+ * and merging the ones that touch or overlap so the PHB sees as few and
+ * as long runs as possible. The lists are short and usually come in
+ * order, so an insertion sort does. Returns the number of ranges left.
+ */
+static uint32_t pci_tce_kill_coalesce(struct pci_tce_kill *kills,
+				      const struct opal_tce_kill_range *ranges,
+				      uint32_t count)
+{
+	struct pci_tce_kill k;
+	uint32_t i, j, n = 0;
+
+	for (i = 0; i < count; i++) {
+		pci_tce_kill_get(&k, &ranges[i]);
+		if (!k.npages)
+			continue;
+
+		for (j = n; j && pci_tce_kill_before(&k, &kills[j - 1]); j--)
+			;
+
+		if (j && pci_tce_kill_merge(&kills[j - 1], &k)) {
+			j--;
+		} else if (j < n && pci_tce_kill_merge(&k, &kills[j])) {
+			kills[j] = k;
+		} else {
+			memmove(&kills[j + 1], &kills[j],
+				(n - j) * sizeof(*kills));
+			kills[j] = k;
+			n++;
+			continue;
+		}
+
+		/* A range that grew may now reach the ones after it */
+		while (j + 1 < n && pci_tce_kill_merge(&kills[j],
+						       &kills[j + 1])) {
+			memmove(&kills[j + 1], &kills[j + 2],
+				(n - j - 2) * sizeof(*kills));
+			n--;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Ranges are coalesced this many at a time, so the work array fits on
+ * the stack. Ranges in different chunks aren't merged with each other.
+ */
+#define PCI_TCE_KILL_CHUNK	32
+
+static int64_t opal_pci_tce_kill_list(uint64_t phb_id,
+				      struct opal_tce_kill_range *ranges,
+				      uint64_t count)
+{
+	struct phb *phb = pci_get_phb(phb_id);
+	struct pci_tce_kill kills[PCI_TCE_KILL_CHUNK], k;
+	int64_t rc = OPAL_SUCCESS;
+	uint32_t i, n, chunk;
+
+	if (!phb || !opal_addr_valid(ranges) ||
+	    !count || count > OPAL_PCI_TCE_KILL_LIST_MAX)
+		return OPAL_PARAMETER;
+	if (!phb->ops->tce_kill_list && !phb->ops->tce_kill)
+		return OPAL_UNSUPPORTED;
+
+	/* Refuse a malformed list before killing any of it */
+	for (i = 0; i < count; i++) {
+		pci_tce_kill_get(&k, &ranges[i]);
+		if (!pci_tce_kill_valid(&k))
+			return OPAL_PARAMETER;
+	}
+
+	phb_lock(phb);
+	for (; count && rc == OPAL_SUCCESS; ranges += chunk, count -= chunk) {
+		chunk = MIN(count, PCI_TCE_KILL_CHUNK);
+		n = pci_tce_kill_coalesce(kills, ranges, chunk);
+		if (!n)
+			continue;
+
+		if (phb->ops->tce_kill_list) {
+			rc = phb->ops->tce_kill_list(phb, kills, n);
+			continue;
+		}
+		for (i = 0; i < n && rc == OPAL_SUCCESS; i++)
+			rc = phb->ops->tce_kill(phb, OPAL_PCI_TCE_KILL_PAGES,
+						kills[i].pe_number,
+						kills[i].tce_size,
+						kills[i].dma_addr,
+						kills[i].npages);
+	}
+	phb_unlock(phb);
+
+	return rc;
+}
+opal_call(OPAL_PCI_TCE_KILL_LIST, opal_pci_tce_kill_list, 3);
+
 static int64_t opal_pci_set_xive_pe(uint64_t phb_id, uint64_t pe_number,
 				    uint32_t xive_num)
 {
@@ -219,6 +219,31 @@ bool pci_wait_crs(struct phb *phb, uint16_t bdfn, uint32_t *out_vdid)
 	return true;
 }
 
+static void pci_dev_map_set(struct phb *phb, uint16_t bdfn,
+			    struct pci_device *pd)
+{
+	struct pci_device **bus = phb->dev_map[PCI_BUS_NUM(bdfn)];
+
+	if (!bus) {
+		if (!pd)
+			return;
+		bus = zalloc(0x100 * sizeof(*bus));
+		assert(bus);
+		phb->dev_map[PCI_BUS_NUM(bdfn)] = bus;
+	}
+	bus[bdfn & 0xff] = pd;
+}
+
+static void pci_dev_map_clear(struct phb *phb)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(phb->dev_map); i++) {
+		free(phb->dev_map[i]);
+		phb->dev_map[i] = NULL;
+	}
+}
+
 static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *parent,
 				       uint16_t bdfn)
 {
@@ -293,6 +318,7 @@ static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *paren
 		list_add_tail(&phb->devices, &pd->link);
 	else
 		list_add_tail(&parent->children, &pd->link);
+	pci_dev_map_set(phb, bdfn, pd);
 
 	/*
 	 * Call PHB hook
@@ -430,13 +456,33 @@ error:
 	pci_slot_set_state(slot, PCI_SLOT_STATE_NORMAL);
 }
 
-static bool pci_bridge_power_on(struct phb *phb, struct pci_device *pd)
+static void pci_bridge_enable_link(struct phb *phb, struct pci_device *pd)
+{
+	int32_t ecap;
+	uint16_t link_ctl;
+
+	ecap = pci_cap(pd, PCI_CFG_CAP_ID_EXP, false);
+	pci_cfg_read16(phb, pd->bdfn, ecap + PCICAP_EXP_LCTL, &link_ctl);
+	PCITRACE(phb, pd->bdfn, " LINK_CTL=%04x\n", link_ctl);
+	link_ctl &= ~PCICAP_EXP_LCTL_LINK_DIS;
+	pci_cfg_write16(phb, pd->bdfn, ecap + PCICAP_EXP_LCTL, link_ctl);
+}
+
+/*
+ * Returns false if there's nothing behind the bridge. If the slot power
+ * was just turned on, @settle is set and the caller must give it a couple
+ * of seconds before calling pci_bridge_enable_link().
+ */
+static bool pci_bridge_power_on(struct phb *phb, struct pci_device *pd,
+				bool *settle)
 {
 	int32_t ecap;
-	uint16_t pcie_cap, slot_sts, slot_ctl, link_ctl;
+	uint16_t pcie_cap, slot_sts, slot_ctl;
 	uint32_t slot_cap;
 	int64_t rc;
 
+	*settle = false;
+
 	/*
 	 * If there is a PCI slot associated with the bridge, to use
 	 * the PCI slot's facality to power it on.
@@ -495,17 +541,11 @@ static bool pci_bridge_power_on(struct phb *phb, struct pci_device *pd)
 		slot_ctl |= SETFIELD(PCICAP_EXP_SLOTCTL_PWRI, 0, PCIE_INDIC_ON);
 		pci_cfg_write16(phb, pd->bdfn,
 				ecap + PCICAP_EXP_SLOTCTL, slot_ctl);
-
-		/* Wait a couple of seconds */
-		time_wait_ms(2000);
+		*settle = true;
+		return true;
 	}
 
-	/* Enable link */
-	pci_cfg_read16(phb, pd->bdfn, ecap + PCICAP_EXP_LCTL, &link_ctl);
-	PCITRACE(phb, pd->bdfn, " LINK_CTL=%04x\n", link_ctl);
-	link_ctl &= ~PCICAP_EXP_LCTL_LINK_DIS;
-	pci_cfg_write16(phb, pd->bdfn, ecap + PCICAP_EXP_LCTL, link_ctl);
-
+	pci_bridge_enable_link(phb, pd);
 	return true;
 }
 
@@ -559,22 +599,69 @@ static bool pci_bridge_wait_link(struct phb *phb,
 	return true;
 }
 
-/* pci_enable_bridge - Called before scanning a bridge
- *
- * Ensures error flags are clean, disable master abort, and
- * check if the subordinate bus isn't reset, the slot is enabled
- * on PCIe, etc...
+/* Clear up bridge resources */
+static void pci_cleanup_bridge(struct phb *phb, struct pci_device *pd)
+{
+	uint16_t cmd;
+
+	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_IO_BASE_U16, 0xffff);
+	pci_cfg_write8(phb, pd->bdfn, PCI_CFG_IO_BASE, 0xf0);
+	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_IO_LIMIT_U16, 0);
+	pci_cfg_write8(phb, pd->bdfn, PCI_CFG_IO_LIMIT, 0);
+	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_MEM_BASE, 0xfff0);
+	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_MEM_LIMIT, 0);
+	pci_cfg_write32(phb, pd->bdfn, PCI_CFG_PREF_MEM_BASE_U32, 0xffffffff);
+	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_PREF_MEM_BASE, 0xfff0);
+	pci_cfg_write32(phb, pd->bdfn, PCI_CFG_PREF_MEM_LIMIT_U32, 0);
+	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_PREF_MEM_LIMIT, 0);
+
+	/* Note: This is a bit fishy but since we have closed all the
+	 * bridge windows above, it shouldn't be a problem. Basically
+	 * we enable Memory, IO and Bus Master on the bridge because
+	 * some versions of Linux will fail to do it themselves.
+	 */
+	pci_cfg_read16(phb, pd->bdfn, PCI_CFG_CMD, &cmd);
+	cmd |= PCI_CFG_CMD_IO_EN | PCI_CFG_CMD_MEM_EN;
+	cmd |= PCI_CFG_CMD_BUS_MASTER_EN;
+	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_CMD, cmd);	
+}
+
+/*
+ * Bringing up the link behind a bridge means waiting for slot power to
+ * settle, for the secondary reset to take effect and for link training,
+ * which adds up to seconds. Rather than doing that one bridge at a time,
+ * all the bridges of a bus (typically the downstream ports of a switch)
+ * go through each step together so that their delays overlap. Only the
+ * buses behind them depend on their links being up.
  */
-static bool pci_enable_bridge(struct phb *phb, struct pci_device *pd)
+enum pci_bridge_state {
+	PCI_BRIDGE_EMPTY,	/* Nothing behind it, don't scan */
+	PCI_BRIDGE_READY,	/* Link up, ready to scan */
+	PCI_BRIDGE_ENABLING,	/* Power, reset and link being sorted out */
+	PCI_BRIDGE_TRAINING,	/* Waiting for the link to come up */
+};
+
+struct pci_bridge_enable {
+	struct pci_device	*pd;
+	enum pci_bridge_state	state;
+	uint16_t		bctl;
+	bool			settle;
+	bool			was_reset;
+};
+
+/* Time allowed for a downstream link to train */
+#define PCI_BRIDGE_LINK_TIMEOUT_MS	10000
+
+static void pci_bridge_enable_start(struct phb *phb,
+				    struct pci_bridge_enable *be)
 {
-	uint16_t bctl;
-	bool was_reset = false;
+	struct pci_device *pd = be->pd;
 
 	/* Disable master aborts, clear errors */
-	pci_cfg_read16(phb, pd->bdfn, PCI_CFG_BRCTL, &bctl);
-	bctl &= ~PCI_CFG_BRCTL_MABORT_REPORT;
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_BRCTL, bctl);
-
+	pci_cfg_read16(phb, pd->bdfn, PCI_CFG_BRCTL, &be->bctl);
+	be->bctl &= ~PCI_CFG_BRCTL_MABORT_REPORT;
+	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_BRCTL, be->bctl);
+	be->state = PCI_BRIDGE_ENABLING;
 
 	/* PCI-E bridge, check the slot state. We don't do that on the
 	 * root complex as this is handled separately and not all our
@@ -587,10 +674,6 @@ static bool pci_enable_bridge(struct phb *phb, struct pci_device *pd)
 			uint32_t link_cap = 0;
 			uint16_t link_sts = 0;
 
-			ecap = pci_cap(pd, PCI_CFG_CAP_ID_EXP, false);
-			pci_cfg_read32(phb, pd->bdfn,
-				       ecap + PCICAP_EXP_LCAP, &link_cap);
-
 			/*
 			 * No need to touch the power supply if the PCIe link has
 			 * been up. Further more, the slot presence bit is lost while
@@ -608,62 +691,207 @@ static bool pci_enable_bridge(struct phb *phb, struct pci_device *pd)
 			pci_cfg_read16(phb, pd->bdfn,
 				       ecap + PCICAP_EXP_LSTAT, &link_sts);
 			if ((link_cap & PCICAP_EXP_LCAP_DL_ACT_REP) &&
-			    (link_sts & PCICAP_EXP_LSTAT_DLLL_ACT))
-				return true;
+			    (link_sts & PCICAP_EXP_LSTAT_DLLL_ACT)) {
+				be->state = PCI_BRIDGE_READY;
+				return;
+			}
 		}
 
 		/* Power on the downstream slot or link */
-		if (!pci_bridge_power_on(phb, pd))
-			return false;
+		if (!pci_bridge_power_on(phb, pd, &be->settle))
+			be->state = PCI_BRIDGE_EMPTY;
 	}
+}
+
+static void pci_bridge_enable_reset(struct phb *phb,
+				    struct pci_bridge_enable *be)
+{
+	struct pci_device *pd = be->pd;
+
+	if (be->settle)
+		pci_bridge_enable_link(phb, pd);
 
 	/* Clear secondary reset */
-	if (bctl & PCI_CFG_BRCTL_SECONDARY_RESET) {
+	if (be->bctl & PCI_CFG_BRCTL_SECONDARY_RESET) {
 		PCIDBG(phb, pd->bdfn,
 		       "Bridge secondary reset is on, clearing it ...\n");
-		bctl &= ~PCI_CFG_BRCTL_SECONDARY_RESET;
-		pci_cfg_write16(phb, pd->bdfn, PCI_CFG_BRCTL, bctl);
-		time_wait_ms(1000);
-		was_reset = true;
+		be->bctl &= ~PCI_CFG_BRCTL_SECONDARY_RESET;
+		pci_cfg_write16(phb, pd->bdfn, PCI_CFG_BRCTL, be->bctl);
+		be->was_reset = true;
 	}
+}
 
-	/* PCI-E bridge, wait for link */
-	if (pd->dev_type == PCIE_TYPE_ROOT_PORT ||
-	    pd->dev_type == PCIE_TYPE_SWITCH_DNPORT) {
-		if (!pci_bridge_wait_link(phb, pd, was_reset))
-			return false;
+/*
+ * Like pci_bridge_wait_link() for all the bridges in TRAINING state at
+ * once. They go back to ENABLING if their link came up, EMPTY otherwise.
+ * Returns the time by which config space behind all of them can be
+ * accessed.
+ */
+static uint64_t pci_bridges_wait_links(struct phb *phb,
+				       struct pci_bridge_enable *be,
+				       unsigned int count)
+{
+	uint64_t start = mftb(), now, ready = start;
+	unsigned int i, pending;
+	uint32_t link_cap;
+	uint16_t link_sts;
+	int32_t ecap;
+
+	for (;;) {
+		now = mftb();
+		pending = 0;
+		for (i = 0; i < count; i++) {
+			struct pci_device *pd = be[i].pd;
+
+			if (be[i].state != PCI_BRIDGE_TRAINING)
+				continue;
+
+			link_cap = 0;
+			ecap = 0;
+			if (pci_has_cap(pd, PCI_CFG_CAP_ID_EXP, false)) {
+				ecap = pci_cap(pd, PCI_CFG_CAP_ID_EXP, false);
+				pci_cfg_read32(phb, pd->bdfn,
+					       ecap + PCICAP_EXP_LCAP, &link_cap);
+			}
+
+			/*
+			 * If link state reporting isn't supported, wait 1
+			 * second if the downstream link was ever resetted.
+			 */
+			if (!(link_cap & PCICAP_EXP_LCAP_DL_ACT_REP)) {
+				if (be[i].was_reset &&
+				    tb_compare(now, start + msecs_to_tb(1000)) ==
+				    TB_ABEFOREB) {
+					pending++;
+					continue;
+				}
+				be[i].state = PCI_BRIDGE_ENABLING;
+				continue;
+			}
+
+			pci_cfg_read16(phb, pd->bdfn,
+				       ecap + PCICAP_EXP_LSTAT, &link_sts);
+			if (link_sts & PCICAP_EXP_LSTAT_DLLL_ACT) {
+				PCIDBG(phb, pd->bdfn, "link is up after %lu ms\n",
+				       tb_to_msecs(now - start));
+				be[i].state = PCI_BRIDGE_ENABLING;
+
+				/* Need another 100ms before touching the
+				 * config space
+				 */
+				if (tb_compare(ready, now + msecs_to_tb(100)) ==
+				    TB_ABEFOREB)
+					ready = now + msecs_to_tb(100);
+				continue;
+			}
+
+			if (tb_compare(now, start +
+				       msecs_to_tb(PCI_BRIDGE_LINK_TIMEOUT_MS)) ==
+			    TB_AAFTERB) {
+				PCIERR(phb, pd->bdfn,
+				       "Timeout waiting for downstream link\n");
+				be[i].state = PCI_BRIDGE_EMPTY;
+				continue;
+			}
+			pending++;
+		}
+
+		if (!pending)
+			break;
+		time_wait_ms(100);
 	}
 
-	/* Clear error status */
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_STAT, 0xffff);
-	return true;
+	return ready;
 }
 
-/* Clear up bridge resources */
-static void pci_cleanup_bridge(struct phb *phb, struct pci_device *pd)
+/* pci_enable_bridges - Called before scanning the bridges of a bus
+ *
+ * Ensures error flags are clean, disable master abort, and
+ * check if the subordinate bus isn't reset, the slot is enabled
+ * on PCIe, etc... Returns an array of @count entries, one per bridge
+ * in @list, in order.
+ */
+static struct pci_bridge_enable *pci_enable_bridges(struct phb *phb,
+						    struct list_head *list,
+						    unsigned int *count)
 {
-	uint16_t cmd;
+	struct pci_bridge_enable *be;
+	struct pci_device *pd;
+	unsigned int i, n = 0;
+	bool settle = false, was_reset = false, training = false;
+	uint64_t start = mftb(), ready;
 
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_IO_BASE_U16, 0xffff);
-	pci_cfg_write8(phb, pd->bdfn, PCI_CFG_IO_BASE, 0xf0);
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_IO_LIMIT_U16, 0);
-	pci_cfg_write8(phb, pd->bdfn, PCI_CFG_IO_LIMIT, 0);
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_MEM_BASE, 0xfff0);
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_MEM_LIMIT, 0);
-	pci_cfg_write32(phb, pd->bdfn, PCI_CFG_PREF_MEM_BASE_U32, 0xffffffff);
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_PREF_MEM_BASE, 0xfff0);
-	pci_cfg_write32(phb, pd->bdfn, PCI_CFG_PREF_MEM_LIMIT_U32, 0);
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_PREF_MEM_LIMIT, 0);
+	list_for_each(list, pd, link) {
+		if (pd->is_bridge)
+			n++;
+	}
+	*count = n;
+	if (!n)
+		return NULL;
 
-	/* Note: This is a bit fishy but since we have closed all the
-	 * bridge windows above, it shouldn't be a problem. Basically
-	 * we enable Memory, IO and Bus Master on the bridge because
-	 * some versions of Linux will fail to do it themselves.
-	 */
-	pci_cfg_read16(phb, pd->bdfn, PCI_CFG_CMD, &cmd);
-	cmd |= PCI_CFG_CMD_IO_EN | PCI_CFG_CMD_MEM_EN;
-	cmd |= PCI_CFG_CMD_BUS_MASTER_EN;
-	pci_cfg_write16(phb, pd->bdfn, PCI_CFG_CMD, cmd);	
+	be = zalloc(n * sizeof(*be));
+	assert(be);
+
+	i = 0;
+	list_for_each(list, pd, link) {
+		if (!pd->is_bridge)
+			continue;
+		be[i].pd = pd;
+
+		/* Clear up bridge resources */
+		pci_cleanup_bridge(phb, pd);
+
+		/* Configure the bridge. This will enable power to the slot
+		 * if it's currently disabled, etc...
+		 */
+		pci_bridge_enable_start(phb, &be[i]);
+		settle |= be[i].settle;
+		i++;
+	}
+
+	/* Wait a couple of seconds for slot power, once for all of them */
+	if (settle)
+		time_wait_ms(2000);
+
+	/* Enable links and lift resets */
+	for (i = 0; i < n; i++) {
+		if (be[i].state != PCI_BRIDGE_ENABLING)
+			continue;
+		pci_bridge_enable_reset(phb, &be[i]);
+		was_reset |= be[i].was_reset;
+	}
+	if (was_reset)
+		time_wait_ms(1000);
+
+	/* PCI-E bridge, wait for link */
+	for (i = 0; i < n; i++) {
+		if (be[i].state != PCI_BRIDGE_ENABLING)
+			continue;
+		if (be[i].pd->dev_type == PCIE_TYPE_ROOT_PORT ||
+		    be[i].pd->dev_type == PCIE_TYPE_SWITCH_DNPORT) {
+			be[i].state = PCI_BRIDGE_TRAINING;
+			training = true;
+		}
+	}
+	if (training) {
+		ready = pci_bridges_wait_links(phb, be, n);
+		if (tb_compare(mftb(), ready) == TB_ABEFOREB)
+			time_wait(ready - mftb());
+	}
+
+	for (i = 0; i < n; i++) {
+		if (be[i].state != PCI_BRIDGE_ENABLING)
+			continue;
+
+		/* Clear error status */
+		pci_cfg_write16(phb, be[i].pd->bdfn, PCI_CFG_STAT, 0xffff);
+		be[i].state = PCI_BRIDGE_READY;
+	}
+
+	PCIDBG(phb, be[0].pd->bdfn & 0xff00, "%u bridge(s) enabled in %lu ms\n",
+	       n, tb_to_msecs(mftb() - start));
+
+	return be;
 }
 
 /* Remove all subordinate PCI devices leading from the indicated
@@ -673,6 +901,7 @@ static void pci_cleanup_bridge(struct phb *phb, struct pci_device *pd)
 void pci_remove_bus(struct phb *phb, struct list_head *list)
 {
 	struct pci_device *pd, *tmp;
+	struct pci_cfg_reg_filter *pcrf;
 
 	list_for_each_safe(list, pd, tmp, link) {
 		pci_remove_bus(phb, &pd->children);
@@ -686,8 +915,15 @@ void pci_remove_bus(struct phb *phb, struct list_head *list)
 		if (pd->slot)
 			free(pd->slot);
 
+		/* And the config filters, a new device may get its BDFN */
+		while ((pcrf = list_pop(&pd->pcrf, struct pci_cfg_reg_filter,
+					link)) != NULL)
+			free(pcrf);
+		bitmap_clr_bit(*phb->filter_map, pd->bdfn);
+
 		/* Remove from parent list and release itself */
 		list_del(&pd->link);
+		pci_dev_map_set(phb, pd->bdfn, NULL);
 		free(pd);
 	}
 }
@@ -741,7 +977,9 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 		     bool scan_downstream)
 {
 	struct pci_device *pd = NULL, *rc = NULL;
+	struct pci_bridge_enable *bridges;
 	uint8_t dev, fn, next_bus, max_sub;
+	unsigned int i, count;
 	uint32_t scan_map;
 
 	/* Decide what to scan  */
@@ -807,12 +1045,12 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 	next_bus = bus + 1;
 	max_sub = bus;
 
-	/* Scan down bridges */
-	list_for_each(list, pd, link) {
-		bool do_scan;
+	/* Bring up all the links at once, then scan down bridges */
+	bridges = pci_enable_bridges(phb, list, &count);
+	for (i = 0; i < count; i++) {
+		uint64_t start = mftb();
 
-		if (!pd->is_bridge)
-			continue;
+		pd = bridges[i].pd;
 
 		/* Configure the bridge with the returned values */
 		if (next_bus <= bus) {
@@ -830,18 +1068,10 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 		PCIDBG(phb, pd->bdfn, "Bus %02x..%02x scanning...\n",
 		       next_bus, max_bus);
 
-		/* Clear up bridge resources */
-		pci_cleanup_bridge(phb, pd);
-
-		/* Configure the bridge. This will enable power to the slot
-		 * if it's currently disabled, lift reset, etc...
-		 *
-		 * Return false if we know there's nothing behind the bridge
+		/* Perform recursive scan, unless we know there's nothing
+		 * behind the bridge
 		 */
-		do_scan = pci_enable_bridge(phb, pd);
-
-		/* Perform recursive scan */
-		if (do_scan) {
+		if (bridges[i].state == PCI_BRIDGE_READY) {
 			max_sub = pci_scan_bus(phb, next_bus, max_bus,
 					       &pd->children, pd, true);
 		} else {
@@ -864,7 +1094,11 @@ uint8_t pci_scan_bus(struct phb *phb, uint8_t bus, uint8_t max_bus,
 		/* power off the slot if there's nothing below it */
 		if (list_empty(&pd->children))
 			pci_slot_set_power_state(phb, pd, PCI_SLOT_POWER_OFF);
+
+		PCIDBG(phb, pd->bdfn, "Bus %02x..%02x scanned in %lu ms\n",
+		       pd->secondary_bus, max_sub, tb_to_msecs(mftb() - start));
 	}
+	free(bridges);
 
 	return max_sub;
 }
@@ -962,6 +1196,7 @@ static void pci_reset_phb(void *data)
 {
 	struct phb *phb = data;
 	struct pci_slot *slot = phb->slot;
+	uint64_t start = mftb();
 	int64_t rc;
 
 	if (!slot || !slot->ops.run_sm) {
@@ -979,6 +1214,9 @@ static void pci_reset_phb(void *data)
 	pci_slot_remove_flags(slot, PCI_SLOT_FLAG_BOOTUP);
 	if (rc < 0)
 		PCIDBG(phb, 0, "Error %lld resetting\n", rc);
+
+	PCINOTICE(phb, 0, "Reset and link training took %lu ms (chip %d)\n",
+		  tb_to_msecs(mftb() - start), this_cpu()->chip_id);
 }
 
 static void pci_scan_phb(void *data)
@@ -987,6 +1225,7 @@ static void pci_scan_phb(void *data)
 	struct pci_slot *slot = phb->slot;
 	uint8_t link;
 	uint32_t mps = 0xffffffff;
+	uint64_t start = mftb();
 	int64_t rc;
 
 	if (!slot || !slot->ops.get_link_state) {
@@ -1015,6 +1254,9 @@ static void pci_scan_phb(void *data)
 	pci_walk_dev(phb, NULL, pci_get_mps, &mps);
 	phb->mps = mps;
 	pci_walk_dev(phb, NULL, pci_configure_mps, NULL);
+
+	PCINOTICE(phb, 0, "Probing took %lu ms (chip %d)\n",
+		  tb_to_msecs(mftb() - start), this_cpu()->chip_id);
 }
 
 int64_t pci_register_phb(struct phb *phb, int opal_id)
@@ -1053,6 +1295,7 @@ int64_t pci_register_phb(struct phb *phb, int opal_id)
 
 	phb->filter_map = zalloc(BITMAP_BYTES(0x10000));
 	assert(phb->filter_map);
+	memset(phb->dev_map, 0, sizeof(phb->dev_map));
 
 	return OPAL_SUCCESS;
 }
@@ -1667,34 +1910,44 @@ void __noinline pci_add_device_nodes(struct phb *phb,
 
 static void pci_do_jobs(void (*fn)(void *))
 {
-	struct cpu_job **jobs;
-	int i;
-
-	jobs = zalloc(sizeof(struct cpu_job *) * ARRAY_SIZE(phbs));
-	assert(jobs);
-	for (i = 0; i < ARRAY_SIZE(phbs); i++) {
-		if (!phbs[i]) {
-			jobs[i] = NULL;
-			continue;
-		}
+	struct cpu_job_group grp;
+	struct phb *phb;
+	uint32_t chip_id;
+	bool queued;
+	int i, pass;
 
-		jobs[i] = __cpu_queue_job(NULL, phbs[i]->dt_node->name,
-					  fn, phbs[i], false);
-		assert(jobs[i]);
+	cpu_job_group_init(&grp);
 
+	/*
+	 * Keep each PHB's config and MMIO traffic on its own chip. A job
+	 * for our own chip may end up running synchronously if there is
+	 * no other CPU there, so queue the other chips' first.
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < ARRAY_SIZE(phbs); i++) {
+			phb = phbs[i];
+			if (!phb)
+				continue;
+
+			chip_id = __dt_get_chip_id(phb->dt_node);
+			if ((chip_id == this_cpu()->chip_id) != pass)
+				continue;
+
+			if (chip_id != 0xffffffff)
+				queued = cpu_job_group_queue_on_node(&grp, chip_id,
+						phb->dt_node->name, fn, phb);
+			else
+				queued = cpu_job_group_queue(&grp, NULL,
+						phb->dt_node->name, fn, phb);
+			assert(queued);
+		}
 	}
 
 	/* If no secondary CPUs, do everything sync */
 	cpu_process_local_jobs();
 
 	/* Wait until all tasks are done */
-	for (i = 0; i < ARRAY_SIZE(phbs); i++) {
-		if (!jobs[i])
-			continue;
-
-		cpu_wait_job(jobs[i], true);
-	}
-	free(jobs);
+	cpu_job_group_wait(&grp);
 }
 
 static void __pci_init_slots(void)
@@ -1773,6 +2026,8 @@ int64_t pci_reset(void)
 		if (!phb)
 			continue;
 		__pci_reset(&phb->devices);
+		pci_dev_map_clear(phb);
+		memset(phb->filter_map, 0, BITMAP_BYTES(0x10000));
 
 		pci_slot_set_state(phb->slot, PCI_SLOT_STATE_CRESET_START);
 	}
@@ -1840,23 +2095,11 @@ struct pci_device *pci_walk_dev(struct phb *phb,
 	return __pci_walk_dev(phb, &phb->devices, cb, userdata);
 }
 
-static int __pci_find_dev(struct phb *phb,
-			  struct pci_device *pd, void *userdata)
-{
-	uint16_t bdfn = *((uint16_t *)userdata);
-
-	if (!phb || !pd)
-		return 0;
-
-	if (pd->bdfn == bdfn)
-		return 1;
-
-	return 0;
-}
-
 struct pci_device *pci_find_dev(struct phb *phb, uint16_t bdfn)
 {
-	return pci_walk_dev(phb, NULL, __pci_find_dev, &bdfn);
+	struct pci_device **bus = phb->dev_map[PCI_BUS_NUM(bdfn)];
+
+	return bus ? bus[bdfn & 0xff] : NULL;
 }
 
 static int __pci_restore_bridge_buses(struct phb *phb,
@@ -183,6 +183,17 @@ static int generic_start_preload_resource(enum resource_id id, uint32_t subid,
 	return OPAL_EMPTY;
 }
 
+static int generic_start_preload_resource_xz(enum resource_id id,
+					     uint32_t subid, void *buf,
+					     size_t *len,
+					     struct xz_decompress *xz)
+{
+	if (dt_find_by_path(dt_root, "bmc"))
+		return flash_start_preload_resource_xz(id, subid, buf, len, xz);
+
+	return OPAL_EMPTY;
+}
+
 /* These values will work for a ZZ booted using BML */
 static const struct platform_ocapi generic_ocapi = {
 	.i2c_engine          = 1,
@@ -214,6 +225,7 @@ static struct platform generic_platform = {
 	.nvram_write	= fake_nvram_write,
 	.cec_power_down	= generic_cec_power_down,
 	.start_preload_resource	= generic_start_preload_resource,
+	.start_preload_resource_xz = generic_start_preload_resource_xz,
 	.resource_loaded	= generic_resource_loaded,
 	.ocapi		= &generic_ocapi,
 	.npu2_device_detect = npu2_i2c_presence_detect, /* Assumes ZZ */
@@ -275,6 +287,25 @@ int start_preload_resource(enum resource_id id, uint32_t subid,
 	return platform.start_preload_resource(id, subid, buf, len);
 }
 
+/*
+ * As start_preload_resource(), also decompressing the resource into xz->dst
+ * while it's read if the platform can. Otherwise xz->status is left as
+ * OPAL_EMPTY and it's up to the caller to decompress it once it's loaded.
+ */
+int start_preload_resource_xz(enum resource_id id, uint32_t subid,
+			      void *buf, size_t *len, struct xz_decompress *xz)
+{
+	xz->status = OPAL_EMPTY;
+	xz->job = NULL;
+	xz->streaming = false;
+
+	if (platform.start_preload_resource_xz)
+		return platform.start_preload_resource_xz(id, subid, buf,
+							  len, xz);
+
+	return start_preload_resource(id, subid, buf, len);
+}
+
 int resource_loaded(enum resource_id id, uint32_t idx)
 {
 	if (!platform.resource_loaded)
@@ -289,6 +320,9 @@ int wait_for_resource_loaded(enum resource_id id, uint32_t idx)
 	int waited = 0;
 
 	while(r == OPAL_BUSY) {
+		/* The load may be waiting on a job queued here */
+		if (cpu_check_jobs(this_cpu()))
+			cpu_process_jobs();
 		opal_run_pollers();
 		r = resource_loaded(id, idx);
 		if (r != OPAL_BUSY)
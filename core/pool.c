@@ -13,10 +13,19 @@
  *    pool if there are less than the reserved number of allocations
  *    available.
  *
+ * On top of that, pool caches provide unbounded, lock-free (in the common
+ * case) allocation of small fixed size objects: each CPU keeps a
+ * magazine of free objects and only touches the shared depot, under the
+ * cache lock, to exchange a batch of them. The depot grows from the heap
+ * a slab at a time so the heap lock is taken once per batch.
+ *
  * Copyright 2013-2014 IBM Corp.
  */
 
+#include <skiboot.h>
 #include <pool.h>
+#include <cpu.h>
+#include <lock.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ccan/list/list.h>
@@ -66,3 +75,215 @@ int pool_init(struct pool *pool, size_t obj_size, int count, int reserved)
 
 	return 0;
 }
+
+static struct lock pool_caches_lock = LOCK_UNLOCKED;
+static LIST_HEAD(pool_caches);
+static int pool_caches_count;
+
+static void pool_cache_register(struct pool_cache *cache)
+{
+	lock(&pool_caches_lock);
+	if (!cache->registered) {
+		assert(cache->batch && cache->batch <= POOL_MAG_SIZE);
+		if (cache->obj_size < sizeof(struct list_node))
+			cache->obj_size = sizeof(struct list_node);
+		cache->obj_size = ALIGN_UP(cache->obj_size, sizeof(long));
+
+		/* Without a magazine slot we just always use the depot */
+		if (pool_caches_count < POOL_CACHE_MAX)
+			cache->index = pool_caches_count++;
+		else
+			prlog(PR_WARNING, "POOL: No per-CPU magazines for %s\n",
+			      cache->name);
+		list_add_tail(&pool_caches, &cache->link);
+		/* pool_cache_get() checks this without the lock */
+		lwsync();
+		cache->registered = true;
+	}
+	unlock(&pool_caches_lock);
+}
+
+static struct pool_magazine *pool_cache_mag(struct pool_cache *cache)
+{
+	struct cpu_thread *cpu = this_cpu();
+	struct pool_magazine *mag;
+
+	if (cache->index < 0)
+		return NULL;
+
+	mag = cpu->pool_mags[cache->index];
+	if (mag)
+		return mag;
+
+	mag = calloc(1, sizeof(*mag));
+	if (!mag)
+		return NULL;
+
+	lock(&cache->lock);
+	list_add_tail(&cache->mags, &mag->link);
+	unlock(&cache->lock);
+
+	cpu->pool_mags[cache->index] = mag;
+	return mag;
+}
+
+/*
+ * Carve a new slab of cache->batch objects out of the heap. They go
+ * straight into the (empty) magazine if we have one, otherwise all but
+ * the returned one go into the depot.
+ */
+static void *pool_cache_grow(struct pool_cache *cache,
+			     struct pool_magazine *mag)
+{
+	void *slab, *obj;
+	unsigned int i;
+
+	/* Not under cache->lock, a failing malloc() dumps the caches */
+	slab = malloc(cache->obj_size * cache->batch);
+	if (!slab)
+		return NULL;
+
+	lock(&cache->lock);
+	for (i = 1; i < cache->batch; i++) {
+		obj = slab + cache->obj_size * i;
+		if (mag)
+			mag->objs[mag->count++] = obj;
+		else {
+			list_add_tail(&cache->depot, (struct list_node *)obj);
+			cache->depot_count++;
+		}
+	}
+	cache->total += cache->batch;
+	cache->slabs++;
+	unlock(&cache->lock);
+
+	return slab;
+}
+
+/* Move up to a batch of objects from the depot into an empty magazine */
+static bool pool_cache_refill(struct pool_cache *cache,
+			      struct pool_magazine *mag)
+{
+	void *obj;
+
+	lock(&cache->lock);
+	while (mag->count < cache->batch) {
+		obj = (void *)list_pop_(&cache->depot, 0);
+		if (!obj)
+			break;
+		cache->depot_count--;
+		mag->objs[mag->count++] = obj;
+	}
+	if (mag->count)
+		cache->refills++;
+	unlock(&cache->lock);
+
+	if (!mag->count) {
+		obj = pool_cache_grow(cache, mag);
+		if (!obj)
+			return false;
+		mag->objs[mag->count++] = obj;
+	}
+
+	return true;
+}
+
+/* Give a batch of objects from a full magazine back to the depot */
+static void pool_cache_drain(struct pool_cache *cache,
+			     struct pool_magazine *mag)
+{
+	unsigned int i;
+
+	lock(&cache->lock);
+	for (i = 0; i < cache->batch; i++)
+		list_add(&cache->depot,
+			 (struct list_node *)mag->objs[--mag->count]);
+	cache->depot_count += cache->batch;
+	cache->drains++;
+	unlock(&cache->lock);
+}
+
+void *pool_cache_get(struct pool_cache *cache)
+{
+	struct pool_magazine *mag;
+	void *obj;
+
+	if (!cache->registered)
+		pool_cache_register(cache);
+	else
+		lwsync(); /* Pairs with pool_cache_register() */
+
+	mag = pool_cache_mag(cache);
+	if (mag) {
+		if (!mag->count && !pool_cache_refill(cache, mag))
+			return NULL;
+		obj = mag->objs[--mag->count];
+		mag->allocs++;
+	} else {
+		lock(&cache->lock);
+		obj = (void *)list_pop_(&cache->depot, 0);
+		if (obj)
+			cache->depot_count--;
+		unlock(&cache->lock);
+		if (!obj)
+			obj = pool_cache_grow(cache, NULL);
+		if (!obj)
+			return NULL;
+	}
+
+	memset(obj, 0, cache->obj_size);
+	return obj;
+}
+
+void pool_cache_put(struct pool_cache *cache, void *obj)
+{
+	struct pool_magazine *mag;
+
+	if (!obj)
+		return;
+
+	assert(cache->registered);
+
+	mag = pool_cache_mag(cache);
+	if (!mag) {
+		lock(&cache->lock);
+		list_add(&cache->depot, (struct list_node *)obj);
+		cache->depot_count++;
+		unlock(&cache->lock);
+		return;
+	}
+
+	if (mag->count == POOL_MAG_SIZE)
+		pool_cache_drain(cache, mag);
+	mag->objs[mag->count++] = obj;
+	mag->frees++;
+}
+
+void pool_cache_dump(void)
+{
+	struct pool_cache *cache;
+	struct pool_magazine *mag;
+
+	lock(&pool_caches_lock);
+	if (!list_empty(&pool_caches))
+		prlog(PR_NOTICE, "Pool caches:\n");
+	list_for_each(&pool_caches, cache, link) {
+		unsigned long allocs = 0, frees = 0, cached = 0, nr_mags = 0;
+
+		/* Magazine counters are only read here, don't lock them */
+		list_for_each(&cache->mags, mag, link) {
+			allocs += mag->allocs;
+			frees += mag->frees;
+			cached += mag->count;
+			nr_mags++;
+		}
+		prlog(PR_NOTICE, "  %-16s 0x%.4zx bytes: %lu objs in %lu slabs,"
+		      " %lu in depot, %lu in %lu magazines\n",
+		      cache->name, cache->obj_size, cache->total,
+		      cache->slabs, cache->depot_count, cached, nr_mags);
+		prlog(PR_NOTICE, "  %-16s %lu allocs, %lu frees, %lu refills,"
+		      " %lu drains\n", "", allocs, frees, cache->refills,
+		      cache->drains);
+	}
+	unlock(&pool_caches_lock);
+}
@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Single threaded lock stubs, for tests which include code taking locks.
+ * They still catch a lock taken twice or released when it isn't held.
+ *
+ * Copyright 2019 IBM Corp.
+ */
+
+#include <assert.h>
+#include <lock.h>
+
+void lock_caller(struct lock *l, const char *caller)
+{
+	(void)caller;
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
@@ -3,6 +3,10 @@
  * Copyright 2019 IBM Corp.
  */
 
+#define __TEST__
+
+static inline unsigned long mfspr(unsigned int spr);
+
 #include <skiboot.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,9 +29,7 @@ static inline bool fake_is_rodata(const void *p)
 #include <assert.h>
 #include "../../test/dt_common.c"
 
-#define __TEST__
-
-static inline unsigned long mfspr(unsigned int spr);
+#include "lock-stubs.c"
 
 #include <ccan/str/str.c>
 
@@ -5,6 +5,9 @@
 
 #include <skiboot.h>
 #include <stdlib.h>
+#include <malloc.h>
+#include <time.h>
+#include <skiboot-valgrind.h>
 
 /* Override this for testing. */
 #define is_rodata(p) fake_is_rodata(p)
@@ -22,6 +25,8 @@ static inline bool fake_is_rodata(const void *p)
 #include "../device.c"
 #include <assert.h>
 #include "../../test/dt_common.c"
+
+#include "lock-stubs.c"
 const char *prop_to_fix[] = {"something", NULL};
 const char **props_to_fix(struct dt_node *node);
 
@@ -90,6 +95,297 @@ const char **props_to_fix(struct dt_node *node)
 	return NULL;
 }
 
+/* Reference lookups, as done before the indexes */
+static struct dt_node *linear_find_by_phandle(struct dt_node *root,
+					      u32 phandle)
+{
+	struct dt_node *node;
+
+	dt_for_each_node(root, node)
+		if (node->phandle == phandle)
+			return node;
+	return NULL;
+}
+
+static struct dt_node *linear_find_child(struct dt_node *parent,
+					 const char *name)
+{
+	struct dt_node *node;
+
+	dt_for_each_child(parent, node)
+		if (!strcmp(node->name, name))
+			return node;
+	return NULL;
+}
+
+static const struct dt_property *linear_find_property(struct dt_node *node,
+						      const char *name)
+{
+	const struct dt_property *p;
+
+	list_for_each(&node->properties, p, list)
+		if (!strcmp(p->name, name))
+			return p;
+	return NULL;
+}
+
+/* The indexes must follow nodes and properties coming and going */
+static void test_index(void)
+{
+	struct dt_node *root, *n, *gone;
+	struct dt_property *p;
+	u32 phandle;
+	char name[32];
+	int i;
+
+	root = dt_new_root("");
+	for (i = 0; i < DT_INDEX_MIN * 4; i++) {
+		snprintf(name, sizeof(name), "n@%x", i);
+		n = dt_new(root, name);
+		assert(n);
+		snprintf(name, sizeof(name), "p%d", i);
+		dt_add_property_cells(root, name, i);
+	}
+	assert(root->child_index && root->prop_index);
+	assert(root->nr_children == DT_INDEX_MIN * 4);
+	assert(root->nr_props == DT_INDEX_MIN * 4);
+
+	/* Out of order insertion takes the slow path, still indexed */
+	n = dt_new(root, "a");
+	assert(n && dt_first(root) == n);
+	assert(dt_find_by_path(root, "/a") == n);
+	assert(!dt_new(root, "a"));
+
+	/* Exact names come from the index, partial ones still work */
+	n = dt_find_by_path(root, "/n@2a");
+	assert(n && !strcmp(n->name, "n@2a"));
+	assert(dt_find_by_path(root, "/n") == linear_find_child(root, "n@0"));
+	assert(dt_find_by_path(root, "/@2a") == n);
+	assert(!dt_find_by_path(root, "/n@1000"));
+	assert(dt_find_by_phandle(root, n->phandle) == n);
+
+	gone = n;
+	dt_free(gone);
+	assert(!dt_find_by_path(root, "/n@2a"));
+	assert(root->nr_children == DT_INDEX_MIN * 4);
+	n = dt_new(root, "n@2a");
+	assert(dt_find_by_path(root, "/n@2a") == n);
+
+	/* phandles move with the property, and can't be found elsewhere */
+	phandle = 0x4242;
+	dt_add_property(n, "phandle", &phandle, sizeof(phandle));
+	assert(dt_find_by_phandle(root, 0x4242) == n);
+	assert(!dt_find_by_phandle(n, 0x4242));
+
+	/* Deleting and resizing properties keeps the index intact */
+	p = __dt_find_property(root, "p7");
+	assert(p && dt_property_get_cell(p, 0) == 7);
+	dt_del_property(root, p);
+	assert(!dt_find_property(root, "p7"));
+	p = __dt_find_property(root, "p8");
+	dt_resize_property(&p, 4096);
+	assert(dt_find_property(root, "p8") == p);
+	for (i = 0; i < DT_INDEX_MIN * 4; i++) {
+		snprintf(name, sizeof(name), "p%d", i);
+		assert(dt_find_property(root, name) ==
+		       linear_find_property(root, name));
+	}
+	dt_add_property_cells(root, "p7", 7);
+	assert(dt_prop_get_u32(root, "p7") == 7);
+
+	dt_free(root);
+}
+
+/* Everything comes out of, and goes back to, the arena */
+static void test_arena(void)
+{
+	struct dt_node *root, *a, *b;
+	struct dt_property *pa, *pb, *big, *p;
+	unsigned long live;
+	char val[1024];
+
+	assert(!dt_arena_live && !dt_arena_slabs);
+
+	root = dt_new_root("");
+	a = dt_new(root, "a@1");
+	b = dt_new(root, "b@2");
+	assert(a->name == (const char *)(a + 1));
+
+	/* Property names are shared */
+	pa = dt_add_property_cells(a, "interned", 1);
+	pb = dt_add_property_cells(b, "interned", 2);
+	assert(pa->name == pb->name);
+
+	/* Growing into the slack doesn't move a property, more does */
+	assert(pa->size >= 4 && pa->size < DT_ARENA_MAX);
+	p = pa;
+	dt_resize_property(&pa, pa->size);
+	assert(pa == p);
+	dt_resize_property(&pa, DT_ARENA_MAX);
+	assert(pa->size >= DT_ARENA_MAX);
+	assert(dt_find_property(a, "interned") == pa);
+	assert(dt_prop_get_u32(a, "interned") == 1);
+
+	/* Big ones come from the heap */
+	memset(val, 0x5a, sizeof(val));
+	big = dt_add_property(a, "big", val, sizeof(val));
+	assert(big->size == sizeof(val));
+	assert(!memcmp(dt_prop_get(a, "big"), val, sizeof(val)));
+
+	/* Names go once the last property using them does */
+	dt_del_property(a, pa);
+	assert(streq(pb->name, "interned"));
+	dt_free(b);
+	assert(!dt_name_lookup("interned", dt_hash_str("interned")));
+
+	/* Freed objects get reused */
+	live = dt_arena_live;
+	b = dt_new(root, "b@2");
+	dt_add_property_cells(b, "interned", 2);
+	dt_free(b);
+	assert(dt_arena_live == live);
+
+	dt_free(root);
+	assert(!dt_arena_live && !dt_arena_slabs);
+}
+
+#define BENCH_MIDS	1000
+#define BENCH_LEAVES	100
+#define BENCH_PROPS	(DT_INDEX_MIN + 4)
+#define BENCH_LOOKUPS	1000
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* What glibc takes for one allocation of @size bytes */
+static size_t malloc_chunk(size_t size)
+{
+	size = ALIGN_UP(size + sizeof(size_t), 16);
+	return size < 32 ? 32 : size;
+}
+
+/* Heap used by @root with a malloc() per node, property and name */
+static size_t per_object_heap(struct dt_node *root)
+{
+	const struct dt_property *p;
+	struct dt_node *n;
+	size_t sz = 0;
+
+	dt_for_each_node(root, n) {
+		sz += malloc_chunk(sizeof(*n));
+		if (!is_rodata(n->name))
+			sz += malloc_chunk(strlen(n->name) + 1);
+		list_for_each(&n->properties, p, list) {
+			sz += malloc_chunk(sizeof(*p) + p->len);
+			if (!is_rodata(p->name))
+				sz += malloc_chunk(strlen(p->name) + 1);
+		}
+	}
+	return sz;
+}
+
+/* Lookups on a 100k node tree, with and without the indexes */
+static struct dt_node *found[BENCH_LOOKUPS];
+static u32 phandles[BENCH_LOOKUPS];
+
+static void bench_index(void)
+{
+	struct dt_node *root, *mid, *n;
+	const struct dt_property *p;
+	char path[64], name[32];
+	double t, fast, slow;
+	size_t heap;
+	int i, j, lookups;
+
+	/* The linear lookups are slow enough already */
+	lookups = RUNNING_ON_VALGRIND ? 10 : BENCH_LOOKUPS;
+
+	heap = mallinfo2().uordblks;
+	t = now_usecs();
+	root = dt_new_root("");
+	for (i = 0; i < BENCH_MIDS; i++) {
+		snprintf(name, sizeof(name), "mid@%x", i);
+		mid = dt_new(root, name);
+		for (j = 0; j < BENCH_PROPS; j++) {
+			snprintf(name, sizeof(name), "prop-%d", j);
+			dt_add_property_cells(mid, name, j);
+		}
+		for (j = 0; j < BENCH_LEAVES; j++) {
+			n = dt_new_addr(mid, "leaf", j);
+			dt_add_property_string(n, "compatible", "leaf");
+		}
+	}
+	printf("DT bench: built %d nodes in %.0f us\n",
+	       BENCH_MIDS * (BENCH_LEAVES + 1), now_usecs() - t);
+	heap = mallinfo2().uordblks - heap;
+	if (!RUNNING_ON_VALGRIND)
+		printf("DT bench: %zu KB of heap, %zu KB with one allocation "
+		       "per object\n", heap >> 10, per_object_heap(root) >> 10);
+
+	for (i = 0; i < lookups; i++) {
+		snprintf(path, sizeof(path), "/mid@%x/leaf@%x",
+			 rand() % BENCH_MIDS, rand() % BENCH_LEAVES);
+		found[i] = dt_find_by_path(root, path);
+		assert(found[i]);
+		phandles[i] = found[i]->phandle;
+	}
+
+	t = now_usecs();
+	for (i = 0; i < lookups; i++)
+		assert(dt_find_by_phandle(root, phandles[i]) == found[i]);
+	fast = now_usecs() - t;
+	t = now_usecs();
+	for (i = 0; i < lookups; i++)
+		assert(linear_find_by_phandle(root, phandles[i]) == found[i]);
+	slow = now_usecs() - t;
+	printf("DT bench: phandle: %.3f us indexed, %.3f us linear, %.0fx\n",
+	       fast / lookups, slow / lookups, slow / fast);
+
+	t = now_usecs();
+	for (i = 0; i < lookups; i++) {
+		snprintf(name, sizeof(name), "mid@%x", i % BENCH_MIDS);
+		mid = dt_find_by_path(root, name);
+		assert(mid);
+		n = dt_find_by_path(mid, found[i]->name);
+		assert(n == found[i] || n->parent != found[i]->parent);
+	}
+	fast = now_usecs() - t;
+	t = now_usecs();
+	for (i = 0; i < lookups; i++) {
+		snprintf(name, sizeof(name), "mid@%x", i % BENCH_MIDS);
+		mid = linear_find_child(root, name);
+		assert(mid);
+		n = linear_find_child(mid, found[i]->name);
+		assert(n == found[i] || n->parent != found[i]->parent);
+	}
+	slow = now_usecs() - t;
+	printf("DT bench: path: %.3f us indexed, %.3f us linear, %.0fx\n",
+	       fast / lookups, slow / lookups, slow / fast);
+
+	snprintf(name, sizeof(name), "prop-%d", BENCH_PROPS - 1);
+	t = now_usecs();
+	dt_for_each_child(root, mid) {
+		p = dt_find_property(mid, name);
+		assert(p && dt_property_get_cell(p, 0) == BENCH_PROPS - 1);
+	}
+	fast = now_usecs() - t;
+	t = now_usecs();
+	dt_for_each_child(root, mid)
+		assert(linear_find_property(mid, name));
+	slow = now_usecs() - t;
+	printf("DT bench: property: %.3f us indexed, %.3f us linear, %.1fx\n",
+	       fast / BENCH_MIDS, slow / BENCH_MIDS, slow / fast);
+
+	t = now_usecs();
+	dt_free(root);
+	printf("DT bench: freed in %.0f us\n", now_usecs() - t);
+}
+
 int main(void)
 {
 	struct dt_node *root, *other_root, *c1, *c2, *c2_c, *gc1, *gc2, *gc3, *ggc1, *ggc2;
@@ -389,6 +685,7 @@ int main(void)
 	assert(dt_attach_root(root, other_root));
 	other_root = dt_new_root("other_root");
 	assert(!dt_attach_root(root, other_root));
+	dt_free(other_root);
 	dt_free(root);
 
 	/* Test child node sorting */
@@ -466,6 +763,10 @@ int main(void)
 	new_prop_ph = dt_prop_get_u32(ut2, "something");
 	assert(!(new_prop_ph == ev1_ph));
 	dt_free(subtree);
+
+	test_index();
+	bench_index();
+	test_arena();
 	return 0;
 }
 
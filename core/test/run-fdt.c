@@ -0,0 +1,322 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ */
+
+#include <skiboot.h>
+#include <stdlib.h>
+#include <time.h>
+#include <skiboot-valgrind.h>
+
+/* Override this for testing. */
+#define is_rodata(p) fake_is_rodata(p)
+
+char __rodata_start[16];
+#define __rodata_end (__rodata_start + sizeof(__rodata_start))
+
+static inline bool fake_is_rodata(const void *p)
+{
+	return ((char *)p >= __rodata_start && (char *)p < __rodata_end);
+}
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+#define __CPU_H
+struct cpu_thread {
+	uint32_t pir;
+};
+
+#include "../device.c"
+#include "../fdt.c"
+#include "../../libfdt/fdt.c"
+#include "../../libfdt/fdt_ro.c"
+#include "../../libfdt/fdt_sw.c"
+#include "../../libfdt/fdt_strerror.c"
+#include <assert.h>
+
+u64 top_of_ram = -1ul;
+
+#include "lock-stubs.c"
+
+/* The old way of doing it, through libfdt */
+#define REF_FDT_SIZE	0x4000000
+
+static void ref_flatten(void *fdt, const struct dt_node *dn, bool exclusive)
+{
+	const struct dt_property *p;
+	const struct dt_node *child;
+
+	if (!exclusive) {
+		assert(!fdt_begin_node(fdt, dn->name));
+		assert(!fdt_property_cell(fdt, "phandle", dn->phandle));
+		list_for_each(&dn->properties, p, list) {
+			if (strstarts(p->name, DT_PRIVATE))
+				continue;
+			assert(!fdt_property(fdt, p->name, p->prop, p->len));
+		}
+	}
+
+	list_for_each(&dn->children, child, list)
+		ref_flatten(fdt, child, false);
+
+	if (!exclusive)
+		assert(!fdt_end_node(fdt));
+}
+
+static void *ref_dtb(const struct dt_node *root, bool exclusive)
+{
+	const struct dt_property *ranges = NULL;
+	const __be64 *r;
+	void *fdt = malloc(REF_FDT_SIZE);
+	unsigned int i;
+
+	assert(fdt);
+	assert(!fdt_create(fdt, REF_FDT_SIZE));
+	if (root == dt_root && !exclusive)
+		ranges = dt_find_property(root, "reserved-ranges");
+	if (ranges) {
+		r = (const void *)ranges->prop;
+		for (i = 0; i < ranges->len / 16; i++, r += 2)
+			assert(!fdt_add_reservemap_entry(fdt, be64_to_cpu(r[0]),
+							 be64_to_cpu(r[1])));
+	}
+	assert(!fdt_finish_reservemap(fdt));
+	ref_flatten(fdt, root, exclusive);
+	assert(!fdt_finish(fdt));
+	return fdt;
+}
+
+/* Same tags, names and values, wherever the strings ended up */
+static void check_same(const void *a, const void *b)
+{
+	const struct fdt_property *pa, *pb;
+	uint64_t aa, as, ba, bs;
+	int oa = 0, ob = 0, na, nb, i;
+	uint32_t ta, tb;
+
+	assert(!fdt_check_header(a));
+	assert(fdt_num_mem_rsv(a) == fdt_num_mem_rsv(b));
+	for (i = 0; i < fdt_num_mem_rsv(a); i++) {
+		assert(!fdt_get_mem_rsv(a, i, &aa, &as));
+		assert(!fdt_get_mem_rsv(b, i, &ba, &bs));
+		assert(aa == ba && as == bs);
+	}
+	assert(fdt_size_dt_struct(a) == fdt_size_dt_struct(b));
+
+	do {
+		ta = fdt_next_tag(a, oa, &na);
+		tb = fdt_next_tag(b, ob, &nb);
+		assert(ta == tb);
+		assert(na - oa == nb - ob);
+
+		if (ta == FDT_BEGIN_NODE) {
+			assert(streq(fdt_offset_ptr(a, oa + FDT_TAGSIZE, 1),
+				     fdt_offset_ptr(b, ob + FDT_TAGSIZE, 1)));
+		} else if (ta == FDT_PROP) {
+			pa = fdt_offset_ptr(a, oa, sizeof(*pa));
+			pb = fdt_offset_ptr(b, ob, sizeof(*pb));
+			assert(pa->len == pb->len);
+			assert(!memcmp(pa->data, pb->data,
+				       fdt32_to_cpu(pa->len)));
+			assert(streq(fdt_string(a, fdt32_to_cpu(pa->nameoff)),
+				     fdt_string(b, fdt32_to_cpu(pb->nameoff))));
+		}
+		oa = na;
+		ob = nb;
+	} while (ta != FDT_END);
+}
+
+static void check_dtb(const struct dt_node *root, bool exclusive)
+{
+	void *fdt = create_dtb(root, exclusive);
+	void *ref = ref_dtb(root, exclusive);
+
+	assert(fdt);
+	check_same(fdt, ref);
+	free(fdt);
+	free(ref);
+}
+
+static void check_clean(const struct dt_node *root)
+{
+	const struct dt_node *n;
+
+	assert(!root->flat_dirty);
+	dt_for_each_node(root, n)
+		assert(!n->flat_dirty);
+}
+
+static void check_get_device_tree(const struct dt_node *node)
+{
+	void *ref = ref_dtb(node, true);
+	int64_t size;
+	void *buf;
+
+	size = opal_get_device_tree(node->phandle, 0, 0);
+	assert(size > 0);
+	buf = malloc(size);
+	assert(opal_get_device_tree(node->phandle, (u64)buf, size - 1) ==
+	       OPAL_NO_MEM);
+	assert(opal_get_device_tree(node->phandle, (u64)buf, size) ==
+	       OPAL_SUCCESS);
+	assert(fdt_totalsize(buf) == size);
+	check_same(buf, ref);
+	free(buf);
+	free(ref);
+}
+
+static void test_cache(void)
+{
+	struct dt_node *c1, *c2, *gc, *other, *n;
+	struct dt_property *p;
+	u64 ranges[] = { cpu_to_be64(0x1000), cpu_to_be64(0x2000),
+			 cpu_to_be64(0x8000), cpu_to_be64(0x100) };
+	void *fdt;
+	char name[32];
+	u32 phandle;
+	int i;
+
+	dt_root = dt_new_root("");
+	dt_add_property_cells(dt_root, "#address-cells", 2);
+	dt_add_property(dt_root, "reserved-ranges", ranges, sizeof(ranges));
+	c1 = dt_new(dt_root, "c1");
+	c2 = dt_new(dt_root, "c2");
+	dt_add_property_string(c1, "compatible", "test,c1");
+	dt_add_property_string(c1, DT_PRIVATE "hidden", "nope");
+	dt_add_property(c2, "empty", NULL, 0);
+	for (i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "gc@%d", i);
+		gc = dt_new(c1, name);
+		dt_add_property_cells(gc, "reg", i, 0x10);
+		dt_add_property_string(gc, "name", "gc");
+	}
+
+	check_dtb(dt_root, false);
+	check_clean(dt_root);
+
+	/* The blob is usable as is */
+	fdt = create_dtb(dt_root, false);
+	assert(fdt_path_offset(fdt, "/c1/gc@3") >= 0);
+	assert(fdt_num_mem_rsv(fdt) == 2);
+	assert(!fdt_getprop(fdt, fdt_path_offset(fdt, "/c1"),
+			    DT_PRIVATE "hidden", NULL));
+	free(fdt);
+
+	/* Only the way down to a change gets dirty */
+	gc = dt_find_by_path(dt_root, "/c1/gc@5");
+	dt_add_property_cells(gc, "new", 42);
+	assert(gc->flat_dirty && c1->flat_dirty && dt_root->flat_dirty);
+	assert(!c2->flat_dirty);
+	assert(!dt_find_by_path(dt_root, "/c1/gc@4")->flat_dirty);
+	check_dtb(dt_root, false);
+	check_clean(dt_root);
+
+	/* Nodes and properties coming and going */
+	dt_free(dt_find_by_path(dt_root, "/c1/gc@2"));
+	n = dt_new(c2, "late");
+	dt_add_property_cells(n, "x", 1);
+	p = __dt_find_property(c1, "compatible");
+	dt_del_property(c1, p);
+	check_dtb(dt_root, false);
+
+	/* Changes we can't pin on a node */
+	p = __dt_find_property(gc, "reg");
+	dt_property_set_cell(p, 1, 0x20);
+	check_dtb(dt_root, false);
+	dt_resize_property(&p, 64);
+	p->len = 64;
+	check_dtb(dt_root, false);
+
+	/* Renumbered phandles */
+	phandle = 0x4242;
+	dt_add_property(gc, "phandle", &phandle, sizeof(phandle));
+	assert(gc->phandle == 0x4242);
+	check_dtb(dt_root, false);
+
+	/* Subtrees, from the cache */
+	check_dtb(c1, true);
+	check_dtb(c1, false);
+	check_get_device_tree(c1);
+	check_get_device_tree(c2);
+	check_get_device_tree(n);
+
+	/* And from a tree on its own */
+	other = dt_new_root("other");
+	dt_add_property_cells(dt_new(other, "a"), "a", 1);
+	dt_add_property_cells(dt_new(other, "b"), "b", 2);
+	check_dtb(other, false);
+	check_dtb(other, true);
+	dt_free(other);
+
+	/* A new tree altogether */
+	dt_free(dt_root);
+	dt_root = dt_new_root("");
+	dt_new(dt_root, "again");
+	check_dtb(dt_root, false);
+	dt_free(dt_root);
+	dt_root = NULL;
+}
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench(void)
+{
+	int nodes = RUNNING_ON_VALGRIND ? 100 : 20000;
+	struct dt_node *parent = NULL, *n;
+	double t, full, incr, ref;
+	char name[32];
+	void *fdt;
+	int i, j;
+
+	dt_root = dt_new_root("");
+	for (i = 0; i < nodes; i++) {
+		if (!(i % 100)) {
+			snprintf(name, sizeof(name), "bus@%x", i);
+			parent = dt_new(dt_root, name);
+		}
+		snprintf(name, sizeof(name), "dev@%x", i);
+		n = dt_new(parent, name);
+		for (j = 0; j < 8; j++) {
+			snprintf(name, sizeof(name), "prop-%d", j);
+			dt_add_property_cells(n, name, i, j);
+		}
+	}
+
+	t = now_usecs();
+	fdt = ref_dtb(dt_root, false);
+	ref = now_usecs() - t;
+	free(fdt);
+
+	t = now_usecs();
+	fdt = create_dtb(dt_root, false);
+	full = now_usecs() - t;
+	free(fdt);
+
+	dt_add_property_cells(n, "changed", 1);
+	t = now_usecs();
+	fdt = create_dtb(dt_root, false);
+	incr = now_usecs() - t;
+	free(fdt);
+
+	printf("FDT bench: %d nodes, libfdt %.0f us, full %.0f us, "
+	       "one change %.0f us\n", nodes, ref, full, incr);
+
+	dt_free(dt_root);
+	dt_root = NULL;
+}
+
+int main(void)
+{
+	test_cache();
+	bench();
+
+	free(fdt_cache.dt_struct);
+	fdt_strtab_free(&fdt_cache.strings);
+	return 0;
+}
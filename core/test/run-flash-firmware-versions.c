@@ -3,6 +3,8 @@
  * Copyright 2018-2019 IBM Corp.
  */
 
+#define __TEST__
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -81,6 +83,8 @@ void *__zalloc(size_t bytes, const char *location)
 
 #include "../../core/device.c"
 
+#include "lock-stubs.c"
+
 #include "../../libstb/container-utils.h"
 #include "../../libstb/container.h"
 #include "../../libstb/container.c"
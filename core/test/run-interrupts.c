@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2019 IBM Corp.
+ */
+
+#define __TEST__
+#include <config.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include <skiboot-valgrind.h>
+
+/* Don't include this, it's PPC-specific */
+#define __CPU_H
+
+struct cpu_thread {
+	uint32_t pir;
+	uint32_t chip_id;
+	void *icp_regs;
+	uint32_t irq_readers;
+};
+
+#define CPUS 2
+
+static struct cpu_thread fake_cpus[CPUS];
+
+static inline struct cpu_thread *next_cpu(struct cpu_thread *cpu)
+{
+	if (cpu == NULL)
+		return &fake_cpus[0];
+	cpu++;
+	if (cpu == &fake_cpus[CPUS])
+		return NULL;
+	return cpu;
+}
+
+#define first_cpu() next_cpu(NULL)
+
+#define for_each_cpu(cpu)	\
+	for (cpu = first_cpu(); cpu; cpu = next_cpu(cpu))
+
+static struct cpu_thread *this_cpu(void)
+{
+	return &fake_cpus[0];
+}
+
+static struct cpu_thread *find_cpu_by_server(uint32_t server_no)
+{
+	(void)server_no;
+	return NULL;
+}
+
+/* Nor this, the ICP accessors aren't exercised here */
+#define __IO_H
+#include <ccan/endian/endian.h>
+static inline uint32_t in_be32(const volatile void *addr)
+{
+	(void)addr;
+	return 0;
+}
+static inline void out_be32(volatile void *addr, uint32_t val)
+{
+	(void)addr;
+	(void)val;
+}
+static inline void out_8(volatile void *addr, uint8_t val)
+{
+	(void)addr;
+	(void)val;
+}
+
+#define sync()
+#define lwsync()
+#define smt_lowest()
+#define smt_medium()
+
+#define zalloc(size) calloc((size), 1)
+
+#include "../interrupts.c"
+#include "../device.c"
+
+char __rodata_start[1], __rodata_end[1];
+struct dt_node *opal_node;
+enum proc_gen proc_gen = proc_gen_p9;
+u64 top_of_ram = -1ul;
+
+struct proc_chip *get_chip(uint32_t chip_id)
+{
+	(void)chip_id;
+	return NULL;
+}
+
+bool p8_sbe_timer_ok(void) { return true; }
+bool p9_sbe_timer_ok(void) { return true; }
+void check_timers(bool from_interrupt) { (void)from_interrupt; }
+uint64_t opal_pending_events;
+
+void lock_caller(struct lock *l, const char *caller)
+{
+	(void)caller;
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
+static uint32_t last_isn;
+static struct irq_source *last_is;
+
+static void test_interrupt(struct irq_source *is, uint32_t isn)
+{
+	/* The source can't go away from under us */
+	assert(this_cpu()->irq_readers);
+	last_is = is;
+	last_isn = isn;
+}
+
+static const struct irq_source_ops test_ops = {
+	.interrupt = test_interrupt,
+};
+
+static struct irq_source big;
+
+static void test_lookup(void)
+{
+	unsigned int i;
+
+	assert(!irq_find_source(0x10));
+
+	/* Registered out of order, with a secondary covering the rest */
+	register_irq_source(&test_ops, (void *)1, 0x30, 0x10);
+	register_irq_source(&test_ops, (void *)2, 0x10, 0x8);
+	register_irq_source(&test_ops, (void *)3, 0x40, 0x1);
+	register_irq_source(&test_ops, (void *)4, 0x20, 0x10);
+	big.start = 0;
+	big.end = 0x1000;
+	big.ops = &test_ops;
+	__register_irq_source(&big, true);
+
+	assert(irq_index->nr == 4 && irq_index->nr2 == 1);
+	for (i = 1; i < irq_index->nr; i++)
+		assert(irq_index->r[i - 1].end <= irq_index->r[i].start);
+
+	assert(irq_find_source(0x10)->data == (void *)2);
+	assert(irq_find_source(0x17)->data == (void *)2);
+	assert(irq_find_source(0x18) == &big);
+	assert(irq_find_source(0x20)->data == (void *)4);
+	assert(irq_find_source(0x2f)->data == (void *)4);
+	assert(irq_find_source(0x30)->data == (void *)1);
+	assert(irq_find_source(0x3f)->data == (void *)1);
+	assert(irq_find_source(0x40)->data == (void *)3);
+	assert(irq_find_source(0x41) == &big);
+	assert(irq_find_source(0x0) == &big);
+	assert(!irq_find_source(0x1000));
+	assert(!this_cpu()->irq_readers);
+
+	assert(opal_handle_interrupt(0x33, NULL) == OPAL_SUCCESS);
+	assert(last_isn == 0x33 && last_is->data == (void *)1);
+	assert(opal_set_xive(0x33, 0, 0) == OPAL_PARAMETER);
+	assert(!this_cpu()->irq_readers);
+
+	/* Going away falls back to the secondary */
+	unregister_irq_source(0x30, 0x10);
+	assert(irq_find_source(0x30) == &big);
+	assert(irq_index->nr == 3);
+	unregister_irq_source(0x10, 0x8);
+	unregister_irq_source(0x20, 0x10);
+	unregister_irq_source(0x40, 0x1);
+	assert(irq_index->nr == 0);
+	assert(irq_find_source(0x40) == &big);
+}
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench(void)
+{
+	unsigned int nr = 512, loops = RUNNING_ON_VALGRIND ? 10000 : 10000000;
+	unsigned int i, found = 0;
+	double t;
+
+	/* A few dozen sources per chip on a big box */
+	for (i = 0; i < nr; i++)
+		register_irq_source(&test_ops, NULL, 0x10000 + i * 0x800,
+				    0x800);
+
+	t = now_usecs();
+	for (i = 0; i < loops; i++)
+		if (irq_find_source(0x10000 + (i * 2654435761u) % (nr * 0x800)))
+			found++;
+	t = now_usecs() - t;
+	assert(found == loops);
+
+	printf("IRQ bench: %u sources, %.1f ns per lookup\n", nr,
+	       t * 1000 / loops);
+}
+
+int main(void)
+{
+	test_lookup();
+	bench();
+	return 0;
+}
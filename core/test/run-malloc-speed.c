@@ -5,6 +5,9 @@
 
 #include <config.h>
 
+/* List debugging makes every list_del_from() O(n): measure without it. */
+#undef CCAN_LIST_DEBUG
+
 #define BITS_PER_LONG (sizeof(long) * 8)
 #include "dummy-cpu.h"
 
@@ -35,6 +38,7 @@ static inline void real_free(void *p)
 
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
 
 char __rodata_start[1], __rodata_end[1];
 struct dt_node *dt_root;
@@ -63,8 +67,152 @@ bool lock_held_by_me(struct lock *l)
 
 #define NUM_ALLOCS 4096
 
+/*
+ * Benchmark parameters: the heap is filled with small objects (the
+ * fragmented free space left behind by boot-time probing), then a mix of
+ * small and larger allocations is run against it. Fixed seed so runs
+ * compare.
+ */
+#define BENCH_FILL_MIN	16
+#define BENCH_FILL_MAX	256
+#define BENCH_MIN_SIZE	16
+#define BENCH_MAX_SIZE	4096
+#define BENCH_OPS	200000
+#define BENCH_WORKING_SET 512
+#define BENCH_GROW	2048
+#define BENCH_GROW_MIN	512
+#define BENCH_GROW_MAX	2048
+
+static unsigned long bench_seed;
+
+static size_t bench_size(size_t min, size_t max)
+{
+	bench_seed = bench_seed * 6364136223846793005UL + 1442695040888963407UL;
+	return min + (bench_seed >> 33) % (max - min);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fragmentation: how much of the free space is *not* the largest block. */
+static double heap_fragmentation(size_t *free_bytes, size_t *free_blocks,
+				 size_t *largest_free)
+{
+	struct alloc_hdr *hdr;
+	size_t largest = 0;
+
+	*free_bytes = *free_blocks = 0;
+	for (hdr = region_start(&skiboot_heap); hdr;
+	     hdr = next_hdr(&skiboot_heap, hdr)) {
+		size_t bytes = hdr->num_longs * sizeof(long);
+
+		if (!hdr->free)
+			continue;
+		*free_bytes += bytes;
+		(*free_blocks)++;
+		if (bytes > largest)
+			largest = bytes;
+	}
+	*largest_free = largest;
+	if (!*free_bytes)
+		return 0;
+	return 1.0 - (double)largest / *free_bytes;
+}
+
+/*
+ * Fill the heap to the given percentage with randomly sized blocks, free
+ * every other one so the free lists are well fragmented, then time a
+ * stream of malloc/free pairs against that heap.
+ */
+static void bench_fill_level(unsigned int percent)
+{
+	size_t target = skiboot_heap.len / 100 * percent;
+	size_t used = 0, nr = 0, max = target / BENCH_FILL_MIN;
+	size_t free_bytes, free_blocks, largest, grown, nr_grow, i;
+	void **p = real_malloc(sizeof(void *) * max);
+	double frag, frag_after, start, secs, grow_secs;
+	static void *grow[BENCH_GROW];
+
+	assert(p);
+	assert(max > 2 * BENCH_WORKING_SET);
+	bench_seed = percent;
+
+	/* Start from an empty heap. */
+	skiboot_heap.free_list[0].n.next = NULL;
+
+	while (used < target && nr < max) {
+		size_t size = bench_size(BENCH_FILL_MIN, BENCH_FILL_MAX);
+
+		p[nr] = __malloc(size, __location__);
+		if (!p[nr])
+			break;
+		used += mem_allocated_size(p[nr]) + sizeof(struct alloc_hdr);
+		nr++;
+	}
+	for (i = 0; i < nr; i += 2) {
+		__free(p[i], __location__);
+		p[i] = NULL;
+	}
+	assert(mem_check(&skiboot_heap));
+
+	frag = heap_fragmentation(&free_bytes, &free_blocks, &largest);
+
+	start = now();
+	for (i = 0; i < BENCH_OPS; i++) {
+		/* Replace a live (odd) block with a new random size */
+		size_t slot = 1 + 2 * (i % BENCH_WORKING_SET);
+
+		__free(p[slot], __location__);
+		p[slot] = __malloc(bench_size(BENCH_MIN_SIZE, BENCH_MAX_SIZE),
+				   __location__);
+		assert(p[slot]);
+	}
+	secs = now() - start;
+	assert(mem_check(&skiboot_heap));
+
+	/*
+	 * Now grow: long-lived allocations too big for most of the holes.
+	 * Only use up half of the largest free block so we never fail.
+	 */
+	heap_fragmentation(&free_bytes, &free_blocks, &largest);
+	start = now();
+	for (nr_grow = 0, grown = 0;
+	     nr_grow < BENCH_GROW && grown < largest / 2; nr_grow++) {
+		size_t size = bench_size(BENCH_GROW_MIN, BENCH_GROW_MAX);
+
+		grow[nr_grow] = __malloc(size, __location__);
+		assert(grow[nr_grow]);
+		grown += size;
+	}
+	grow_secs = now() - start;
+	assert(mem_check(&skiboot_heap));
+	frag_after = heap_fragmentation(&free_bytes, &free_blocks, &largest);
+
+	printf("fill %3u%%: %6zu live, fragmentation %.3f -> %.3f"
+	       " (%zu free blocks, %zu KB), %.0f allocs/sec mixed,"
+	       " %.0f allocs/sec growing\n",
+	       percent, nr / 2, frag, frag_after, free_blocks,
+	       free_bytes / 1024, secs ? BENCH_OPS / secs : 0.0,
+	       grow_secs ? nr_grow / grow_secs : 0.0);
+
+	for (i = 0; i < nr_grow; i++)
+		__free(grow[i], __location__);
+
+	for (i = 0; i < nr; i++)
+		__free(p[i], __location__);
+	assert(mem_check(&skiboot_heap));
+	assert(skiboot_heap.free_list_lock.lock_val == 0);
+	real_free(p);
+}
+
 int main(void)
 {
+	static const unsigned int fill_levels[] = { 10, 25, 50, 75, 90 };
 	uint64_t i, len;
 	void **p = real_malloc(sizeof(void*)*NUM_ALLOCS);
 
@@ -82,7 +230,11 @@ int main(void)
 	}
 	assert(mem_check(&skiboot_heap));
 	assert(skiboot_heap.free_list_lock.lock_val == 0);
-	free(region_start(&skiboot_heap));
 	real_free(p);
+
+	for (i = 0; i < ARRAY_SIZE(fill_levels); i++)
+		bench_fill_level(fill_levels[i]);
+
+	real_free(region_start(&skiboot_heap));
 	return 0;
 }
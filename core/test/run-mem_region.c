@@ -228,7 +228,7 @@ int main(void)
 			assert(r->len == TEST_HEAP_SIZE/2);
 			assert(strcmp(r->name, "splitter") == 0);
 			assert(r->type == REGION_RESERVED);
-			assert(!r->free_list.n.next);
+			assert(!region_free_list_inited(r));
 		} else if (region_start(r) == test_heap + TEST_HEAP_SIZE/4*3) {
 			assert(r->len == TEST_HEAP_SIZE/4);
 			assert(strcmp(r->name, "base") == 0);
@@ -16,7 +16,7 @@ static void *__malloc(size_t size, const char *location __attribute__((unused)))
 	return malloc(size);
 }
 
-static void *__realloc(void *ptr, size_t size, const char *location __attribute__((unused)))
+static inline void *__realloc(void *ptr, size_t size, const char *location __attribute__((unused)))
 {
 	return realloc(ptr, size);
 }
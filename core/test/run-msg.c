@@ -3,12 +3,17 @@
  * Copyright 2013-2019 IBM Corp.
  */
 
+#define __TEST__
+#include <config.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <time.h>
+#include <skiboot-valgrind.h>
 
 static bool zalloc_should_fail = false;
 static int zalloc_should_fail_after = 0;
@@ -28,9 +33,60 @@ static void *zalloc(size_t size)
         return calloc(size, 1);
 }
 
+/* Don't include this, it's PPC-specific */
+#define __CPU_H
+
+struct cpu_thread {
+	uint32_t pir;
+	uint32_t chip_id;
+};
+
+static struct cpu_thread fake_cpu;
+
+static struct cpu_thread *this_cpu(void)
+{
+	return &fake_cpu;
+}
+
+static void *local_alloc(unsigned int chip_id, size_t size, size_t align)
+{
+	void *p;
+
+	(void)chip_id;
+	if (posix_memalign(&p, align, size))
+		p = NULL;
+	return p;
+}
+
+#define sync()
+#define lwsync()
+
+static void cpu_relax(void)
+{
+}
+
+static uint32_t __cmpxchg32(uint32_t *mem, uint32_t old, uint32_t new)
+{
+	return __sync_val_compare_and_swap(mem, old, new);
+}
+
+static uint64_t __cmpxchg64(uint64_t *mem, uint64_t old, uint64_t new)
+{
+	return __sync_val_compare_and_swap(mem, old, new);
+}
+
+struct dt_node;
+extern struct dt_node *opal_node;
+
 #include "../opal-msg.c"
+#include "../opal-export.c"
+#include "../device.c"
 #include <skiboot.h>
 
+char __rodata_start[1], __rodata_end[1];
+struct dt_node *opal_node;
+uint64_t opal_pending_events;
+
 void lock_caller(struct lock *l, const char *caller)
 {
 	(void)caller;
@@ -46,8 +102,7 @@ void unlock(struct lock *l)
 
 void opal_update_pending_evt(uint64_t evt_mask, uint64_t evt_values)
 {
-        (void)evt_mask;
-        (void)evt_values;
+	opal_pending_events = (opal_pending_events & ~evt_mask) | evt_values;
 }
 
 static long magic = 8097883813087437089UL;
@@ -57,42 +112,38 @@ static void callback(void *data, int status)
         assert(*(uint64_t *)data == magic);
 }
 
-static size_t list_count(struct list_head *list)
+static size_t pending_count(void)
 {
-        size_t count = 0;
-        struct opal_msg_entry *dummy;
+	size_t count = 0;
+	uint64_t pos;
 
-        list_for_each(list, dummy, link)
-                count++;
-        return count;
+	for (pos = msg_head; pos != (msg_tail & ~MSG_TAIL_OVERFLOW); pos++)
+		if (!msg_ring[pos & OPAL_MSG_RING_MASK].taken)
+			count++;
+	return count + msg_overflowed;
 }
 
-int main(void)
+static bool msg_event(void)
+{
+	return opal_pending_events & OPAL_EVENT_MSG_PENDING;
+}
+
+static void test_basic(void)
 {
-        struct opal_msg_entry* entry;
-        int free_size = OPAL_MAX_MSGS;
-        int nfree = free_size;
         int npending = 0;
-        int r;
+        int r, i;
         static struct opal_msg m;
         uint64_t *m_ptr = (uint64_t *)&m;
 
-	zalloc_should_fail = true;
-	zalloc_should_fail_after = 3;
-	opal_init_msg();
-
-	zalloc_should_fail = false;
-	opal_init_msg();
-
-        assert(list_count(&msg_pending_list) == npending);
-        assert(list_count(&msg_free_list) == nfree);
+        assert(pending_count() == npending);
+	assert(!msg_event());
 
         /* Callback. */
         r = opal_queue_msg(0, &magic, callback, (u64)0, (u64)1, (u64)2);
         assert(r == 0);
 
-        assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(pending_count() == ++npending);
+	assert(msg_event());
 
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == 0);
@@ -101,47 +152,41 @@ int main(void)
         assert(m.params[1] == 1);
         assert(m.params[2] == 2);
 
-        assert(list_count(&msg_pending_list) == --npending);
-        assert(list_count(&msg_free_list) == ++nfree);
+        assert(pending_count() == --npending);
+	assert(!msg_event());
 
         /* No params. */
         r = opal_queue_msg(0, NULL, NULL);
         assert(r == 0);
 
-        assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(pending_count() == ++npending);
 
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == 0);
 
-        assert(list_count(&msg_pending_list) == --npending);
-        assert(list_count(&msg_free_list) == ++nfree);
+        assert(pending_count() == --npending);
 
         /* > 8 params (ARRAY_SIZE(entry->msg.params) */
         r = opal_queue_msg(0, NULL, NULL, 0, 1, 2, 3, 4, 5, 6, 7, 0xBADDA7A);
         assert(r == 0);
 
-        assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == nfree);
+        assert(pending_count() == ++npending);
 
         r = opal_get_msg(m_ptr, sizeof(m));
 	assert(r == OPAL_PARTIAL);
 
-        assert(list_count(&msg_pending_list) == --npending);
-        assert(list_count(&msg_free_list) == nfree);
+        assert(pending_count() == --npending);
 
         /* Return OPAL_PARTIAL to callback */
 	r = opal_queue_msg(0, &magic, callback, 0, 1, 2, 3, 4, 5, 6, 7, 0xBADDA7A);
 	assert(r == 0);
 
-	assert(list_count(&msg_pending_list) == ++npending);
-	assert(list_count(&msg_free_list) == nfree);
+	assert(pending_count() == ++npending);
 
 	r = opal_get_msg(m_ptr, sizeof(m));
 	assert(r == OPAL_PARTIAL);
 
-	assert(list_count(&msg_pending_list) == --npending);
-	assert(list_count(&msg_free_list) == nfree);
+	assert(pending_count() == --npending);
 
         /* return OPAL_PARAMETER */
 	r = _opal_queue_msg(0, NULL, NULL, OPAL_MSG_SIZE, m_ptr);
@@ -160,14 +205,12 @@ int main(void)
         r = opal_queue_msg(0, NULL, NULL, 0, 10, 20, 30, 40, 50, 60, 70);
         assert(r == 0);
 
-        assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(pending_count() == ++npending);
 
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == 0);
 
-        assert(list_count(&msg_pending_list) == --npending);
-        assert(list_count(&msg_free_list) == ++nfree);
+        assert(pending_count() == --npending);
 
         assert(m.params[0] == 0);
         assert(m.params[1] == 10);
@@ -178,50 +221,79 @@ int main(void)
         assert(m.params[6] == 60);
         assert(m.params[7] == 70);
 
-        /* Full list (no free nodes in pending). */
-        while (nfree > 0) {
-                r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL);
+        /* Full ring, further messages are queued outside it */
+        while (npending < OPAL_MSG_RING_SIZE) {
+                r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL,
+				   cpu_to_be64(npending));
                 assert(r == 0);
-                assert(list_count(&msg_pending_list) == ++npending);
-                assert(list_count(&msg_free_list) == --nfree);
+                assert(pending_count() == ++npending);
         }
-        assert(list_count(&msg_free_list) == 0);
-        assert(nfree == 0);
-        assert(npending == OPAL_MAX_MSGS);
+	assert(!msg_overflowed);
 
-        r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL);
-        assert(r == 0);
-
-        assert(list_count(&msg_pending_list) == OPAL_MAX_MSGS+1);
-        assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == nfree);
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, cpu_to_be64(1000));
+	assert(r == 0);
+	assert(msg_overflowed == 1);
+	assert(msg_tail & MSG_TAIL_OVERFLOW);
+	assert(pending_count() == ++npending);
+	assert(be64_to_cpu(msg_stats[OPAL_MSG_ASYNC_COMP].overflowed) == 1);
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, cpu_to_be64(1001));
+	assert(r == 0);
+	assert(pending_count() == ++npending);
 
-        /* Make zalloc fail to test error handling. */
+	/* Only lost if that can't be allocated either */
         zalloc_should_fail = true;
         r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL);
         assert(r == OPAL_RESOURCE);
+        r = opal_queue_msg(0, NULL, NULL, 0, 1, 2, 3, 4, 5, 6, 7, 8);
+        assert(r == OPAL_RESOURCE);
+        zalloc_should_fail = false;
+        assert(pending_count() == npending);
+	assert(be64_to_cpu(msg_stats[OPAL_MSG_ASYNC_COMP].dropped) == 1);
+	assert(be32_to_cpu(msg_stats[OPAL_MSG_ASYNC_COMP].pending) == npending);
+	assert(be32_to_cpu(msg_stats[OPAL_MSG_ASYNC_COMP].high_water) ==
+	       npending);
+
+	/* Completions are found outside the ring too */
+	r = opal_check_completion(m_ptr, sizeof(m), 1000);
+	assert(r == OPAL_SUCCESS);
+	assert(be64_to_cpu(m.params[0]) == 1000);
+	assert(pending_count() == --npending);
+
+	/* Once there's room, new ones still queue up behind the overflow */
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == 0);
+	assert(be64_to_cpu(m.params[0]) == 0);
+	npending--;
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, cpu_to_be64(1002));
+	assert(r == 0);
+	assert(msg_overflowed == 2);
+	npending++;
 
-        assert(list_count(&msg_pending_list) == OPAL_MAX_MSGS+1);
-        assert(list_count(&msg_pending_list) == npending);
-        assert(list_count(&msg_free_list) == nfree);
-
-        /* Empty list (no nodes). */
-        while(!list_empty(&msg_pending_list)) {
+        /* Empty ring, all in order */
+        for (i = 1; i < OPAL_MSG_RING_SIZE; i++) {
                 r = opal_get_msg(m_ptr, sizeof(m));
                 assert(r == 0);
+		assert(be64_to_cpu(m.params[0]) == i);
                 npending--;
-                nfree++;
         }
-        assert(list_count(&msg_pending_list) == npending);
-        assert(list_count(&msg_free_list) == nfree);
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == 0);
+	assert(be64_to_cpu(m.params[0]) == 1001);
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == 0);
+	assert(be64_to_cpu(m.params[0]) == 1002);
+	npending -= 2;
         assert(npending == 0);
-        assert(nfree == OPAL_MAX_MSGS+1);
+	assert(!pending_count());
+	assert(!msg_overflowed);
+	assert(!(msg_tail & MSG_TAIL_OVERFLOW));
+	assert(!msg_event());
+	assert(!msg_stats[OPAL_MSG_ASYNC_COMP].pending);
 
         r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL);
         assert(r == 0);
 
-        assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(pending_count() == ++npending);
 
         /* Request invalid size. */
         r = opal_get_msg(m_ptr, sizeof(m) - 1);
@@ -263,19 +335,173 @@ int main(void)
         test_queue_num(s16, -1);
         test_queue_num(u8, -1);
         test_queue_num(s8, -1);
+}
 
-        /* Clean up the list to keep valgrind happy. */
-        while(!list_empty(&msg_free_list)) {
-                entry = list_pop(&msg_free_list, struct opal_msg_entry, link);
-                assert(entry);
-                free(entry);
-        }
+static void test_completion(void)
+{
+	struct opal_msg m;
+	int r;
+
+	/* Taken out of order, the rest still comes in order */
+	opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, cpu_to_be64(1));
+	opal_queue_msg(OPAL_MSG_ASYNC_COMP, &magic, callback, cpu_to_be64(2));
+	opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, cpu_to_be64(3));
+
+	assert(opal_check_completion((uint64_t *)&m, sizeof(m), 4) == OPAL_BUSY);
+	r = opal_check_completion((uint64_t *)&m, sizeof(m), 2);
+	assert(r == OPAL_SUCCESS);
+	assert(be64_to_cpu(m.params[0]) == 2);
+	assert(opal_check_completion((uint64_t *)&m, sizeof(m), 2) == OPAL_BUSY);
+	assert(pending_count() == 2);
+
+	assert(opal_get_msg((uint64_t *)&m, sizeof(m)) == OPAL_SUCCESS);
+	assert(be64_to_cpu(m.params[0]) == 1);
+	assert(opal_get_msg((uint64_t *)&m, sizeof(m)) == OPAL_SUCCESS);
+	assert(be64_to_cpu(m.params[0]) == 3);
+	assert(opal_get_msg((uint64_t *)&m, sizeof(m)) == OPAL_RESOURCE);
+	assert(msg_head == opal_msg_tail());
+
+	/* The last one taken clears the event */
+	opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, cpu_to_be64(5));
+	assert(msg_event());
+	assert(opal_check_completion((uint64_t *)&m, sizeof(m), 5) ==
+	       OPAL_SUCCESS);
+	assert(!msg_event());
+}
 
-        while(!list_empty(&msg_pending_list)) {
-                entry = list_pop(&msg_pending_list, struct opal_msg_entry, link);
-                assert(entry);
-                free(entry);
-        }
+static void test_batch(void)
+{
+	uint64_t buf[64];
+	struct opal_msg *m;
+	int i;
+
+	assert(opal_get_msgs(buf, sizeof(buf)) == OPAL_RESOURCE);
+	assert(opal_get_msgs(buf, sizeof(struct opal_msg) - 1) ==
+	       OPAL_PARAMETER);
+
+	for (i = 0; i < 4; i++)
+		opal_queue_msg(OPAL_MSG_OCC, &magic, callback, cpu_to_be64(i),
+			       0, 0, 0, 0, 0, 0, 0);
+	opal_queue_msg(OPAL_MSG_PRD, NULL, NULL, 0, 1, 2, 3, 4, 5, 6, 7, 8);
+	opal_queue_msg(OPAL_MSG_OCC, NULL, NULL, cpu_to_be64(5));
+
+	/* Records are packed, up to what fits */
+	assert(opal_get_msgs(buf, 3 * sizeof(struct opal_msg)) == 3);
+	m = (struct opal_msg *)buf;
+	for (i = 0; i < 3; i++, m++) {
+		assert(be32_to_cpu(m->msg_type) == OPAL_MSG_OCC);
+		assert(be32_to_cpu(m->size) == 64);
+		assert(be64_to_cpu(m->params[0]) == i);
+	}
+	assert(msg_event());
+
+	/* Stops before a message that doesn't fit */
+	assert(opal_get_msgs(buf, sizeof(struct opal_msg)) == 1);
+	assert(opal_get_msgs(buf, sizeof(struct opal_msg)) == OPAL_PARTIAL);
+	assert(opal_get_msgs(buf, sizeof(buf)) == 2);
+	m = (struct opal_msg *)buf;
+	assert(be32_to_cpu(m->msg_type) == OPAL_MSG_PRD);
+	assert(be32_to_cpu(m->size) == 9 * 8);
+	assert(m->params[7] == 7);
+	m = (struct opal_msg *)((char *)buf + OPAL_MSG_HDR_SIZE + 72);
+	assert(be32_to_cpu(m->msg_type) == OPAL_MSG_OCC);
+	assert(be64_to_cpu(m->params[0]) == 5);
+	assert(!msg_event());
+
+	assert(be64_to_cpu(msg_stats[OPAL_MSG_OCC].queued) == 5);
+	assert(be32_to_cpu(msg_stats[OPAL_MSG_OCC].high_water) == 5);
+	assert(!msg_stats[OPAL_MSG_OCC].pending);
+}
+
+static void test_exports(void)
+{
+	struct opal_msg_stats_header *hdr;
+	const struct dt_property *p;
+	uint64_t queued;
+
+	queued = be64_to_cpu(boot_msg_stats[OPAL_MSG_ASYNC_COMP].queued);
+	assert(queued);
+
+	opal_node = dt_new_root("opal");
+	dt_new(dt_new(opal_node, "firmware"), "exports");
+	opal_init_msg();
+
+	p = dt_find_property(dt_find_by_path(opal_node, "firmware/exports"),
+			     "opal_msg_stats");
+	assert(p);
+	hdr = (void *)dt_property_get_u64(p, 0);
+	assert(((uint64_t)hdr & (OPAL_EXPORT_ALIGN - 1)) == 0);
+	assert(dt_property_get_u64(p, 1) == sizeof(*hdr) +
+	       OPAL_MSG_TYPE_MAX * sizeof(struct opal_msg_type_stats));
+	assert(be32_to_cpu(hdr->version) == OPAL_MSG_STATS_VERSION);
+	assert(be32_to_cpu(hdr->nr_types) == OPAL_MSG_TYPE_MAX);
+	assert(be32_to_cpu(hdr->ring_size) == OPAL_MSG_RING_SIZE);
+	assert(msg_stats == (void *)(hdr + 1));
+
+	/* Carried over, and counting on */
+	assert(be64_to_cpu(msg_stats[OPAL_MSG_ASYNC_COMP].queued) == queued);
+	opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL);
+	assert(be64_to_cpu(msg_stats[OPAL_MSG_ASYNC_COMP].queued) ==
+	       queued + 1);
+	while (pending_count()) {
+		struct opal_msg m;
+
+		assert(opal_get_msg((uint64_t *)&m, sizeof(m)) == OPAL_SUCCESS);
+	}
+
+	msg_stats = boot_msg_stats;
+	free(hdr);
+	dt_free(opal_node);
+	opal_node = NULL;
+}
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench(void)
+{
+	unsigned int loops = RUNNING_ON_VALGRIND ? 100 : 100000;
+	unsigned int burst = OPAL_GET_MSGS_MAX, i, j;
+	uint64_t buf[OPAL_GET_MSGS_MAX * sizeof(struct opal_msg) / 8];
+	struct opal_msg m;
+	double t, one, batch;
+
+	/* Bursts of messages, drained one at a time then in batches */
+	t = now_usecs();
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < burst; j++)
+			opal_queue_msg(OPAL_MSG_OCC, NULL, NULL, j, i);
+		for (j = 0; j < burst; j++)
+			assert(opal_get_msg((uint64_t *)&m, sizeof(m)) ==
+			       OPAL_SUCCESS);
+	}
+	one = (now_usecs() - t) * 1000 / (loops * burst);
+
+	t = now_usecs();
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < burst; j++)
+			opal_queue_msg(OPAL_MSG_OCC, NULL, NULL, j, i);
+		assert(opal_get_msgs(buf, sizeof(buf)) == burst);
+	}
+	batch = (now_usecs() - t) * 1000 / (loops * burst);
+
+	printf("MSG bench: bursts of %u, %.1f ns per message with "
+	       "OPAL_GET_MSG, %.1f ns with OPAL_GET_MSGS\n", burst, one, batch);
+}
+
+int main(void)
+{
+	/* Before opal_init_msg(), nothing to set up */
+	test_basic();
+	test_completion();
+	test_batch();
+	test_exports();
+	bench();
 
         return 0;
 }
@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2019 IBM Corp.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Don't include this, it's PPC-specific */
+#define __CPU_H
+
+struct cpu_thread {
+	uint32_t pir;
+	uint32_t chip_id;
+	struct opal_lat_cpu *opal_lat;
+};
+
+#define CPUS 4
+
+static struct cpu_thread fake_cpus[CPUS];
+
+static inline struct cpu_thread *next_cpu(struct cpu_thread *cpu)
+{
+	if (cpu == NULL)
+		return &fake_cpus[0];
+	cpu++;
+	if (cpu == &fake_cpus[CPUS])
+		return NULL;
+	return cpu;
+}
+
+#define first_cpu() next_cpu(NULL)
+
+#define for_each_cpu(cpu)	\
+	for (cpu = first_cpu(); cpu; cpu = next_cpu(cpu))
+
+static struct cpu_thread *this_cpu(void)
+{
+	return &fake_cpus[0];
+}
+
+static void *local_alloc(unsigned int chip_id, size_t size, size_t align)
+{
+	void *p;
+
+	(void)chip_id;
+	if (posix_memalign(&p, align, size))
+		p = NULL;
+	return p;
+}
+
+#define zalloc(size) calloc((size), 1)
+
+unsigned long tb_hz = 512000000;
+
+struct dt_node;
+extern struct dt_node *opal_node;
+
+#include "../opal-latency.c"
+#include "../opal-export.c"
+#include "../device.c"
+
+char __rodata_start[1], __rodata_end[1];
+struct dt_node *opal_node;
+
+#include "lock-stubs.c"
+
+int main(void)
+{
+	struct opal_lat_header *hdr;
+	struct opal_lat_token *t;
+	const struct dt_property *p;
+	unsigned int i;
+
+	opal_node = dt_new_root("opal");
+	dt_new(dt_new(opal_node, "firmware"), "exports");
+	for (i = 0; i < CPUS; i++)
+		fake_cpus[i].pir = 0x10 + i;
+
+	/* Nothing is accounted before we have somewhere to put it */
+	opal_lat_record(&fake_cpus[0], OPAL_POLL_EVENTS, 100);
+
+	opal_lat_init();
+	p = dt_find_property(dt_find_by_path(opal_node, "firmware/exports"),
+			     "opal_latency");
+	assert(p);
+	hdr = (void *)dt_property_get_u64(p, 0);
+	assert(hdr && ((uint64_t)hdr & (OPAL_EXPORT_ALIGN - 1)) == 0);
+	assert(dt_property_get_u64(p, 1) == sizeof(*hdr) +
+	       CPUS * sizeof(struct opal_lat_cpu));
+	assert(be32_to_cpu(hdr->version) == OPAL_LAT_VERSION);
+	assert(be32_to_cpu(hdr->nr_cpus) == CPUS);
+	assert(be32_to_cpu(hdr->nr_tokens) == OPAL_LAST + 1);
+	assert(be32_to_cpu(hdr->nr_buckets) == OPAL_LAT_BUCKETS);
+	assert(be64_to_cpu(hdr->tb_hz) == tb_hz);
+	assert(be64_to_cpu(hdr->cpu_size) == sizeof(struct opal_lat_cpu));
+
+	/* Each CPU gets its own block, tagged with its PIR */
+	for (i = 0; i < CPUS; i++) {
+		assert(fake_cpus[i].opal_lat ==
+		       (struct opal_lat_cpu *)(hdr + 1) + i);
+		assert(be32_to_cpu(fake_cpus[i].opal_lat->pir) == 0x10 + i);
+	}
+
+	/* Buckets are log2 of the timebase delta */
+	assert(opal_lat_bucket(0) == 0);
+	assert(opal_lat_bucket(1) == 0);
+	assert(opal_lat_bucket(2) == 1);
+	assert(opal_lat_bucket(3) == 1);
+	assert(opal_lat_bucket(1024) == 10);
+	assert(opal_lat_bucket(2047) == 10);
+	assert(opal_lat_bucket(1ul << (OPAL_LAT_BUCKETS - 1)) ==
+	       OPAL_LAT_BUCKETS - 1);
+	assert(opal_lat_bucket(-1ul) == OPAL_LAT_BUCKETS - 1);
+
+	opal_lat_record(&fake_cpus[1], OPAL_POLL_EVENTS, 100);
+	opal_lat_record(&fake_cpus[1], OPAL_POLL_EVENTS, 120);
+	opal_lat_record(&fake_cpus[1], OPAL_POLL_EVENTS, 5000);
+	opal_lat_record(&fake_cpus[1], OPAL_POLL_EVENTS, 110);
+	t = &fake_cpus[1].opal_lat->tokens[OPAL_POLL_EVENTS];
+	assert(be32_to_cpu(t->buckets[6]) == 3);
+	assert(be32_to_cpu(t->buckets[12]) == 1);
+	assert(be64_to_cpu(t->total_tb) == 5330);
+	assert(be64_to_cpu(t->max_tb) == 5000);
+
+	/* Other CPUs and tokens are untouched */
+	t = &fake_cpus[0].opal_lat->tokens[OPAL_POLL_EVENTS];
+	assert(!t->total_tb && !t->max_tb && !t->buckets[6]);
+	t = &fake_cpus[1].opal_lat->tokens[OPAL_CONSOLE_WRITE];
+	assert(!t->total_tb && !t->max_tb && !t->buckets[6]);
+
+	/* Bad tokens are ignored */
+	opal_lat_record(&fake_cpus[1], OPAL_LAST + 1, 100);
+
+	free(hdr);
+	dt_free(opal_node);
+	return 0;
+}
@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2019 IBM Corp.
+ */
+
+#define __TEST__
+#include <config.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Don't include this, it's PPC-specific */
+#define __CPU_H
+
+struct cpu_thread {
+	uint32_t chip_id;
+};
+
+static struct cpu_thread fake_cpu;
+
+static struct cpu_thread *this_cpu(void)
+{
+	return &fake_cpu;
+}
+
+static void *local_alloc(unsigned int chip_id, size_t size, size_t align)
+{
+	void *p;
+
+	(void)chip_id;
+	if (posix_memalign(&p, align, size))
+		p = NULL;
+	return p;
+}
+
+static unsigned long stamp;
+
+#define mftb()		(stamp)
+#define lwsync()
+
+static uint64_t __cmpxchg64(uint64_t *mem, uint64_t old, uint64_t new)
+{
+	uint64_t prev = *mem;
+
+	if (prev == old)
+		*mem = new;
+	return prev;
+}
+
+#define zalloc(size) calloc((size), 1)
+
+unsigned long tb_hz = 512000000;
+
+struct dt_node;
+extern struct dt_node *opal_node;
+
+#include "../opal-poller.c"
+#include "../opal-export.c"
+#include "../device.c"
+
+char __rodata_start[1], __rodata_end[1];
+struct dt_node *opal_node;
+
+#include "lock-stubs.c"
+
+static unsigned int calls[2];
+
+/* Each run takes a tick per call so far, to see it accounted */
+static void poll_every(void *data)
+{
+	assert(data == &calls[0]);
+	calls[0]++;
+	stamp += calls[0];
+}
+
+static void poll_slow(void *data)
+{
+	(void)data;
+	calls[1]++;
+}
+
+static void poll(unsigned long when)
+{
+	stamp = when;
+	opal_run_poller_list();
+}
+
+int main(void)
+{
+	struct opal_poller_header *hdr;
+	struct opal_poller_stats *s;
+	const struct dt_property *p;
+	uint64_t ms = msecs_to_tb(1);
+
+	opal_node = dt_new_root("opal");
+	dt_new(dt_new(opal_node, "firmware"), "exports");
+
+	/* Registered before and after the table exists */
+	opal_add_poller(poll_every, &calls[0]);
+	opal_poller_init();
+	opal_add_poller_sched(poll_slow, NULL, 1000);
+
+	p = dt_find_property(dt_find_by_path(opal_node, "firmware/exports"),
+			     "opal_pollers");
+	assert(p);
+	hdr = (void *)dt_property_get_u64(p, 0);
+	assert(hdr == poller_hdr &&
+	       ((uint64_t)hdr & (OPAL_EXPORT_ALIGN - 1)) == 0);
+	assert(dt_property_get_u64(p, 1) == sizeof(*hdr) +
+	       OPAL_POLLER_MAX * sizeof(struct opal_poller_stats));
+	assert(be32_to_cpu(hdr->version) == OPAL_POLLER_VERSION);
+	assert(be32_to_cpu(hdr->nr_pollers) == 2);
+	assert(be32_to_cpu(hdr->max_pollers) == OPAL_POLLER_MAX);
+	assert(be64_to_cpu(hdr->tb_hz) == tb_hz);
+	assert(be64_to_cpu(hdr->entry_size) == sizeof(*s));
+
+	s = (struct opal_poller_stats *)(hdr + 1);
+	assert(streq(s[0].name, "poll_every"));
+	assert(streq(s[1].name, "poll_slow"));
+	assert(!s[0].interval_tb);
+	assert(be64_to_cpu(s[1].interval_tb) == ms);
+
+	/* Everything is due the first time round */
+	poll(100 * ms);
+	assert(calls[0] == 1 && calls[1] == 1);
+
+	/* The slow one waits for its interval */
+	poll(100 * ms + ms / 2);
+	poll(100 * ms + ms / 2);
+	assert(calls[0] == 3 && calls[1] == 1);
+	poll(101 * ms + 100);
+	assert(calls[0] == 4 && calls[1] == 2);
+	assert(be64_to_cpu(s[1].runs) == 2);
+	assert(be64_to_cpu(s[1].skips) == 2);
+
+	/* Run times are accounted, poll_every took 1, 2, ... ticks */
+	assert(be64_to_cpu(s[0].runs) == calls[0]);
+	assert(be64_to_cpu(s[0].total_tb) ==
+	       calls[0] * (calls[0] + 1) / 2);
+	assert(be64_to_cpu(s[0].max_tb) == calls[0]);
+	assert(!s[0].skips);
+
+	free(hdr);
+	dt_free(opal_node);
+	return 0;
+}
@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2019 IBM Corp.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+
+/* The PCI slot messages print uint64_t with %llx */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "../pci-opal.c"
+#pragma GCC diagnostic pop
+#include "lock-stubs.c"
+
+unsigned long top_of_ram = ~0ul;
+unsigned long tb_hz = 512000000;
+
+/* Stubs for the rest of pci-opal.c */
+
+bool try_lock_caller(struct lock *l, const char *caller)
+{
+	lock_caller(l, caller);
+	return true;
+}
+
+void init_timer(struct timer *t __unused, timer_func_t expiry __unused,
+		void *data __unused)
+{
+}
+
+uint64_t schedule_timer(struct timer *t __unused, uint64_t how_long __unused)
+{
+	return 0;
+}
+
+int _opal_queue_msg(enum opal_msg_type msg_type __unused, void *data __unused,
+		    void (*consumed)(void *data, int status) __unused,
+		    size_t params_size __unused, const void *params __unused)
+{
+	return 0;
+}
+
+void opal_update_pending_evt(uint64_t evt_mask __unused,
+			     uint64_t evt_values __unused)
+{
+}
+
+struct pci_slot *pci_slot_find(uint64_t id __unused)
+{
+	return NULL;
+}
+
+void pci_remove_bus(struct phb *phb __unused, struct list_head *list __unused)
+{
+}
+
+uint8_t pci_scan_bus(struct phb *phb __unused, uint8_t bus __unused,
+		     uint8_t max_bus __unused, struct list_head *list __unused,
+		     struct pci_device *parent __unused,
+		     bool scan_downstream __unused)
+{
+	return 0;
+}
+
+void pci_add_device_nodes(struct phb *phb __unused,
+			  struct list_head *list __unused,
+			  struct dt_node *parent_node __unused,
+			  struct pci_lsi_state *lstate __unused,
+			  uint8_t swizzle __unused)
+{
+}
+
+/* A PHB which records the lists it was asked to kill */
+
+static struct pci_tce_kill seen[OPAL_PCI_TCE_KILL_LIST_MAX];
+static uint32_t nr_seen;
+
+static int64_t fake_tce_kill_list(struct phb *phb __unused,
+				  const struct pci_tce_kill *kills,
+				  uint32_t count)
+{
+	assert(count <= PCI_TCE_KILL_CHUNK);
+	memcpy(&seen[nr_seen], kills, count * sizeof(*kills));
+	nr_seen += count;
+	return OPAL_SUCCESS;
+}
+
+static const struct phb_ops fake_phb_ops = {
+	.tce_kill_list = fake_tce_kill_list,
+};
+
+static struct phb fake_phb = {
+	.ops = &fake_phb_ops,
+};
+
+struct phb *pci_get_phb(uint64_t phb_id)
+{
+	return phb_id ? NULL : &fake_phb;
+}
+
+static struct opal_tce_kill_range ranges[OPAL_PCI_TCE_KILL_LIST_MAX];
+
+static void range(unsigned int i, uint64_t pe, uint64_t addr,
+		  uint32_t tce_size, uint32_t npages)
+{
+	ranges[i].pe_number = cpu_to_be64(pe);
+	ranges[i].dma_addr = cpu_to_be64(addr);
+	ranges[i].tce_size = cpu_to_be32(tce_size);
+	ranges[i].npages = cpu_to_be32(npages);
+}
+
+static void check(unsigned int i, uint64_t pe, uint64_t addr,
+		  uint32_t tce_size, uint32_t npages)
+{
+	assert(i < nr_seen);
+	assert(seen[i].pe_number == pe);
+	assert(seen[i].dma_addr == addr);
+	assert(seen[i].tce_size == tce_size);
+	assert(seen[i].npages == npages);
+}
+
+static int64_t kill_list(uint64_t count)
+{
+	nr_seen = 0;
+	return opal_pci_tce_kill_list(0, ranges, count);
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	/* Overlapping ranges, given out of order, become one */
+	range(0, 1, 0x10000, 0x1000, 8);
+	range(1, 1, 0x4000, 0x1000, 16);
+	range(2, 1, 0x12000, 0x1000, 2);
+	assert(kill_list(3) == OPAL_SUCCESS);
+	assert(nr_seen == 1);
+	check(0, 1, 0x4000, 0x1000, 20);
+
+	/* Adjacent ones too, even when a later one bridges a gap */
+	range(0, 1, 0x0, 0x1000, 2);
+	range(1, 1, 0x4000, 0x1000, 2);
+	range(2, 1, 0x2000, 0x1000, 2);
+	assert(kill_list(3) == OPAL_SUCCESS);
+	assert(nr_seen == 1);
+	check(0, 1, 0x0, 0x1000, 6);
+
+	/* But not with a gap between them */
+	range(0, 1, 0x0, 0x1000, 2);
+	range(1, 1, 0x3000, 0x1000, 2);
+	assert(kill_list(2) == OPAL_SUCCESS);
+	assert(nr_seen == 2);
+	check(0, 1, 0x0, 0x1000, 2);
+	check(1, 1, 0x3000, 0x1000, 2);
+
+	/* Nor across page sizes or PEs, which come out sorted */
+	range(0, 2, 0x0, 0x1000, 16);
+	range(1, 1, 0x0, 0x10000, 1);
+	range(2, 1, 0x0, 0x1000, 16);
+	range(3, 1, 0x10000, 0x10000, 1);
+	assert(kill_list(4) == OPAL_SUCCESS);
+	assert(nr_seen == 3);
+	check(0, 1, 0x0, 0x1000, 16);
+	check(1, 1, 0x0, 0x10000, 2);
+	check(2, 2, 0x0, 0x1000, 16);
+
+	/* Empty ranges are dropped */
+	range(0, 1, 0x0, 0x1000, 0);
+	range(1, 1, 0x8000, 0x1000, 1);
+	assert(kill_list(2) == OPAL_SUCCESS);
+	assert(nr_seen == 1);
+	check(0, 1, 0x8000, 0x1000, 1);
+
+	/* A range which would overflow npages once merged stays apart */
+	range(0, 1, 0x0, 0x1000, UINT32_MAX);
+	range(1, 1, (uint64_t)UINT32_MAX * 0x1000, 0x1000, 1);
+	assert(kill_list(2) == OPAL_SUCCESS);
+	assert(nr_seen == 2);
+	check(0, 1, 0x0, 0x1000, UINT32_MAX);
+	check(1, 1, (uint64_t)UINT32_MAX * 0x1000, 0x1000, 1);
+
+	/* Malformed page sizes and misaligned addresses are refused */
+	range(0, 1, 0x0, 0x1800, 1);
+	assert(kill_list(1) == OPAL_PARAMETER);
+	range(0, 1, 0x0, 0, 1);
+	assert(kill_list(1) == OPAL_PARAMETER);
+	range(0, 1, 0x800, 0x1000, 1);
+	assert(kill_list(1) == OPAL_PARAMETER);
+	assert(!nr_seen);
+
+	/* Long lists are killed a chunk at a time */
+	for (i = 0; i < PCI_TCE_KILL_CHUNK + 8; i++)
+		range(i, 1, i * 0x2000, 0x1000, 1);
+	assert(kill_list(PCI_TCE_KILL_CHUNK + 8) == OPAL_SUCCESS);
+	assert(nr_seen == PCI_TCE_KILL_CHUNK + 8);
+	for (i = 0; i < PCI_TCE_KILL_CHUNK + 8; i++)
+		check(i, 1, i * 0x2000, 0x1000, 1);
+
+	/* And none of one is killed if a later chunk is malformed */
+	range(PCI_TCE_KILL_CHUNK + 4, 1, 0x800, 0x1000, 1);
+	assert(kill_list(PCI_TCE_KILL_CHUNK + 8) == OPAL_PARAMETER);
+	assert(!nr_seen);
+
+	assert(opal_pci_tce_kill_list(0, ranges, 0) == OPAL_PARAMETER);
+	assert(opal_pci_tce_kill_list(0, ranges,
+			OPAL_PCI_TCE_KILL_LIST_MAX + 1) == OPAL_PARAMETER);
+	assert(opal_pci_tce_kill_list(1, ranges, 1) == OPAL_PARAMETER);
+
+	return 0;
+}
@@ -41,6 +41,8 @@ static inline bool fake_is_rodata(const void *p)
 struct dt_node *dt_root = NULL;
 char dt_prop[] = "DUMMY DT PROP";
 
+#include "lock-stubs.c"
+
 int rtc_cache_get_datetime(uint32_t *year_month_day,
 			   uint64_t *hour_minute_second_millisecond)
 {
@@ -3,10 +3,33 @@
  * Copyright 2014 IBM Corp
  */
 
+#include <config.h>
 #include <pool.h>
 
+/* We don't want the real, PPC-specific, cpu.h */
+#define __CPU_H
+struct cpu_thread {
+	struct pool_magazine		*pool_mags[POOL_CACHE_MAX];
+};
+
+static struct cpu_thread *cur_cpu;
+
+static inline struct cpu_thread *this_cpu(void)
+{
+	return cur_cpu;
+}
+
+#define lwsync()	do { } while (0)
+
 #include "../pool.c"
 
+#include "lock-stubs.c"
+
+bool lock_held_by_me(struct lock *l)
+{
+	return l->lock_val;
+}
+
 #define POOL_OBJ_COUNT 10
 #define POOL_RESERVED_COUNT 2
 #define POOL_NORMAL_COUNT (POOL_OBJ_COUNT - POOL_RESERVED_COUNT)
@@ -18,6 +41,72 @@ struct test_object
 	int c;
 };
 
+#define CACHE_BATCH	4
+#define CACHE_OBJS	(POOL_MAG_SIZE * 3)
+
+static DEFINE_POOL_CACHE(test_cache, "test", sizeof(struct test_object),
+			 CACHE_BATCH);
+
+static void test_pool_cache(void)
+{
+	struct cpu_thread cpus[2];
+	struct test_object *o[CACHE_OBJS];
+	struct pool_magazine *mag;
+	int i;
+
+	memset(cpus, 0, sizeof(cpus));
+	cur_cpu = &cpus[0];
+
+	/* The first allocation registers the cache and carves a slab */
+	o[0] = pool_cache_get(&test_cache);
+	assert(o[0]);
+	assert(test_cache.registered && test_cache.index == 0);
+	assert(test_cache.slabs == 1 && test_cache.total == CACHE_BATCH);
+	mag = cpus[0].pool_mags[0];
+	assert(mag && mag->count == CACHE_BATCH - 1);
+
+	/* Objects come back zeroed */
+	o[0]->a = 0xdead;
+	pool_cache_put(&test_cache, o[0]);
+	assert(mag->count == CACHE_BATCH);
+	o[0] = pool_cache_get(&test_cache);
+	assert(o[0] && o[0]->a == 0);
+
+	for (i = 1; i < CACHE_OBJS; i++) {
+		o[i] = pool_cache_get(&test_cache);
+		assert(o[i]);
+		o[i]->a = i;
+	}
+	assert(test_cache.total == CACHE_OBJS);
+	assert(test_cache.slabs == CACHE_OBJS / CACHE_BATCH);
+	assert(mag->count == 0);
+
+	/* Free on the other CPU: its magazine fills, then drains a batch */
+	cur_cpu = &cpus[1];
+	for (i = 0; i < CACHE_OBJS; i++) {
+		assert(o[i]->a == i);
+		pool_cache_put(&test_cache, o[i]);
+	}
+	mag = cpus[1].pool_mags[0];
+	assert(mag);
+	assert(mag->count + test_cache.depot_count == CACHE_OBJS);
+	assert(mag->count <= POOL_MAG_SIZE);
+	assert(test_cache.drains);
+
+	/* Back on the first CPU we refill from the depot, no new slabs */
+	cur_cpu = &cpus[0];
+	for (i = 0; i < (int)test_cache.depot_count; i++) {
+		o[i] = pool_cache_get(&test_cache);
+		assert(o[i]);
+	}
+	assert(test_cache.refills);
+	assert(test_cache.total == CACHE_OBJS);
+	assert(!test_cache.lock.lock_val);
+	assert(!pool_caches_lock.lock_val);
+
+	pool_cache_dump();
+}
+
 int main(void)
 {
 	int i, count = 0;
@@ -54,6 +143,8 @@ int main(void)
 	a[3] = pool_get(&pool, POOL_HIGH);
 	assert(a[3]);
 
+	test_pool_cache();
+
 	/* This exits depending on whether all tests passed */
 	return 0;
 }
@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <skiboot-valgrind.h>
 
 #define __TEST__
 #include <timer.h>
@@ -52,9 +54,19 @@ static void expiry(struct timer *t, void *data, uint64_t now)
 	(void)data;
 	(void)now;
 	assert(t->target >= last);
+	last = t->target;
 	count--;
 }
 
+static unsigned int order[8], fired;
+
+static void expiry_order(struct timer *t, void *data, uint64_t now)
+{
+	(void)t;
+	(void)now;
+	order[fired++] = (unsigned long)data;
+}
+
 void p8_sbe_update_timer_expiry(uint64_t new_target)
 {
 	(void)new_target;
@@ -66,6 +78,90 @@ void p9_sbe_update_timer_expiry(uint64_t new_target)
 	(void)new_target;
 }
 
+static void test_semantics(void)
+{
+	unsigned int i;
+
+	/* Equal targets fire in the order they were scheduled */
+	stamp = last = 0;
+	fired = 0;
+	for (i = 0; i < 8; i++) {
+		init_timer(&timers[i], expiry_order, (void *)(unsigned long)i);
+		schedule_timer_at(&timers[i], i < 4 ? 20 : 10);
+	}
+
+	/* Cancel one, move one, re-arm one at the same target */
+	cancel_timer(&timers[2]);
+	assert(!timers[2].heap_idx);
+	cancel_timer_async(&timers[2]);
+	schedule_timer_at(&timers[5], 30);
+	schedule_timer_at(&timers[4], 10);
+
+	stamp = 9;
+	check_timers(false);
+	assert(fired == 0);
+
+	stamp = 10;
+	check_timers(true);
+	assert(fired == 3);
+	assert(order[0] == 6 && order[1] == 7 && order[2] == 4);
+
+	stamp = 30;
+	check_timers(false);
+	assert(fired == 7);
+	assert(order[3] == 0 && order[4] == 1 && order[5] == 3);
+	assert(order[6] == 5);
+	assert(!timer_heap_len && timer_next == TIMER_POLL);
+
+	/* Timer not seen since it was cancelled */
+	for (i = 0; i < fired; i++)
+		assert(order[i] != 2);
+}
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*
+ * Arm, re-arm and cancel a growing number of timers, then let them all
+ * expire. The cost per operation should only grow with log(n).
+ */
+static void bench(void)
+{
+	unsigned int max = RUNNING_ON_VALGRIND ? 1000 : 100000;
+	struct timer *t;
+	unsigned int n, i;
+	double start;
+
+	t = calloc(max, sizeof(*t));
+	assert(t);
+
+	for (n = 100; n <= max; n *= 10) {
+		stamp = last = 0;
+		start = now_usecs();
+		for (i = 0; i < n; i++) {
+			init_timer(&t[i], expiry, NULL);
+			schedule_timer(&t[i], 1 + (random() >> rand_shift));
+		}
+		for (i = 0; i < n; i += 2)
+			schedule_timer(&t[i], 1 + (random() >> rand_shift));
+		for (i = 0; i < n; i += 4)
+			cancel_timer(&t[i]);
+		count = n - (n + 3) / 4;
+		stamp = TIMER_POLL - 1;
+		check_timers(false);
+		assert(!count && !timer_heap_len);
+
+		printf("timer bench: %6u timers, %.0f ns per timer\n", n,
+		       (now_usecs() - start) * 1000 / n);
+	}
+	free(t);
+}
+
 int main(void)
 {
 	unsigned int i;
@@ -80,5 +176,11 @@ int main(void)
 		check_timers(false);
 		stamp++;
 	}
+
+	test_semantics();
+	bench();
+
+	if (timer_heap != timer_heap_init)
+		free(timer_heap);
 	return 0;
 }
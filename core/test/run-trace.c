@@ -52,6 +52,9 @@ static struct cpu_thread *this_cpu(void);
 
 #define CPUS 4
 
+/* Two threads per core, see main() */
+static unsigned int cpu_thread_count = 2;
+
 static struct cpu_thread fake_cpus[CPUS];
 
 static inline struct cpu_thread *next_cpu(struct cpu_thread *cpu)
@@ -252,12 +255,57 @@ static void test_parallel(void)
 	 */
 }
 
+/* Without room in the descriptor, threads share per core buffers */
+static void test_per_core(void)
+{
+	struct trace_reader tr = { 0 };
+	union trace minimal, trace;
+	unsigned int i;
+
+	dt_free(dt_find_by_path(opal_node, "firmware/exports/traces"));
+	dt_check_del_prop(opal_node, "ibm,opal-traces");
+	dt_check_del_prop(opal_node, "ibm,opal-trace-mask");
+
+	/* Fill the descriptor up with some other threads' buffers */
+	for (i = 0; i < DEBUG_DESC_MAX_TRACES - CPUS; i++)
+		debug_descriptor.trace_pir[i] = cpu_to_be16(0x1000 + i);
+	debug_descriptor.num_traces = cpu_to_be32(DEBUG_DESC_MAX_TRACES - CPUS);
+	for (i = 0; i < CPUS; i++)
+		fake_cpus[i].trace = &boot_tracebuf.trace_info;
+	init_trace_buffers();
+	assert(trace_per_core);
+	assert(be32_to_cpu(debug_descriptor.num_traces) ==
+	       DEBUG_DESC_MAX_TRACES - CPUS + 1 + CPUS / 2);
+	for (i = 0; i < CPUS; i++) {
+		assert(fake_cpus[i].trace != &boot_tracebuf.trace_info);
+		assert(fake_cpus[i].trace == fake_cpus[i].primary->trace);
+	}
+	assert(fake_cpus[0].trace != fake_cpus[2].trace);
+	assert(be64_to_cpu(fake_cpus[0].trace->tb.buf_size) == TBUF_SZ);
+
+	/* A secondary writes to its primary's buffer, under the lock */
+	my_fake_cpu = &fake_cpus[1];
+	tr.tb = &fake_cpus[0].trace->tb;
+	timestamp = 1;
+	trace_add(&minimal, 100, sizeof(minimal.hdr));
+	assert(!fake_cpus[1].trace->lock.lock_val);
+	assert(trace_get(&trace, &tr));
+	assert(be16_to_cpu(trace.hdr.cpu) == 1);
+	assert(!trace_get(&trace, &tr));
+
+	for (i = 0; i < CPUS; i += 2)
+		free(fake_cpus[i].trace);
+	my_fake_cpu = &fake_cpus[0];
+	trace_per_core = false;
+}
+
 int main(void)
 {
 	union trace minimal;
 	union trace large;
 	union trace trace;
 	unsigned int i, j;
+	uint64_t tbuf_sz;
 
 	opal_node = dt_new_root("opal");
 	dt_new(dt_new(opal_node, "firmware"), "exports");
@@ -272,11 +320,22 @@ int main(void)
 	init_trace_buffers();
 
 	for (i = 0; i < CPUS; i++) {
+		/* Every thread gets its own buffer, secondaries included. */
+		assert(fake_cpus[i].trace);
+		assert(fake_cpus[i].trace != &boot_tracebuf.trace_info);
+		for (j = 0; j < i; j++)
+			assert(fake_cpus[i].trace != fake_cpus[j].trace);
+
 		trace_readers[i].tb = &fake_cpus[i].trace->tb;
 		assert(trace_empty(&trace_readers[i]));
 		assert(!trace_get(&trace, &trace_readers[i]));
 	}
 
+	/* Each thread has half of what a core's buffer would take */
+	tbuf_sz = be64_to_cpu(fake_cpus[0].trace->tb.buf_size);
+	assert(tbuf_sz == TBUF_CORE_ALLOC / 2 - sizeof(struct trace_info) -
+	       sizeof(union trace));
+
 	assert(sizeof(trace.hdr) % 8 == 0);
 	timestamp = 1;
 	trace_add(&minimal, 100, sizeof(trace.hdr));
@@ -285,7 +344,7 @@ int main(void)
 	assert(be64_to_cpu(trace.hdr.timestamp) == timestamp);
 
 	/* Make it wrap once. */
-	for (i = 0; i < TBUF_SZ / (minimal.hdr.len_div_8 * 8) + 1; i++) {
+	for (i = 0; i < tbuf_sz / (minimal.hdr.len_div_8 * 8) + 1; i++) {
 		timestamp = i;
 		trace_add(&minimal, 99 + (i%2), sizeof(trace.hdr));
 	}
@@ -296,7 +355,7 @@ int main(void)
 	assert(trace.hdr.len_div_8 * 8 == sizeof(trace.overflow));
 	assert(be64_to_cpu(trace.overflow.bytes_missed) == minimal.hdr.len_div_8 * 8);
 
-	for (i = 0; i < TBUF_SZ / (minimal.hdr.len_div_8 * 8); i++) {
+	for (i = 0; i < tbuf_sz / (minimal.hdr.len_div_8 * 8); i++) {
 		assert(trace_get(&trace, my_trace_reader));
 		assert(trace.hdr.len_div_8 == minimal.hdr.len_div_8);
 		assert(be64_to_cpu(trace.hdr.timestamp) == i+1);
@@ -307,7 +366,7 @@ int main(void)
 	/* Now put in some weird-length ones, to test overlap.
 	 * Last power of 2, minus 8. */
 	for (j = 0; (1 << j) < sizeof(large); j++);
-	for (i = 0; i < TBUF_SZ; i++) {
+	for (i = 0; i < tbuf_sz; i++) {
 		timestamp = i;
 		trace_add(&large, 100 + (i%2), (1 << (j-1)));
 	}
@@ -366,7 +425,7 @@ int main(void)
 	assert(trace.hdr.len_div_8 == minimal.hdr.len_div_8);
 	assert(trace.hdr.type == 100);
 
-	for (i = 1; i < TBUF_SZ; i++) {
+	for (i = 1; i < tbuf_sz; i++) {
 		timestamp = i;
 		trace_add(&minimal, 100, sizeof(trace.hdr));
 		assert(trace_get(&trace, my_trace_reader));
@@ -383,9 +442,9 @@ int main(void)
 	}
 
 	for (i = 0; i < CPUS; i++)
-		if (!fake_cpus[i].is_secondary)
-			free(fake_cpus[i].trace);
+		free(fake_cpus[i].trace);
 
+	test_per_core();
 	test_parallel();
 
 	return 0;
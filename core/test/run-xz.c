@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <skiboot-valgrind.h>
+
+#include "../../libxz/xz_crc32.c"
+#include "../../libxz/xz_dec_lzma2.c"
+#include "../../libxz/xz_dec_stream.c"
+
+/* As many CPUs as core/flash.c will use */
+#define XZ_PARALLEL_MAX		8
+
+/* Some real text to compress, the skiboot source will do */
+#define PAYLOAD_FILES	"core/*.c hw/*.c"
+#define PAYLOAD_SMALL	"core/flash.c"
+
+#define MAX_SIZE	(32 << 20)
+
+static size_t run(const char *cmd, uint8_t *buf)
+{
+	FILE *f = popen(cmd, "r");
+	size_t n;
+
+	assert(f);
+	n = fread(buf, 1, MAX_SIZE, f);
+	assert(n < MAX_SIZE);
+	pclose(f);
+	return n;
+}
+
+static size_t compress(const char *files, const char *opts, uint8_t *buf)
+{
+	char cmd[256];
+
+	snprintf(cmd, sizeof(cmd), "cat %s | xz %s 2>/dev/null", files, opts);
+	return run(cmd, buf);
+}
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static enum xz_ret decode_block(struct xz_dec *s, const uint8_t *in,
+				const struct xz_block *blk, uint8_t *out)
+{
+	struct xz_buf b = {
+		.in = in + blk->in_pos,
+		.in_size = blk->in_size,
+		.out = out + blk->out_pos,
+		.out_size = blk->out_size,
+	};
+	enum xz_ret ret;
+
+	ret = xz_dec_block_run(s, &b, blk->check);
+	if (ret == XZ_STREAM_END)
+		assert(b.out_pos == blk->out_size);
+	else
+		assert(b.in_pos == 0 && b.out_pos == 0);
+	return ret;
+}
+
+static enum xz_ret decode_all(const uint8_t *in, size_t in_size,
+			      uint8_t *out, size_t out_size, size_t *out_pos)
+{
+	struct xz_dec *s = xz_dec_init(XZ_SINGLE, 0);
+	struct xz_buf b = {
+		.in = in,
+		.in_size = in_size,
+		.out = out,
+		.out_size = out_size,
+	};
+	enum xz_ret ret;
+
+	ret = xz_dec_run(s, &b);
+	*out_pos = b.out_pos;
+	xz_dec_end(s);
+	return ret;
+}
+
+static void test_blocks(const uint8_t *raw, size_t raw_size, uint8_t *xz,
+			size_t xz_size, uint8_t *out)
+{
+	struct xz_dec *s = xz_dec_init(XZ_SINGLE, 0);
+	struct xz_block *blocks;
+	size_t in_pos = STREAM_HEADER_SIZE, out_pos = 0, n;
+	int nr, i;
+
+	nr = xz_dec_blocks(xz, xz_size, NULL, 0);
+	assert(nr > 2);
+	blocks = calloc(nr, sizeof(*blocks));
+	assert(xz_dec_blocks(xz, xz_size, blocks, 2) == nr);
+	assert(blocks[1].in_pos && !blocks[2].in_pos);
+	assert(xz_dec_blocks(xz, xz_size, blocks, nr) == nr);
+
+	/* Back to back, covering the whole thing */
+	for (i = 0; i < nr; i++) {
+		assert(blocks[i].in_pos == in_pos);
+		assert(blocks[i].out_pos == out_pos);
+		assert(blocks[i].check == XZ_CHECK_CRC32);
+		in_pos += blocks[i].in_size;
+		out_pos += blocks[i].out_size;
+	}
+	assert(out_pos == raw_size);
+
+	/* In any order */
+	memset(out, 0, raw_size);
+	for (i = nr - 1; i >= 0; i--)
+		assert(decode_block(s, xz, &blocks[i], out) == XZ_STREAM_END);
+	assert(!memcmp(out, raw, raw_size));
+
+	/* The serial decoder is still happy with it */
+	memset(out, 0, raw_size);
+	assert(decode_all(xz, xz_size, out, raw_size, &n) == XZ_STREAM_END);
+	assert(n == raw_size && !memcmp(out, raw, raw_size));
+
+	/* Only the block with a bad byte fails */
+	xz[blocks[1].in_pos + blocks[1].in_size / 2] ^= 0x10;
+	assert(decode_block(s, xz, &blocks[1], out) != XZ_STREAM_END);
+	assert(decode_block(s, xz, &blocks[0], out) == XZ_STREAM_END);
+	xz[blocks[1].in_pos + blocks[1].in_size / 2] ^= 0x10;
+
+	/* Or one that's been given too little input, or output */
+	blocks[0].in_size -= 4;
+	assert(decode_block(s, xz, &blocks[0], out) == XZ_DATA_ERROR);
+	blocks[0].in_size += 4;
+	blocks[0].out_size--;
+	assert(decode_block(s, xz, &blocks[0], out) == XZ_BUF_ERROR);
+	blocks[0].out_size++;
+
+	/* A broken index isn't used */
+	xz[xz_size - STREAM_HEADER_SIZE - 6] ^= 1;
+	assert(xz_dec_blocks(xz, xz_size, NULL, 0) == -1);
+	xz[xz_size - STREAM_HEADER_SIZE - 6] ^= 1;
+	assert(xz_dec_blocks(xz, xz_size - 4, NULL, 0) == -1);
+	assert(xz_dec_blocks(xz, 20, NULL, 0) == -1);
+
+	free(blocks);
+	xz_dec_end(s);
+}
+
+/* What the CPUs in xz_decompress_parallel() would take, from block timings */
+static double parallel_usecs(const double *t, int nr, int cpus)
+{
+	double busy[XZ_PARALLEL_MAX] = { 0 }, end = 0;
+	int i, c, first;
+
+	for (i = 0; i < nr; i++) {
+		first = 0;
+		for (c = 1; c < cpus; c++)
+			if (busy[c] < busy[first])
+				first = c;
+		busy[first] += t[i];
+	}
+	for (c = 0; c < cpus; c++)
+		if (busy[c] > end)
+			end = busy[c];
+	return end;
+}
+
+static void bench(size_t raw_size, const uint8_t *xz,
+		  size_t xz_size, const uint8_t *xz1, size_t xz1_size,
+		  uint8_t *out)
+{
+	struct xz_dec *s = xz_dec_init(XZ_SINGLE, 0);
+	struct xz_block *blocks;
+	double t, serial, total = 0, *times;
+	int nr, i, cpus;
+	size_t n;
+
+	t = now_usecs();
+	assert(decode_all(xz1, xz1_size, out, raw_size, &n) == XZ_STREAM_END);
+	serial = now_usecs() - t;
+
+	nr = xz_dec_blocks(xz, xz_size, NULL, 0);
+	blocks = calloc(nr, sizeof(*blocks));
+	times = calloc(nr, sizeof(*times));
+	xz_dec_blocks(xz, xz_size, blocks, nr);
+	for (i = 0; i < nr; i++) {
+		t = now_usecs();
+		assert(decode_block(s, xz, &blocks[i], out) == XZ_STREAM_END);
+		times[i] = now_usecs() - t;
+		total += times[i];
+	}
+
+	printf("xz bench: %zu bytes, one block %zu bytes %.0f us, "
+	       "%d blocks %zu bytes %.0f us\n", raw_size, xz1_size, serial,
+	       nr, xz_size, total);
+	for (cpus = 2; cpus <= XZ_PARALLEL_MAX; cpus *= 2)
+		printf("xz bench: %d CPUs, modelled %.0f us\n", cpus,
+		       parallel_usecs(times, nr, cpus));
+
+	free(times);
+	free(blocks);
+	xz_dec_end(s);
+}
+
+int main(void)
+{
+	const char *files = RUNNING_ON_VALGRIND ? PAYLOAD_SMALL : PAYLOAD_FILES;
+	uint8_t *raw = malloc(MAX_SIZE), *xz = malloc(MAX_SIZE);
+	uint8_t *xz1 = malloc(MAX_SIZE), *out = malloc(MAX_SIZE);
+	size_t raw_size, xz_size, xz1_size, n;
+	char cmd[256];
+
+	xz_crc32_init();
+
+	snprintf(cmd, sizeof(cmd), "cat %s", files);
+	raw_size = run(cmd, raw);
+	assert(raw_size);
+
+	/* As the build does it, only split up */
+	xz_size = compress(files, "-9 -C crc32 --block-size=16KiB", xz);
+	if (!xz_size) {
+		printf("xz not found, skipping\n");
+		return 0;
+	}
+	xz1_size = compress(files, "-9 -C crc32", xz1);
+	assert(xz1_size);
+
+	test_blocks(raw, raw_size, xz, xz_size, out);
+
+	/* Nothing to do in parallel with a single block */
+	assert(xz_dec_blocks(xz1, xz1_size, NULL, 0) == 1);
+
+	/* Nor with a check we don't do */
+	n = compress(PAYLOAD_SMALL, "-C sha256 --block-size=4KiB", out);
+	assert(n);
+	assert(xz_dec_blocks(out, n, NULL, 0) == -1);
+
+	bench(raw_size, xz, xz_size, xz1, xz1_size, out);
+
+	free(raw);
+	free(xz);
+	free(xz1);
+	free(out);
+	return 0;
+}
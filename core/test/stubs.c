@@ -99,3 +99,8 @@ STUB(dt_has_node_property);
 STUB(dt_get_address);
 STUB(add_chip_dev_associativity);
 STUB(pci_check_clear_freeze);
+
+void pool_cache_dump(void) __attribute__((weak));
+void pool_cache_dump(void)
+{
+}
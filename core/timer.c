@@ -29,11 +29,31 @@
 #define HEARTBEAT_DEFAULT_MS	200
 
 static struct lock timer_lock = LOCK_UNLOCKED;
-static LIST_HEAD(timer_list);
 static LIST_HEAD(timer_poll_list);
 static bool timer_in_poll;
 static uint64_t timer_poll_gen;
 
+/*
+ * Real timers live in a binary min-heap ordered by target, ties broken
+ * by the order they were scheduled in (t->gen doubles as the sequence
+ * number), so insertion and removal are O(log n) and the next expiry is
+ * always at the top. Each timer remembers its slot (+1, 0 when not
+ * queued) so it can be cancelled or rescheduled without a search.
+ *
+ * The array starts out static so that early boot never has to allocate,
+ * and doubles on demand.
+ */
+#define TIMER_HEAP_INIT		64
+
+static struct timer *timer_heap_init[TIMER_HEAP_INIT];
+static struct timer **timer_heap = timer_heap_init;
+static unsigned int timer_heap_cap = TIMER_HEAP_INIT;
+static unsigned int timer_heap_len;
+static uint64_t timer_seq;
+
+/* Target of the top of the heap, for check_timers() to peek at locklessly */
+static uint64_t timer_next = TIMER_POLL;
+
 static inline void update_timer_expiry(uint64_t target)
 {
 	if (proc_gen < proc_gen_p9)
@@ -45,18 +65,131 @@ static inline void update_timer_expiry(uint64_t target)
 void init_timer(struct timer *t, timer_func_t expiry, void *data)
 {
 	t->link.next = t->link.prev = NULL;
+	t->heap_idx = 0;
 	t->target = 0;
 	t->expiry = expiry;
 	t->user_data = data;
 	t->running = NULL;
 }
 
+static inline bool timer_before(const struct timer *a, const struct timer *b)
+{
+	if (a->target != b->target)
+		return a->target < b->target;
+	return (int64_t)(a->gen - b->gen) < 0;
+}
+
+static inline void timer_heap_set(unsigned int i, struct timer *t)
+{
+	timer_heap[i] = t;
+	t->heap_idx = i + 1;
+}
+
+static void timer_heap_up(unsigned int i)
+{
+	struct timer *t = timer_heap[i];
+	unsigned int parent;
+
+	while (i) {
+		parent = (i - 1) / 2;
+		if (!timer_before(t, timer_heap[parent]))
+			break;
+		timer_heap_set(i, timer_heap[parent]);
+		i = parent;
+	}
+	timer_heap_set(i, t);
+}
+
+static void timer_heap_down(unsigned int i)
+{
+	struct timer *t = timer_heap[i];
+	unsigned int child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= timer_heap_len)
+			break;
+		if (child + 1 < timer_heap_len &&
+		    timer_before(timer_heap[child + 1], timer_heap[child]))
+			child++;
+		if (!timer_before(timer_heap[child], t))
+			break;
+		timer_heap_set(i, timer_heap[child]);
+		i = child;
+	}
+	timer_heap_set(i, t);
+}
+
+static void timer_heap_grow(void)
+{
+	unsigned int cap = timer_heap_cap * 2;
+	struct timer **heap, **old = NULL;
+
+	/* Don't call into the allocator with the timer lock held */
+	unlock(&timer_lock);
+	heap = malloc(cap * sizeof(*heap));
+	assert(heap);
+	lock(&timer_lock);
+
+	/* Somebody may have beaten us to it */
+	if (timer_heap_cap < cap) {
+		memcpy(heap, timer_heap, timer_heap_len * sizeof(*heap));
+		if (timer_heap != timer_heap_init)
+			old = timer_heap;
+		timer_heap = heap;
+		timer_heap_cap = cap;
+	} else
+		old = heap;
+
+	unlock(&timer_lock);
+	free(old);
+	lock(&timer_lock);
+}
+
+static void timer_heap_add(struct timer *t)
+{
+	t->gen = timer_seq++;
+	timer_heap[timer_heap_len++] = t;
+	timer_heap_up(timer_heap_len - 1);
+	timer_next = timer_heap[0]->target;
+}
+
+static void timer_heap_del(struct timer *t)
+{
+	unsigned int i = t->heap_idx - 1;
+	struct timer *last = timer_heap[--timer_heap_len];
+
+	t->heap_idx = 0;
+	if (last != t) {
+		timer_heap_set(i, last);
+		if (i && timer_before(last, timer_heap[(i - 1) / 2]))
+			timer_heap_up(i);
+		else
+			timer_heap_down(i);
+	}
+	timer_next = timer_heap_len ? timer_heap[0]->target : TIMER_POLL;
+}
+
+static inline struct timer *timer_heap_top(void)
+{
+	return timer_heap_len ? timer_heap[0] : NULL;
+}
+
 static void __remove_timer(struct timer *t)
 {
+	if (t->heap_idx) {
+		timer_heap_del(t);
+		return;
+	}
 	list_del(&t->link);
 	t->link.next = t->link.prev = NULL;
 }
 
+static inline bool timer_queued(struct timer *t)
+{
+	return t->heap_idx || t->link.next;
+}
+
 static void __sync_timer(struct timer *t)
 {
 	sync();
@@ -86,7 +219,7 @@ void cancel_timer(struct timer *t)
 {
 	lock(&timer_lock);
 	__sync_timer(t);
-	if (t->link.next)
+	if (timer_queued(t))
 		__remove_timer(t);
 	unlock(&timer_lock);
 }
@@ -94,17 +227,21 @@ void cancel_timer(struct timer *t)
 void cancel_timer_async(struct timer *t)
 {
 	lock(&timer_lock);
-	if (t->link.next)
+	if (timer_queued(t))
 		__remove_timer(t);
 	unlock(&timer_lock);
 }
 
 static void __schedule_timer_at(struct timer *t, uint64_t when)
 {
-	struct timer *lt;
+	struct timer *top;
+
+	/* Make room first, this may drop the lock */
+	while (when != TIMER_POLL && timer_heap_len == timer_heap_cap)
+		timer_heap_grow();
 
 	/* If the timer is already scheduled, take it out */
-	if (t->link.next)
+	if (timer_queued(t))
 		__remove_timer(t);
 
 	/* Update target */
@@ -115,22 +252,14 @@ static void __schedule_timer_at(struct timer *t, uint64_t when)
 		t->gen = timer_poll_gen;
 		list_add_tail(&timer_poll_list, &t->link);
 	} else {
-		/* It's a real timer, add it in the right spot in the
-		 * ordered timer list
-		 */
-		list_for_each(&timer_list, lt, link) {
-			if (when >= lt->target)
-				continue;
-			list_add_before(&timer_list, &t->link, &lt->link);
-			goto bail;
-		}
-		list_add_tail(&timer_list, &t->link);
+		/* It's a real timer, add it to the heap */
+		timer_heap_add(t);
 	}
- bail:
+
 	/* Pick up the next timer and upddate the SBE HW timer */
-	lt = list_top(&timer_list, struct timer, link);
-	if (lt) {
-		update_timer_expiry(lt->target);
+	top = timer_heap_top();
+	if (top) {
+		update_timer_expiry(top->target);
 	}
 }
 
@@ -212,13 +341,13 @@ static void __check_timers(uint64_t now)
 	struct timer *t;
 
 	for (;;) {
-		t = list_top(&timer_list, struct timer, link);
+		t = timer_heap_top();
 
-		/* Top of list not expired ? that's it ... */
+		/* Top of heap not expired ? that's it ... */
 		if (!t || t->target > now)
 			break;
 
-		/* Top of list still running, we have to delay handling
+		/* Top of heap still running, we have to delay handling
 		 * it. For now just skip until the next poll, when we have
 		 * SLW interrupts, we'll probably want to trip another one
 		 * ASAP
@@ -253,10 +382,11 @@ void check_timers(bool from_interrupt)
 	 */
 
 	/* Lockless "peek", a bit racy but shouldn't be a problem as
-	 * we are only looking at whether the list is empty
+	 * we are only looking at whether there are pollers or anything
+	 * due. A timer we miss here gets picked up on the next call.
 	 */
-	if (list_empty_nocheck(&timer_poll_list) &&
-	    list_empty_nocheck(&timer_list))
+	if ((from_interrupt || list_empty_nocheck(&timer_poll_list)) &&
+	    timer_next > now)
 		return;
 
 	/* Take lock and try again */
@@ -39,10 +39,16 @@ void init_boot_tracebuf(struct cpu_thread *boot_cpu)
 	boot_cpu->trace = &boot_tracebuf.trace_info;
 }
 
-static size_t tracebuf_extra(void)
+/*
+ * Set when there are too many threads to give each its own buffer in the
+ * debug descriptor, threads then share a locked buffer per core.
+ */
+static bool trace_per_core;
+
+static size_t tracebuf_extra(size_t buf_size)
 {
 	/* We make room for the largest possible record */
-	return TBUF_SZ + MAX_SIZE;
+	return buf_size + MAX_SIZE;
 }
 
 /* To avoid bloating each entry, repeats are actually specific entries.
@@ -71,7 +77,6 @@ static bool handle_repeat(struct tracebuf *tb, const union trace *trace)
 	/* OK, it's a duplicate.  Do we already have repeat? */
 	if (be64_to_cpu(tb->last) + len != be64_to_cpu(tb->end)) {
 		u64 pos = be64_to_cpu(tb->last) + len;
-		/* FIXME: Reader is not protected from seeing this! */
 		rpt = (void *)tb->buf + pos % be64_to_cpu(tb->buf_size);
 		assert(pos + rpt->len_div_8*8 == be64_to_cpu(tb->end));
 		assert(rpt->type == TRACE_REPEAT);
@@ -80,7 +85,12 @@ static bool handle_repeat(struct tracebuf *tb, const union trace *trace)
 		if (be16_to_cpu(rpt->num) == 0xFFFF)
 			return false;
 
+		/*
+		 * The reader may be looking at this entry, it copes with
+		 * seeing the new count along with the old timestamp.
+		 */
 		rpt->num = cpu_to_be16(be16_to_cpu(rpt->num) + 1);
+		lwsync(); /* write barrier: update num before timestamp */
 		rpt->timestamp = trace->hdr.timestamp;
 		return true;
 	}
@@ -107,6 +117,7 @@ void trace_add(union trace *trace, u8 type, u16 len)
 {
 	struct trace_info *ti = this_cpu()->trace;
 	unsigned int tsz;
+	bool shared;
 
 	trace->hdr.type = type;
 	trace->hdr.len_div_8 = (len + 7) >> 3;
@@ -127,7 +138,14 @@ void trace_add(union trace *trace, u8 type, u16 len)
 	trace->hdr.timestamp = cpu_to_be64(mftb());
 	trace->hdr.cpu = cpu_to_be16(this_cpu()->server_no);
 
-	lock(&ti->lock);
+	/*
+	 * Once init_trace_buffers() has run every thread owns its buffer
+	 * and is its only writer, so only the boot buffer needs the lock,
+	 * unless we fell back to per core buffers.
+	 */
+	shared = trace_per_core || ti == &boot_tracebuf.trace_info;
+	if (shared)
+		lock(&ti->lock);
 
 	/* Throw away old entries before we overwrite them. */
 	while ((be64_to_cpu(ti->tb.start) + be64_to_cpu(ti->tb.buf_size))
@@ -152,7 +170,8 @@ void trace_add(union trace *trace, u8 type, u16 len)
 		lwsync(); /* write barrier: write entry before exposing */
 		ti->tb.end = cpu_to_be64(be64_to_cpu(ti->tb.end) + tsz);
 	}
-	unlock(&ti->lock);
+	if (shared)
+		unlock(&ti->lock);
 }
 
 static void trace_add_dt_props(void)
@@ -218,43 +237,59 @@ static void trace_add_desc(struct trace_info *t, uint64_t size, uint16_t pir)
 void init_trace_buffers(void)
 {
 	struct cpu_thread *t;
-	struct trace_info *any = &boot_tracebuf.trace_info;
-	uint64_t size;
+	struct trace_info *ti;
+	unsigned int threads = 0;
+	uint64_t size, buf_size;
 
 	/* Boot the boot trace in the debug descriptor */
-	trace_add_desc(any, sizeof(boot_tracebuf), this_cpu()->pir);
+	trace_add_desc(&boot_tracebuf.trace_info, sizeof(boot_tracebuf),
+		       this_cpu()->pir);
+
+	for_each_cpu(t)
+		threads++;
+	if (be32_to_cpu(debug_descriptor.num_traces) + threads >
+	    DEBUG_DESC_MAX_TRACES) {
+		prlog(PR_NOTICE, "TRACE: %u threads, using per core buffers\n",
+		      threads);
+		trace_per_core = true;
+	}
+
+	/*
+	 * Allocate a trace buffer for each thread, so each buffer has a
+	 * single writer. If an allocation fails, that thread keeps writing
+	 * to the (locked) boot buffer. The threads of a core split what a
+	 * per core buffer takes, so the total doesn't grow with SMT.
+	 */
+	size = TBUF_CORE_ALLOC;
+	if (!trace_per_core && cpu_thread_count > 1)
+		size /= cpu_thread_count;
+	buf_size = size - sizeof(*ti) - MAX_SIZE;
 
-	/* Allocate a trace buffer for each primary cpu. */
 	for_each_cpu(t) {
-		if (t->is_secondary)
+		if (trace_per_core && t->is_secondary)
 			continue;
 
 		/* Use a 64K alignment for TCE mapping */
-		size = ALIGN_UP(sizeof(*t->trace) + tracebuf_extra(), 0x10000);
-		t->trace = local_alloc(t->chip_id, size, 0x10000);
-		if (t->trace) {
-			any = t->trace;
-			memset(t->trace, 0, size);
-			init_lock(&t->trace->lock);
-			t->trace->tb.max_size = cpu_to_be32(MAX_SIZE);
-			t->trace->tb.buf_size = cpu_to_be64(TBUF_SZ);
-			trace_add_desc(any, sizeof(t->trace->tb) +
-				       tracebuf_extra(), t->pir);
-		} else
+		ti = local_alloc(t->chip_id, size, 0x10000);
+		if (!ti) {
 			prerror("TRACE: cpu 0x%x allocation failed\n", t->pir);
+			continue;
+		}
+		memset(ti, 0, size);
+		init_lock(&ti->lock);
+		ti->tb.max_size = cpu_to_be32(MAX_SIZE);
+		ti->tb.buf_size = cpu_to_be64(buf_size);
+		trace_add_desc(ti, sizeof(ti->tb) + tracebuf_extra(buf_size),
+			       t->pir);
+
+		lwsync(); /* write barrier: init buffer before switching over */
+		t->trace = ti;
 	}
 
-	/* In case any allocations failed, share trace buffers. */
-	for_each_cpu(t) {
-		if (!t->is_secondary && !t->trace)
-			t->trace = any;
-	}
-
-	/* And copy those to the secondaries. */
+	/* Secondaries share the buffer of their primary */
 	for_each_cpu(t) {
-		if (!t->is_secondary)
-			continue;
-		t->trace = t->primary->trace;
+		if (trace_per_core && t->is_secondary)
+			t->trace = t->primary->trace;
 	}
 
 	/* Trace node in DT. */
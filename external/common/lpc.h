@@ -0,0 +1 @@
+../../include/lpc.h
\ No newline at end of file
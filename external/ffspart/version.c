@@ -0,0 +1 @@
+const char version[] = "4cfbda2-dirty-c033268";
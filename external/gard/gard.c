@@ -41,6 +41,13 @@
 #define VPNOR_GARD_DIR "/media/pnor-prsv"
 #define VPNOR_GARD_FILE VPNOR_GARD_DIR"/GUARD"
 
+/*
+ * Erase blocks to cache. Clearing a record rewrites the records after it
+ * and then the last one, which the cache turns into a single erase and
+ * write of the block. Two in case the partition straddles a block.
+ */
+#define GARD_CACHE_BLOCKS 2
+
 /* Full gard version number (possibly includes gitid). */
 extern const char version[];
 
@@ -811,6 +818,7 @@ int main(int argc, char **argv)
 	const char *action, *progname;
 	char *filename = NULL;
 	struct gard_ctx _ctx, *ctx;
+	struct blocklevel_device *backend;
 	uint64_t bl_size;
 	int rc, i = 0;
 	bool part = 0;
@@ -927,13 +935,17 @@ int main(int argc, char **argv)
 	 */
 	arch_flash_access(ctx->bl, PNOR_MTD);
 
-	if (arch_flash_init(&(ctx->bl), filename, true)) {
+	if (arch_flash_init(&backend, filename, true)) {
 		/* Can fail for a few ways, most likely couldn't open MTD device */
 		fprintf(stderr, "Can't open %s\n", filename ? filename : "MTD Device. Are you root?");
 		rc = EXIT_FAILURE;
 		goto out_free;
 	}
 
+	/* Without the cache we're only slower */
+	if (blocklevel_cache_init(backend, GARD_CACHE_BLOCKS, &ctx->bl))
+		ctx->bl = backend;
+
 	rc = blocklevel_get_info(ctx->bl, NULL, &bl_size, NULL);
 	if (rc)
 		goto out;
@@ -987,7 +999,17 @@ out:
 	if (ctx->ffs)
 		ffs_close(ctx->ffs);
 
-	file_exit_close(ctx->bl);
+	if (ctx->bl != backend) {
+		int cache_rc = blocklevel_cache_exit(ctx->bl);
+
+		if (cache_rc) {
+			fprintf(stderr, "Couldn't write the GARD records back to flash\n");
+			if (!rc)
+				rc = cache_rc;
+		}
+	}
+
+	file_exit_close(backend);
 
 	if (i == ARRAY_SIZE(actions)) {
 		fprintf(stderr, "%s: '%s' isn't a valid command\n", progname, action);
@@ -44,6 +44,7 @@ bool pnor_available(struct pnor *pnor)
 
 int pnor_init(struct pnor *pnor)
 {
+	struct ffs_handle *ffsh;
 	int rc;
 
 	if (!pnor)
@@ -61,9 +62,18 @@ int pnor_init(struct pnor *pnor)
 		goto out;
 	}
 
-	rc = ffs_init(0, pnor->size, pnor->bl, &pnor->ffsh, 0);
+	rc = ffs_cache_init(0, pnor->size, pnor->bl, false, &pnor->ffs);
+	if (rc) {
+		pr_log(LOG_ERR, "PNOR: Failed to allocate partition table cache");
+		goto out;
+	}
+
+	/* Parse it now, so that a bad TOC fails here rather than later */
+	rc = ffs_cache_get(pnor->ffs, 0, &ffsh);
 	if (rc) {
 		pr_log(LOG_ERR, "PNOR: Failed to open pnor partition table");
+		ffs_cache_close(pnor->ffs);
+		pnor->ffs = NULL;
 		goto out;
 	}
 
@@ -79,8 +89,8 @@ void pnor_close(struct pnor *pnor)
 	if (!pnor)
 		return;
 
-	if (pnor->ffsh)
-		ffs_close(pnor->ffsh);
+	if (pnor->ffs)
+		ffs_cache_close(pnor->ffs);
 
 	if (pnor->bl)
 		arch_flash_close(pnor->bl, pnor->path);
@@ -146,22 +156,30 @@ static int mtd_read(struct pnor *pnor, void *data, uint64_t offset,
 int pnor_operation(struct pnor *pnor, const char *name, uint64_t offset,
 		   void *data, size_t requested_size, enum pnor_op op)
 {
+	struct ffs_handle *ffsh;
 	int rc;
 	uint32_t pstart, psize, idx;
 	int size;
 
-	if (!pnor->ffsh) {
+	if (!pnor->ffs) {
 		pr_log(LOG_ERR, "PNOR: ffs not initialised");
 		return -EBUSY;
 	}
 
-	rc = ffs_lookup_part(pnor->ffsh, name, &idx);
+	/* Only re-read if a write below went over the TOC */
+	rc = ffs_cache_get(pnor->ffs, 0, &ffsh);
+	if (rc) {
+		pr_log(LOG_ERR, "PNOR: Failed to open pnor partition table");
+		return -EIO;
+	}
+
+	rc = ffs_lookup_part(ffsh, name, &idx);
 	if (rc) {
 		pr_log(LOG_WARNING, "PNOR: no partiton named '%s'", name);
 		return -ENOENT;
 	}
 
-	ffs_part_info(pnor->ffsh, idx, NULL, &pstart, &psize, NULL, NULL);
+	ffs_part_info(ffsh, idx, NULL, &pstart, &psize, NULL, NULL);
 	if (rc) {
 		pr_log(LOG_ERR, "PNOR: unable to fetch partition info for %s",
 				name);
@@ -198,6 +216,7 @@ int pnor_operation(struct pnor *pnor, const char *name, uint64_t offset,
 		break;
 	case PNOR_OP_WRITE:
 		rc = mtd_write(pnor, data, pstart + offset, size);
+		ffs_cache_invalidate(pnor->ffs, pstart + offset, size);
 		break;
 	default:
 		rc  = -EIO;
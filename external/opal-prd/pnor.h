@@ -9,7 +9,7 @@
 
 struct pnor {
 	char			*path;
-	struct ffs_handle	*ffsh;
+	struct ffs_cache	*ffs;
 	uint64_t		size;
 	uint32_t		erasesize;
 	struct blocklevel_device *bl;
@@ -24,6 +24,7 @@ void pr_log(int priority, const char *fmt, ...)
 
 int main(int argc, char **argv)
 {
+	struct ffs_handle *ffsh = NULL;
 	struct pnor pnor;
 	int rc;
 
@@ -38,7 +39,8 @@ int main(int argc, char **argv)
 	rc = pnor_init(&pnor);
 	assert(rc);
 
-	dump_parts(pnor.ffsh);
+	ffs_cache_get(pnor.ffs, 0, &ffsh);
+	dump_parts(ffsh);
 
 	pnor_close(&pnor);
 
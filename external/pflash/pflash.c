@@ -51,10 +51,18 @@ const char *flashfilename = NULL;
 static bool must_confirm = true;
 static bool dummy_run;
 static bool bmc_flash;
+static bool delta_write;
 
 #define FILE_BUF_SIZE	0x10000
 static uint8_t file_buf[FILE_BUF_SIZE] __aligned(0x1000);
 
+/*
+ * With --delta the file is compared with the flash a block at a time, the
+ * erase block or this if that's smaller.
+ */
+#define DELTA_BLOCK_MIN	0x1000
+static uint8_t flash_buf[FILE_BUF_SIZE] __aligned(0x1000);
+
 static bool check_confirm(void)
 {
 	char yes[8], *p;
@@ -187,15 +195,32 @@ static void print_flash_info(struct flash_details *flash)
 	flash->toc = toc;
 }
 
+/* The TOCs we operate on, side 0 is the one at flash->toc */
+static struct ffs_cache *ffs_cache;
+
 static struct ffs_handle *open_partition(struct flash_details *flash,
-		const char *name, uint32_t *index)
+		int side, const char *name, uint32_t *index)
 {
 	struct ffs_handle *ffsh;
 	int rc;
 
-	ffsh = open_ffs(flash);
-	if (!ffsh)
+	if (!ffs_cache) {
+		rc = ffs_cache_init(flash->toc, flash->total_size, flash->bl,
+				flash->mark_ecc, &ffs_cache);
+		if (rc) {
+			fprintf(stderr, "Error %d opening ffs !\n", rc);
+			return NULL;
+		}
+	}
+
+	rc = ffs_cache_get(ffs_cache, side, &ffsh);
+	if (rc) {
+		fprintf(stderr, "Error %d opening ffs !\n", rc);
+		if (flash->toc)
+			fprintf(stderr, "You specified 0x%" PRIx64 " as the libffs TOC\n"
+				   	"Looks like it doesn't exist\n", flash->toc);
 		return NULL;
+	}
 
 	if (!name)
 		/* Just open the FFS */
@@ -214,14 +239,14 @@ static struct ffs_handle *open_partition(struct flash_details *flash,
 	}
 	return ffsh;
 out:
-	ffs_close(ffsh);
+	/* It stays cached, ffs_cache_close() cleans up */
 	return NULL;
 }
 
 static struct ffs_handle *lookup_partition_at_toc(struct flash_details *flash,
 		const char *name, uint32_t *index)
 {
-	return open_partition(flash, name, index);
+	return open_partition(flash, 0, name, index);
 }
 
 static struct ffs_handle *lookup_partition_at_side(struct flash_details *flash,
@@ -234,19 +259,19 @@ static struct ffs_handle *lookup_partition_at_side(struct flash_details *flash,
 		struct ffs_handle *ffsh;
 		uint32_t side_index;
 
-		ffsh = open_partition(flash, "OTHER_SIDE", &side_index);
+		ffsh = open_partition(flash, 0, "OTHER_SIDE", &side_index);
 		if (!ffsh)
 			return NULL;
 
 		/* Just need to know where it starts */
 		rc = ffs_part_info(ffsh, side_index, NULL, &toc, NULL, NULL, NULL);
-		ffs_close(ffsh);
 		if (rc)
 			return NULL;
 	}
 
+	/* The cache finds the other side by itself, this is for --info */
 	flash->toc = toc;
-	return lookup_partition_at_toc(flash, name, index);
+	return open_partition(flash, side, name, index);
 }
 
 static int erase_chip(struct flash_details *flash)
@@ -409,20 +434,104 @@ static int set_ecc(struct flash_details *flash, uint32_t start, uint32_t size)
 	return 0;
 }
 
-static int program_file(struct blocklevel_device *bl,
+/* How much of the file to take next, to end on a delta block boundary */
+static uint32_t delta_chunk(struct flash_details *flash, uint32_t start)
+{
+	uint32_t block = flash->erase_granule;
+
+	if (block < DELTA_BLOCK_MIN)
+		block = DELTA_BLOCK_MIN;
+	if (block > FILE_BUF_SIZE)
+		block = FILE_BUF_SIZE;
+
+	return block - (start & (block - 1));
+}
+
+/*
+ * Only program what differs from the flash. blocklevel_smart_write() only
+ * erases the erase blocks that need it, and doesn't touch those that are
+ * already right, but it doesn't verify so do that here.
+ */
+static int write_delta(struct flash_details *flash, uint32_t start,
+		const void *buf, uint32_t len, bool *changed)
+{
+	int rc;
+
+	/* Anything unreadable, such as bad ECC, is rewritten */
+	rc = blocklevel_read(flash->bl, start, flash_buf, len);
+	if (!rc && !memcmp(flash_buf, buf, len)) {
+		*changed = false;
+		return 0;
+	}
+
+	*changed = true;
+	rc = blocklevel_smart_write(flash->bl, start, buf, len);
+	if (rc)
+		return rc;
+
+	rc = blocklevel_read(flash->bl, start, flash_buf, len);
+	if (rc)
+		return rc;
+	if (memcmp(flash_buf, buf, len))
+		return FLASH_ERR_VERIFY_FAILURE;
+	return 0;
+}
+
+/*
+ * With --delta, --erase of the region past the end of the image only
+ * erases the blocks there that aren't erased already.
+ */
+static int erase_delta_tail(struct flash_details *flash,
+		uint32_t start, uint32_t end)
+{
+	uint32_t len, i, blocks = 0, erased = 0;
+	int rc;
+
+	while (start < end) {
+		len = MIN(end - start, delta_chunk(flash, start));
+
+		rc = blocklevel_raw_read(flash->bl, start, flash_buf, len);
+		if (rc) {
+			fprintf(stderr, "Flash read error %d at 0x%08x\n",
+				rc, start);
+			return rc;
+		}
+		for (i = 0; i < len && flash_buf[i] == 0xff; i++)
+			;
+		if (i < len) {
+			rc = blocklevel_smart_erase(flash->bl, start, len);
+			if (rc) {
+				fprintf(stderr, "Failed to blocklevel_smart_erase(): %d\n", rc);
+				return rc;
+			}
+			erased++;
+		}
+		blocks++;
+		start += len;
+	}
+
+	if (blocks)
+		printf("%u of %u blocks past the image erased\n",
+		       erased, blocks);
+	return 0;
+}
+
+static int program_file(struct flash_details *flash,
 		const char *file, uint32_t start, uint32_t size,
-		struct ffs_handle *ffsh, int ffs_index)
+		uint32_t *written, struct ffs_handle *ffsh, int ffs_index)
 {
-	uint32_t actual_size = 0;
+	uint32_t actual_size = 0, blocks = 0, changed_blocks = 0;
 	struct ffs_entry *toc;
 	int fd, rc = 0;
-	bool confirm;
+	bool confirm, changed;
 
 	fd = open(file, O_RDONLY);
 	if (fd == -1) {
 		perror("Failed to open file");
 		return 1;
 	}
+	/* Have the kernel read further ahead while we wait on the flash */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 	printf("About to program \"%s\" at 0x%08x..0x%08x !\n",
 	       file, start, start + size);
 	confirm = check_confirm();
@@ -442,7 +551,8 @@ static int program_file(struct blocklevel_device *bl,
 	while(size) {
 		ssize_t len;
 
-		len = read(fd, file_buf, FILE_BUF_SIZE);
+		len = read(fd, file_buf, delta_write ?
+			   delta_chunk(flash, start) : FILE_BUF_SIZE);
 		if (len < 0) {
 			perror("Error reading file");
 			rc = 1;
@@ -454,7 +564,14 @@ static int program_file(struct blocklevel_device *bl,
 			len = size;
 		size -= len;
 		actual_size += len;
-		rc = blocklevel_write(bl, start, file_buf, len);
+		if (delta_write) {
+			rc = write_delta(flash, start, file_buf, len, &changed);
+			blocks++;
+			if (changed)
+				changed_blocks++;
+		} else {
+			rc = blocklevel_write(flash->bl, start, file_buf, len);
+		}
 		if (rc) {
 			if (rc == FLASH_ERR_VERIFY_FAILURE)
 				fprintf(stderr, "Verification failed for"
@@ -469,6 +586,10 @@ static int program_file(struct blocklevel_device *bl,
 	}
 	progress_end();
 
+	if (delta_write)
+		printf("%u of %u blocks changed\n", changed_blocks, blocks);
+	*written = actual_size;
+
 	if (!ffsh)
 		goto out;
 
@@ -702,6 +823,10 @@ static void print_help(const char *pname)
 	printf("\t\tthe specified size (whatever is smaller). If used in\n");
 	printf("\t\tconjunction with any erase command, the erase will\n");
 	printf("\t\ttake place first.\n\n");
+	printf("\t--delta\n");
+	printf("\t\tUsed with -p, only erase and program the blocks whose\n");
+	printf("\t\tcontent differs from the file. With --erase, the rest\n");
+	printf("\t\tof the region is only erased where it isn't already.\n\n");
 	printf("\t-t, --tune\n");
 	printf("\t\tJust tune the flash controller & access size\n");
 	printf("\t\tMust be used in conjuction with --direct\n");
@@ -731,7 +856,7 @@ int main(int argc, char *argv[])
 	static struct ffs_handle *ffsh = NULL;
 	uint32_t ffs_index;
 	uint32_t address = 0, read_size = 0, detail_id = UINT_MAX;
-	uint32_t write_size = 0, write_size_minus_ecc = 0;
+	uint32_t write_size = 0, write_size_minus_ecc = 0, written = 0;
 	bool erase = false, do_clear = false;
 	bool program = false, erase_all = false, info = false, do_read = false;
 	bool enable_4B = false, disable_4B = false;
@@ -769,6 +894,7 @@ int main(int argc, char *argv[])
 			{"toc",		required_argument,	NULL,	'T'},
 			{"clear",   no_argument,        NULL,   'c'},
 			{"ecc",         no_argument,            NULL,   '9'},
+			{"delta",	no_argument,		NULL,	'x'},
 			{NULL,	    0,                  NULL,    0 }
 		};
 		int c, oidx = 0;
@@ -891,6 +1017,9 @@ int main(int argc, char *argv[])
 		case '9':
 			flash.mark_ecc = true;
 			break;
+		case 'x':
+			delta_write = true;
+			break;
 		case ':':
 			fprintf(stderr, "Unrecognised option \"%s\" to '%c'\n", optarg, optopt);
 			no_action = true;
@@ -998,6 +1127,19 @@ int main(int argc, char *argv[])
 		goto out;
 	}
 
+	if (delta_write && !program) {
+		fprintf(stderr, "--delta requires a --program command !\n");
+		rc = 1;
+		goto out;
+	}
+
+	if (delta_write && erase_all) {
+		fprintf(stderr, "--delta and --erase-all are mutually"
+			" exclusive !\n");
+		rc = 1;
+		goto out;
+	}
+
 	if (do_clear && !part_name) {
 		fprintf(stderr, "--clear only supported on a partition name\n");
 		rc = 1;
@@ -1206,12 +1348,18 @@ int main(int argc, char *argv[])
 		rc = do_read_file(flash.bl, read_file, address, read_size, skip_size);
 	if (!rc && erase_all)
 		rc = erase_chip(&flash);
-	else if (!rc && erase)
+	else if (!rc && erase && !delta_write)
 		rc = erase_range(&flash, address, write_size,
 				program, ffsh, ffs_index);
 	if (!rc && program)
-		rc = program_file(flash.bl, write_file, address, write_size_minus_ecc,
-				ffsh, ffs_index);
+		rc = program_file(&flash, write_file, address, write_size_minus_ecc,
+				&written, ffsh, ffs_index);
+	if (!rc && program && erase && delta_write) {
+		if (write_size != write_size_minus_ecc)
+			written = ecc_buffer_size(written);
+		rc = erase_delta_tail(&flash, address + written,
+				      address + write_size);
+	}
 	if (!rc && do_clear)
 		rc = set_ecc(&flash, address, write_size);
 
@@ -1219,8 +1367,7 @@ close:
 	if (flash.need_relock)
 		arch_flash_set_wrprotect(flash.bl, 1);
 	arch_flash_close(flash.bl, flashfilename);
-	if (ffsh)
-		ffs_close(ffsh);
+	ffs_cache_close(ffs_cache);
 out:
 	free(part_name);
 	free(read_file);
@@ -0,0 +1 @@
+const char version[] = "4cfbda2-dirty-d1817df";
@@ -29,11 +29,27 @@
 struct trace_entry {
 	int index;
 	union trace t;
-	struct list_node link;
+	/* Was the last non-repeat entry from this buffer shown? */
+	bool shown;
 };
 
+enum output_format {
+	OUTPUT_TEXT,
+	OUTPUT_CSV,
+	OUTPUT_BINARY,
+};
+
+#define MAX_TOKENS	1024
+
 static int follow;
 static long poll_msecs;
+static enum output_format format;
+
+/* Filters: when a filter is enabled, only matching entries are shown */
+static bool filter_types, filter_cpus, filter_tokens;
+static bool want_type[256];
+static bool want_cpu[65536];
+static bool want_token[MAX_TOKENS];
 
 static void *ezalloc(size_t size)
 {
@@ -144,22 +160,6 @@ static void dump_uart(struct trace_uart *t)
 	}
 }
 
-static void load_traces(struct trace_reader *trs, int count)
-{
-	struct trace_entry *te;
-	union trace t;
-	int i;
-
-	for (i = 0; i < count; i++) {
-		while (trace_get(&t, &trs[i])) {
-			te = ezalloc(sizeof(struct trace_entry));
-			memcpy(&te->t, &t, sizeof(union trace));
-			te->index = i;
-			list_add_tail(&trs[i].traces, &te->link);
-		}
-	}
-}
-
 static void print_trace(union trace *t)
 {
 	display_header(&t->hdr);
@@ -191,6 +191,70 @@ static void print_trace(union trace *t)
 	}
 }
 
+static void print_csv(union trace *t)
+{
+	printf("%"PRIu64",%u,%u,%u,", be64_to_cpu(t->hdr.timestamp),
+	       be16_to_cpu(t->hdr.cpu), t->hdr.type, t->hdr.len_div_8 * 8);
+
+	switch (t->hdr.type) {
+	case TRACE_REPEAT:
+		printf("%u\n", be16_to_cpu(t->repeat.num));
+		break;
+	case TRACE_OVERFLOW:
+		printf("%"PRIu64"\n", be64_to_cpu(t->overflow.bytes_missed));
+		break;
+	case TRACE_OPAL:
+		printf("%"PRIu64"\n", be64_to_cpu(t->opal.token));
+		break;
+	default:
+		printf("\n");
+	}
+}
+
+static void output_trace(union trace *t)
+{
+	switch (format) {
+	case OUTPUT_TEXT:
+		print_trace(t);
+		break;
+	case OUTPUT_CSV:
+		print_csv(t);
+		break;
+	case OUTPUT_BINARY:
+		/* Records as they are in the buffer, big endian */
+		if (fwrite(t, t->hdr.len_div_8 * 8, 1, stdout) != 1)
+			err(1, "Writing trace");
+		break;
+	}
+}
+
+static bool trace_wanted(struct trace_entry *te)
+{
+	union trace *t = &te->t;
+
+	/* Always report lost entries */
+	if (t->hdr.type == TRACE_OVERFLOW)
+		return true;
+
+	/* Repeats follow whatever they repeat */
+	if (t->hdr.type == TRACE_REPEAT)
+		return te->shown;
+
+	te->shown = false;
+	if (filter_types && !want_type[t->hdr.type])
+		return false;
+	if (filter_cpus && !want_cpu[be16_to_cpu(t->hdr.cpu)])
+		return false;
+	if (filter_tokens) {
+		if (t->hdr.type != TRACE_OPAL ||
+		    be64_to_cpu(t->opal.token) >= MAX_TOKENS ||
+		    !want_token[be64_to_cpu(t->opal.token)])
+			return false;
+	}
+	te->shown = true;
+	return true;
+}
+
 /* Gives a min heap */
 bool earlier_entry(const void *va, const void *vb)
 {
@@ -206,21 +270,22 @@ bool earlier_entry(const void *va, const void *vb)
 	return be64_to_cpu(a->t.hdr.timestamp) < be64_to_cpu(b->t.hdr.timestamp);
 }
 
-static void display_traces(struct trace_reader *trs, int count)
+/*
+ * k-way merge: the heap holds at most one entry per buffer, the oldest
+ * we haven't shown yet, and is refilled from the buffer we just took an
+ * entry from. In follow mode a buffer which was empty can still produce
+ * entries older than ones already shown, they're shown as they arrive.
+ */
+static void display_traces(struct trace_reader *trs, struct trace_entry *tes,
+			   struct heap *h, int count)
 {
-	struct trace_entry *current, *next;
-	struct heap *h;
+	struct trace_entry *current;
 	int i;
 
-	h = heap_init(earlier_entry);
-	if (!h)
-		err(1, "Allocating memory");
-
 	for (i = 0; i < count; i++) {
-		current = list_pop(&trs[i].traces, struct trace_entry, link);
 		/* no need to add empty ones */
-		if (current)
-			heap_push(h, current);
+		if (trace_get(&tes[i].t, &trs[i]))
+			heap_push(h, &tes[i]);
 	}
 
 	while (h->len) {
@@ -228,14 +293,29 @@ static void display_traces(struct trace_reader *trs, int count)
 		if (!current)
 			break;
 
-		print_trace(&current->t);
+		if (trace_wanted(current))
+			output_trace(&current->t);
 
-		next = list_pop(&trs[current->index].traces, struct trace_entry,
-				link);
-		heap_push(h, next);
-		free(current);
+		if (trace_get(&current->t, &trs[current->index]))
+			heap_push(h, current);
+	}
+	fflush(stdout);
+}
+
+/* Parse a comma separated list of numbers into a filter */
+static void parse_filter(char *s, bool *want, unsigned long max,
+			 const char *what)
+{
+	unsigned long v;
+	char *tok, *end;
+
+	for (tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+		errno = 0;
+		v = strtoul(tok, &end, 0);
+		if (errno || *end || v >= max)
+			errx(1, "Invalid %s '%s'", what, tok);
+		want[v] = true;
 	}
-	heap_free(h);
 }
 
 
@@ -254,22 +334,47 @@ static long get_mseconds(char *s)
 
 static void usage(void)
 {
-	errx(1, "Usage: dump_trace [-f [-s msecs]] file...");
+	errx(1, "Usage: dump_trace [-f [-s msecs]] [-t types] [-c cpus]"
+	     " [-T tokens] [-o text|csv|binary] file...");
 }
 
 int main(int argc, char *argv[])
 {
 	struct trace_reader *trs;
+	struct trace_entry *tes;
 	struct trace_info *ti;
+	struct heap *h;
 	struct stat sb;
 	int fd, opt, i;
 
 	poll_msecs = 1000;
-	while ((opt = getopt(argc, argv, "fs:")) != -1) {
+	while ((opt = getopt(argc, argv, "fs:t:c:T:o:")) != -1) {
 		switch (opt) {
 		case 'f':
 			follow++;
 			break;
+		case 't':
+			filter_types = true;
+			parse_filter(optarg, want_type, 256, "type");
+			break;
+		case 'c':
+			filter_cpus = true;
+			parse_filter(optarg, want_cpu, 65536, "cpu");
+			break;
+		case 'T':
+			filter_tokens = true;
+			parse_filter(optarg, want_token, MAX_TOKENS, "token");
+			break;
+		case 'o':
+			if (!strcmp(optarg, "text"))
+				format = OUTPUT_TEXT;
+			else if (!strcmp(optarg, "csv"))
+				format = OUTPUT_CSV;
+			else if (!strcmp(optarg, "binary"))
+				format = OUTPUT_BINARY;
+			else
+				usage();
+			break;
 		case 's':
 			poll_msecs = get_mseconds(optarg);
 			if (follow && poll_msecs)
@@ -286,6 +391,7 @@ int main(int argc, char *argv[])
 		usage();
 
 	trs = ezalloc(sizeof(struct trace_reader) * argc);
+	tes = ezalloc(sizeof(struct trace_entry) * argc);
 
 	for (i =  0; i < argc; i++) {
 		fd = open(argv[i], O_RDONLY);
@@ -295,20 +401,28 @@ int main(int argc, char *argv[])
 		if (fstat(fd, &sb) < 0)
 			err(1, "Stating %s", argv[1]);
 
-		ti = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		/* Shared, so we see the writer's updates in follow mode */
+		ti = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
 		if (ti == MAP_FAILED)
 			err(1, "Mmaping %s", argv[i]);
 
 		trs[i].tb = &ti->tb;
-		list_head_init(&trs[i].traces);
+		tes[i].index = i;
 	}
 
+	h = heap_init(earlier_entry);
+	if (!h)
+		err(1, "Allocating memory");
+
+	if (format == OUTPUT_CSV)
+		printf("timestamp,cpu,type,len,arg\n");
+
 	do {
-		load_traces(trs, argc);
-		display_traces(trs, argc);
+		display_traces(trs, tes, h, argc);
 		if (follow)
 			usleep(poll_msecs * 1000);
 	} while (follow);
 
+	heap_free(h);
 	return 0;
 }
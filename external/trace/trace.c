@@ -15,7 +15,7 @@
 #if defined(__powerpc__) || defined(__powerpc64__)
 #define rmb() lwsync()
 #else
-#define rmb()
+#define rmb() asm volatile("" : : : "memory")
 #endif
 
 bool trace_empty(const struct trace_reader *tr)
@@ -80,7 +80,24 @@ again:
 
 	/* Repeat entries need special handling */
 	if (t->hdr.type == TRACE_REPEAT) {
-		u32 num = be16_to_cpu(t->repeat.num);
+		const struct trace_repeat *src = (void *)tr->tb->buf +
+			rpos % be64_to_cpu(tr->tb->buf_size);
+		u32 num;
+
+		/*
+		 * Our copy may be torn by an update in place, take num and
+		 * timestamp again: the writer updates num first, so at
+		 * worst the count is one ahead of the timestamp.
+		 */
+		t->repeat.timestamp = src->timestamp;
+		rmb(); /* read barrier: timestamp before num */
+		t->repeat.num = src->num;
+
+		rmb(); /* read barrier: copy repeat before checking start. */
+		if (rpos < be64_to_cpu(tr->tb->start))
+			goto again;
+
+		num = be16_to_cpu(t->repeat.num);
 
 		/* In case we've read some already... */
 		t->repeat.num = cpu_to_be16(num - tr->last_repeat);
@@ -71,28 +71,14 @@ static int ast_copy_to_ahb(uint32_t reg, const void *src, uint32_t len)
 
 	/* SPI flash, use LPC->AHB bridge */
 	if ((reg >> 28) == (PNOR_AHB_ADDR >> 28)) {
-		uint32_t chunk, off = reg - PNOR_AHB_ADDR + pnor_lpc_offset;
+		uint32_t off = reg - PNOR_AHB_ADDR + pnor_lpc_offset;
 		int64_t rc;
 
-		while(len) {
-			/* Chose access size */
-			if (len > 3 && !(off & 3)) {
-				rc = lpc_write(OPAL_LPC_FW, off,
-					       *(uint32_t *)src, 4);
-				chunk = 4;
-			} else {
-				rc = lpc_write(OPAL_LPC_FW, off,
-					       *(uint8_t *)src, 1);
-				chunk = 1;
-			}
-			if (rc) {
-				prerror("AST_IO: lpc_write.sb failure %lld"
-					" to FW 0x%08x\n", rc, off);
-				return rc;
-			}
-			len -= chunk;
-			off += chunk;
-			src += chunk;
+		rc = lpc_fw_write(off, src, len);
+		if (rc) {
+			prerror("AST_IO: lpc_write.sb failure %lld"
+				" to FW 0x%08x\n", rc, off);
+			return rc;
 		}
 		return 0;
 	}
@@ -110,32 +96,14 @@ static int ast_copy_from_ahb(void *dst, uint32_t reg, uint32_t len)
 
 	/* SPI flash, use LPC->AHB bridge */
 	if ((reg >> 28) == (PNOR_AHB_ADDR >> 28)) {
-		uint32_t chunk, off = reg - PNOR_AHB_ADDR + pnor_lpc_offset;
+		uint32_t off = reg - PNOR_AHB_ADDR + pnor_lpc_offset;
 		int64_t rc;
 
-		while(len) {
-			uint32_t dat;
-
-			/* Chose access size */
-			if (len > 3 && !(off & 3)) {
-				rc = lpc_read(OPAL_LPC_FW, off, &dat, 4);
-				if (!rc)
-					*(uint32_t *)dst = dat;
-				chunk = 4;
-			} else {
-				rc = lpc_read(OPAL_LPC_FW, off, &dat, 1);
-				if (!rc)
-					*(uint8_t *)dst = dat;
-				chunk = 1;
-			}
-			if (rc) {
-				prerror("AST_IO: lpc_read.sb failure %lld"
-					" to FW 0x%08x\n", rc, off);
-				return rc;
-			}
-			len -= chunk;
-			off += chunk;
-			dst += chunk;
+		rc = lpc_fw_read(off, dst, len);
+		if (rc) {
+			prerror("AST_IO: lpc_read.sb failure %lld"
+				" to FW 0x%08x\n", rc, off);
+			return rc;
 		}
 		return 0;
 	}
@@ -19,6 +19,7 @@
 #include <timebase.h>
 #include <chip.h>
 #include <interrupts.h>
+#include <pool.h>
 
 /* BT registers */
 #define BT_CTRL			0
@@ -88,9 +89,17 @@ struct bt_msg {
 	uint8_t seq;
 	uint8_t send_count;
 	bool disable_retry;
+	bool from_cache;
 	struct ipmi_msg ipmi_msg;
 };
 
+/*
+ * Anything that fits in the BT FIFO comes from a per-CPU cache, bigger
+ * messages (which are rare) go to the heap.
+ */
+#define BT_CACHE_MSG_SIZE	(sizeof(struct bt_msg) + BT_FIFO_LEN)
+static DEFINE_POOL_CACHE(bt_msg_cache, "bt_msg", BT_CACHE_MSG_SIZE, 4);
+
 struct bt_caps {
 	uint8_t num_requests;
 	uint16_t input_buf_len;
@@ -587,9 +596,15 @@ static void bt_irq(uint32_t chip_id __unused, uint32_t irq_mask __unused)
  */
 static struct ipmi_msg *bt_alloc_ipmi_msg(size_t request_size, size_t response_size)
 {
+	size_t size = sizeof(struct bt_msg) + MAX(request_size, response_size);
 	struct bt_msg *bt_msg;
 
-	bt_msg = zalloc(sizeof(struct bt_msg) + MAX(request_size, response_size));
+	if (size <= BT_CACHE_MSG_SIZE) {
+		bt_msg = pool_cache_get(&bt_msg_cache);
+		if (bt_msg)
+			bt_msg->from_cache = true;
+	} else
+		bt_msg = zalloc(size);
 	if (!bt_msg)
 		return NULL;
 
@@ -607,7 +622,10 @@ static void bt_free_ipmi_msg(struct ipmi_msg *ipmi_msg)
 {
 	struct bt_msg *bt_msg = container_of(ipmi_msg, struct bt_msg, ipmi_msg);
 
-	free(bt_msg);
+	if (bt_msg->from_cache)
+		pool_cache_put(&bt_msg_cache, bt_msg);
+	else
+		free(bt_msg);
 }
 
 /*
@@ -436,6 +436,6 @@ void fsp_elog_write_init(void)
 
 	elog_init();
 
-	/* Add a poller */
-	opal_add_poller(elog_timeout_poll, NULL);
+	/* Add a poller, the timeouts are in minutes so don't rush it */
+	opal_add_poller_sched(elog_timeout_poll, NULL, 100000);
 }
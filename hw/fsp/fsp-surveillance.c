@@ -213,9 +213,10 @@ void fsp_init_surveillance(void)
 	/* Always register the poller, so we don't have to add/remove
 	 * it on reset-reload or change of surveillance state. Also the
 	 * poller list has no locking so we don't want to play with it
-	 * at runtime.
+	 * at runtime. The heartbeat is every 60 seconds, so checking
+	 * once a second is plenty.
 	 */
-	opal_add_poller(fsp_surv_poll, NULL);
+	opal_add_poller_sched(fsp_surv_poll, NULL, 1000000);
 
 	/* Register for the reset/reload event */
 	fsp_register_client(&fsp_surv_client_rr, FSP_MCLASS_RR_EVENT);
@@ -2087,8 +2087,12 @@ static bool fsp_init_one(const char *compat)
 			list_head_init(&fsp_cmdclass_rr.clientq);
 			list_head_init(&fsp_cmdclass_rr.rr_queue);
 
-			/* Register poller */
-			opal_add_poller(fsp_opal_poll, NULL);
+			/*
+			 * Register poller. The FSP interrupt does most of
+			 * the work, this only needs to keep one CPU at a
+			 * time on the mailbox.
+			 */
+			opal_add_poller_sched(fsp_opal_poll, NULL, 100);
 
 			inited = true;
 		}
@@ -2235,8 +2239,8 @@ void fsp_opl(void)
 		opal_run_pollers();
 	}
 
-	/* Initiate the timeout poller */
-	opal_add_poller(fsp_timeout_poll, NULL);
+	/* Initiate the timeout poller, it only acts every 30 seconds */
+	opal_add_poller_sched(fsp_timeout_poll, NULL, 1000000);
 
 	/* Tell FSP we are in standby */
 	prlog(PR_INFO, "INIT: Sending HV Functional: Standby...\n");
@@ -120,6 +120,7 @@ static struct combined_units_node cu_node[] = {
 };
 
 static char *compress_buf;
+static struct xz_decompress *imc_xz;
 static size_t compress_buf_size;
 const char **prop_to_fix(struct dt_node *node);
 static const char *props_to_fix[] = {"events", NULL};
@@ -434,10 +435,31 @@ void imc_catalog_preload(void)
 		return;
 	}
 
-	ret = start_preload_resource(RESOURCE_ID_IMA_CATALOG,
-					pvr, compress_buf, &compress_buf_size);
+	/*
+	 * Memory for decompression, which happens while the catalog is read
+	 * where possible.
+	 */
+	imc_xz = zalloc(sizeof(struct xz_decompress));
+	if (imc_xz)
+		imc_xz->dst = malloc(MAX_DECOMPRESSED_IMC_DTB_SIZE);
+	if (!imc_xz || !imc_xz->dst) {
+		prerror("No memory to decompress IMC catalog\n");
+		free(imc_xz);
+		imc_xz = NULL;
+		free(compress_buf);
+		compress_buf = NULL;
+		return;
+	}
+	imc_xz->dst_size = MAX_DECOMPRESSED_IMC_DTB_SIZE;
+
+	ret = start_preload_resource_xz(RESOURCE_ID_IMA_CATALOG, pvr,
+					compress_buf, &compress_buf_size,
+					imc_xz);
 	if (ret != OPAL_SUCCESS) {
 		prerror("Failed to load IMA_CATALOG: %d\n", ret);
+		free(imc_xz->dst);
+		free(imc_xz);
+		imc_xz = NULL;
 		free(compress_buf);
 		compress_buf = NULL;
 	}
@@ -472,11 +494,8 @@ static void imc_dt_update_nest_node(struct dt_node *dev)
 	}
 }
 
-static struct xz_decompress *imc_xz;
-
 void imc_decompress_catalog(void)
 {
-	void *decompress_buf = NULL;
 	uint32_t pvr = (mfspr(SPR_PVR) & ~(0xf0ff));
 	int ret;
 
@@ -487,31 +506,20 @@ void imc_decompress_catalog(void)
 	ret = wait_for_resource_loaded(RESOURCE_ID_IMA_CATALOG, pvr);
 	if (ret != OPAL_SUCCESS) {
 		prerror("IMC Catalog load failed\n");
+		free(imc_xz->dst);
+		free(imc_xz);
+		imc_xz = NULL;
 		return;
 	}
 
-	/*
-	 * Memory for decompression.
-	 */
-	decompress_buf = malloc(MAX_DECOMPRESSED_IMC_DTB_SIZE);
-	if (!decompress_buf) {
-		prerror("No memory for decompress_buf \n");
+	/* Already decompressed as it was read from flash */
+	if (imc_xz->status != OPAL_EMPTY)
 		return;
-	}
 
 	/*
 	 * Decompress the compressed buffer
 	 */
-	imc_xz = malloc(sizeof(struct xz_decompress));
-	if (!imc_xz) {
-		prerror("No memory to decompress IMC catalog\n");
-		free(decompress_buf);
-		return;
-	}
-
-	imc_xz->dst = decompress_buf;
 	imc_xz->src = compress_buf;
-	imc_xz->dst_size = MAX_DECOMPRESSED_IMC_DTB_SIZE;
 	imc_xz->src_size = compress_buf_size;
 	xz_start_decompress(imc_xz);
 }
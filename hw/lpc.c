@@ -667,6 +667,148 @@ int64_t lpc_probe_read(enum OpalLPCAddressType addr_type, uint32_t addr,
 	return __lpc_read_sanity(addr_type, addr, data, sz, true);
 }
 
+/*
+ * Bulk FW space copies, for the flash backends which move whole windows
+ * at a time. The range is checked once, the host controller is set up
+ * once per run of same sized accesses, and on P9 the data moves straight
+ * through the MMIO mapping of the OPB. The lock is dropped every
+ * LPC_FW_CHUNK bytes so the console isn't held off for a whole window.
+ */
+#define LPC_FW_CHUNK	0x1000
+
+static void lpc_fw_mmio_copy(void *mmio, void *buf, uint32_t len,
+			     uint32_t sz, bool is_write)
+{
+	/* Cache inhibited accesses to the OPB are performed in order */
+	sync();
+	for (; len; len -= sz, mmio += sz, buf += sz) {
+		if (sz == 4 && is_write)
+			__out_be32(mmio, be32_to_cpu(*(__be32 *)buf));
+		else if (sz == 4)
+			*(__be32 *)buf = cpu_to_be32(__in_be32(mmio));
+		else if (is_write)
+			__out_8(mmio, *(uint8_t *)buf);
+		else
+			*(uint8_t *)buf = __in_8(mmio);
+	}
+	if (is_write)
+		sync();
+}
+
+/* Without MMIO every access is an XSCOM round-trip anyway */
+static int64_t lpc_fw_opb_copy(struct lpcm *lpc, uint32_t addr, void *buf,
+			       uint32_t len, uint32_t sz, bool is_write)
+{
+	uint32_t data;
+	int64_t rc;
+
+	for (; len; len -= sz, addr += sz, buf += sz) {
+		if (is_write) {
+			if (sz == 4)
+				data = be32_to_cpu(*(__be32 *)buf);
+			else
+				data = *(uint8_t *)buf;
+			rc = opb_write(lpc, addr, data, sz);
+		} else {
+			rc = opb_read(lpc, addr, &data, sz);
+			if (sz == 4)
+				*(__be32 *)buf = cpu_to_be32(data);
+			else
+				*(uint8_t *)buf = data;
+		}
+		if (rc)
+			return rc;
+	}
+
+	return OPAL_SUCCESS;
+}
+
+/* Call with lpc->lock held, the whole range is in one FW segment */
+static int64_t lpc_fw_copy_chunk(struct lpcm *lpc, uint32_t addr, void *buf,
+				 uint32_t len, bool is_write)
+{
+	uint32_t opb_base, sz, n;
+	int64_t rc;
+
+	while (len) {
+		/* Use the widest access the alignment allows */
+		if (len >= 4 && !(addr & 3)) {
+			sz = 4;
+			n = len & ~3;
+		} else {
+			sz = 1;
+			n = (addr & 3) ? MIN(len, 4 - (addr & 3)) : len;
+		}
+
+		rc = lpc_opb_prepare(lpc, OPAL_LPC_FW, addr, sz, &opb_base,
+				     is_write);
+		if (rc)
+			return rc;
+
+		if (lpc->mbase)
+			lpc_fw_mmio_copy(lpc->mbase + opb_base + addr, buf, n,
+					 sz, is_write);
+		else
+			rc = lpc_fw_opb_copy(lpc, opb_base + addr, buf, n, sz,
+					     is_write);
+		if (rc)
+			return rc;
+
+		addr += n;
+		buf += n;
+		len -= n;
+	}
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t lpc_fw_copy(uint32_t addr, void *buf, uint32_t len,
+			   bool is_write)
+{
+	struct proc_chip *chip;
+	struct lpcm *lpc;
+	uint32_t chunk;
+	int64_t rc;
+
+	if (lpc_default_chip_id < 0)
+		return OPAL_PARAMETER;
+	chip = get_chip(lpc_default_chip_id);
+	if (!chip || !chip->lpc)
+		return OPAL_PARAMETER;
+	lpc = chip->lpc;
+
+	if (!len)
+		return OPAL_SUCCESS;
+	/* No wraparound, and FW segments are 256M */
+	if (addr + len < addr || ((addr + len - 1) >> 28) != (addr >> 28))
+		return OPAL_PARAMETER;
+
+	while (len) {
+		chunk = LPC_FW_CHUNK - (addr & (LPC_FW_CHUNK - 1));
+		chunk = MIN(len, chunk);
+		lock(&lpc->lock);
+		rc = lpc_fw_copy_chunk(lpc, addr, buf, chunk, is_write);
+		unlock(&lpc->lock);
+		if (rc)
+			return rc;
+		addr += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return OPAL_SUCCESS;
+}
+
+int64_t lpc_fw_read(uint32_t addr, void *buf, uint32_t len)
+{
+	return lpc_fw_copy(addr, buf, len, false);
+}
+
+int64_t lpc_fw_write(uint32_t addr, const void *buf, uint32_t len)
+{
+	return lpc_fw_copy(addr, (void *)buf, len, true);
+}
+
 /*
  * The "OPAL" variant add the emulation of 2 and 4 byte accesses using
  * byte accesses for IO and MEM space in order to be compatible with
@@ -1234,13 +1234,47 @@ static int64_t npu2_eeh_next_error(struct phb *phb,
 	return OPAL_SUCCESS;
 }
 
+static int64_t npu2_tce_kill_check(struct npu2 *npu, uint64_t pe_number,
+				   uint32_t tce_size)
+{
+	uint32_t tce_page_size;
+
+	tce_page_size = 1ULL << (
+			11 + GETFIELD(npu->tve_cache[pe_number],
+				NPU2_ATS_IODA_TBL_TVT_PSIZE));
+	if (tce_page_size != tce_size) {
+		NPU2ERR(npu, "npu2_tce_kill: Unexpected TCE size (got 0x%x expected 0x%x)\n",
+			tce_size, tce_page_size);
+		return OPAL_PARAMETER;
+	}
+	return OPAL_SUCCESS;
+}
+
+static void npu2_tce_kill_pages(struct npu2 *npu, uint64_t pe_number,
+				uint32_t tce_size, uint64_t dma_addr,
+				uint32_t npages)
+{
+	uint64_t val;
+
+	while (npages--) {
+		val = SETFIELD(NPU2_ATS_TCE_KILL_PENUM, dma_addr, pe_number);
+		npu2_write(npu, NPU2_ATS_TCE_KILL, NPU2_ATS_TCE_KILL_ONE | val);
+		dma_addr += tce_size;
+	}
+}
+
+/*
+ * For too many TCEs do not bother killing them one by one and simply
+ * flush everything, going to be lot faster.
+ */
+#define NPU2_TCE_KILL_ALL_PAGES	128
+
 static int64_t npu2_tce_kill(struct phb *phb, uint32_t kill_type,
 			     uint64_t pe_number, uint32_t tce_size,
 			     uint64_t dma_addr, uint32_t npages)
 {
 	struct npu2 *npu = phb_to_npu2_nvlink(phb);
-	uint32_t tce_page_size;
-	uint64_t val;
+	int64_t rc;
 
 	if (pe_number > NPU2_MAX_PE_NUM)
 		return OPAL_PARAMETER;
@@ -1248,27 +1282,15 @@ static int64_t npu2_tce_kill(struct phb *phb, uint32_t kill_type,
 	sync();
 	switch(kill_type) {
 	case OPAL_PCI_TCE_KILL_PAGES:
-		tce_page_size = 1ULL << (
-				11 + GETFIELD(npu->tve_cache[pe_number],
-					NPU2_ATS_IODA_TBL_TVT_PSIZE));
-		if (tce_page_size != tce_size) {
-			NPU2ERR(npu, "npu2_tce_kill: Unexpected TCE size (got 0x%x expected 0x%x)\n",
-				tce_size, tce_page_size);
-			return OPAL_PARAMETER;
-		}
+		rc = npu2_tce_kill_check(npu, pe_number, tce_size);
+		if (rc)
+			return rc;
 
-		if (npages < 128) {
-			while (npages--) {
-				val = SETFIELD(NPU2_ATS_TCE_KILL_PENUM, dma_addr, pe_number);
-				npu2_write(npu, NPU2_ATS_TCE_KILL, NPU2_ATS_TCE_KILL_ONE | val);
-				dma_addr += tce_size;
-			}
+		if (npages < NPU2_TCE_KILL_ALL_PAGES) {
+			npu2_tce_kill_pages(npu, pe_number, tce_size,
+					    dma_addr, npages);
 			break;
 		}
-		/*
-		 * For too many TCEs do not bother with the loop above and simply
-		 * flush everything, going to be lot faster.
-		 */
 		/* Fall through */
 	case OPAL_PCI_TCE_KILL_PE:
 		/*
@@ -1285,6 +1307,38 @@ static int64_t npu2_tce_kill(struct phb *phb, uint32_t kill_type,
 	return OPAL_SUCCESS;
 }
 
+static int64_t npu2_tce_kill_list(struct phb *phb,
+				  const struct pci_tce_kill *kills,
+				  uint32_t count)
+{
+	struct npu2 *npu = phb_to_npu2_nvlink(phb);
+	uint64_t npages = 0;
+	uint32_t i;
+	int64_t rc;
+
+	for (i = 0; i < count; i++) {
+		if (kills[i].pe_number > NPU2_MAX_PE_NUM)
+			return OPAL_PARAMETER;
+		rc = npu2_tce_kill_check(npu, kills[i].pe_number,
+					 kills[i].tce_size);
+		if (rc)
+			return rc;
+		npages += kills[i].npages;
+	}
+
+	sync();
+	if (npages >= NPU2_TCE_KILL_ALL_PAGES) {
+		npu2_write(npu, NPU2_ATS_TCE_KILL, NPU2_ATS_TCE_KILL_ALL);
+		return OPAL_SUCCESS;
+	}
+
+	for (i = 0; i < count; i++)
+		npu2_tce_kill_pages(npu, kills[i].pe_number, kills[i].tce_size,
+				    kills[i].dma_addr, kills[i].npages);
+
+	return OPAL_SUCCESS;
+}
+
 static const struct phb_ops npu_ops = {
 	.cfg_read8		= npu2_cfg_read8,
 	.cfg_read16		= npu2_cfg_read16,
@@ -1317,6 +1371,7 @@ static const struct phb_ops npu_ops = {
 	.set_capi_mode		= NULL,
 	.set_capp_recovery	= NULL,
 	.tce_kill		= npu2_tce_kill,
+	.tce_kill_list		= npu2_tce_kill_list,
 };
 
 static void assign_mmio_bars(uint64_t gcid, uint32_t scom, uint64_t reg[2], uint64_t mm_win[2])
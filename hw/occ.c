@@ -1805,10 +1805,14 @@ void occ_pstates_init(void)
 	if (occ_pstates_initialized)
 		return;
 
-	/* Add opal_poller to poll OCC throttle status of each chip */
+	/*
+	 * Add opal_poller to poll OCC throttle status of each chip. The
+	 * host can wait 10ms to hear of a change, so don't read the tables
+	 * on every poll.
+	 */
 	for_each_chip(chip)
 		chip->throttle = 0;
-	opal_add_poller(occ_throttle_poll, NULL);
+	opal_add_poller_sched(occ_throttle_poll, NULL, 10000);
 	occ_pstates_initialized = true;
 
 	/* Init OPAL-OCC command-response interface */
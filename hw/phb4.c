@@ -974,75 +974,128 @@ static int64_t phb4_wait_bit(struct phb4 *p, uint32_t reg,
 	return OPAL_SUCCESS;
 }
 
+static int64_t phb4_tce_kill_wait_slot(struct phb4 *p)
+{
+	/* Wait for a slot in the HW kill queue */
+	return phb4_wait_bit(p, PHB_TCE_KILL,
+			     PHB_TCE_KILL_ALL |
+			     PHB_TCE_KILL_PE |
+			     PHB_TCE_KILL_ONE, 0);
+}
+
+/* Check the page size and address, and get the page size selector */
+static int64_t phb4_tce_kill_psel(uint32_t tce_size, uint64_t dma_addr,
+				  uint64_t *psel)
+{
+	switch(tce_size) {
+	case 0x1000:
+		if (dma_addr & 0xf000000000000fffull)
+			return OPAL_PARAMETER;
+		*psel = 0;
+		break;
+	case 0x10000:
+		if (dma_addr & 0xf00000000000ffffull)
+			return OPAL_PARAMETER;
+		*psel = PHB_TCE_KILL_PSEL | PHB_TCE_KILL_64K;
+		break;
+	case 0x200000:
+		if (dma_addr & 0xf0000000001fffffull)
+			return OPAL_PARAMETER;
+		*psel = PHB_TCE_KILL_PSEL | PHB_TCE_KILL_2M;
+		break;
+	case 0x40000000:
+		if (dma_addr & 0xf00000003fffffffull)
+			return OPAL_PARAMETER;
+		*psel = PHB_TCE_KILL_PSEL | PHB_TCE_KILL_1G;
+		break;
+	default:
+		return OPAL_PARAMETER;
+	}
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb4_tce_kill_pages(struct phb4 *p, uint64_t pe_number,
+				   uint32_t tce_size, uint64_t dma_addr,
+				   uint32_t npages)
+{
+	uint64_t val, psel;
+	int64_t rc;
+
+	if (!npages)
+		return OPAL_SUCCESS;
+
+	/* Set appropriate page size */
+	rc = phb4_tce_kill_psel(tce_size, dma_addr, &psel);
+	if (rc)
+		return rc;
+
+	while (npages--) {
+		rc = phb4_tce_kill_wait_slot(p);
+		if (rc)
+			return rc;
+		val = SETFIELD(PHB_TCE_KILL_PENUM, dma_addr, pe_number);
+
+		/* Perform kill */
+		out_be64(p->regs + PHB_TCE_KILL, PHB_TCE_KILL_ONE | psel | val);
+		/* Next page */
+		dma_addr += tce_size;
+	}
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb4_tce_kill_pe(struct phb4 *p, uint64_t pe_number)
+{
+	int64_t rc;
+
+	rc = phb4_tce_kill_wait_slot(p);
+	if (rc)
+		return rc;
+	/* Perform kill */
+	out_be64(p->regs + PHB_TCE_KILL, PHB_TCE_KILL_PE |
+		 SETFIELD(PHB_TCE_KILL_PENUM, 0ull, pe_number));
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb4_tce_kill_sync(struct phb4 *p)
+{
+	int64_t rc;
+
+	/* Start DMA sync process */
+	out_be64(p->regs + PHB_DMARD_SYNC, PHB_DMARD_SYNC_START);
+
+	/* Wait for kill to complete */
+	rc = phb4_wait_bit(p, PHB_Q_DMA_R, PHB_Q_DMA_R_TCE_KILL_STATUS, 0);
+	if (rc)
+		return rc;
+
+	/* Wait for DMA sync to complete */
+	return phb4_wait_bit(p, PHB_DMARD_SYNC,
+			     PHB_DMARD_SYNC_COMPLETE,
+			     PHB_DMARD_SYNC_COMPLETE);
+}
+
 static int64_t phb4_tce_kill(struct phb *phb, uint32_t kill_type,
 			     uint64_t pe_number, uint32_t tce_size,
 			     uint64_t dma_addr, uint32_t npages)
 {
 	struct phb4 *p = phb_to_phb4(phb);
-	uint64_t val;
 	int64_t rc;
 
 	sync();
 	switch(kill_type) {
 	case OPAL_PCI_TCE_KILL_PAGES:
-		while (npages--) {
-			/* Wait for a slot in the HW kill queue */
-			rc = phb4_wait_bit(p, PHB_TCE_KILL,
-					   PHB_TCE_KILL_ALL |
-					   PHB_TCE_KILL_PE |
-					   PHB_TCE_KILL_ONE, 0);
-			if (rc)
-				return rc;
-			val = SETFIELD(PHB_TCE_KILL_PENUM, dma_addr, pe_number);
-
-			/* Set appropriate page size */
-			switch(tce_size) {
-			case 0x1000:
-				if (dma_addr & 0xf000000000000fffull)
-					return OPAL_PARAMETER;
-				break;
-			case 0x10000:
-				if (dma_addr & 0xf00000000000ffffull)
-					return OPAL_PARAMETER;
-				val |= PHB_TCE_KILL_PSEL | PHB_TCE_KILL_64K;
-				break;
-			case 0x200000:
-				if (dma_addr & 0xf0000000001fffffull)
-					return OPAL_PARAMETER;
-				val |= PHB_TCE_KILL_PSEL | PHB_TCE_KILL_2M;
-				break;
-			case 0x40000000:
-				if (dma_addr & 0xf00000003fffffffull)
-					return OPAL_PARAMETER;
-				val |= PHB_TCE_KILL_PSEL | PHB_TCE_KILL_1G;
-				break;
-			default:
-				return OPAL_PARAMETER;
-			}
-			/* Perform kill */
-			out_be64(p->regs + PHB_TCE_KILL, PHB_TCE_KILL_ONE | val);
-			/* Next page */
-			dma_addr += tce_size;
-		}
+		rc = phb4_tce_kill_pages(p, pe_number, tce_size, dma_addr,
+					 npages);
+		if (rc)
+			return rc;
 		break;
 	case OPAL_PCI_TCE_KILL_PE:
-		/* Wait for a slot in the HW kill queue */
-		rc = phb4_wait_bit(p, PHB_TCE_KILL,
-				   PHB_TCE_KILL_ALL |
-				   PHB_TCE_KILL_PE |
-				   PHB_TCE_KILL_ONE, 0);
+		rc = phb4_tce_kill_pe(p, pe_number);
 		if (rc)
 			return rc;
-		/* Perform kill */
-		out_be64(p->regs + PHB_TCE_KILL, PHB_TCE_KILL_PE |
-			 SETFIELD(PHB_TCE_KILL_PENUM, 0ull, pe_number));
 		break;
 	case OPAL_PCI_TCE_KILL_ALL:
-		/* Wait for a slot in the HW kill queue */
-		rc = phb4_wait_bit(p, PHB_TCE_KILL,
-				   PHB_TCE_KILL_ALL |
-				   PHB_TCE_KILL_PE |
-				   PHB_TCE_KILL_ONE, 0);
+		rc = phb4_tce_kill_wait_slot(p);
 		if (rc)
 			return rc;
 		/* Perform kill */
@@ -1052,18 +1105,60 @@ static int64_t phb4_tce_kill(struct phb *phb, uint32_t kill_type,
 		return OPAL_PARAMETER;
 	}
 
-	/* Start DMA sync process */
-	out_be64(p->regs + PHB_DMARD_SYNC, PHB_DMARD_SYNC_START);
+	return phb4_tce_kill_sync(p);
+}
 
-	/* Wait for kill to complete */
-	rc = phb4_wait_bit(p, PHB_Q_DMA_R, PHB_Q_DMA_R_TCE_KILL_STATUS, 0);
-	if (rc)
-		return rc;
+/*
+ * Above this many pages for one PE, killing the whole PE is cheaper than
+ * queueing the pages one at a time.
+ */
+#define PHB4_TCE_KILL_PE_PAGES	128
 
-	/* Wait for DMA sync to complete */
-	return phb4_wait_bit(p, PHB_DMARD_SYNC,
-			     PHB_DMARD_SYNC_COMPLETE,
-			     PHB_DMARD_SYNC_COMPLETE);
+static int64_t phb4_tce_kill_list(struct phb *phb,
+				  const struct pci_tce_kill *kills,
+				  uint32_t count)
+{
+	struct phb4 *p = phb_to_phb4(phb);
+	uint32_t i, j;
+	uint64_t npages, psel;
+	int64_t rc;
+
+	sync();
+	for (i = 0; i < count; i = j) {
+		/*
+		 * The list is sorted, so a PE's ranges are together. Check
+		 * them all first, so the PE shortcut refuses the same
+		 * ranges as killing page by page would.
+		 */
+		npages = 0;
+		for (j = i; j < count &&
+			     kills[j].pe_number == kills[i].pe_number; j++) {
+			rc = phb4_tce_kill_psel(kills[j].tce_size,
+						kills[j].dma_addr, &psel);
+			if (rc)
+				return rc;
+			npages += kills[j].npages;
+		}
+
+		if (npages > PHB4_TCE_KILL_PE_PAGES) {
+			rc = phb4_tce_kill_pe(p, kills[i].pe_number);
+			if (rc)
+				return rc;
+			continue;
+		}
+
+		for (; i < j; i++) {
+			rc = phb4_tce_kill_pages(p, kills[i].pe_number,
+						 kills[i].tce_size,
+						 kills[i].dma_addr,
+						 kills[i].npages);
+			if (rc)
+				return rc;
+		}
+	}
+
+	/* One sync for the lot */
+	return phb4_tce_kill_sync(p);
 }
 
 /* phb4_ioda_reset - Reset the IODA tables
@@ -4881,6 +4976,7 @@ static const struct phb_ops phb4_ops = {
 	.err_inject		= phb4_err_inject,
 	.get_diag_data2		= phb4_get_diag_data,
 	.tce_kill		= phb4_tce_kill,
+	.tce_kill_list		= phb4_tce_kill_list,
 	.set_capi_mode		= phb4_set_capi_mode,
 	.set_p2p		= phb4_set_p2p,
 	.set_capp_recovery	= phb4_set_capp_recovery,
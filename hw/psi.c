@@ -932,10 +932,10 @@ void psi_fsp_link_in_use(struct psi *psi __unused)
 {
 	static bool poller_created = false;
 
-	/* Do this once only */
+	/* Do this once only, the link is checked every 10 seconds */
 	if (!poller_created) {
 		poller_created = true;
-		opal_add_poller(psi_link_poll, NULL);
+		opal_add_poller_sched(psi_link_poll, NULL, 1000000);
 	}
 }
 
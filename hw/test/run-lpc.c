@@ -0,0 +1,381 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Test the LPC FW space bulk copies against a fake OPB MMIO window
+ *
+ * Copyright 2020 IBM Corp.
+ */
+
+#define __TEST__
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <skiboot-valgrind.h>
+
+/* The MMIO accessors go to the fake OPB below */
+#define __IO_H
+#include <types.h>
+#include <ccan/endian/endian.h>
+
+#define FAKE_MBASE	((uintptr_t)0x100000000000ul)
+#define FAKE_FW_BASE	0xf0000000u	/* lpc_fw_opb_base */
+#define FAKE_FW_OFF	0x0fe00000u	/* Flash window, top of segment 0 */
+#define FAKE_FW_SIZE	0x100000u
+#define FAKE_REG_BASE	0xc0012000u	/* lpc_reg_opb_base */
+
+static uint8_t fw_space[FAKE_FW_SIZE];
+static uint32_t fw_idsel_reg, fw_rdsz_reg;
+static unsigned long mmio_ops, reg_writes;
+
+static uint8_t *fake_fw(const volatile void *addr, uint32_t sz)
+{
+	uint32_t opb = (uintptr_t)addr - FAKE_MBASE;
+
+	assert(opb >= FAKE_FW_BASE + FAKE_FW_OFF);
+	assert(opb + sz <= FAKE_FW_BASE + FAKE_FW_OFF + FAKE_FW_SIZE);
+	/* The host controller was set up for this segment */
+	assert(fw_idsel_reg == ((opb - FAKE_FW_BASE) >> 28));
+	mmio_ops++;
+	return &fw_space[opb - FAKE_FW_BASE - FAKE_FW_OFF];
+}
+
+static uint32_t *fake_reg(const volatile void *addr)
+{
+	uint32_t opb = (uintptr_t)addr - FAKE_MBASE;
+
+	if (opb == FAKE_REG_BASE + 0x24)
+		return &fw_idsel_reg;
+	if (opb == FAKE_REG_BASE + 0x28)
+		return &fw_rdsz_reg;
+	assert(false);
+	return NULL;
+}
+
+static void fake_check_rdsz(uint32_t sz)
+{
+	assert(fw_rdsz_reg == (sz == 4 ? 0x02000000 : 0));
+}
+
+static inline void sync(void) { }
+
+static inline uint8_t __in_8(const volatile uint8_t *addr)
+{
+	fake_check_rdsz(1);
+	return *fake_fw(addr, 1);
+}
+#define in_8 __in_8
+
+static inline uint16_t in_be16(const volatile uint16_t *addr)
+{
+	(void)addr;
+	assert(false);
+	return 0;
+}
+
+static inline uint32_t __in_be32(const volatile uint32_t *addr)
+{
+	uint32_t opb = (uintptr_t)addr - FAKE_MBASE;
+	__be32 val;
+
+	if (opb < FAKE_FW_BASE)
+		return *fake_reg(addr);
+	fake_check_rdsz(4);
+	memcpy(&val, fake_fw(addr, 4), 4);
+	return be32_to_cpu(val);
+}
+#define in_be32 __in_be32
+
+static inline void __out_8(volatile uint8_t *addr, uint8_t val)
+{
+	*fake_fw(addr, 1) = val;
+}
+#define out_8 __out_8
+
+static inline void out_be16(volatile uint16_t *addr, uint16_t val)
+{
+	(void)addr;
+	(void)val;
+	assert(false);
+}
+
+static inline void __out_be32(volatile uint32_t *addr, uint32_t val)
+{
+	uint32_t opb = (uintptr_t)addr - FAKE_MBASE;
+	__be32 v = cpu_to_be32(val);
+
+	if (opb < FAKE_FW_BASE) {
+		*fake_reg(addr) = val;
+		reg_writes++;
+		return;
+	}
+	memcpy(fake_fw(addr, 4), &v, 4);
+}
+#define out_be32 __out_be32
+
+#define zalloc(size) calloc((size), 1)
+
+/* The error logs print int64_t with %lld */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "../lpc.c"
+#pragma GCC diagnostic pop
+#include "../../core/device.c"
+#include "../../ccan/list/list.c"
+
+static struct lpcm fake_lpc;
+static struct proc_chip fake_chip;
+
+char __rodata_start[1], __rodata_end[1];
+u64 top_of_ram = -1ul;
+bool manufacturing_mode;
+
+void _prlog(int log_level, const char *fmt, ...)
+{
+	(void)log_level;
+	(void)fmt;
+}
+
+/* Nothing here goes through XSCOM or needs the rest of skiboot */
+int _xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val,
+		bool take_lock)
+{
+	(void)partid;
+	(void)pcb_addr;
+	(void)val;
+	(void)take_lock;
+	return OPAL_HARDWARE;
+}
+
+int _xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val,
+		 bool take_lock)
+{
+	(void)partid;
+	(void)pcb_addr;
+	(void)val;
+	(void)take_lock;
+	return OPAL_HARDWARE;
+}
+
+bool xscom_ok(void)
+{
+	return true;
+}
+
+void xscom_used_by_console(void)
+{
+}
+
+void time_wait_nopoll(unsigned long duration)
+{
+	(void)duration;
+}
+
+uint32_t log_simple_error(struct opal_err_info *e_info, const char *fmt, ...)
+{
+	(void)e_info;
+	(void)fmt;
+	return 0;
+}
+
+/* Only for expanding a flattened tree */
+int fdt_check_header(const void *fdt)
+{
+	(void)fdt;
+	return -1;
+}
+
+int fdt_check_node_offset_(const void *fdt, int offset)
+{
+	(void)fdt;
+	(void)offset;
+	return -1;
+}
+
+uint32_t fdt_next_tag(const void *fdt, int offset, int *nextoffset)
+{
+	(void)fdt;
+	(void)offset;
+	(void)nextoffset;
+	return 0;
+}
+
+const char *fdt_string(const void *fdt, int stroffset)
+{
+	(void)fdt;
+	(void)stroffset;
+	return NULL;
+}
+
+const char *fdt_get_name(const void *fdt, int nodeoffset, int *lenp)
+{
+	(void)fdt;
+	(void)nodeoffset;
+	(void)lenp;
+	return NULL;
+}
+
+void __opal_register(uint64_t token, void *func, unsigned num_args)
+{
+	(void)token;
+	(void)func;
+	(void)num_args;
+}
+
+struct proc_chip *next_chip(struct proc_chip *chip)
+{
+	return chip ? NULL : &fake_chip;
+}
+
+struct proc_chip *get_chip(uint32_t chip_id)
+{
+	return chip_id ? NULL : &fake_chip;
+}
+
+void lock_caller(struct lock *l, const char *caller)
+{
+	(void)caller;
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
+bool lock_held_by_me(struct lock *l)
+{
+	return l->lock_val;
+}
+
+/* The way the flash backends copied windows before */
+static int64_t ref_read(uint32_t off, void *buf, uint32_t len)
+{
+	uint32_t chunk, dat;
+	int64_t rc;
+
+	while (len) {
+		if (len > 3 && !(off & 3)) {
+			rc = lpc_read(OPAL_LPC_FW, off, &dat, 4);
+			if (!rc)
+				*(__be32 *)buf = cpu_to_be32(dat);
+			chunk = 4;
+		} else {
+			rc = lpc_read(OPAL_LPC_FW, off, &dat, 1);
+			if (!rc)
+				*(uint8_t *)buf = dat;
+			chunk = 1;
+		}
+		if (rc)
+			return rc;
+		len -= chunk;
+		off += chunk;
+		buf += chunk;
+	}
+
+	return 0;
+}
+
+static void test_copy(void)
+{
+	static uint8_t buf[0x3000], ref[0x3000];
+	uint32_t base = FAKE_FW_OFF, i, off, len;
+	unsigned long ops;
+
+	for (i = 0; i < FAKE_FW_SIZE; i++)
+		fw_space[i] = i * 7 + (i >> 8);
+
+	/* Same bytes, same order as a loop of lpc_read() */
+	for (off = 0; off < 8; off++) {
+		for (len = 0; len < 12; len++) {
+			memset(buf, 0, sizeof(buf));
+			memset(ref, 0, sizeof(ref));
+			assert(!lpc_fw_read(base + off, buf, len));
+			assert(!ref_read(base + off, ref, len));
+			assert(!memcmp(buf, ref, sizeof(buf)));
+			assert(!memcmp(buf, fw_space + off, len));
+		}
+	}
+
+	/* Spans chunks, with word accesses apart from the ends */
+	mmio_ops = 0;
+	assert(!lpc_fw_read(base + 3, buf, 0x2ffe));
+	assert(!memcmp(buf, fw_space + 3, 0x2ffe));
+	assert(mmio_ops == 1 + (0x2ffe - 2) / 4 + 1);
+	assert(!fake_lpc.lock.lock_val);
+
+	/* The host controller is only told about size changes */
+	reg_writes = 0;
+	assert(!lpc_fw_read(base, buf, 0x3000));
+	assert(reg_writes <= 1);
+
+	/* Writes */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = ~i;
+	ops = mmio_ops;
+	assert(!lpc_fw_write(base + 0x101, buf, 0x2001));
+	assert(!memcmp(fw_space + 0x101, buf, 0x2001));
+	assert(mmio_ops - ops == 3 + 0x1ffc / 4 + 2);
+	assert(fw_space[0x100] == (uint8_t)(0x100 * 7 + 1));
+	assert(fw_space[0x2102] == (uint8_t)(0x2102 * 7 + 0x21));
+
+	/* Ranges we can't do */
+	assert(lpc_fw_read(0x0ffffffe, buf, 4) == OPAL_PARAMETER);
+	assert(lpc_fw_read(0xfffffffe, buf, 4) == OPAL_PARAMETER);
+	assert(lpc_fw_write(0x1ffffffc, buf, 8) == OPAL_PARAMETER);
+	assert(!lpc_fw_read(0x0ffffffe, buf, 0));
+	lpc_default_chip_id = 1;
+	assert(lpc_fw_read(base, buf, 4) == OPAL_PARAMETER);
+	lpc_default_chip_id = 0;
+}
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench(void)
+{
+	static uint8_t buf[FAKE_FW_SIZE];
+	unsigned int i, loops = RUNNING_ON_VALGRIND ? 1 : 50;
+	double t, bulk, ref;
+
+	t = now_usecs();
+	for (i = 0; i < loops; i++)
+		assert(!ref_read(FAKE_FW_OFF, buf, FAKE_FW_SIZE));
+	ref = now_usecs() - t;
+
+	t = now_usecs();
+	for (i = 0; i < loops; i++)
+		assert(!lpc_fw_read(FAKE_FW_OFF, buf, FAKE_FW_SIZE));
+	bulk = now_usecs() - t;
+
+	/* The bus itself is free here, this is the software overhead */
+	printf("LPC FW read bench: lpc_read loop %.0f MB/s, "
+	       "lpc_fw_read %.0f MB/s\n",
+	       loops * (double)FAKE_FW_SIZE / ref,
+	       loops * (double)FAKE_FW_SIZE / bulk);
+}
+
+int main(void)
+{
+	init_lock(&fake_lpc.lock);
+	fake_lpc.mbase = (void *)FAKE_MBASE;
+	fake_lpc.fw_idsel = 0xff;
+	fake_lpc.fw_rdsz = 0xff;
+	fake_chip.lpc = &fake_lpc;
+	lpc_default_chip_id = 0;
+
+	test_copy();
+	bench();
+
+	return 0;
+}
@@ -11,6 +11,7 @@
 #include <opal.h>
 #include <stack.h>
 #include <timer.h>
+#include <pool.h>
 
 /*
  * cpu_thread is our internal structure representing each
@@ -30,6 +31,7 @@ enum cpu_thread_state {
 
 struct cpu_job;
 struct xive_cpu_state;
+struct opal_lat_cpu;
 
 struct cpu_thread {
 	/*
@@ -50,6 +52,8 @@ struct cpu_thread {
 	uint32_t			in_opal_call;
 	uint32_t			quiesce_opal_call;
 	uint64_t entered_opal_call_at;
+	struct opal_lat_cpu		*opal_lat;
+	uint32_t			irq_readers;
 	uint32_t			con_suspend;
 	struct list_head		locks_held;
 	bool				con_need_flush;
@@ -74,6 +78,8 @@ struct cpu_thread {
 	struct list_head		job_queue;
 	uint32_t			job_count;
 	bool				job_has_no_return;
+	/* Per-CPU magazines of the pool caches */
+	struct pool_magazine		*pool_mags[POOL_CACHE_MAX];
 	/*
 	 * Per-core mask tracking for threads in HMI handler and
 	 * a cleanup done bit.
@@ -261,11 +267,44 @@ static inline struct cpu_job *cpu_queue_job(struct cpu_thread *cpu,
 	return __cpu_queue_job(cpu, name, func, data, false);
 }
 
+/*
+ * Queue a job on any other CPU. Unlike cpu_queue_job(NULL, ...) it's
+ * never run synchronously, NULL is returned if nobody can take it.
+ */
+extern struct cpu_job *cpu_queue_job_remote(const char *name,
+					    void (*func)(void *data),
+					    void *data);
+
 extern struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 				       const char *name,
 				       void (*func)(void *data), void *data);
 
 
+/*
+ * A set of jobs to wait for together. Each is freed as it completes and
+ * the CPU which initialised the group, the only one which may wait for
+ * it, is woken up once they all have.
+ */
+struct cpu_job_group {
+	uint32_t		pending;
+	struct cpu_thread	*waiter;
+};
+
+extern void cpu_job_group_init(struct cpu_job_group *grp);
+
+/* Queue a job in the group on @cpu, or anywhere if NULL */
+extern bool cpu_job_group_queue(struct cpu_job_group *grp,
+				struct cpu_thread *cpu, const char *name,
+				void (*func)(void *data), void *data);
+
+/* Queue a job in the group on @chip_id if it has a CPU, else anywhere */
+extern bool cpu_job_group_queue_on_node(struct cpu_job_group *grp,
+					uint32_t chip_id, const char *name,
+					void (*func)(void *data), void *data);
+
+/* Wait for all the jobs in the group, helping out while booting */
+extern void cpu_job_group_wait(struct cpu_job_group *grp);
+
 /* Poll job status, returns true if completed */
 extern bool cpu_poll_job(struct cpu_job *job);
 
@@ -281,6 +320,8 @@ extern void cpu_process_jobs(void);
 extern void cpu_process_local_jobs(void);
 /* Check if there's any job pending */
 bool cpu_check_jobs(struct cpu_thread *cpu);
+/* Run a job queued on a busier CPU, returns false if there was none */
+extern bool cpu_steal_jobs(void);
 
 /* Set/clear HILE on all CPUs */
 void cpu_set_hile_mode(bool hile);
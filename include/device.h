@@ -18,10 +18,25 @@
  * Note that the add_* routines will make a copy of the name if it's not
  * a read-only string (ie. usually a string literal).
  */
+/*
+ * Hash chain entry for the lookup indexes (see core/device.c). pprev
+ * points at whatever points at us, so an entry can be unlinked, or fixed
+ * up after it moves, without knowing which index it's in.
+ */
+struct dt_hnode {
+	struct dt_hnode *next;
+	struct dt_hnode **pprev;
+	u32 hash;
+};
+
+struct dt_index;
+
 struct dt_property {
 	struct list_node list;
+	struct dt_hnode hash;
 	const char *name;
 	size_t len;
+	size_t size;	/* Space allocated for prop[] */
 	char prop[/* len */];
 };
 
@@ -32,6 +47,23 @@ struct dt_node {
 	struct list_head children;
 	struct dt_node *parent;
 	u32 phandle;
+
+	/* Lookup indexes */
+	u32 nr_children;
+	u32 nr_props;
+	struct dt_hnode name_hash;
+	struct dt_hnode phandle_hash;
+	struct dt_index *child_index;
+	struct dt_index *prop_index;
+
+	/*
+	 * Flattened tree cache (see core/fdt.c): where this node's
+	 * subtree sits relative to its parent's, and whether it changed
+	 * since. Only changes made through the dt_* API are noticed.
+	 */
+	bool flat_dirty;
+	u32 flat_off;
+	u32 flat_len;
 };
 
 /* This is shared with device_tree.c .. make it static when
@@ -42,6 +74,9 @@ extern u32 last_phandle;
 extern struct dt_node *dt_root;
 extern struct dt_node *dt_chosen;
 
+/* Set by changes the flattened tree cache can't pin on a node */
+extern bool dt_flat_stale;
+
 /* Create a root node: ie. a parentless one. */
 struct dt_node *dt_new_root(const char *name);
 
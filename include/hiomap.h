@@ -24,6 +24,7 @@
 #define HIOMAP_C_ERASE                  10
 #define HIOMAP_C_DEVICE_NAME            11
 #define HIOMAP_C_LOCK                   12
+#define HIOMAP_C_COUNT                  (HIOMAP_C_LOCK + 1)
 
 #define HIOMAP_E_ACK_MASK               0x3
 #define HIOMAP_E_PROTOCOL_RESET	        (1 << 0)
@@ -52,4 +53,19 @@ struct hiomap_v2_create_window {
     le16 offset;
 } __packed;
 
+/* Round-trip statistics for one command, times in timebase ticks */
+struct hiomap_rtt {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+};
+
+static inline void hiomap_rtt_account(struct hiomap_rtt *rtt, uint64_t tb)
+{
+    rtt->count++;
+    rtt->total += tb;
+    if (tb > rtt->max)
+        rtt->max = tb;
+}
+
 #endif /* __HIOMAP_H */
@@ -167,6 +167,11 @@ extern void __register_irq_source(struct irq_source *is, bool secondary);
 extern void register_irq_source(const struct irq_source_ops *ops, void *data,
 				uint32_t start, uint32_t count);
 extern void unregister_irq_source(uint32_t start, uint32_t count);
+
+/* Lockless. The OPAL XICS entry points and irq_source_eoi() keep the
+ * source alive across their callback, other users must make sure it
+ * can't be unregistered under them.
+ */
 extern struct irq_source *irq_find_source(uint32_t isn);
 
 /* Warning: callback is called with internal source lock held
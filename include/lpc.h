@@ -102,6 +102,15 @@ extern int64_t lpc_probe_write(enum OpalLPCAddressType addr_type, uint32_t addr,
 extern int64_t lpc_probe_read(enum OpalLPCAddressType addr_type, uint32_t addr,
 			      uint32_t *data, uint32_t sz);
 
+/*
+ * Copy @len bytes between @buf and FW space at @addr, in address order.
+ * Much faster than lpc_read()/lpc_write() in a loop, the range is
+ * checked once and as many accesses as possible are 4 bytes wide. The
+ * range must not cross a 256M FW segment.
+ */
+extern int64_t lpc_fw_read(uint32_t addr, void *buf, uint32_t len);
+extern int64_t lpc_fw_write(uint32_t addr, const void *buf, uint32_t len);
+
 /* Mark LPC bus as used by console */
 extern void lpc_used_by_console(void);
 
@@ -28,6 +28,12 @@ enum mem_region_type {
 	REGION_OS,
 };
 
+/*
+ * Free blocks are kept in segregated lists, one per power-of-two size
+ * class (in longs). The last list catches everything larger.
+ */
+#define MEM_REGION_FREE_BINS	16
+
 /* An area of physical memory. */
 struct mem_region {
 	struct list_node list;
@@ -35,7 +41,8 @@ struct mem_region {
 	uint64_t start, len;
 	struct dt_node *node;
 	enum mem_region_type type;
-	struct list_head free_list;
+	struct list_head free_list[MEM_REGION_FREE_BINS];
+	unsigned long free_bins;	/* bitmap of non-empty free_list[] */
 	struct lock free_list_lock;
 };
 
@@ -227,7 +227,9 @@
 #define OPAL_SECVAR_ENQUEUE_UPDATE		178
 #define OPAL_PHB_SET_OPTION			179
 #define OPAL_PHB_GET_OPTION			180
-#define OPAL_LAST				180
+#define OPAL_PCI_TCE_KILL_LIST			181
+#define OPAL_GET_MSGS				182
+#define OPAL_LAST				182
 
 #define QUIESCE_HOLD			1 /* Spin all calls at entry */
 #define QUIESCE_REJECT			2 /* Fail all calls with OPAL_BUSY */
@@ -1144,6 +1146,16 @@ enum {
 	OPAL_PCI_TCE_KILL_ALL,
 };
 
+/* Argument to OPAL_PCI_TCE_KILL_LIST, an array of pages to kill */
+struct opal_tce_kill_range {
+	__be64 pe_number;
+	__be64 dma_addr;
+	__be32 tce_size;
+	__be32 npages;
+};
+
+#define OPAL_PCI_TCE_KILL_LIST_MAX	256
+
 /* The xive operation mode indicates the active "API" and
  * corresponds to the "mode" parameter of the opal_xive_reset()
  * call
@@ -60,12 +60,25 @@ extern void __opal_register(uint64_t token, void *func, unsigned num_args);
 
 int64_t opal_quiesce(uint32_t shutdown_type, int32_t cpu);
 
+/*
+ * Allocate @size bytes of zeroed memory on this chip, and export them to
+ * the host as firmware/exports/@name. Returns NULL on failure.
+ */
+extern void *opal_export_alloc(const char *name, size_t size);
+
 /* Warning: no locking at the moment, do at init time only
  *
  * XXX TODO: Add the big RCU-ish "opal API lock" to protect us here
  * which will also be used for other things such as runtime updates
  */
-extern void opal_add_poller(void (*poller)(void *data), void *data);
+extern void __opal_add_poller(void (*poller)(void *data), void *data,
+			      const char *name, uint32_t interval_us);
+#define opal_add_poller(poller, data)					\
+	__opal_add_poller(poller, data, #poller, 0)
+
+/* Run @poller at most every @interval_us */
+#define opal_add_poller_sched(poller, data, interval_us)		\
+	__opal_add_poller(poller, data, #poller, interval_us)
 extern void opal_del_poller(void (*poller)(void *data));
 extern void opal_run_pollers(void);
 
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2019 IBM Corp. */
+
+#ifndef __OPAL_LATENCY_H
+#define __OPAL_LATENCY_H
+
+#include <types.h>
+#include <opal-api.h>
+
+/*
+ * Per-CPU, per-token OPAL call latency histograms.
+ *
+ * Exported read-only to the host as firmware/exports/opal_latency, so
+ * they can be read while the machine runs. All fields are big endian.
+ * The region is a struct opal_lat_header followed by nr_cpus blocks of
+ * cpu_size bytes, each a struct opal_lat_cpu.
+ *
+ * Bucket n counts calls which took [2^n, 2^(n+1)) timebase ticks (bucket
+ * 0 also counts calls under one tick), the last bucket counts anything
+ * longer. Counters wrap, so readers should look at deltas.
+ */
+#define OPAL_LAT_VERSION	1
+#define OPAL_LAT_BUCKETS	32
+
+struct opal_lat_header {
+	__be32 version;
+	__be32 nr_cpus;
+	__be32 nr_tokens;
+	__be32 nr_buckets;
+	__be64 tb_hz;
+	__be64 cpu_size;
+};
+
+struct opal_lat_token {
+	/* Sum of all latencies, for the mean */
+	__be64 total_tb;
+	/* Worst latency seen on this CPU */
+	__be64 max_tb;
+	__be32 buckets[OPAL_LAT_BUCKETS];
+};
+
+struct opal_lat_cpu {
+	__be32 pir;
+	__be32 reserved;
+	struct opal_lat_token tokens[OPAL_LAST + 1];
+};
+
+struct cpu_thread;
+
+/* Allocate and export the histograms. Depends on add_opal_node() */
+void opal_lat_init(void);
+
+/* Account one call of @token which took @tb timebase ticks */
+void opal_lat_record(struct cpu_thread *cpu, uint64_t token, uint64_t tb);
+
+#endif /* __OPAL_LATENCY_H */
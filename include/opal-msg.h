@@ -21,6 +21,40 @@
 #define OPAL_MSG_FIXED_PARAMS_SIZE	\
 				(sizeof(struct opal_msg) - OPAL_MSG_HDR_SIZE)
 
+/* Capacity of the message ring, a power of 2 */
+#define OPAL_MSG_RING_SIZE	256
+
+/* Most messages returned by one OPAL_GET_MSGS call */
+#define OPAL_GET_MSGS_MAX	32
+
+/*
+ * OPAL message statistics.
+ *
+ * Exported read-only to the host as firmware/exports/opal_msg_stats. All
+ * fields are big endian. The region is a struct opal_msg_stats_header
+ * followed by nr_types entries of entry_size bytes, each a struct
+ * opal_msg_type_stats, indexed by message type.
+ */
+#define OPAL_MSG_STATS_VERSION	1
+
+struct opal_msg_stats_header {
+	__be32 version;
+	__be32 nr_types;
+	__be32 ring_size;
+	__be32 entry_size;
+};
+
+struct opal_msg_type_stats {
+	__be64 queued;
+	/* Messages lost, as the ring was full and allocating failed */
+	__be64 dropped;
+	/* Queued and not consumed yet, and the most there ever were */
+	__be32 pending;
+	__be32 high_water;
+	/* Messages which found the ring full and were queued outside it */
+	__be64 overflowed;
+};
+
 int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
 		    void (*consumed)(void *data, int status),
 		    size_t params_size, const void *params);
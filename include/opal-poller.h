@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2019 IBM Corp. */
+
+#ifndef __OPAL_POLLER_H
+#define __OPAL_POLLER_H
+
+#include <types.h>
+
+/*
+ * OPAL poller statistics.
+ *
+ * Exported read-only to the host as firmware/exports/opal_pollers. All
+ * fields are big endian. The region is a struct opal_poller_header
+ * followed by up to max_pollers entries of entry_size bytes, each a
+ * struct opal_poller_stats; nr_pollers of them are in use. Pollers
+ * registered once the table is full run normally but aren't exported.
+ *
+ * Times are in timebase ticks. A poller which runs on several CPUs at
+ * once may lose an update now and then, these are statistics.
+ */
+#define OPAL_POLLER_VERSION	1
+#define OPAL_POLLER_MAX		64
+#define OPAL_POLLER_NAME_LEN	32
+
+struct opal_poller_header {
+	__be32 version;
+	__be32 nr_pollers;
+	__be32 max_pollers;
+	__be32 reserved;
+	__be64 tb_hz;
+	__be64 entry_size;
+};
+
+struct opal_poller_stats {
+	char name[OPAL_POLLER_NAME_LEN];
+	/* Minimum time between runs, 0 to run on every poll */
+	__be64 interval_tb;
+	__be64 runs;
+	/* Polls which found it not due yet, or claimed by another CPU */
+	__be64 skips;
+	__be64 total_tb;
+	__be64 max_tb;
+};
+
+/* Allocate and export the statistics. Depends on add_opal_node() */
+void opal_poller_init(void);
+
+/* Run the pollers that are due */
+void opal_run_poller_list(void);
+
+#endif /* __OPAL_POLLER_H */
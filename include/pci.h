@@ -201,6 +201,14 @@ struct pci_lsi_state {
 struct phb;
 extern int last_phb_id;
 
+/* One range of OPAL_PCI_TCE_KILL_LIST, in host order */
+struct pci_tce_kill {
+	uint64_t	pe_number;
+	uint64_t	dma_addr;
+	uint32_t	tce_size;
+	uint32_t	npages;
+};
+
 struct phb_ops {
 	/*
 	 * Config space ops
@@ -327,6 +335,15 @@ struct phb_ops {
 			    uint64_t pe_number, uint32_t tce_size,
 			    uint64_t dma_addr, uint32_t npages);
 
+	/*
+	 * Kill a list of page ranges at once, sorted by PE, page size and
+	 * address, with adjacent ranges merged. Optional, the core falls
+	 * back to tce_kill() for each range.
+	 */
+	int64_t (*tce_kill_list)(struct phb *phb,
+				 const struct pci_tce_kill *kills,
+				 uint32_t count);
+
 	/* Put phb in capi mode or pcie mode */
 	int64_t (*set_capi_mode)(struct phb *phb, uint64_t mode,
 				 uint64_t pe_number);
@@ -374,6 +391,9 @@ struct phb {
 	uint32_t		mps;
 	bitmap_t		*filter_map;
 
+	/* Devices by BDFN, one 256 entry table per bus, on demand */
+	struct pci_device	**dev_map[0x100];
+
 	/* PCI-X only slot info, for PCI-E this is in the RC bridge */
 	struct pci_slot		*slot;
 
@@ -11,6 +11,7 @@ struct pci_slot;
 struct errorlog;
 struct npu2;
 struct npu3;
+struct xz_decompress;
 
 enum resource_id {
 	RESOURCE_ID_KERNEL,
@@ -234,6 +235,16 @@ struct platform {
 						  uint32_t idx,
 						  void *buf, size_t *len);
 
+	/*
+	 * As start_preload_resource(), also decompressing the resource
+	 * into xz->dst as it's loaded. Optional, the caller decompresses
+	 * it once it's loaded otherwise.
+	 */
+	int		(*start_preload_resource_xz)(enum resource_id id,
+						     uint32_t idx,
+						     void *buf, size_t *len,
+						     struct xz_decompress *xz);
+
 	/*
 	 * Returns true when resource is loaded.
 	 * Only has to return true once, for the
@@ -306,6 +317,10 @@ extern void probe_platform(void);
 extern int start_preload_resource(enum resource_id id, uint32_t subid,
 				  void *buf, size_t *len);
 
+extern int start_preload_resource_xz(enum resource_id id, uint32_t subid,
+				     void *buf, size_t *len,
+				     struct xz_decompress *xz);
+
 extern int resource_loaded(enum resource_id id, uint32_t idx);
 
 extern int wait_for_resource_loaded(enum resource_id id, uint32_t idx);
@@ -7,6 +7,7 @@
 #include <ccan/list/list.h>
 #include <stddef.h>
 #include <compiler.h>
+#include <lock.h>
 
 struct pool {
 	void *buf;
@@ -22,4 +23,61 @@ void* pool_get(struct pool *pool, enum pool_priority priority) __warn_unused_res
 void pool_free_object(struct pool *pool, void *obj);
 int pool_init(struct pool *pool, size_t obj_size, int count, int reserved) __warn_unused_result;
 
+/*
+ * A pool cache hands out zeroed fixed size objects from a per-CPU
+ * magazine without taking any lock. Empty magazines are refilled, and
+ * full ones drained, a batch at a time from a per-cache depot, which
+ * grows from the heap one batch-sized slab at a time. Objects are never
+ * given back to the heap.
+ */
+
+/* Maximum number of caches with per-CPU magazines, see struct cpu_thread */
+#define POOL_CACHE_MAX		4
+#define POOL_MAG_SIZE		16
+
+struct pool_magazine {
+	struct list_node	link;
+	unsigned int		count;
+	unsigned long		allocs;
+	unsigned long		frees;
+	void			*objs[POOL_MAG_SIZE];
+};
+
+struct pool_cache {
+	const char		*name;
+	size_t			obj_size;
+	unsigned int		batch;
+	int			index;
+	bool			registered;
+	struct list_node	link;
+
+	/* The lock protects the depot, magazine list and statistics */
+	struct lock		lock;
+	struct list_head	depot;
+	unsigned long		depot_count;
+	struct list_head	mags;
+	unsigned long		slabs;
+	unsigned long		total;
+	unsigned long		refills;
+	unsigned long		drains;
+};
+
+#define POOL_CACHE_INIT(_cache, _name, _obj_size, _batch) {	\
+	.name		= _name,				\
+	.obj_size	= _obj_size,				\
+	.batch		= _batch,				\
+	.index		= -1,					\
+	.lock		= LOCK_UNLOCKED,			\
+	.depot		= LIST_HEAD_INIT(_cache.depot),		\
+	.mags		= LIST_HEAD_INIT(_cache.mags),		\
+}
+
+#define DEFINE_POOL_CACHE(_cache, _name, _obj_size, _batch)	\
+	struct pool_cache _cache =				\
+		POOL_CACHE_INIT(_cache, _name, _obj_size, _batch)
+
+void *pool_cache_get(struct pool_cache *cache) __warn_unused_result;
+void pool_cache_put(struct pool_cache *cache, void *obj);
+void pool_cache_dump(void);
+
 #endif /* __POOL_H */
@@ -216,6 +216,10 @@ struct flash_chip;
 extern int flash_register(struct blocklevel_device *bl);
 extern int flash_start_preload_resource(enum resource_id id, uint32_t subid,
 					void *buf, size_t *len);
+struct xz_decompress;
+extern int flash_start_preload_resource_xz(enum resource_id id, uint32_t subid,
+					   void *buf, size_t *len,
+					   struct xz_decompress *xz);
 extern int flash_resource_loaded(enum resource_id id, uint32_t idx);
 extern bool flash_reserve(void);
 extern void flash_release(void);
@@ -259,6 +263,12 @@ struct xz_decompress {
 	 * `wait_xz_decompression` function, in any other case its the
 	 * responsibility of caller to free the allocation job.  */
 	struct cpu_job *job;
+	/* When streaming, only the first src_avail bytes of src have been
+	 * filled in so far, and src_done says no more are coming. Used by
+	 * the flash loader to decompress as it reads.  */
+	bool streaming;
+	bool src_done;
+	size_t src_avail;
 };
 
 extern void xz_start_decompress(struct xz_decompress *);
@@ -23,6 +23,7 @@ typedef void (*timer_func_t)(struct timer *t, void *data, uint64_t now);
  */
 struct timer {
 	struct list_node	link;
+	unsigned int		heap_idx;
 	uint64_t		target;
 	timer_func_t		expiry;
 	void *			user_data;
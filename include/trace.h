@@ -15,13 +15,18 @@ struct cpu_thread;
 void init_boot_tracebuf(struct cpu_thread *boot_cpu);
 
 struct trace_info {
-	/* Lock for writers. Exposed to kernel. */
+	/* Lock for writers of the shared boot buffer. Exposed to kernel. */
 	struct lock lock;
 	/* Exposed to kernel. */
 	struct tracebuf tb;
 };
 
-#define TBUF_SZ ((1024 * 1024) - sizeof(struct trace_info) - sizeof(union trace))
+/*
+ * Trace memory for each core, a 1M allocation. Per-thread buffers split it
+ * between the core's threads.
+ */
+#define TBUF_CORE_ALLOC	(1024 * 1024)
+#define TBUF_SZ (TBUF_CORE_ALLOC - sizeof(struct trace_info) - sizeof(union trace))
 
 /* Allocate trace buffers once we know memory topology */
 void init_trace_buffers(void);
@@ -17,7 +17,15 @@
 #define TRACE_FSP_EVENT	5	/* FSP driver event */
 #define TRACE_UART	6	/* UART driver traces */
 
-/* One per cpu, plus one for NMIs */
+/*
+ * One per cpu, plus one for early boot.
+ *
+ * start, end and last are byte counts which only ever increase (the
+ * buffer offset is the count modulo buf_size). The writer advances start
+ * before overwriting old entries, so a reader which copied the entry at
+ * its own position and then still sees start at or below it knows the
+ * copy is intact.
+ */
 struct tracebuf {
 	/* Size used to get buffer offset */
 	__be64 buf_size;
@@ -50,7 +58,10 @@ struct trace_repeat {
 	__be16 cpu;
 	__be16 prev_len;
 	__be16 num; /* Starts at 1, ie. 1 repeat, or two traces. */
-	/* Note that the count can be one short, if read races a repeat. */
+	/*
+	 * num is updated before timestamp, so if a read races a repeat the
+	 * count can be one ahead of the timestamp.
+	 */
 };
 
 /* Overflow is special */
@@ -11,6 +11,7 @@
  *****************************************************************************/
 
 #include <stddef.h>
+#include "memops.h"
 
 int memcmp(const void *ptr1, const void *ptr2, size_t n);
 int memcmp(const void *ptr1, const void *ptr2, size_t n)
@@ -18,6 +19,13 @@ int memcmp(const void *ptr1, const void *ptr2, size_t n)
 	const unsigned char *p1 = ptr1;
 	const unsigned char *p2 = ptr2;
 
+	/* Skip the equal doublewords, the bytes below find the difference */
+	while (n >= 8 && LOAD64(p1) == LOAD64(p2)) {
+		p1 += 8;
+		p2 += 8;
+		n -= 8;
+	}
+
 	while (n-- > 0) {
 		if (*p1 != *p2)
 			return (*p1 - *p2);
@@ -12,25 +12,85 @@
 
 #include <stddef.h>
 #include <ccan/short_types/short_types.h>
+#include "memops.h"
 
 void *memcpy(void *dest, const void *src, size_t n);
 void *memcpy(void *dest, const void *src, size_t n)
 {
-	void *ret = dest;
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+	uint64_t a, b, c, e, tail;
+	size_t head;
+
+	/*
+	 * Short copies are done with two possibly overlapping accesses
+	 * covering the start and the end.
+	 */
+	if (n < 16) {
+		if (n >= 8) {
+			a = LOAD64(s);
+			b = LOAD64(s + n - 8);
+			STORE64(d, a);
+			STORE64(d + n - 8, b);
+		} else if (n >= 4) {
+			a = LOAD32(s);
+			b = LOAD32(s + n - 4);
+			STORE32(d, a);
+			STORE32(d + n - 4, b);
+		} else {
+			while (n--)
+				*d++ = *s++;
+		}
+		return dest;
+	}
+
+	/*
+	 * Align the destination, misaligned stores cost more than loads.
+	 * The head and the tail are copied with one doubleword each, which
+	 * may overlap the aligned part, so memmove() has its own loops for
+	 * overlapping buffers.
+	 */
+	tail = LOAD64(s + n - 8);
+	STORE64(d, LOAD64(s));
+	head = 8 - ((uintptr_t)d & 7);
+	d += head;
+	s += head;
+	n -= head;
+
+	/* Then a cache line at a time, half of one per iteration */
+	while (n >= 64) {
+		__builtin_prefetch(s + MEMOPS_PREFETCH);
+		__builtin_prefetch(d + MEMOPS_PREFETCH, 1);
+		a = LOAD64(s);
+		b = LOAD64(s + 8);
+		c = LOAD64(s + 16);
+		e = LOAD64(s + 24);
+		*(uint64_t *)d = a;
+		*(uint64_t *)(d + 8) = b;
+		*(uint64_t *)(d + 16) = c;
+		*(uint64_t *)(d + 24) = e;
+		a = LOAD64(s + 32);
+		b = LOAD64(s + 40);
+		c = LOAD64(s + 48);
+		e = LOAD64(s + 56);
+		*(uint64_t *)(d + 32) = a;
+		*(uint64_t *)(d + 40) = b;
+		*(uint64_t *)(d + 48) = c;
+		*(uint64_t *)(d + 56) = e;
+		d += 64;
+		s += 64;
+		n -= 64;
+	}
 
 	while (n >= 8) {
-		*(uint64_t *)dest = *(uint64_t *)src;
-		dest += 8;
-		src += 8;
+		*(uint64_t *)d = LOAD64(s);
+		d += 8;
+		s += 8;
 		n -= 8;
 	}
 
-	while (n > 0) {
-		*(uint8_t *)dest = *(uint8_t *)src;
-		dest += 1;
-		src += 1;
-		n -= 1;
-	}
+	if (n)
+		STORE64(d + n - 8, tail);
 
-	return ret;
+	return dest;
 }
@@ -11,26 +11,46 @@
  *****************************************************************************/
 
 #include <stddef.h>
+#include "memops.h"
 
 void *memcpy(void *dest, const void *src, size_t n);
 void *memmove(void *dest, const void *src, size_t n);
 void *memmove(void *dest, const void *src, size_t n)
 {
-	/* Do the buffers overlap in a bad way? */
-	if (src < dest && src + n >= dest) {
-		char *cdest;
-		const char *csrc;
-		int i;
+	unsigned char *cdest;
+	const unsigned char *csrc;
 
-		/* Copy from end to start */
-		cdest = dest + n - 1;
-		csrc = src + n - 1;
-		for (i = 0; i < n; i++) {
-			*cdest-- = *csrc--;
+	/* Normal copy is possible if they don't overlap */
+	if (src + n <= dest || dest + n <= src)
+		return memcpy(dest, src, n);
+
+	/*
+	 * Otherwise copy away from the overlap, each doubleword is loaded
+	 * before anything it overlaps is stored.
+	 */
+	if (src < dest) {
+		cdest = dest + n;
+		csrc = src + n;
+		while (n >= 8) {
+			cdest -= 8;
+			csrc -= 8;
+			STORE64(cdest, LOAD64(csrc));
+			n -= 8;
 		}
-		return dest;
+		while (n--)
+			*--cdest = *--csrc;
 	} else {
-		/* Normal copy is possible */
-		return memcpy(dest, src, n);
+		cdest = dest;
+		csrc = src;
+		while (n >= 8) {
+			STORE64(cdest, LOAD64(csrc));
+			cdest += 8;
+			csrc += 8;
+			n -= 8;
+		}
+		while (n--)
+			*cdest++ = *csrc++;
 	}
+
+	return dest;
 }
@@ -0,0 +1,38 @@
+/******************************************************************************
+ * Copyright (c) 2004, 2008 IBM Corporation
+ * All rights reserved.
+ * This program and the accompanying materials
+ * are made available under the terms of the BSD License
+ * which accompanies this distribution, and is available at
+ * http://www.opensource.org/licenses/bsd-license.php
+ *
+ * Contributors:
+ *     IBM Corporation - initial implementation
+ *****************************************************************************/
+
+#ifndef _MEMOPS_H
+#define _MEMOPS_H
+
+#include <stdint.h>
+
+/*
+ * Helpers shared by the mem* routines. Skiboot is built without VMX/VSX
+ * (and doesn't enable them in the MSR), so these stick to 64-bit GPR
+ * accesses, which POWER handles fine unaligned within a cache line.
+ */
+
+#define CACHE_LINE_SIZE 128
+
+/* How far ahead of a copy to touch the source and destination */
+#define MEMOPS_PREFETCH (4 * CACHE_LINE_SIZE)
+
+/* Doubleword and word accesses of any alignment */
+typedef uint64_t __attribute__((__may_alias__, __aligned__(1))) memops_u64;
+typedef uint32_t __attribute__((__may_alias__, __aligned__(1))) memops_u32;
+
+#define LOAD64(p)	(*(const memops_u64 *)(p))
+#define STORE64(p, v)	(*(memops_u64 *)(p) = (v))
+#define LOAD32(p)	(*(const memops_u32 *)(p))
+#define STORE32(p, v)	(*(memops_u32 *)(p) = (v))
+
+#endif /* _MEMOPS_H */
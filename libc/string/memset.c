@@ -10,45 +10,68 @@
  *     IBM Corporation - initial implementation
  *****************************************************************************/
 
-#define CACHE_LINE_SIZE 128
-
 #include <stddef.h>
+#include "memops.h"
 
 void *memset(void *dest, int c, size_t size);
 void *memset(void *dest, int c, size_t size)
 {
 	unsigned char *d = (unsigned char *)dest;
-	unsigned long big_c = 0;
+	uint64_t big_c = (unsigned char)c * 0x0101010101010101ull;
+
+	/* Short ones, with possibly overlapping stores as in memcpy() */
+	if (size < 16) {
+		if (size >= 8) {
+			STORE64(d, big_c);
+			STORE64(d + size - 8, big_c);
+		} else if (size >= 4) {
+			STORE32(d, big_c);
+			STORE32(d + size - 4, big_c);
+		} else {
+			while (size--)
+				*d++ = (unsigned char)c;
+		}
+		return dest;
+	}
+
+	/* One unaligned store covers the head, then carry on aligned */
+	STORE64(d, big_c);
+	size -= 8 - ((unsigned long)d & 7);
+	d += 8 - ((unsigned long)d & 7);
 
 #if defined(__powerpc__) || defined(__powerpc64__)
-	if (size > CACHE_LINE_SIZE && c==0) {
-		while ((unsigned long long)d % CACHE_LINE_SIZE) {
-			*d++ = (unsigned char)c;
-			size--;
+	if (size >= 2 * CACHE_LINE_SIZE && c == 0) {
+		while ((unsigned long)d % CACHE_LINE_SIZE) {
+			*(uint64_t *)d = 0;
+			d += 8;
+			size -= 8;
 		}
 		while (size >= CACHE_LINE_SIZE) {
 			asm volatile ("dcbz 0,%0\n" : : "r"(d) : "memory");
-			d+= CACHE_LINE_SIZE;
-			size-= CACHE_LINE_SIZE;
+			d += CACHE_LINE_SIZE;
+			size -= CACHE_LINE_SIZE;
 		}
 	}
 #endif
 
-	if (c) {
-		big_c = c;
-		big_c |= (big_c << 8) | big_c;
-		big_c |= (big_c << 16) | big_c;
-		big_c |= (big_c << 32) | big_c;
-	}
-	while (size >= 8 && c == 0) {
-		*((unsigned long *)d) = big_c;
-		d+=8;
-		size-=8;
+	while (size >= 32) {
+		*(uint64_t *)d = big_c;
+		*(uint64_t *)(d + 8) = big_c;
+		*(uint64_t *)(d + 16) = big_c;
+		*(uint64_t *)(d + 24) = big_c;
+		d += 32;
+		size -= 32;
 	}
 
-	while (size-- > 0) {
-		*d++ = (unsigned char)c;
+	while (size >= 8) {
+		*(uint64_t *)d = big_c;
+		d += 8;
+		size -= 8;
 	}
 
+	/* And the tail, ending where the buffer does */
+	if (size)
+		STORE64(d + size - 8, big_c);
+
 	return dest;
 }
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * The skiboot mem* routines for run-memops-bench, renamed so that the
+ * host libc ones are still there to compare against.
+ */
+
+#define memcpy skiboot_memcpy
+#define memset skiboot_memset
+#define memcmp skiboot_memcmp
+#define memmove skiboot_memmove
+
+#include "../string/memcpy.c"
+#include "../string/memset.c"
+#include "../string/memcmp.c"
+#include "../string/memmove.c"
@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Throughput of the skiboot mem* routines against the byte and
+ * doubleword loops they replaced, and against the host libc, across
+ * sizes and alignments.
+ *
+ * Copyright 2020 IBM Corp.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <skiboot-valgrind.h>
+
+/* From run-memops-bench-test.c */
+void *skiboot_memcpy(void *dest, const void *src, size_t n);
+void *skiboot_memset(void *dest, int c, size_t size);
+int skiboot_memcmp(const void *ptr1, const void *ptr2, size_t n);
+
+/* What we had before */
+static void *old_memcpy(void *dest, const void *src, size_t n)
+{
+	void *ret = dest;
+
+	while (n >= 8) {
+		*(uint64_t *)dest = *(uint64_t *)src;
+		dest += 8;
+		src += 8;
+		n -= 8;
+	}
+	while (n > 0) {
+		*(uint8_t *)dest = *(uint8_t *)src;
+		dest += 1;
+		src += 1;
+		n -= 1;
+	}
+	return ret;
+}
+
+static void *old_memset(void *dest, int c, size_t size)
+{
+	unsigned char *d = dest;
+
+	while (size >= 8 && c == 0) {
+		*((unsigned long *)d) = 0;
+		d += 8;
+		size -= 8;
+	}
+	while (size-- > 0)
+		*d++ = (unsigned char)c;
+	return dest;
+}
+
+static int old_memcmp(const void *ptr1, const void *ptr2, size_t n)
+{
+	const unsigned char *p1 = ptr1;
+	const unsigned char *p2 = ptr2;
+
+	while (n-- > 0) {
+		if (*p1 != *p2)
+			return (*p1 - *p2);
+		p1 += 1;
+		p2 += 1;
+	}
+	return 0;
+}
+
+enum op { OP_MEMCPY, OP_MEMSET, OP_MEMCMP };
+
+static const char *op_names[] = { "memcpy", "memset", "memcmp" };
+
+struct impl {
+	const char *name;
+	void *(*cpy)(void *, const void *, size_t);
+	void *(*set)(void *, int, size_t);
+	int (*cmp)(const void *, const void *, size_t);
+};
+
+static const struct impl impls[] = {
+	{ "old", old_memcpy, old_memset, old_memcmp },
+	{ "skiboot", skiboot_memcpy, skiboot_memset, skiboot_memcmp },
+	{ "host", memcpy, memset, memcmp },
+};
+
+#define NR_IMPLS	(sizeof(impls) / sizeof(impls[0]))
+
+static const size_t sizes[] = { 8, 32, 128, 512, 4096, 65536 };
+static const struct { size_t dst, src; } aligns[] = {
+	{ 0, 0 }, { 1, 0 }, { 0, 3 }, { 5, 3 },
+};
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static volatile int sink;
+
+/* MB/s moving @total bytes @size at a time */
+static double run(const struct impl *im, enum op op, unsigned char *dst,
+		  unsigned char *src, size_t size, size_t total)
+{
+	size_t i, loops = total / size;
+	double t;
+	int r = 0;
+
+	t = now_usecs();
+	for (i = 0; i < loops; i++) {
+		switch (op) {
+		case OP_MEMCPY:
+			im->cpy(dst, src, size);
+			break;
+		case OP_MEMSET:
+			im->set(dst, i & 0xff, size);
+			break;
+		case OP_MEMCMP:
+			r += im->cmp(dst, src, size);
+			break;
+		}
+	}
+	t = now_usecs() - t;
+	sink = r;
+
+	return t ? (double)loops * size / t : 0;
+}
+
+int main(void)
+{
+	size_t total = RUNNING_ON_VALGRIND ? 1 << 16 : 1 << 23;
+	size_t max = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+	unsigned char *src, *dst;
+	unsigned int s, a, i;
+	enum op op;
+
+	src = malloc(max + 64);
+	dst = malloc(max + 64);
+	assert(src && dst);
+	for (i = 0; i < max + 64; i++)
+		src[i] = i * 7;
+	memcpy(dst, src, max + 64);
+
+	/* Quick sanity check that we're timing the right thing */
+	assert(skiboot_memcmp(dst + 3, src + 3, max) == 0);
+	skiboot_memset(dst + 1, 0, max);
+	assert(skiboot_memcmp(dst + 1, src + 1, max) < 0);
+	skiboot_memcpy(dst + 5, src + 3, max);
+	assert(memcmp(dst + 5, src + 3, max) == 0);
+
+	printf("%-7s %6s %5s", "op", "size", "align");
+	for (i = 0; i < NR_IMPLS; i++)
+		printf(" %9s", impls[i].name);
+	printf("  (MB/s)\n");
+
+	for (op = OP_MEMCPY; op <= OP_MEMCMP; op++) {
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			for (a = 0; a < sizeof(aligns) / sizeof(aligns[0]); a++) {
+				/* Only the destination matters to memset */
+				if (op == OP_MEMSET && aligns[a].src)
+					continue;
+				printf("%-7s %6zu %2zu/%-2zu", op_names[op],
+				       sizes[s], aligns[a].dst, aligns[a].src);
+				for (i = 0; i < NR_IMPLS; i++) {
+					/* memcmp has to walk the whole buffer */
+					memcpy(dst + aligns[a].dst,
+					       src + aligns[a].src, sizes[s]);
+					printf(" %9.0f",
+					       run(&impls[i], op,
+						   dst + aligns[a].dst,
+						   src + aligns[a].src,
+						   sizes[s], total));
+				}
+				printf("\n");
+			}
+		}
+	}
+
+	free(src);
+	free(dst);
+	return 0;
+}
@@ -40,6 +40,7 @@ int test_strrchr(const char *s, int c, char *expected);
 int test_strcasecmp(const char *s1, const char *s2, int expected);
 int test_strncasecmp(const char *s1, const char *s2, size_t n, int expected);
 int test_memmove(void *dest, const void *src, size_t n, const void *r, const void *expected, size_t expected_n);
+int test_memops_align(void);
 
 int test_memset(char* buf, int c, size_t s)
 {
@@ -95,3 +96,120 @@ int test_memmove(void *dest, const void *src, size_t n, const void *r, const voi
 		return -1;
 	return(memcmp(r, expected, expected_n) == 0);
 }
+
+/*
+ * The word-at-a-time paths have heads and tails to get right, so try
+ * every size up to a few cache lines at every alignment, checking that
+ * the bytes either side are left alone.
+ */
+#define ALIGN_BUFSZ	512
+#define ALIGN_MAXSZ	300
+
+static unsigned char align_src[ALIGN_BUFSZ], align_dst[ALIGN_BUFSZ];
+
+static void align_fill(unsigned char *p, unsigned int seed)
+{
+	int i;
+
+	for (i = 0; i < ALIGN_BUFSZ; i++)
+		p[i] = (i * 7 + seed) & 0xff;
+}
+
+static int align_check(size_t off, size_t n, int (*expected)(size_t i))
+{
+	size_t i;
+
+	for (i = 0; i < ALIGN_BUFSZ; i++) {
+		if (i < off || i >= off + n) {
+			if (align_dst[i] != ((i * 7 + 0x55) & 0xff))
+				return -1;
+		} else if (align_dst[i] != expected(i - off)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static size_t align_soff;
+
+static int align_copied(size_t i)
+{
+	return align_src[align_soff + i];
+}
+
+static int align_set(size_t i)
+{
+	(void)i;
+	return 0xa5;
+}
+
+int test_memops_align(void)
+{
+	size_t doff, soff, n, i;
+	int r;
+
+	align_fill(align_src, 0x11);
+	for (doff = 0; doff < 16; doff++) {
+		for (soff = 0; soff < 16; soff++) {
+			align_soff = soff;
+			for (n = 0; n < ALIGN_MAXSZ; n++) {
+				align_fill(align_dst, 0x55);
+				memcpy(align_dst + doff, align_src + soff, n);
+				if (align_check(doff, n, align_copied))
+					return -1;
+
+				align_fill(align_dst, 0x55);
+				memmove(align_dst + doff, align_src + soff, n);
+				if (align_check(doff, n, align_copied))
+					return -2;
+			}
+		}
+
+		for (n = 0; n < ALIGN_MAXSZ; n++) {
+			align_fill(align_dst, 0x55);
+			memset(align_dst + doff, 0xa5, n);
+			if (align_check(doff, n, align_set))
+				return -3;
+		}
+	}
+
+	/* Overlapping moves, both ways, against a byte at a time copy */
+	for (doff = 0; doff < 24; doff++) {
+		for (soff = 0; soff < 24; soff++) {
+			for (n = 0; n < ALIGN_MAXSZ; n++) {
+				align_fill(align_dst, 0x33);
+				align_fill(align_src, 0x33);
+				if (doff < soff)
+					for (i = 0; i < n; i++)
+						align_src[doff + i] = align_src[soff + i];
+				else
+					for (i = n; i-- > 0;)
+						align_src[doff + i] = align_src[soff + i];
+				memmove(align_dst + doff, align_dst + soff, n);
+				for (i = 0; i < ALIGN_BUFSZ; i++)
+					if (align_dst[i] != align_src[i])
+						return -4;
+			}
+		}
+	}
+
+	/* The first difference decides, wherever it is in a doubleword */
+	align_fill(align_src, 0x11);
+	for (soff = 0; soff < 16; soff++) {
+		for (n = 1; n < 64; n++) {
+			for (i = 0; i < n; i++) {
+				memcpy(align_dst, align_src + soff, n);
+				align_dst[i] = align_src[soff + i] + 1;
+				if (i + 1 < n)
+					align_dst[i + 1] = align_src[soff + i + 1] - 1;
+				r = memcmp(align_src + soff, align_dst, n);
+				if (r != align_src[soff + i] - align_dst[i])
+					return -5;
+				if (memcmp(align_src + soff, align_src + soff, n))
+					return -6;
+			}
+		}
+	}
+
+	return 0;
+}
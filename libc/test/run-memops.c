@@ -19,6 +19,7 @@ int test_strrchr(const char *s, int c, char *expected);
 int test_strcasecmp(const char *s1, const char *s2, int expected);
 int test_strncasecmp(const char *s1, const char *s2, size_t n, int expected);
 int test_memmove(void *dest, const void *src, size_t n, const void *r, const void *expected, size_t expected_n);
+int test_memops_align(void);
 
 int main(void)
 {
@@ -94,5 +95,7 @@ int main(void)
 	free(buf);
 	free(buf2);
 
+	assert(test_memops_align() == 0);
+
 	return 0;
 }
@@ -11,6 +11,7 @@
 
 #include <libflash/libflash.h>
 #include <libflash/errors.h>
+#include <ccan/container_of/container_of.h>
 
 #include "blocklevel.h"
 #include "ecc.h"
@@ -739,3 +740,369 @@ int blocklevel_ecc_protect(struct blocklevel_device *bl, uint32_t start, uint32_
 		return -1;
 	return !insert_bl_prot_range(&bl->ecc_prot, range);
 }
+
+/*
+ * Write-back cache of erase blocks, in front of another blocklevel device.
+ *
+ * Callers which update a few bytes at a time, like the GARD tool, otherwise
+ * read, erase and rewrite a whole erase block for each. The
+ * cache keeps the blocks most recently used and only writes them back when
+ * they're evicted or on blocklevel_cache_sync(), erasing them only if
+ * something asked for an erase in between.
+ */
+#define BL_CACHE_MIN_BLOCK	0x100
+#define BL_CACHE_NO_BLOCK	((uint64_t)-1)
+
+struct bl_cache_block {
+	uint64_t pos;
+	uint64_t last_use;
+	/* Range that differs from the backend, empty if start == end */
+	uint32_t dirty_start;
+	uint32_t dirty_end;
+	/* Erase before writing back */
+	bool erased;
+	uint8_t *data;
+};
+
+struct bl_cache {
+	struct blocklevel_device *backend;
+	uint64_t total_size;
+	uint32_t block_size;
+	unsigned int nr_blocks;
+	uint64_t clock;
+	struct bl_cache_block *blocks;
+	uint8_t *data;
+	struct blocklevel_device bl;
+};
+
+static uint32_t bl_cache_len(struct bl_cache *c, uint64_t pos)
+{
+	uint64_t left = c->total_size - pos;
+
+	return left < c->block_size ? left : c->block_size;
+}
+
+static int bl_cache_flush_block(struct bl_cache *c, struct bl_cache_block *b)
+{
+	struct blocklevel_device *backend = c->backend;
+	uint32_t len = bl_cache_len(c, b->pos);
+	uint32_t start = b->dirty_start, end = b->dirty_end;
+	int rc;
+
+	if (start == end)
+		return 0;
+
+	rc = reacquire(backend);
+	if (rc)
+		return rc;
+
+	if (b->erased && (backend->flags & WRITE_NEED_ERASE)) {
+		rc = backend->erase(backend, b->pos, len);
+		if (rc)
+			goto out;
+
+		/* Nothing to write back where it's still erased */
+		start = 0;
+		end = len;
+		while (start < end && b->data[start] == 0xff)
+			start++;
+		while (end > start && b->data[end - 1] == 0xff)
+			end--;
+	}
+
+	if (start < end)
+		rc = backend->write(backend, b->pos + start, b->data + start,
+				    end - start);
+	if (!rc) {
+		b->dirty_start = b->dirty_end = 0;
+		b->erased = false;
+	}
+out:
+	release(backend);
+	return rc;
+}
+
+/*
+ * Find the block at @pos in the cache or make room for it, reading it in
+ * from the backend unless the caller is about to replace all of it.
+ */
+static int bl_cache_get(struct bl_cache *c, uint64_t pos, bool fill,
+		struct bl_cache_block **block)
+{
+	struct bl_cache_block *b, *victim = NULL;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < c->nr_blocks; i++) {
+		b = &c->blocks[i];
+		if (b->pos == pos) {
+			b->last_use = ++c->clock;
+			*block = b;
+			return 0;
+		}
+		if (!victim || b->pos == BL_CACHE_NO_BLOCK ||
+		    (victim->pos != BL_CACHE_NO_BLOCK &&
+		     b->last_use < victim->last_use))
+			victim = b;
+	}
+
+	rc = bl_cache_flush_block(c, victim);
+	if (rc)
+		return rc;
+	victim->pos = BL_CACHE_NO_BLOCK;
+
+	if (fill) {
+		rc = blocklevel_raw_read(c->backend, pos, victim->data,
+					 bl_cache_len(c, pos));
+		if (rc)
+			return rc;
+	}
+
+	victim->pos = pos;
+	victim->last_use = ++c->clock;
+	*block = victim;
+	return 0;
+}
+
+static void bl_cache_dirty(struct bl_cache_block *b, uint32_t start, uint32_t end)
+{
+	if (b->dirty_start == b->dirty_end) {
+		b->dirty_start = start;
+		b->dirty_end = end;
+		return;
+	}
+	if (start < b->dirty_start)
+		b->dirty_start = start;
+	if (end > b->dirty_end)
+		b->dirty_end = end;
+}
+
+static int bl_cache_read(struct blocklevel_device *bl, uint64_t pos, void *buf,
+		uint64_t len)
+{
+	struct bl_cache *c = container_of(bl, struct bl_cache, bl);
+	uint64_t block_pos = pos & ~((uint64_t)c->block_size - 1);
+	uint64_t start, end;
+	struct bl_cache_block *b;
+	unsigned int i;
+	int rc;
+
+	if (pos + len > c->total_size)
+		return FLASH_ERR_PARM_ERROR;
+
+	/* Small reads are likely followed by a write to the same block */
+	if (pos + len <= block_pos + c->block_size) {
+		rc = bl_cache_get(c, block_pos, true, &b);
+		if (rc)
+			return rc;
+		memcpy(buf, b->data + (pos - block_pos), len);
+		return 0;
+	}
+
+	/* Bigger ones go to the backend, with what's cached on top */
+	rc = blocklevel_raw_read(c->backend, pos, buf, len);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < c->nr_blocks; i++) {
+		b = &c->blocks[i];
+		if (b->pos == BL_CACHE_NO_BLOCK ||
+		    b->pos >= pos + len || b->pos + c->block_size <= pos)
+			continue;
+		start = b->pos > pos ? b->pos : pos;
+		end = b->pos + bl_cache_len(c, b->pos);
+		if (end > pos + len)
+			end = pos + len;
+		memcpy(buf + (start - pos), b->data + (start - b->pos),
+		       end - start);
+	}
+
+	return 0;
+}
+
+static int bl_cache_write(struct blocklevel_device *bl, uint64_t pos,
+		const void *buf, uint64_t len)
+{
+	struct bl_cache *c = container_of(bl, struct bl_cache, bl);
+	uint64_t block_pos, offset, chunk;
+	struct bl_cache_block *b;
+	int rc;
+
+	if (pos + len > c->total_size)
+		return FLASH_ERR_PARM_ERROR;
+
+	while (len) {
+		block_pos = pos & ~((uint64_t)c->block_size - 1);
+		offset = pos - block_pos;
+		chunk = bl_cache_len(c, block_pos) - offset;
+		if (chunk > len)
+			chunk = len;
+
+		rc = bl_cache_get(c, block_pos, chunk != bl_cache_len(c, block_pos), &b);
+		if (rc)
+			return rc;
+
+		memcpy(b->data + offset, buf, chunk);
+		bl_cache_dirty(b, offset, offset + chunk);
+
+		pos += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int bl_cache_erase(struct blocklevel_device *bl, uint64_t pos, uint64_t len)
+{
+	struct bl_cache *c = container_of(bl, struct bl_cache, bl);
+	uint64_t block_pos, offset, chunk, block_len;
+	struct bl_cache_block *b;
+	int rc;
+
+	if (pos + len > c->total_size)
+		return FLASH_ERR_PARM_ERROR;
+
+	while (len) {
+		block_pos = pos & ~((uint64_t)c->block_size - 1);
+		block_len = bl_cache_len(c, block_pos);
+		offset = pos - block_pos;
+		chunk = block_len - offset;
+		if (chunk > len)
+			chunk = len;
+
+		/*
+		 * The whole cache block is erased when written back, so
+		 * what's outside the range has to be in the cache too.
+		 */
+		rc = bl_cache_get(c, block_pos, chunk != block_len, &b);
+		if (rc)
+			return rc;
+
+		memset(b->data + offset, 0xff, chunk);
+		b->erased = true;
+		bl_cache_dirty(b, 0, block_len);
+
+		pos += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int bl_cache_get_info(struct blocklevel_device *bl, const char **name,
+		uint64_t *total_size, uint32_t *erase_granule)
+{
+	struct bl_cache *c = container_of(bl, struct bl_cache, bl);
+
+	return blocklevel_get_info(c->backend, name, total_size, erase_granule);
+}
+
+int blocklevel_cache_sync(struct blocklevel_device *bl)
+{
+	struct bl_cache *c = container_of(bl, struct bl_cache, bl);
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < c->nr_blocks; i++) {
+		rc = bl_cache_flush_block(c, &c->blocks[i]);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+int blocklevel_cache_init(struct blocklevel_device *backend,
+		unsigned int nr_blocks, struct blocklevel_device **bl)
+{
+	struct bl_cache *c;
+	uint32_t granule;
+	unsigned int i;
+	int rc;
+
+	if (!backend || !bl || !nr_blocks)
+		return FLASH_ERR_PARM_ERROR;
+
+	*bl = NULL;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return FLASH_ERR_MALLOC_FAILED;
+
+	rc = blocklevel_get_info(backend, NULL, &c->total_size, &granule);
+	if (rc)
+		goto out;
+
+	c->backend = backend;
+	c->nr_blocks = nr_blocks;
+	c->block_size = granule < BL_CACHE_MIN_BLOCK ? BL_CACHE_MIN_BLOCK : granule;
+
+	rc = FLASH_ERR_MALLOC_FAILED;
+	c->blocks = calloc(nr_blocks, sizeof(*c->blocks));
+	c->data = malloc((size_t)nr_blocks * c->block_size);
+	if (!c->blocks || !c->data)
+		goto out;
+
+	for (i = 0; i < nr_blocks; i++) {
+		c->blocks[i].pos = BL_CACHE_NO_BLOCK;
+		c->blocks[i].data = c->data + (size_t)i * c->block_size;
+	}
+
+	/* ECC is handled above us, so carry over what's been set up */
+	for (i = 0; i < backend->ecc_prot.n_prot; i++) {
+		if (!insert_bl_prot_range(&c->bl.ecc_prot,
+					  backend->ecc_prot.prot[i]))
+			goto out;
+	}
+
+	c->bl.read = &bl_cache_read;
+	c->bl.write = &bl_cache_write;
+	c->bl.erase = &bl_cache_erase;
+	c->bl.get_info = &bl_cache_get_info;
+	c->bl.erase_mask = backend->erase_mask;
+	c->bl.flags = backend->flags;
+	/*
+	 * Blocks stay cached between calls, and are only written back as
+	 * described above: the backend is acquired as needed.
+	 */
+	c->bl.keep_alive = true;
+
+	*bl = &c->bl;
+	return 0;
+out:
+	free(c->bl.ecc_prot.prot);
+	free(c->blocks);
+	free(c->data);
+	free(c);
+	return rc;
+}
+
+int blocklevel_cache_exit(struct blocklevel_device *bl)
+{
+	struct bl_cache_block *b;
+	struct bl_cache *c;
+	unsigned int i;
+	int rc;
+
+	if (!bl)
+		return 0;
+
+	c = container_of(bl, struct bl_cache, bl);
+	rc = blocklevel_cache_sync(bl);
+	if (rc) {
+		for (i = 0; i < c->nr_blocks; i++) {
+			b = &c->blocks[i];
+			if (b->dirty_start != b->dirty_end)
+				FL_ERR("%s: block 0x%" PRIx64 " not written back\n",
+				       __func__, b->pos);
+		}
+		return rc;
+	}
+
+	free(c->bl.ecc_prot.prot);
+	free(c->blocks);
+	free(c->data);
+	free(c);
+	return rc;
+}
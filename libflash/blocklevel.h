@@ -75,4 +75,23 @@ int blocklevel_smart_erase(struct blocklevel_device *bl, uint64_t pos, uint64_t
 /* Implemented in software at this level */
 int blocklevel_ecc_protect(struct blocklevel_device *bl, uint32_t start, uint32_t len);
 
+/*
+ * blocklevel_cache_init() puts a write-back cache of @nr_blocks erase
+ * blocks in front of @backend, which can be any blocklevel device. Small
+ * writes, and the read-erase-write cycles of blocklevel_smart_write(), to
+ * the same erase block are merged and only reach the backend when the
+ * block is evicted, on blocklevel_cache_sync() or on blocklevel_cache_exit().
+ * Nothing else may access @backend in the meantime. The ECC protected
+ * ranges of @backend are carried over.
+ */
+int blocklevel_cache_init(struct blocklevel_device *backend,
+		unsigned int nr_blocks, struct blocklevel_device **bl);
+int blocklevel_cache_sync(struct blocklevel_device *bl);
+/*
+ * Writes back and frees the cache, the backend is left alone. If writing
+ * back fails, the cache is kept so that nothing is lost and the call can
+ * be retried.
+ */
+int blocklevel_cache_exit(struct blocklevel_device *bl);
+
 #endif /* __LIBFLASH_BLOCKLEVEL_H */
@@ -42,17 +42,57 @@ enum eccbitfields
  *  Note: To make the math easier (and less shifts in resulting code),
  *        row0 = ECC7.  HW numbering is MSB, order here is LSB.
  *
- *  These values come from the HW design of the ECC algorithm.
+ *  These values come from the HW design of the ECC algorithm:
+ *
+ *        0x0000e8423c0f99ff
+ *        0x00e8423c0f99ff00
+ *        0xe8423c0f99ff0000
+ *        0x423c0f99ff0000e8
+ *        0x3c0f99ff0000e842
+ *        0x0f99ff0000e8423c
+ *        0x99ff0000e8423c0f
+ *        0xff0000e8423c0f99
+ *
+ *  Each row is the previous one rotated left by a byte, so the ECC
+ *  bits a data byte flips are the same whichever byte of the word it
+ *  is, only rotated by its position. Rather than taking the parity of
+ *  each row in turn, look up what each byte contributes and combine:
+ *
+ *  ie. ECC = XOR(n = 0..7) rotl8(ecctable[byte n of data], n)
  */
-static uint64_t eccmatrix[] = {
-        0x0000e8423c0f99ffull,
-        0x00e8423c0f99ff00ull,
-        0xe8423c0f99ff0000ull,
-        0x423c0f99ff0000e8ull,
-        0x3c0f99ff0000e842ull,
-        0x0f99ff0000e8423cull,
-        0x99ff0000e8423c0full,
-        0xff0000e8423c0f99ull
+static const uint8_t ecctable[256] = {
+        0x00, 0xc1, 0x51, 0x90, 0x61, 0xa0, 0x30, 0xf1,
+        0xe9, 0x28, 0xb8, 0x79, 0x88, 0x49, 0xd9, 0x18,
+        0xa1, 0x60, 0xf0, 0x31, 0xc0, 0x01, 0x91, 0x50,
+        0x48, 0x89, 0x19, 0xd8, 0x29, 0xe8, 0x78, 0xb9,
+        0x29, 0xe8, 0x78, 0xb9, 0x48, 0x89, 0x19, 0xd8,
+        0xc0, 0x01, 0x91, 0x50, 0xa1, 0x60, 0xf0, 0x31,
+        0x88, 0x49, 0xd9, 0x18, 0xe9, 0x28, 0xb8, 0x79,
+        0x61, 0xa0, 0x30, 0xf1, 0x00, 0xc1, 0x51, 0x90,
+        0x19, 0xd8, 0x48, 0x89, 0x78, 0xb9, 0x29, 0xe8,
+        0xf0, 0x31, 0xa1, 0x60, 0x91, 0x50, 0xc0, 0x01,
+        0xb8, 0x79, 0xe9, 0x28, 0xd9, 0x18, 0x88, 0x49,
+        0x51, 0x90, 0x00, 0xc1, 0x30, 0xf1, 0x61, 0xa0,
+        0x30, 0xf1, 0x61, 0xa0, 0x51, 0x90, 0x00, 0xc1,
+        0xd9, 0x18, 0x88, 0x49, 0xb8, 0x79, 0xe9, 0x28,
+        0x91, 0x50, 0xc0, 0x01, 0xf0, 0x31, 0xa1, 0x60,
+        0x78, 0xb9, 0x29, 0xe8, 0x19, 0xd8, 0x48, 0x89,
+        0x89, 0x48, 0xd8, 0x19, 0xe8, 0x29, 0xb9, 0x78,
+        0x60, 0xa1, 0x31, 0xf0, 0x01, 0xc0, 0x50, 0x91,
+        0x28, 0xe9, 0x79, 0xb8, 0x49, 0x88, 0x18, 0xd9,
+        0xc1, 0x00, 0x90, 0x51, 0xa0, 0x61, 0xf1, 0x30,
+        0xa0, 0x61, 0xf1, 0x30, 0xc1, 0x00, 0x90, 0x51,
+        0x49, 0x88, 0x18, 0xd9, 0x28, 0xe9, 0x79, 0xb8,
+        0x01, 0xc0, 0x50, 0x91, 0x60, 0xa1, 0x31, 0xf0,
+        0xe8, 0x29, 0xb9, 0x78, 0x89, 0x48, 0xd8, 0x19,
+        0x90, 0x51, 0xc1, 0x00, 0xf1, 0x30, 0xa0, 0x61,
+        0x79, 0xb8, 0x28, 0xe9, 0x18, 0xd9, 0x49, 0x88,
+        0x31, 0xf0, 0x60, 0xa1, 0x50, 0x91, 0x01, 0xc0,
+        0xd8, 0x19, 0x89, 0x48, 0xb9, 0x78, 0xe8, 0x29,
+        0xb9, 0x78, 0xe8, 0x29, 0xd8, 0x19, 0x89, 0x48,
+        0x50, 0x91, 0x01, 0xc0, 0x31, 0xf0, 0x60, 0xa1,
+        0x18, 0xd9, 0x49, 0x88, 0x79, 0xb8, 0x28, 0xe9,
+        0xf1, 0x30, 0xa0, 0x61, 0x90, 0x51, 0xc1, 0x00,
 };
 
 /**
@@ -80,7 +120,7 @@ static uint64_t eccmatrix[] = {
  *
  *  Bits are in MSB order.
  */
-static enum eccbitfields syndromematrix[] = {
+static const uint8_t syndromematrix[] = {
         GD, E7, E6, UE, E5, UE, UE, 47, E4, UE, UE, 37, UE, 35, 39, UE,
         E3, UE, UE, 48, UE, 30, 29, UE, UE, 57, 27, UE, 31, UE, UE, UE,
         E2, UE, UE, 17, UE, 18, 40, UE, UE, 58, 22, UE, 21, UE, UE, UE,
@@ -105,15 +145,21 @@ static enum eccbitfields syndromematrix[] = {
  *  @data:	The 8 byte data to generate ECC for.
  *  @return:	The 1 byte ECC corresponding to the data.
  */
-static uint8_t eccgenerate(uint64_t data)
+static inline uint8_t eccrotl(uint8_t v, int n)
 {
-	int i;
-	uint8_t result = 0;
-
-	for (i = 0; i < 8; i++)
-		result |= __builtin_parityll(eccmatrix[i] & data) << i;
+	return (v << n) | (v >> (8 - n));
+}
 
-	return result;
+static inline uint8_t eccgenerate(uint64_t data)
+{
+	return ecctable[data & 0xff] ^
+		eccrotl(ecctable[(data >> 8) & 0xff], 1) ^
+		eccrotl(ecctable[(data >> 16) & 0xff], 2) ^
+		eccrotl(ecctable[(data >> 24) & 0xff], 3) ^
+		eccrotl(ecctable[(data >> 32) & 0xff], 4) ^
+		eccrotl(ecctable[(data >> 40) & 0xff], 5) ^
+		eccrotl(ecctable[(data >> 48) & 0xff], 6) ^
+		eccrotl(ecctable[data >> 56], 7);
 }
 
 /**
@@ -142,12 +188,32 @@ static inline uint64_t eccflipbit(uint64_t data, uint8_t bit)
 	return data ^ (1ul << (63 - bit));
 }
 
+/*
+ * The buffers come from callers at any byte offset, so the data words
+ * are accessed through these rather than dereferenced. The compiler
+ * turns them into plain loads and stores where that's allowed.
+ */
+static inline uint64_t ecc_load(const void *p)
+{
+	beint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return be64_to_cpu(v);
+}
+
+static inline void ecc_store(void *p, uint64_t data)
+{
+	beint64_t v = cpu_to_be64(data);
+
+	memcpy(p, &v, sizeof(v));
+}
+
 static int eccbyte(beint64_t *dst, struct ecc64 *src)
 {
 	uint8_t ecc, badbit;
 	uint64_t data;
 
-	data = be64_to_cpu(src->data);
+	data = ecc_load(&src->data);
 	ecc = src->ecc;
 
 	badbit = eccverify(data, ecc);
@@ -158,13 +224,16 @@ static int eccbyte(beint64_t *dst, struct ecc64 *src)
 	if (badbit <= UE)
 		FL_INF("ECC: correctable error: %i\n", badbit);
 	if (badbit < 64)
-		*dst = cpu_to_be64(eccflipbit(data, badbit));
+		ecc_store(dst, eccflipbit(data, badbit));
 	else
-		*dst = cpu_to_be64(data);
+		ecc_store(dst, data);
 
 	return 0;
 }
 
+/* Number of words checked or generated per loop in the bulk copies */
+#define ECC_WORDS_PER_LOOP	4
+
 static beint64_t *inc_beint64_by(const void *p, uint64_t i)
 {
 	return (beint64_t *)(((char *)p) + i);
@@ -206,7 +275,8 @@ static uint64_t whole_ecc_structs(uint64_t i)
  */
 int memcpy_from_ecc(beint64_t *dst, struct ecc64 *src, uint64_t len)
 {
-	uint32_t i;
+	uint64_t i, d0, d1, d2, d3;
+	int rc;
 
 	if (len & 0x7) {
 		/* TODO: we could probably handle this */
@@ -218,12 +288,30 @@ int memcpy_from_ecc(beint64_t *dst, struct ecc64 *src, uint64_t len)
 	/* Handle in chunks of 8 bytes, so adjust the length */
 	len >>= 3;
 
-	for (i = 0; i < len; i++) {
-		int rc;
-		rc = eccbyte(dst, src + i);
+	/*
+	 * Almost everything read back is clean, so check a few words
+	 * together and only look at them one by one if any needs fixing.
+	 */
+	for (i = 0; i + ECC_WORDS_PER_LOOP <= len; i += ECC_WORDS_PER_LOOP) {
+		d0 = ecc_load(&src[i].data);
+		d1 = ecc_load(&src[i + 1].data);
+		d2 = ecc_load(&src[i + 2].data);
+		d3 = ecc_load(&src[i + 3].data);
+		if ((eccgenerate(d0) ^ src[i].ecc) |
+		    (eccgenerate(d1) ^ src[i + 1].ecc) |
+		    (eccgenerate(d2) ^ src[i + 2].ecc) |
+		    (eccgenerate(d3) ^ src[i + 3].ecc))
+			break;
+		ecc_store(dst + i, d0);
+		ecc_store(dst + i + 1, d1);
+		ecc_store(dst + i + 2, d2);
+		ecc_store(dst + i + 3, d3);
+	}
+
+	for (; i < len; i++) {
+		rc = eccbyte(dst + i, src + i);
 		if (rc)
 			return rc;
-		dst++;
 	}
 	return 0;
 }
@@ -263,7 +351,10 @@ int memcpy_from_ecc(beint64_t *dst, struct ecc64 *src, uint64_t len)
 int memcpy_from_ecc_unaligned(beint64_t *dst, struct ecc64 *src,
 		uint64_t len, uint8_t alignment)
 {
-	char data[BYTES_PER_ECC];
+	union {
+		beint64_t word;
+		char bytes[BYTES_PER_ECC];
+	} data;
 	uint8_t bytes_wanted;
 	int rc;
 
@@ -277,11 +368,11 @@ int memcpy_from_ecc_unaligned(beint64_t *dst, struct ecc64 *src,
 	 * required - otherwise jump straight to memcpy_from_ecc()
 	 */
 	if (alignment) {
-		rc = eccbyte((beint64_t *)data, src);
+		rc = eccbyte(&data.word, src);
 		if (rc)
 			return rc;
 
-		memcpy(dst, &data[alignment], bytes_wanted);
+		memcpy(dst, &data.bytes[alignment], bytes_wanted);
 
 		src = inc_ecc64_by(src, sizeof(struct ecc64));
 		dst = inc_beint64_by(dst, bytes_wanted);
@@ -303,11 +394,11 @@ int memcpy_from_ecc_unaligned(beint64_t *dst, struct ecc64 *src,
 	}
 
 	if (len) {
-		rc = eccbyte((beint64_t *)data, src);
+		rc = eccbyte(&data.word, src);
 		if (rc)
 			return rc;
 
-		memcpy(dst, data, len);
+		memcpy(dst, data.bytes, len);
 	}
 
 	return 0;
@@ -329,8 +420,7 @@ int memcpy_from_ecc_unaligned(beint64_t *dst, struct ecc64 *src,
  */
 int memcpy_to_ecc(struct ecc64 *dst, const beint64_t *src, uint64_t len)
 {
-	struct ecc64 ecc_word;
-	uint64_t i;
+	uint64_t i, d0, d1, d2, d3;
 
 	if (len & 0x7) {
 		/* TODO: we could probably handle this */
@@ -342,11 +432,25 @@ int memcpy_to_ecc(struct ecc64 *dst, const beint64_t *src, uint64_t len)
 	/* Handle in chunks of 8 bytes, so adjust the length */
 	len >>= 3;
 
-	for (i = 0; i < len; i++) {
-		ecc_word.ecc = eccgenerate(be64_to_cpu(*(src + i)));
-		ecc_word.data = *(src + i);
+	for (i = 0; i + ECC_WORDS_PER_LOOP <= len; i += ECC_WORDS_PER_LOOP) {
+		d0 = ecc_load(src + i);
+		d1 = ecc_load(src + i + 1);
+		d2 = ecc_load(src + i + 2);
+		d3 = ecc_load(src + i + 3);
+		ecc_store(&dst[i].data, d0);
+		dst[i].ecc = eccgenerate(d0);
+		ecc_store(&dst[i + 1].data, d1);
+		dst[i + 1].ecc = eccgenerate(d1);
+		ecc_store(&dst[i + 2].data, d2);
+		dst[i + 2].ecc = eccgenerate(d2);
+		ecc_store(&dst[i + 3].data, d3);
+		dst[i + 3].ecc = eccgenerate(d3);
+	}
 
-		*(dst + i) = ecc_word;
+	for (; i < len; i++) {
+		d0 = ecc_load(src + i);
+		ecc_store(&dst[i].data, d0);
+		dst[i].ecc = eccgenerate(d0);
 	}
 
 	return 0;
@@ -437,7 +541,7 @@ int memcpy_to_ecc_unaligned(struct ecc64 *dst, const beint64_t *src,
 	if (len) {
 		bytes_wanted = BYTES_PER_ECC - len;
 
-		ecc_word.data = *src;
+		memcpy(&ecc_word.data, src, len);
 		memcpy(inc_uint64_by(&ecc_word.data, len), inc_ecc64_by(dst, len),
 				bytes_wanted);
 		ecc_word.ecc = eccgenerate(be64_to_cpu(ecc_word.data));
@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <timebase.h>
 
 #include <ccan/container_of/container_of.h>
 
@@ -64,6 +65,8 @@ static int hiomap_protocol_ready(struct ipmi_hiomap *ctx)
 
 static int hiomap_queue_msg_sync(struct ipmi_hiomap *ctx, struct ipmi_msg *msg)
 {
+	uint8_t cmd = msg->data[0];
+	uint64_t start;
 	int rc;
 
 	/*
@@ -81,7 +84,10 @@ static int hiomap_queue_msg_sync(struct ipmi_hiomap *ctx, struct ipmi_msg *msg)
 		return rc;
 	}
 
+	start = mftb();
 	ipmi_queue_msg_sync(msg);
+	if (cmd < HIOMAP_C_COUNT)
+		hiomap_rtt_account(&ctx->rtt[cmd], mftb() - start);
 
 	return 0;
 }
@@ -204,6 +210,10 @@ static void ipmi_hiomap_cmd_cb(struct ipmi_msg *msg)
 			ctx->window_state = write_window;
 		unlock(&ctx->lock);
 
+		if (msg->data[0] == HIOMAP_C_CREATE_READ_WINDOW &&
+		    ctx->current.size > ctx->window_max)
+			ctx->window_max = ctx->current.size;
+
 		break;
 	}
 	case HIOMAP_C_MARK_DIRTY:
@@ -290,6 +300,28 @@ static int hiomap_get_flash_info(struct ipmi_hiomap *ctx)
 	return 0;
 }
 
+/*
+ * Every window we open costs a round-trip to the BMC, and reading through
+ * it can't start until the BMC has filled it. Ask for read windows as big
+ * as the BMC has been willing to map so far, so that a large read takes as
+ * few round-trips as the BMC allows and the sequential reads that follow a
+ * small one find the window already open. The size is only a hint, the BMC
+ * tells us what it actually mapped.
+ */
+static uint64_t hiomap_read_ahead(struct ipmi_hiomap *ctx, uint64_t pos,
+				  uint64_t len)
+{
+	uint64_t delta = pos & ((1 << ctx->block_size_shift) - 1);
+	uint64_t want = MAX(len, ctx->window_max);
+
+	/* Don't ask for more than the protocol can express */
+	want = MIN(want, ((uint64_t)0xffff << ctx->block_size_shift) - delta);
+	if (pos + want > ctx->total_size)
+		want = ctx->total_size > pos ? ctx->total_size - pos : 0;
+
+	return MAX(want, len);
+}
+
 static int hiomap_window_move(struct ipmi_hiomap *ctx, uint8_t command,
 			      uint64_t pos, uint64_t len, uint64_t *size)
 {
@@ -324,7 +356,8 @@ static int hiomap_window_move(struct ipmi_hiomap *ctx, uint8_t command,
 
 	range = (struct hiomap_v2_range *)&req[2];
 	range->offset = cpu_to_le16(bytes_to_blocks(ctx, pos));
-	range->size = cpu_to_le16(bytes_to_blocks_align_up(ctx, pos, len));
+	range->size = cpu_to_le16(bytes_to_blocks_align_up(ctx, pos,
+			is_read ? hiomap_read_ahead(ctx, pos, len) : len));
 
 	msg = ipmi_mkmsg(IPMI_DEFAULT_INTERFACE,
 		         bmc_platform->sw->ipmi_oem_hiomap_cmd,
@@ -563,34 +596,10 @@ static int lpc_window_read(struct ipmi_hiomap *ctx, uint32_t pos,
 	prlog(PR_TRACE, "Reading at 0x%08x for 0x%08x offset: 0x%08x\n",
 	      pos, len, off);
 
-	while(len) {
-		uint32_t chunk;
-		uint32_t dat;
-
-		/* XXX: make this read until it's aligned */
-		if (len > 3 && !(off & 3)) {
-			rc = lpc_read(OPAL_LPC_FW, off, &dat, 4);
-			if (!rc) {
-				/*
-				 * lpc_read swaps to CPU endian but it's not
-				 * really a 32-bit value, so convert back.
-				 */
-				*(__be32 *)buf = cpu_to_be32(dat);
-			}
-			chunk = 4;
-		} else {
-			rc = lpc_read(OPAL_LPC_FW, off, &dat, 1);
-			if (!rc)
-				*(uint8_t *)buf = dat;
-			chunk = 1;
-		}
-		if (rc) {
-			prlog(PR_ERR, "lpc_read failure %d to FW 0x%08x\n", rc, off);
-			return rc;
-		}
-		len -= chunk;
-		off += chunk;
-		buf += chunk;
+	rc = lpc_fw_read(off, buf, len);
+	if (rc) {
+		prlog(PR_ERR, "lpc_read failure %d to FW 0x%08x\n", rc, off);
+		return rc;
 	}
 
 	return 0;
@@ -616,28 +625,10 @@ static int lpc_window_write(struct ipmi_hiomap *ctx, uint32_t pos,
 	prlog(PR_TRACE, "Writing at 0x%08x for 0x%08x offset: 0x%08x\n",
 	      pos, len, off);
 
-	while(len) {
-		uint32_t chunk;
-
-		if (len > 3 && !(off & 3)) {
-			/* endian swap: see lpc_window_write */
-			uint32_t dat = be32_to_cpu(*(__be32 *)buf);
-
-			rc = lpc_write(OPAL_LPC_FW, off, dat, 4);
-			chunk = 4;
-		} else {
-			uint8_t dat = *(uint8_t *)buf;
-
-			rc = lpc_write(OPAL_LPC_FW, off, dat, 1);
-			chunk = 1;
-		}
-		if (rc) {
-			prlog(PR_ERR, "lpc_write failure %d to FW 0x%08x\n", rc, off);
-			return rc;
-		}
-		len -= chunk;
-		off += chunk;
-		buf += chunk;
+	rc = lpc_fw_write(off, buf, len);
+	if (rc) {
+		prlog(PR_ERR, "lpc_write failure %d to FW 0x%08x\n", rc, off);
+		return rc;
 	}
 
 	return 0;
@@ -744,8 +735,9 @@ restore:
 static int ipmi_hiomap_read(struct blocklevel_device *bl, uint64_t pos,
 			    void *buf, uint64_t len)
 {
+	struct hiomap_rtt *rtt, before;
 	struct ipmi_hiomap *ctx;
-	uint64_t size;
+	uint64_t size, total;
 	int rc = 0;
 
 	/* LPC is only 32bit */
@@ -760,6 +752,9 @@ static int ipmi_hiomap_read(struct blocklevel_device *bl, uint64_t pos,
 
 	prlog(PR_TRACE, "Flash read at %#" PRIx64 " for %#" PRIx64 "\n", pos,
 	      len);
+	rtt = &ctx->rtt[HIOMAP_C_CREATE_READ_WINDOW];
+	before = *rtt;
+	total = len;
 	while (len > 0) {
 		/* Move window and get a new size to read */
 		rc = hiomap_window_move(ctx, HIOMAP_C_CREATE_READ_WINDOW, pos,
@@ -783,8 +778,14 @@ static int ipmi_hiomap_read(struct blocklevel_device *bl, uint64_t pos,
 		pos += size;
 		buf += size;
 	}
-	return rc;
 
+	if (rtt->count != before.count)
+		prlog(PR_DEBUG, "Read %#" PRIx64 " bytes through %" PRIu64
+		      " windows, %lu us waiting for the BMC\n", total,
+		      rtt->count - before.count,
+		      tb_to_usecs(rtt->total - before.total));
+
+	return rc;
 }
 
 static int ipmi_hiomap_write(struct blocklevel_device *bl, uint64_t pos,
@@ -997,6 +998,22 @@ err:
 	return rc;
 }
 
+static void hiomap_print_stats(struct ipmi_hiomap *ctx)
+{
+	struct hiomap_rtt *rtt;
+	int i;
+
+	for (i = 0; i < HIOMAP_C_COUNT; i++) {
+		rtt = &ctx->rtt[i];
+		if (!rtt->count)
+			continue;
+		prlog(PR_INFO, "Command %d: %" PRIu64 " round-trips, "
+		      "%lu us average, %lu us max\n", i, rtt->count,
+		      tb_to_usecs(rtt->total / rtt->count),
+		      tb_to_usecs(rtt->max));
+	}
+}
+
 bool ipmi_hiomap_exit(struct blocklevel_device *bl)
 {
 	bool status = true;
@@ -1004,6 +1021,7 @@ bool ipmi_hiomap_exit(struct blocklevel_device *bl)
 	struct ipmi_hiomap *ctx;
 	if (bl) {
 		ctx = container_of(bl, struct ipmi_hiomap, bl);
+		hiomap_print_stats(ctx);
 		status = hiomap_reset(ctx);
 		free(ctx);
 	}
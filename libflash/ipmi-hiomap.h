@@ -4,6 +4,7 @@
 #ifndef __LIBFLASH_IPMI_HIOMAP_H
 #define __LIBFLASH_IPMI_HIOMAP_H
 
+#include <hiomap.h>
 #include <lock.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -28,6 +29,10 @@ struct ipmi_hiomap {
 	uint32_t total_size;
 	uint32_t erase_granule;
 	struct lpc_window current;
+	/* Largest read window the BMC has granted, to size our requests */
+	uint32_t window_max;
+	/* BMC round-trips, indexed by command */
+	struct hiomap_rtt rtt[HIOMAP_C_COUNT];
 
 	/*
 	 * update, bmc_state and window_state can be accessed by both calls
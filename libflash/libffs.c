@@ -23,6 +23,21 @@ struct ffs_handle {
 	/* The converted header knows how big this is */
 	struct __ffs_hdr *cache;
 	struct blocklevel_device *bl;
+	/*
+	 * Open addressed hash of the entries by name, each slot holds an
+	 * entry index + 1. NULL if it couldn't be allocated, lookups then
+	 * fall back to a linear search.
+	 */
+	uint32_t		*index;
+	uint32_t		index_mask;
+};
+
+struct ffs_cache {
+	struct blocklevel_device *bl;
+	uint32_t		toc;
+	uint32_t		max_size;
+	bool			mark_ecc;
+	struct ffs_handle	*side[FFS_CACHE_SIDES];
 };
 
 static uint32_t ffs_checksum(void* data, size_t size)
@@ -292,6 +307,40 @@ bool has_ecc(struct ffs_entry *ent)
 	return ((ent->user.datainteg & FFS_ENRY_INTEG_ECC) != 0);
 }
 
+/* Names compare on at most FFS_PART_NAME_MAX characters, so hash those */
+static uint32_t ffs_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < FFS_PART_NAME_MAX && name[i]; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void ffs_build_index(struct ffs_handle *ffs)
+{
+	uint32_t i, slot, size = 4;
+
+	while (size < 2 * ffs->hdr.count)
+		size <<= 1;
+
+	ffs->index = calloc(size, sizeof(*ffs->index));
+	if (!ffs->index)
+		return;
+	ffs->index_mask = size - 1;
+
+	/* Duplicate names probe in entry order, so the first one wins */
+	for (i = 0; i < ffs->hdr.count; i++) {
+		slot = ffs_name_hash(ffs->hdr.entries[i]->name);
+		while (ffs->index[slot & ffs->index_mask])
+			slot++;
+		ffs->index[slot & ffs->index_mask] = i + 1;
+	}
+}
+
 int ffs_init(uint32_t offset, uint32_t max_size, struct blocklevel_device *bl,
 		struct ffs_handle **ffs, bool mark_ecc)
 {
@@ -420,6 +469,8 @@ int ffs_init(uint32_t offset, uint32_t max_size, struct blocklevel_device *bl,
 		}
 	}
 
+	ffs_build_index(f);
+
 out:
 	if (rc == 0)
 		*ffs = f;
@@ -454,6 +505,7 @@ void ffs_close(struct ffs_handle *ffs)
 	if (ffs->cache)
 		free(ffs->cache);
 
+	free(ffs->index);
 	free(ffs);
 }
 
@@ -461,8 +513,23 @@ int ffs_lookup_part(struct ffs_handle *ffs, const char *name,
 		    uint32_t *part_idx)
 {
 	struct ffs_entry **ents = ffs->hdr.entries;
+	uint32_t slot, idx;
 	int i;
 
+	if (ffs->index) {
+		slot = ffs_name_hash(name);
+		while ((idx = ffs->index[slot & ffs->index_mask])) {
+			if (!strncmp(name, ents[idx - 1]->name,
+				     FFS_PART_NAME_MAX)) {
+				if (part_idx)
+					*part_idx = idx - 1;
+				return 0;
+			}
+			slot++;
+		}
+		return FFS_ERR_PART_NOT_FOUND;
+	}
+
 	for (i = 0;
 			i < ffs->hdr.count &&
 			strncmp(name, ents[i]->name, FFS_PART_NAME_MAX);
@@ -546,6 +613,117 @@ int ffs_next_side(struct ffs_handle *ffs, struct ffs_handle **new_ffs,
 	return ffs_init(offset, max_size, ffs->bl, new_ffs, mark_ecc);
 }
 
+int ffs_cache_init(uint32_t toc, uint32_t max_size,
+		struct blocklevel_device *bl, bool mark_ecc,
+		struct ffs_cache **cache)
+{
+	struct ffs_cache *c;
+
+	if (!cache || !bl)
+		return FLASH_ERR_PARM_ERROR;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return FLASH_ERR_MALLOC_FAILED;
+
+	c->bl = bl;
+	c->toc = toc;
+	c->max_size = max_size;
+	c->mark_ecc = mark_ecc;
+	*cache = c;
+
+	return 0;
+}
+
+static void ffs_cache_drop(struct ffs_cache *cache, int side)
+{
+	for (; side < FFS_CACHE_SIDES; side++) {
+		if (cache->side[side])
+			ffs_close(cache->side[side]);
+		cache->side[side] = NULL;
+	}
+}
+
+void ffs_cache_close(struct ffs_cache *cache)
+{
+	if (!cache)
+		return;
+
+	ffs_cache_drop(cache, 0);
+	free(cache);
+}
+
+int ffs_cache_get(struct ffs_cache *cache, int side, struct ffs_handle **ffs)
+{
+	struct ffs_handle *first;
+	uint32_t index, toc;
+	int rc;
+
+	if (!cache || !ffs || side < 0 || side >= FFS_CACHE_SIDES)
+		return FLASH_ERR_PARM_ERROR;
+	*ffs = NULL;
+
+	if (cache->side[side]) {
+		*ffs = cache->side[side];
+		return 0;
+	}
+
+	toc = cache->toc;
+	if (side) {
+		/* The other TOC is wherever side 0 says it is */
+		rc = ffs_cache_lookup(cache, "OTHER_SIDE", 0, &first, &index);
+		if (rc)
+			return rc;
+
+		rc = ffs_part_info(first, index, NULL, &toc, NULL, NULL, NULL);
+		if (rc)
+			return rc;
+	}
+
+	rc = ffs_init(toc, cache->max_size, cache->bl, ffs, cache->mark_ecc);
+	if (rc)
+		return rc;
+
+	cache->side[side] = *ffs;
+	return 0;
+}
+
+int ffs_cache_lookup(struct ffs_cache *cache, const char *name, int side,
+		struct ffs_handle **ffs, uint32_t *part_idx)
+{
+	int rc;
+
+	rc = ffs_cache_get(cache, side, ffs);
+	if (rc)
+		return rc;
+
+	return ffs_lookup_part(*ffs, name, part_idx);
+}
+
+void ffs_cache_invalidate(struct ffs_cache *cache, uint64_t offset,
+		uint64_t len)
+{
+	struct ffs_handle *ffs;
+	int side;
+
+	if (!cache || !len)
+		return;
+
+	for (side = 0; side < FFS_CACHE_SIDES; side++) {
+		ffs = cache->side[side];
+		if (!ffs ||
+		    offset >= (uint64_t)ffs->toc_offset + ffs->hdr.size ||
+		    offset + len <= ffs->toc_offset)
+			continue;
+
+		FL_DBG("FFS: Write to TOC at 0x%08x, dropping side %d\n",
+		       ffs->toc_offset, side);
+		/* Later sides were found through this one */
+		ffs_cache_drop(cache, side);
+		break;
+	}
+}
+
 int ffs_entry_add(struct ffs_hdr *hdr, struct ffs_entry *entry)
 {
 	const char *smallest_name;
@@ -119,6 +119,34 @@ void ffs_close(struct ffs_handle *ffs);
 int ffs_lookup_part(struct ffs_handle *ffs, const char *name,
 		    uint32_t *part_idx);
 
+/*
+ * A cache of the TOCs on a flash, for users which look partitions up over
+ * and over. Side 0 is the TOC at @toc, side 1 is the one its OTHER_SIDE
+ * partition points to. Each side is read on first use and kept until a
+ * write over it is reported with ffs_cache_invalidate().
+ *
+ * The handles belong to the cache, don't ffs_close() them, and they are
+ * only good until the next invalidation.
+ */
+#define FFS_CACHE_SIDES	2
+
+struct ffs_cache;
+
+int ffs_cache_init(uint32_t toc, uint32_t max_size,
+		struct blocklevel_device *bl, bool mark_ecc,
+		struct ffs_cache **cache);
+
+void ffs_cache_close(struct ffs_cache *cache);
+
+int ffs_cache_get(struct ffs_cache *cache, int side, struct ffs_handle **ffs);
+
+int ffs_cache_lookup(struct ffs_cache *cache, const char *name, int side,
+		struct ffs_handle **ffs, uint32_t *part_idx);
+
+/* Something wrote or erased @len bytes at @offset, drop any TOC it hit */
+void ffs_cache_invalidate(struct ffs_cache *cache, uint64_t offset,
+		uint64_t len);
+
 int ffs_part_info(struct ffs_handle *ffs, uint32_t part_idx,
 		  char **name, uint32_t *start,
 		  uint32_t *total_size, uint32_t *act_size, bool *ecc);
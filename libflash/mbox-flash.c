@@ -58,6 +58,11 @@ struct mbox_flash_data {
 	bool busy;
 	bool ack;
 	mbox_handler **handlers;
+	/* Command in flight and when it was sent */
+	uint8_t cmd;
+	unsigned long sent;
+	/* BMC round-trips, indexed by command */
+	struct hiomap_rtt rtt[MBOX_COMMAND_COUNT + 1];
 };
 
 static mbox_handler mbox_flash_do_nop;
@@ -152,34 +157,10 @@ static int lpc_window_read(struct mbox_flash_data *mbox_flash, uint32_t pos,
 	prlog(PR_TRACE, "Reading at 0x%08x for 0x%08x offset: 0x%08x\n",
 			pos, len, off);
 
-	while(len) {
-		uint32_t chunk;
-		uint32_t dat;
-
-		/* XXX: make this read until it's aligned */
-		if (len > 3 && !(off & 3)) {
-			rc = lpc_read(OPAL_LPC_FW, off, &dat, 4);
-			if (!rc) {
-				/*
-				 * lpc_read swaps to CPU endian but it's not
-				 * really a 32-bit value, so convert back.
-				 */
-				*(__be32 *)buf = cpu_to_be32(dat);
-			}
-			chunk = 4;
-		} else {
-			rc = lpc_read(OPAL_LPC_FW, off, &dat, 1);
-			if (!rc)
-				*(uint8_t *)buf = dat;
-			chunk = 1;
-		}
-		if (rc) {
-			prlog(PR_ERR, "lpc_read failure %d to FW 0x%08x\n", rc, off);
-			return rc;
-		}
-		len -= chunk;
-		off += chunk;
-		buf += chunk;
+	rc = lpc_fw_read(off, buf, len);
+	if (rc) {
+		prlog(PR_ERR, "lpc_read failure %d to FW 0x%08x\n", rc, off);
+		return rc;
 	}
 
 	return 0;
@@ -195,28 +176,10 @@ static int lpc_window_write(struct mbox_flash_data *mbox_flash, uint32_t pos,
 	prlog(PR_TRACE, "Writing at 0x%08x for 0x%08x offset: 0x%08x\n",
 			pos, len, off);
 
-	while(len) {
-		uint32_t chunk;
-
-		if (len > 3 && !(off & 3)) {
-			/* endian swap: see lpc_window_write */
-			uint32_t dat = be32_to_cpu(*(__be32 *)buf);
-
-			rc = lpc_write(OPAL_LPC_FW, off, dat, 4);
-			chunk = 4;
-		} else {
-			uint8_t dat = *(uint8_t *)buf;
-
-			rc = lpc_write(OPAL_LPC_FW, off, dat, 1);
-			chunk = 1;
-		}
-		if (rc) {
-			prlog(PR_ERR, "lpc_write failure %d to FW 0x%08x\n", rc, off);
-			return rc;
-		}
-		len -= chunk;
-		off += chunk;
-		buf += chunk;
+	rc = lpc_fw_write(off, buf, len);
+	if (rc) {
+		prlog(PR_ERR, "lpc_write failure %d to FW 0x%08x\n", rc, off);
+		return rc;
 	}
 
 	return 0;
@@ -322,6 +285,8 @@ static int msg_send(struct mbox_flash_data *mbox_flash, struct bmc_mbox_msg *msg
 		return FLASH_ERR_AGAIN;
 	mbox_flash->busy = true;
 	mbox_flash->rc = 0;
+	mbox_flash->cmd = msg->command;
+	mbox_flash->sent = mftb();
 	return bmc_mbox_enqueue(msg, timeout_sec);
 }
 
@@ -354,6 +319,11 @@ static int wait_for_bmc(struct mbox_flash_data *mbox_flash, unsigned int timeout
 		return MBOX_R_TIMEOUT;
 	}
 
+	/* Only a real response says anything about the BMC's latency */
+	if (mbox_flash->cmd <= MBOX_COMMAND_COUNT)
+		hiomap_rtt_account(&mbox_flash->rtt[mbox_flash->cmd],
+				   mftb() - mbox_flash->sent);
+
 	return mbox_flash->rc;
 }
 
@@ -771,7 +741,8 @@ static int mbox_flash_read(struct blocklevel_device *bl, uint64_t pos,
 			   void *buf, uint64_t len)
 {
 	struct mbox_flash_data *mbox_flash;
-	uint64_t size;
+	struct hiomap_rtt *rtt, before;
+	uint64_t size, total;
 
 	int rc = 0;
 
@@ -785,6 +756,9 @@ static int mbox_flash_read(struct blocklevel_device *bl, uint64_t pos,
 		return FLASH_ERR_AGAIN;
 
 	prlog(PR_TRACE, "Flash read at %#" PRIx64 " for %#" PRIx64 "\n", pos, len);
+	rtt = &mbox_flash->rtt[MBOX_C_CREATE_READ_WINDOW];
+	before = *rtt;
+	total = len;
 	while (len > 0) {
 		/* Move window and get a new size to read */
 		rc = mbox_window_move(mbox_flash, &mbox_flash->read,
@@ -808,6 +782,13 @@ static int mbox_flash_read(struct blocklevel_device *bl, uint64_t pos,
 		if (!is_valid(mbox_flash, &mbox_flash->read))
 			return FLASH_ERR_AGAIN;
 	}
+
+	if (rtt->count != before.count)
+		prlog(PR_DEBUG, "Read %#" PRIx64 " bytes through %" PRIu64
+		      " windows, %lu us waiting for the BMC\n", total,
+		      rtt->count - before.count,
+		      tb_to_usecs(rtt->total - before.total));
+
 	return rc;
 }
 
@@ -1185,13 +1166,30 @@ int mbox_flash_init(struct blocklevel_device **bl)
 	return 0;
 }
 
+static void mbox_flash_print_stats(struct mbox_flash_data *mbox_flash)
+{
+	struct hiomap_rtt *rtt;
+	int i;
+
+	for (i = 0; i <= MBOX_COMMAND_COUNT; i++) {
+		rtt = &mbox_flash->rtt[i];
+		if (!rtt->count)
+			continue;
+		prlog(PR_INFO, "Command %d: %" PRIu64 " round-trips, "
+		      "%lu us average, %lu us max\n", i, rtt->count,
+		      tb_to_usecs(rtt->total / rtt->count),
+		      tb_to_usecs(rtt->max));
+	}
+}
+
 bool mbox_flash_exit(struct blocklevel_device *bl)
 {
 	bool status = true;
 	struct mbox_flash_data *mbox_flash;
 	if (bl) {
-		status = mbox_flash_reset(bl);
 		mbox_flash = container_of(bl, struct mbox_flash_data, bl);
+		mbox_flash_print_stats(mbox_flash);
+		status = mbox_flash_reset(bl);
 		free(mbox_flash);
 	}
 
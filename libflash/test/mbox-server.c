@@ -92,53 +92,24 @@ static bool check_window(uint32_t pos, uint32_t size)
 }
 
 /* skiboot test stubs */
-int64_t lpc_read(enum OpalLPCAddressType __unused addr_type, uint32_t addr,
-		 uint32_t *data, uint32_t sz);
-int64_t lpc_read(enum OpalLPCAddressType __unused addr_type, uint32_t addr,
-		 uint32_t *data, uint32_t sz)
+int64_t lpc_fw_read(uint32_t addr, void *buf, uint32_t len);
+int64_t lpc_fw_read(uint32_t addr, void *buf, uint32_t len)
 {
 	/* Let it read from a write window... Spec says it ok! */
-	if (!check_window(addr, sz) || server_state.win_type == WIN_CLOSED)
+	if (!check_window(addr, len) || server_state.win_type == WIN_CLOSED)
 		return 1;
 
-	switch (sz) {
-	case 1:
-		*(uint8_t *)data = *(uint8_t *)(server_state.lpc_base + addr);
-		break;
-	case 2:
-		*(uint16_t *)data = be16_to_cpu(*(uint16_t *)(server_state.lpc_base + addr));
-		break;
-	case 4:
-		*(uint32_t *)data = be32_to_cpu(*(uint32_t *)(server_state.lpc_base + addr));
-		break;
-	default:
-		prerror("Invalid data size %d\n", sz);
-		return 1;
-	}
+	memcpy(buf, server_state.lpc_base + addr, len);
 	return 0;
 }
 
-int64_t lpc_write(enum OpalLPCAddressType __unused addr_type, uint32_t addr,
-		  uint32_t data, uint32_t sz);
-int64_t lpc_write(enum OpalLPCAddressType __unused addr_type, uint32_t addr,
-		  uint32_t data, uint32_t sz)
+int64_t lpc_fw_write(uint32_t addr, const void *buf, uint32_t len);
+int64_t lpc_fw_write(uint32_t addr, const void *buf, uint32_t len)
 {
-	if (!check_window(addr, sz) || server_state.win_type != WIN_WRITE)
-		return 1;
-	switch (sz) {
-	case 1:
-		*(uint8_t *)(server_state.lpc_base + addr) = data;
-		break;
-	case 2:
-		*(uint16_t *)(server_state.lpc_base + addr) = cpu_to_be16(data);
-		break;
-	case 4:
-		*(uint32_t *)(server_state.lpc_base + addr) = cpu_to_be32(data);
-		break;
-	default:
-		prerror("Invalid data size %d\n", sz);
+	if (!check_window(addr, len) || server_state.win_type != WIN_WRITE)
 		return 1;
-	}
+
+	memcpy(server_state.lpc_base + addr, buf, len);
 	return 0;
 }
 
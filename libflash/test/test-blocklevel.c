@@ -113,6 +113,170 @@ static void print_ptr(void *ptr, int len)
 	putchar('\n');
 }
 
+/* Counts what reaches the device behind the cache */
+static unsigned int nr_reads, nr_writes, nr_erases;
+static bool fail_writes;
+
+static int bl_count_read(struct blocklevel_device *bl, uint64_t pos, void *buf, uint64_t len)
+{
+	nr_reads++;
+	return bl_test_read(bl, pos, buf, len);
+}
+
+static int bl_count_write(struct blocklevel_device *bl, uint64_t pos, const void *buf, uint64_t len)
+{
+	nr_writes++;
+	if (fail_writes)
+		return FLASH_ERR_VERIFY_FAILURE;
+	return bl_test_write(bl, pos, buf, len);
+}
+
+static int bl_count_erase(struct blocklevel_device *bl, uint64_t pos, uint64_t len)
+{
+	nr_erases++;
+	if ((pos | len) & bl->erase_mask)
+		return FLASH_ERR_ERASE_BOUNDARY;
+	return bl_test_erase(bl, pos, len);
+}
+
+static int bl_count_get_info(struct blocklevel_device *bl, const char **name,
+		uint64_t *total_size, uint32_t *erase_granule)
+{
+	if (name)
+		*name = "test";
+	if (total_size)
+		*total_size = 0x1000;
+	if (erase_granule)
+		*erase_granule = bl->erase_mask + 1;
+	return 0;
+}
+
+static int check_counts(unsigned int reads, unsigned int writes,
+		unsigned int erases, int line)
+{
+	if (nr_reads == reads && nr_writes == writes && nr_erases == erases)
+		return 0;
+	ERR("Cache line %d: %u reads, %u writes, %u erases, expected %u %u %u\n",
+	    line, nr_reads, nr_writes, nr_erases, reads, writes, erases);
+	return 1;
+}
+
+static uint8_t ref[0x1000], buf[0x1000];
+
+static int test_cache(void)
+{
+	struct blocklevel_device backend = { 0 }, *bl;
+	uint8_t *flash;
+	uint32_t record;
+	int i, rc;
+
+	flash = malloc(0x1000);
+	reset_buf(flash);
+	memcpy(ref, flash, 0x1000);
+	backend.priv = flash;
+	backend.read = &bl_count_read;
+	backend.write = &bl_count_write;
+	backend.erase = &bl_count_erase;
+	backend.get_info = &bl_count_get_info;
+	backend.erase_mask = 0xff;
+	backend.flags = WRITE_NEED_ERASE;
+	if (blocklevel_ecc_protect(&backend, 0xc00, 0x400)) {
+		ERR("Failed to blocklevel_ecc_protect(0xc00, 0x400)\n");
+		return 1;
+	}
+
+	if (blocklevel_cache_init(&backend, 4, &bl)) {
+		ERR("Failed to blocklevel_cache_init()\n");
+		return 1;
+	}
+	if (ecc_protected(bl, 0xc00, 0x400, NULL) != 1 ||
+	    ecc_protected(bl, 0x0, 0x400, NULL) != 0) {
+		ERR("Cache didn't carry over ECC ranges\n");
+		return 1;
+	}
+
+	/* Record by record updates of one erase block, like GARD does */
+	for (i = 0; i < 32; i++) {
+		record = 0x01010101 * i;
+		memcpy(&ref[0x210 + i * 4], &record, 4);
+		rc = blocklevel_smart_write(bl, 0x210 + i * 4, &record, 4);
+		if (rc) {
+			ERR("Cache smart_write %d failed: %d\n", i, rc);
+			return 1;
+		}
+	}
+	if (check_counts(1, 0, 0, __LINE__))
+		return 1;
+
+	/* Seen by readers, big or small, but not on the device yet */
+	if (blocklevel_read(bl, 0x200, buf, 0x100) || memcmp(buf, &ref[0x200], 0x100) ||
+	    blocklevel_raw_read(bl, 0, buf, 0x1000) || memcmp(buf, ref, 0x1000)) {
+		ERR("Cache read back doesn't match\n");
+		return 1;
+	}
+	if (check_counts(2, 0, 0, __LINE__) || !memcmp(flash, ref, 0x1000))
+		return 1;
+
+	/* One erase and one write for the lot */
+	if (blocklevel_cache_sync(bl) || check_counts(2, 1, 1, __LINE__) ||
+	    memcmp(flash, ref, 0x1000)) {
+		ERR("Cache sync didn't write back\n");
+		return 1;
+	}
+	if (blocklevel_cache_sync(bl) || check_counts(2, 1, 1, __LINE__))
+		return 1;
+
+	/* A write across two blocks, and more blocks than fit */
+	memset(&ref[0x0f0], 'X', 0x20);
+	if (blocklevel_write(bl, 0x0f0, &ref[0x0f0], 0x20))
+		return 1;
+	for (i = 3; i < 6; i++) {
+		ref[i * 0x100 + 1] = 'Y';
+		if (blocklevel_write(bl, i * 0x100 + 1, "Y", 1))
+			return 1;
+	}
+	/* 0x200 was clean, 0x000 was dirty and the oldest */
+	if (check_counts(7, 2, 1, __LINE__) ||
+	    memcmp(flash, ref, 0x100) || !memcmp(flash, ref, 0x1000))
+		return 1;
+
+	/* Erasing a whole block needs nothing read, nor written back */
+	memset(&ref[0x600], 0xff, 0x100);
+	if (blocklevel_erase(bl, 0x600, 0x100) || check_counts(7, 3, 1, __LINE__))
+		return 1;
+	/* Unaligned erases go through smart_erase, and the cache */
+	memset(&ref[0x780], 0xff, 0x40);
+	if (blocklevel_smart_erase(bl, 0x780, 0x40)) {
+		ERR("Cache smart_erase failed\n");
+		return 1;
+	}
+
+	if (blocklevel_write(bl, 0xff0, buf, 0x20) != FLASH_ERR_PARM_ERROR) {
+		ERR("Cache allowed a write past the end\n");
+		return 1;
+	}
+
+	/* A failed write back keeps the cache, and what's in it */
+	fail_writes = true;
+	if (!blocklevel_cache_exit(bl) || !memcmp(flash, ref, 0x1000)) {
+		ERR("Cache exit didn't fail\n");
+		return 1;
+	}
+	fail_writes = false;
+
+	if (blocklevel_cache_exit(bl) || memcmp(flash, ref, 0x1000)) {
+		ERR("Cache exit didn't write back everything\n");
+		for (i = 0; i < 0x1000 && flash[i] == ref[i]; i++)
+			;
+		dump_buf(flash, i & ~0xf, (i & ~0xf) + 0x20, i);
+		return 1;
+	}
+
+	free(backend.ecc_prot.prot);
+	free(flash);
+	return 0;
+}
+
 int main(void)
 {
 	struct blocklevel_device bl_mem = { 0 };
@@ -657,6 +821,8 @@ int main(void)
 		goto out;
 	}
 
+	rc = test_cache();
+
 out:
 	free(buf);
 	free(data);
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #include <libflash/ecc.h>
 
@@ -352,6 +353,218 @@ struct ecc64 ecc_data[] = {
 
 };
 
+/* The ECC matrix, for eccgenerate() to be checked against */
+static const uint64_t ref_eccmatrix[] = {
+	0x0000e8423c0f99ffull,
+	0x00e8423c0f99ff00ull,
+	0xe8423c0f99ff0000ull,
+	0x423c0f99ff0000e8ull,
+	0x3c0f99ff0000e842ull,
+	0x0f99ff0000e8423cull,
+	0x99ff0000e8423c0full,
+	0xff0000e8423c0f99ull
+};
+
+static uint8_t ref_eccgenerate(uint64_t data)
+{
+	uint8_t result = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		result |= __builtin_parityll(ref_eccmatrix[i] & data) << i;
+
+	return result;
+}
+
+static uint64_t rand_state = 0x2545f4914f6cdd1dull;
+
+static uint64_t rand64(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return rand_state;
+}
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+#define BULK_WORDS	4099
+
+static void test_generate(void)
+{
+	uint64_t data;
+	int i, j;
+
+	printf("Checking eccgenerate() against the matrix\n");
+	for (i = 0; i < 8; i++) {
+		for (j = 0; j < 256; j++) {
+			data = (uint64_t)j << (i * 8);
+			if (eccgenerate(data) != ref_eccgenerate(data)) {
+				ERR("ECC of 0x%016lx is 0x%02x, expecting 0x%02x\n",
+				    data, eccgenerate(data), ref_eccgenerate(data));
+				exit(1);
+			}
+		}
+	}
+	for (i = 0; i < 1000000; i++) {
+		data = rand64();
+		if (eccgenerate(data) != ref_eccgenerate(data)) {
+			ERR("ECC of 0x%016lx is 0x%02x, expecting 0x%02x\n",
+			    data, eccgenerate(data), ref_eccgenerate(data));
+			exit(1);
+		}
+	}
+	printf("pass\n");
+}
+
+/* Whole buffers, at every alignment, with errors in the middle of them */
+static void test_bulk(void)
+{
+	uint8_t *data, *ecc, *out;
+	struct ecc64 *e;
+	uint64_t w, len = BULK_WORDS * 8;
+	int off, i, bad;
+
+	printf("Testing bulk ECC copies\n");
+	data = malloc(len + 8);
+	out = malloc(len + 8);
+	ecc = malloc(ecc_buffer_size(len) + 8);
+	if (!data || !out || !ecc) {
+		ERR("malloc failed during bulk ecc test\n");
+		exit(1);
+	}
+
+	for (off = 0; off < 8; off++) {
+		for (i = 0; i < len; i++)
+			data[off + i] = rand64();
+
+		e = (struct ecc64 *)(ecc + (7 - off));
+		if (memcpy_to_ecc(e, (beint64_t *)(data + off), len)) {
+			ERR("memcpy_to_ecc failed at offset %d\n", off);
+			exit(1);
+		}
+		for (i = 0; i < BULK_WORDS; i++) {
+			memcpy(&w, data + off + i * 8, 8);
+			if (memcmp(&e[i].data, &w, 8) ||
+			    e[i].ecc != ref_eccgenerate(be64toh(w))) {
+				ERR("memcpy_to_ecc got word %d wrong at offset %d\n",
+				    i, off);
+				exit(1);
+			}
+		}
+
+		/* One flipped bit here and there, in data and ECC */
+		for (i = 0; i < 16; i++) {
+			bad = rand64() % BULK_WORDS;
+			((uint8_t *)&e[bad])[rand64() % 9] ^= 1 << (rand64() % 8);
+		}
+		memset(out, 0, len + 8);
+		if (memcpy_from_ecc((beint64_t *)(out + off), e, len) ||
+		    memcmp(out + off, data + off, len)) {
+			ERR("memcpy_from_ecc didn't correct at offset %d\n", off);
+			exit(1);
+		}
+
+		/* Two in the same word can't be */
+		bad = BULK_WORDS / 2 + off;
+		memcpy(&e[bad], &e[bad - 1], sizeof(*e));
+		e[bad].ecc ^= 0x11;
+		if (memcpy_from_ecc((beint64_t *)(out + off), e, len) != UE) {
+			ERR("memcpy_from_ecc missed a UE at offset %d\n", off);
+			exit(1);
+		}
+	}
+	printf("pass\n");
+
+	free(data);
+	free(out);
+	free(ecc);
+}
+
+/* A source ending part way into a word is only read up to its end */
+static void test_short_tail(void)
+{
+	struct ecc64 e[2];
+	uint8_t *data, w[8];
+	int i;
+
+	printf("Testing a short unaligned tail\n");
+	data = malloc(13);
+	if (!data) {
+		ERR("malloc failed during short tail test\n");
+		exit(1);
+	}
+	for (i = 0; i < 13; i++)
+		data[i] = rand64();
+	memset(w, 0xff, 8);
+	for (i = 0; i < 2; i++) {
+		memcpy(&e[i].data, w, 8);
+		e[i].ecc = ref_eccgenerate(be64toh(e[i].data));
+	}
+
+	if (memcpy_to_ecc_unaligned(e, (beint64_t *)data, 13, 0)) {
+		ERR("memcpy_to_ecc_unaligned failed on a short tail\n");
+		exit(1);
+	}
+	memcpy(w, data + 8, 5);
+	if (memcmp(&e[0].data, data, 8) || memcmp(&e[1].data, w, 8) ||
+	    e[0].ecc != ref_eccgenerate(be64toh(e[0].data)) ||
+	    e[1].ecc != ref_eccgenerate(be64toh(e[1].data))) {
+		ERR("memcpy_to_ecc_unaligned got a short tail wrong\n");
+		exit(1);
+	}
+	printf("pass\n");
+
+	free(data);
+}
+
+static void bench(void)
+{
+	uint64_t i, j, len = 1 << 20, loops = 8;
+	struct ecc64 *e;
+	beint64_t *buf;
+	double t, ref, enc, dec;
+
+	buf = malloc(len);
+	e = malloc(ecc_buffer_size(len));
+	for (i = 0; i < len / 8; i++)
+		buf[i] = rand64();
+
+	/* What memcpy_to_ecc() used to do */
+	t = now_usecs();
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < len / 8; j++) {
+			e[j].data = buf[j];
+			e[j].ecc = ref_eccgenerate(be64toh(buf[j]));
+		}
+	}
+	ref = now_usecs() - t;
+
+	t = now_usecs();
+	for (i = 0; i < loops; i++)
+		memcpy_to_ecc(e, buf, len);
+	enc = now_usecs() - t;
+
+	t = now_usecs();
+	for (i = 0; i < loops; i++)
+		if (memcpy_from_ecc(buf, e, len))
+			exit(1);
+	dec = now_usecs() - t;
+
+	printf("ECC bench: matrix %.0f MB/s, encode %.0f MB/s, "
+	       "decode %.0f MB/s\n", loops * len / ref,
+	       loops * len / enc, loops * len / dec);
+
+	free(buf);
+	free(e);
+}
+
 int main(void)
 {
 	int i;
@@ -370,6 +583,7 @@ int main(void)
 		if (eccgenerate(be64toh(ecc_data[i].data)) != ecc_data[i].ecc) {
 			ERR("ECC did not generate the correct value, expecting 0x%02x, got 0x%02x\n",
 					ecc_data[i].ecc, eccgenerate(be64toh(ecc_data[i].data)));
+			exit(1);
 		}
 	}
 
@@ -506,5 +720,10 @@ int main(void)
 		ERR("ecc_buffer_align(0, 50) not 45 -> %ld\n", ecc_buffer_align(0, 50));
 		exit(1);
 	}
+
+	test_generate();
+	test_bulk();
+	test_short_tail();
+	bench();
 	return 0;
 }
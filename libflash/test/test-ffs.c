@@ -0,0 +1,282 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020 IBM Corp. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <skiboot-valgrind.h>
+
+#include <libflash/blocklevel.h>
+#include <libflash/libffs.h>
+
+#include "../ecc.c"
+#include "../blocklevel.c"
+#include "../libffs.c"
+
+bool libflash_debug;
+
+#define MEM_BLOCK	0x1000
+#define MEM_SIZE	0x40000
+#define SIDE1_TOC	0x20000
+#define NR_PARTS	16
+
+static uint8_t mem[MEM_SIZE];
+static unsigned long mem_reads;
+
+static int mem_read(struct blocklevel_device *bl __unused, uint64_t pos,
+		void *buf, uint64_t len)
+{
+	if (pos + len > MEM_SIZE)
+		return FLASH_ERR_PARM_ERROR;
+
+	memcpy(buf, mem + pos, len);
+	mem_reads++;
+
+	return 0;
+}
+
+static int mem_write(struct blocklevel_device *bl __unused, uint64_t pos,
+		const void *buf, uint64_t len)
+{
+	if (pos + len > MEM_SIZE)
+		return FLASH_ERR_PARM_ERROR;
+
+	memcpy(mem + pos, buf, len);
+
+	return 0;
+}
+
+static int mem_erase(struct blocklevel_device *bl __unused, uint64_t pos,
+		uint64_t len)
+{
+	if (pos + len > MEM_SIZE)
+		return FLASH_ERR_PARM_ERROR;
+
+	memset(mem + pos, 0xff, len);
+
+	return 0;
+}
+
+static int mem_get_info(struct blocklevel_device *bl __unused,
+		const char **name, uint64_t *total_size,
+		uint32_t *erase_granule)
+{
+	if (name)
+		*name = "mem";
+	if (total_size)
+		*total_size = MEM_SIZE;
+	if (erase_granule)
+		*erase_granule = MEM_BLOCK;
+
+	return 0;
+}
+
+static struct blocklevel_device mem_bl = {
+	.read = mem_read,
+	.write = mem_write,
+	.erase = mem_erase,
+	.get_info = mem_get_info,
+	.erase_mask = MEM_BLOCK - 1,
+};
+
+static void add_part(struct ffs_hdr *hdr, const char *name, uint32_t base,
+		uint32_t size)
+{
+	struct ffs_entry *ent;
+
+	assert(!ffs_entry_new(name, base, size, &ent));
+	assert(!ffs_entry_add(hdr, ent));
+}
+
+/*
+ * Side 0 at 0 with NR_PARTS partitions and an OTHER_SIDE, side 1 at
+ * SIDE1_TOC with the same ones plus @extra.
+ */
+static void write_tocs(const char *extra)
+{
+	struct ffs_entry *part = NULL;
+	struct ffs_hdr *hdr;
+	char name[FFS_PART_NAME_MAX + 1];
+	uint32_t i;
+
+	memset(mem, 0xff, sizeof(mem));
+
+	assert(!ffs_hdr_new(MEM_BLOCK, MEM_SIZE / MEM_BLOCK, NULL, &hdr));
+	for (i = 0; i < NR_PARTS; i++) {
+		snprintf(name, sizeof(name), "PART%02u", i);
+		add_part(hdr, name, (i + 2) * MEM_BLOCK, MEM_BLOCK);
+	}
+	add_part(hdr, "ABCDEFGHIJKLMNO", (NR_PARTS + 2) * MEM_BLOCK, MEM_BLOCK);
+	add_part(hdr, "OTHER_SIDE", SIDE1_TOC, MEM_SIZE - SIDE1_TOC);
+	assert(!ffs_hdr_finalise(&mem_bl, hdr));
+	ffs_hdr_free(hdr);
+
+	assert(!ffs_entry_new("part", SIDE1_TOC, 0, &part));
+	assert(!ffs_hdr_new(MEM_BLOCK, MEM_SIZE / MEM_BLOCK, &part, &hdr));
+	ffs_entry_put(part);
+	for (i = 0; i < NR_PARTS; i++) {
+		snprintf(name, sizeof(name), "PART%02u", i);
+		add_part(hdr, name, SIDE1_TOC + (i + 2) * MEM_BLOCK, MEM_BLOCK);
+	}
+	if (extra)
+		add_part(hdr, extra, SIDE1_TOC + (NR_PARTS + 2) * MEM_BLOCK,
+			 MEM_BLOCK);
+	assert(!ffs_hdr_finalise(&mem_bl, hdr));
+	ffs_hdr_free(hdr);
+}
+
+/* What ffs_lookup_part() did before it had an index */
+static int ref_lookup(struct ffs_handle *ffs, const char *name, uint32_t *idx)
+{
+	struct ffs_entry **ents = ffs->hdr.entries;
+	uint32_t i;
+
+	for (i = 0; i < ffs->hdr.count; i++) {
+		if (!strncmp(name, ents[i]->name, FFS_PART_NAME_MAX)) {
+			*idx = i;
+			return 0;
+		}
+	}
+	return FFS_ERR_PART_NOT_FOUND;
+}
+
+static void test_lookup(void)
+{
+	static const char *names[] = {
+		"part", "PART00", "PART07", "PART15", "OTHER_SIDE",
+		"ABCDEFGHIJKLMNO", "ABCDEFGHIJKLMNOP", "ABCDEFGHIJKLMN",
+		"PART1", "PART16", "", "NVRAM",
+	};
+	struct ffs_handle *ffs;
+	uint32_t i, idx, ref;
+	int rc;
+
+	write_tocs(NULL);
+	assert(!ffs_init(0, MEM_SIZE, &mem_bl, &ffs, false));
+	assert(ffs->index);
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		idx = ref = -1;
+		rc = ffs_lookup_part(ffs, names[i], &idx);
+		assert(rc == ref_lookup(ffs, names[i], &ref));
+		assert(idx == ref);
+	}
+
+	/* Names only count up to FFS_PART_NAME_MAX */
+	assert(!ffs_lookup_part(ffs, "ABCDEFGHIJKLMNOP", NULL));
+	assert(ffs_lookup_part(ffs, "PART16", NULL) == FFS_ERR_PART_NOT_FOUND);
+
+	ffs_close(ffs);
+}
+
+static void test_cache(void)
+{
+	struct ffs_handle *side0, *side1, *ffs;
+	struct ffs_cache *cache;
+	unsigned long reads;
+	uint32_t idx, start;
+
+	write_tocs("SIDE1ONLY");
+	assert(!ffs_cache_init(0, MEM_SIZE, &mem_bl, false, &cache));
+	assert(ffs_cache_get(cache, FFS_CACHE_SIDES, &ffs) ==
+	       FLASH_ERR_PARM_ERROR);
+
+	/* Each side is read once */
+	reads = mem_reads;
+	assert(!ffs_cache_lookup(cache, "PART03", 0, &side0, &idx));
+	assert(mem_reads > reads);
+	assert(!ffs_part_info(side0, idx, NULL, &start, NULL, NULL, NULL));
+	assert(start == 5 * MEM_BLOCK);
+
+	assert(!ffs_cache_lookup(cache, "PART03", 1, &side1, &idx));
+	assert(side1 != side0);
+	assert(!ffs_part_info(side1, idx, NULL, &start, NULL, NULL, NULL));
+	assert(start == SIDE1_TOC + 5 * MEM_BLOCK);
+	assert(!ffs_cache_lookup(cache, "SIDE1ONLY", 1, &ffs, NULL));
+	assert(ffs_cache_lookup(cache, "SIDE1ONLY", 0, &ffs, NULL) ==
+	       FFS_ERR_PART_NOT_FOUND);
+
+	reads = mem_reads;
+	assert(!ffs_cache_get(cache, 0, &ffs) && ffs == side0);
+	assert(!ffs_cache_get(cache, 1, &ffs) && ffs == side1);
+	assert(mem_reads == reads);
+
+	/* Writes to the partitions leave the TOCs alone */
+	ffs_cache_invalidate(cache, 2 * MEM_BLOCK, SIDE1_TOC - 2 * MEM_BLOCK);
+	ffs_cache_invalidate(cache, SIDE1_TOC + MEM_BLOCK, MEM_BLOCK);
+	ffs_cache_invalidate(cache, 0, 0);
+	assert(cache->side[0] == side0 && cache->side[1] == side1);
+
+	/* A write to side 1's TOC only drops that */
+	ffs_cache_invalidate(cache, SIDE1_TOC - 1, 2);
+	assert(cache->side[0] == side0 && !cache->side[1]);
+
+	/* Side 0 takes side 1 with it, as that's where OTHER_SIDE was */
+	assert(!ffs_cache_get(cache, 1, &side1));
+	write_tocs("NEWPART");
+	ffs_cache_invalidate(cache, MEM_BLOCK - 1, 1);
+	assert(!cache->side[0] && !cache->side[1]);
+	assert(!ffs_cache_lookup(cache, "NEWPART", 1, &ffs, NULL));
+	assert(ffs_cache_lookup(cache, "SIDE1ONLY", 1, &ffs, NULL) ==
+	       FFS_ERR_PART_NOT_FOUND);
+
+	/* A bad TOC isn't cached */
+	mem_erase(&mem_bl, 0, MEM_BLOCK);
+	ffs_cache_invalidate(cache, 0, MEM_SIZE);
+	assert(ffs_cache_get(cache, 0, &ffs) && !ffs);
+	assert(ffs_cache_get(cache, 1, &ffs) && !ffs);
+	write_tocs(NULL);
+	assert(!ffs_cache_get(cache, 1, &ffs) && ffs);
+
+	ffs_cache_close(cache);
+}
+
+static double now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench(void)
+{
+	unsigned int i, loops = RUNNING_ON_VALGRIND ? 100 : 20000;
+	struct ffs_handle *ffs;
+	struct ffs_cache *cache;
+	double t, parse, cached;
+	uint32_t idx;
+
+	write_tocs(NULL);
+
+	/* How resources used to be looked up */
+	t = now_usecs();
+	for (i = 0; i < loops; i++) {
+		assert(!ffs_init(0, MEM_SIZE, &mem_bl, &ffs, false));
+		assert(!ffs_lookup_part(ffs, "PART15", &idx));
+		ffs_close(ffs);
+	}
+	parse = now_usecs() - t;
+
+	assert(!ffs_cache_init(0, MEM_SIZE, &mem_bl, false, &cache));
+	t = now_usecs();
+	for (i = 0; i < loops; i++)
+		assert(!ffs_cache_lookup(cache, "PART15", 0, &ffs, &idx));
+	cached = now_usecs() - t;
+	ffs_cache_close(cache);
+
+	printf("FFS bench: parse and lookup %.2f us, cached lookup %.3f us\n",
+	       parse / loops, cached / loops);
+}
+
+int main(void)
+{
+	test_lookup();
+	test_cache();
+	bench();
+
+	return 0;
+}
@@ -205,20 +205,17 @@ int ipmi_sel_register(uint8_t oem_cmd __attribute__((unused)),
 	return 0;
 }
 
-int64_t lpc_write(enum OpalLPCAddressType addr_type __attribute__((unused)),
-		  uint32_t addr __attribute__((unused)),
-		  uint32_t data __attribute__((unused)),
-		  uint32_t sz)
+int64_t lpc_fw_write(uint32_t addr __attribute__((unused)),
+		     const void *buf __attribute__((unused)), uint32_t len)
 {
-	assert(sz != 0);
+	assert(len != 0);
 	return 0;
 }
 
-int64_t lpc_read(enum OpalLPCAddressType addr_type __attribute__((unused)),
-		 uint32_t addr __attribute__((unused)), uint32_t *data,
-		 uint32_t sz)
+int64_t lpc_fw_read(uint32_t addr __attribute__((unused)), void *buf,
+		    uint32_t len)
 {
-	memset(data, 0xaa, sz);
+	memset(buf, 0xaa, len);
 
 	return 0;
 }
@@ -1102,6 +1099,114 @@ static void test_hiomap_protocol_read_one_block_twice(void)
 	scenario_exit();
 }
 
+static const struct scenario_event
+scenario_hiomap_protocol_read_ahead[] = {
+	{ .type = scenario_event_p, .p = &hiomap_ack_call, },
+	{ .type = scenario_event_p, .p = &hiomap_get_info_call, },
+	{ .type = scenario_event_p, .p = &hiomap_get_flash_info_call, },
+	{
+		.type = scenario_cmd,
+		.c = {
+			.req = {
+				.cmd = HIOMAP_C_CREATE_READ_WINDOW,
+				.seq = 4,
+				.args = {
+					[0] = 0x00, [1] = 0x00,
+					[2] = 0x01, [3] = 0x00,
+				},
+			},
+			.cc = IPMI_CC_NO_ERROR,
+			.resp = {
+				.cmd = HIOMAP_C_CREATE_READ_WINDOW,
+				.seq = 4,
+				.args = {
+					[0] = 0xf0, [1] = 0x0f,
+					[2] = 0x04, [3] = 0x00,
+					[4] = 0x00, [5] = 0x00,
+				},
+			},
+		},
+	},
+	/* Asks for as much as it was given last time */
+	{
+		.type = scenario_cmd,
+		.c = {
+			.req = {
+				.cmd = HIOMAP_C_CREATE_READ_WINDOW,
+				.seq = 5,
+				.args = {
+					[0] = 0x04, [1] = 0x00,
+					[2] = 0x04, [3] = 0x00,
+				},
+			},
+			.cc = IPMI_CC_NO_ERROR,
+			.resp = {
+				.cmd = HIOMAP_C_CREATE_READ_WINDOW,
+				.seq = 5,
+				.args = {
+					[0] = 0xf0, [1] = 0x0f,
+					[2] = 0x04, [3] = 0x00,
+					[4] = 0x04, [5] = 0x00,
+				},
+			},
+		},
+	},
+	/* But not past the end of the flash */
+	{
+		.type = scenario_cmd,
+		.c = {
+			.req = {
+				.cmd = HIOMAP_C_CREATE_READ_WINDOW,
+				.seq = 6,
+				.args = {
+					[0] = 0xfe, [1] = 0x1f,
+					[2] = 0x02, [3] = 0x00,
+				},
+			},
+			.cc = IPMI_CC_NO_ERROR,
+			.resp = {
+				.cmd = HIOMAP_C_CREATE_READ_WINDOW,
+				.seq = 6,
+				.args = {
+					[0] = 0xf0, [1] = 0x0f,
+					[2] = 0x02, [3] = 0x00,
+					[4] = 0xfe, [5] = 0x1f,
+				},
+			},
+		},
+	},
+	{ .type = scenario_event_p, .p = &hiomap_reset_call_seq_7, },
+	SCENARIO_SENTINEL,
+};
+
+static void test_hiomap_protocol_read_ahead(void)
+{
+	struct blocklevel_device *bl;
+	struct ipmi_hiomap *ctx;
+	uint8_t *buf;
+	size_t len;
+
+	scenario_enter(scenario_hiomap_protocol_read_ahead);
+	assert(!ipmi_hiomap_init(&bl));
+	ctx = container_of(bl, struct ipmi_hiomap, bl);
+	len = 1 << ctx->block_size_shift;
+	buf = calloc(1, 3 * len);
+	assert(buf);
+	assert(!bl->read(bl, 0, buf, len));
+	assert(ctx->window_max == 4 * len);
+	/* The rest of the first window is already open */
+	assert(!bl->read(bl, len, buf, 3 * len));
+	assert(lpc_read_success(buf, 3 * len));
+	assert(!bl->read(bl, 4 * len, buf, len));
+	assert(!bl->read(bl, 0x1ffe * len, buf, len));
+	assert(lpc_read_success(buf, len));
+	assert(ctx->rtt[HIOMAP_C_CREATE_READ_WINDOW].count == 3);
+	assert(ctx->rtt[HIOMAP_C_ACK].count == 1);
+	free(buf);
+	ipmi_hiomap_exit(bl);
+	scenario_exit();
+}
+
 static const struct scenario_event
 scenario_hiomap_protocol_event_before_action[] = {
 	{ .type = scenario_event_p, .p = &hiomap_ack_call, },
@@ -3326,6 +3431,7 @@ struct test_case test_cases[] = {
 	TEST_CASE(test_hiomap_protocol_read_two_blocks),
 	TEST_CASE(test_hiomap_protocol_read_1block_1byte),
 	TEST_CASE(test_hiomap_protocol_read_one_block_twice),
+	TEST_CASE(test_hiomap_protocol_read_ahead),
 	TEST_CASE(test_hiomap_protocol_event_before_read),
 	TEST_CASE(test_hiomap_protocol_event_during_read),
 	TEST_CASE(test_hiomap_protocol_write_one_block),
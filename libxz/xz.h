@@ -237,6 +237,54 @@ XZ_EXTERN void xz_dec_reset(struct xz_dec *s);
  */
 XZ_EXTERN void xz_dec_end(struct xz_dec *s);
 
+/**
+ * struct xz_block - Location of a Block in a single-Stream .xz file
+ * @in_pos:     Offset of the Block Header in the file
+ * @in_size:    Size of the Block including its padding and Check
+ * @out_pos:    Offset of the Block's data in the uncompressed output
+ * @out_size:   Uncompressed size of the Block
+ * @check:      Type of the integrity check, from the Stream Header
+ *
+ * Blocks are compressed independently of each other, so when a file has
+ * several (xz --block-size=...) they can be decompressed in any order, or
+ * in parallel, with xz_dec_block_run().
+ */
+struct xz_block {
+    size_t in_pos;
+    size_t in_size;
+    size_t out_pos;
+    size_t out_size;
+    int check;
+};
+
+/**
+ * xz_dec_blocks() - Find the Blocks of a .xz file from its Index
+ * @in:         The whole .xz file
+ * @in_size:    Size of the file
+ * @blocks:     Filled in with up to @max_blocks Blocks, may be NULL
+ * @max_blocks: Size of @blocks
+ *
+ * Only files made of exactly one Stream, without Stream Padding, and with
+ * a supported Check are handled. Returns the number of Blocks, which may be
+ * more than @max_blocks, or -1 if the file isn't one of those.
+ */
+XZ_EXTERN int xz_dec_blocks(const uint8_t *in, size_t in_size,
+        struct xz_block *blocks, int max_blocks);
+
+/**
+ * xz_dec_block_run() - Decompress a single Block
+ * @s:          Decoder state allocated using xz_dec_init() in XZ_SINGLE mode
+ * @b:          Input and output buffers. The input is exactly the Block as
+ *              described by struct xz_block, the output has room for its
+ *              uncompressed size.
+ * @check:      Type of the integrity check, from struct xz_block
+ *
+ * Returns XZ_STREAM_END once the Block has been decompressed and checked,
+ * otherwise the same errors as xz_dec_run().
+ */
+XZ_EXTERN enum xz_ret xz_dec_block_run(struct xz_dec *s, struct xz_buf *b,
+        int check);
+
 /*
  * Standalone build (userspace build or in-kernel build for boot time use)
  * needs a CRC32 implementation. For normal in-kernel use, kernel's own
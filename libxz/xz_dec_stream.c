@@ -845,3 +845,130 @@ XZ_EXTERN void xz_dec_end(struct xz_dec *s)
         kfree(s);
     }
 }
+
+/*
+ * Multi-Block support. The Index at the end of the Stream gives the size of
+ * each Block, from which we work out where each one starts in the input and
+ * in the output, so they can be decompressed separately.
+ */
+static bool dec_vli_buf(const uint8_t *in, size_t *pos, size_t end,
+        vli_type *vli)
+{
+    uint32_t i = 0;
+    uint8_t byte;
+
+    *vli = 0;
+    do {
+        if (*pos == end || i == VLI_BYTES_MAX)
+            return false;
+
+        byte = in[(*pos)++];
+        *vli |= (vli_type)(byte & 0x7F) << (i++ * 7);
+    } while (byte & 0x80);
+
+    return true;
+}
+
+XZ_EXTERN int xz_dec_blocks(const uint8_t *in, size_t in_size,
+        struct xz_block *blocks, int max_blocks)
+{
+    const uint8_t *footer;
+    size_t index_pos, index_size, pos, end, in_pos, out_pos;
+    vli_type count, unpadded, uncompressed, i;
+    int check;
+
+    if (in_size < 2 * STREAM_HEADER_SIZE)
+        return -1;
+
+    /* Stream Header, as in dec_stream_header() */
+    if (!memeq(in, HEADER_MAGIC, HEADER_MAGIC_SIZE)
+            || xz_crc32(in + HEADER_MAGIC_SIZE, 2, 0)
+                != get_le32(in + HEADER_MAGIC_SIZE + 2)
+            || in[HEADER_MAGIC_SIZE] != 0)
+        return -1;
+
+    check = in[HEADER_MAGIC_SIZE + 1];
+    if (check != XZ_CHECK_NONE && check != XZ_CHECK_CRC32
+            && !IS_CRC64(check))
+        return -1;
+
+    /* Stream Footer, which has to be right at the end */
+    footer = in + in_size - STREAM_HEADER_SIZE;
+    if (!memeq(footer + 10, FOOTER_MAGIC, FOOTER_MAGIC_SIZE)
+            || xz_crc32(footer + 4, 6, 0) != get_le32(footer)
+            || footer[8] != 0 || footer[9] != check)
+        return -1;
+
+    index_size = ((size_t)get_le32(footer + 4) + 1) * 4;
+    if (index_size > in_size - 2 * STREAM_HEADER_SIZE)
+        return -1;
+
+    /* The Index, its CRC32 covers everything but itself */
+    index_pos = in_size - STREAM_HEADER_SIZE - index_size;
+    end = index_pos + index_size - 4;
+    if (in[index_pos] != 0
+            || xz_crc32(in + index_pos, end - index_pos, 0)
+                != get_le32(in + end))
+        return -1;
+
+    pos = index_pos + 1;
+    if (!dec_vli_buf(in, &pos, end, &count) || count > 0x7FFFFFFF)
+        return -1;
+
+    in_pos = STREAM_HEADER_SIZE;
+    out_pos = 0;
+    for (i = 0; i < count; ++i) {
+        if (!dec_vli_buf(in, &pos, end, &unpadded)
+                || !dec_vli_buf(in, &pos, end, &uncompressed))
+            return -1;
+
+        unpadded = (unpadded + 3) & ~(vli_type)3;
+        if (unpadded == 0 || unpadded > index_pos - in_pos
+                || uncompressed > (size_t)-1 - out_pos)
+            return -1;
+
+        if (blocks != NULL && i < (vli_type)max_blocks) {
+            blocks[i].in_pos = in_pos;
+            blocks[i].in_size = unpadded;
+            blocks[i].out_pos = out_pos;
+            blocks[i].out_size = uncompressed;
+            blocks[i].check = check;
+        }
+
+        in_pos += unpadded;
+        out_pos += uncompressed;
+    }
+
+    /* The Blocks have to account for everything up to the Index */
+    if (in_pos != index_pos)
+        return -1;
+
+    return count;
+}
+
+XZ_EXTERN enum xz_ret xz_dec_block_run(struct xz_dec *s, struct xz_buf *b,
+        int check)
+{
+    size_t in_start = b->in_pos;
+    size_t out_start = b->out_pos;
+    enum xz_ret ret;
+
+    /* Skip the Stream Header, we've been told what it said */
+    xz_dec_reset(s);
+    s->check_type = check;
+    s->sequence = SEQ_BLOCK_START;
+
+    ret = dec_main(s, b);
+
+    /* Having used all of the input on exactly one Block */
+    if (ret == XZ_OK && s->sequence == SEQ_BLOCK_START
+            && s->block.count == 1 && b->in_pos == b->in_size)
+        return XZ_STREAM_END;
+
+    if (ret == XZ_OK || ret == XZ_STREAM_END)
+        ret = b->in_pos == b->in_size ? XZ_DATA_ERROR : XZ_BUF_ERROR;
+
+    b->in_pos = in_start;
+    b->out_pos = out_start;
+    return ret;
+}
@@ -132,6 +132,7 @@ DECLARE_PLATFORM(habanero) = {
 	.cec_reboot             = astbmc_ipmi_reboot,
 	.elog_commit		= ipmi_elog_commit,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.exit			= ipmi_wdt_final_reset,
 	.terminate		= ipmi_terminate,
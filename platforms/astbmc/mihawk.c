@@ -292,6 +292,7 @@ DECLARE_PLATFORM(mihawk) = {
 	.probe			= mihawk_probe,
 	.init			= astbmc_init,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.bmc			= &bmc_plat_ast2500_openbmc,
 	.pci_get_slot_info	= mihawk_get_slot_info,
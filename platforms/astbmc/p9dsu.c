@@ -713,6 +713,7 @@ DECLARE_PLATFORM(p9dsu1u) = {
 	.probe			= p9dsu_probe,
 	.init			= p9dsu_init,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.bmc			= &bmc_plat_ast2500_smc,
 	.pci_get_slot_info	= slot_table_get_slot_info,
@@ -121,5 +121,6 @@ DECLARE_PLATFORM(swift) = {
 	.probe			= swift_probe,
 	.resource_loaded	= flash_resource_loaded,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.terminate		= ipmi_terminate,
 };
@@ -63,6 +63,7 @@ DECLARE_PLATFORM(talos) = {
 	.probe			= talos_probe,
 	.init			= astbmc_init,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.bmc			= &bmc_plat_ast2500_openbmc,
 	.pci_get_slot_info	= slot_table_get_slot_info,
@@ -243,6 +243,7 @@ DECLARE_PLATFORM(zaius) = {
 	.probe			= zaius_probe,
 	.init			= astbmc_init,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.bmc			= &bmc_zaius_openbmc,
 	.pci_get_slot_info	= zaius_get_slot_info,
@@ -292,6 +292,7 @@ DECLARE_PLATFORM(mambo) = {
 	.cec_power_down = mambo_cec_power_down,
 	.terminate	= mambo_terminate,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.heartbeat_time		= mambo_heartbeat_time,
 	.nvram_info		= fake_nvram_info,
@@ -93,6 +93,7 @@ DECLARE_PLATFORM(qemu) = {
 	.cec_reboot     = astbmc_ipmi_reboot,
 	.pci_get_slot_info = slot_table_get_slot_info,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.terminate	= ipmi_terminate,
 };
@@ -110,6 +111,7 @@ DECLARE_PLATFORM(qemu_powernv8) = {
 	.cec_reboot     = astbmc_ipmi_reboot,
 	.pci_get_slot_info = slot_table_get_slot_info,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.exit			= astbmc_exit,
 	.terminate	= ipmi_terminate,
@@ -128,6 +130,7 @@ DECLARE_PLATFORM(qemu_powernv9) = {
 	.pci_get_slot_info = slot_table_get_slot_info,
 	.cec_reboot     = astbmc_ipmi_reboot,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.exit			= astbmc_exit,
 	.terminate	= ipmi_terminate,
@@ -146,6 +149,7 @@ DECLARE_PLATFORM(qemu_powernv10) = {
 	.cec_reboot     = astbmc_ipmi_reboot,
 	.pci_get_slot_info = slot_table_get_slot_info,
 	.start_preload_resource	= flash_start_preload_resource,
+	.start_preload_resource_xz = flash_start_preload_resource_xz,
 	.resource_loaded	= flash_resource_loaded,
 	.exit			= astbmc_exit,
 	.terminate	= ipmi_terminate,